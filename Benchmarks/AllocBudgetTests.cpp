@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Allocation budgets of the core's hot paths, the Linux side of AllocProfile.h: each
+// path runs with operator new counted, and fails when it allocates more per call than
+// its budget in AllocBudgets.h, which the COM calls' budgets are built on. The shell
+// allocator is modelled with a counted malloc, the way CoreBenchmarks does. It's its
+// own executable, since it replaces the global operator new; ctest runs it as
+// AllocBudgetTests.
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+
+#include "AllocBudgets.h"
+#include "OWCore.h"
+#include "OWHistory.h"
+#include "OWTaskQueue.h"
+#include "OWTimeline.h"
+#include "FuzzyMatch.h"
+#include "SearchIndex.h"
+
+//========================================================================================
+// Counting
+
+namespace
+{
+
+bool g_Counting;
+unsigned long g_Allocations;
+
+} // namespace
+
+void *operator new(size_t Size)
+{
+	if (g_Counting)
+		g_Allocations++;
+	void *p = malloc(Size ? Size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t Size)
+{
+	return operator new(Size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+namespace
+{
+
+// Allocations per call of f, over Calls calls
+template <class F>
+double PerCall(int Calls, F f)
+{
+	int i;
+	g_Allocations = 0;
+	g_Counting = true;
+	for (i = 0; i < Calls; i++)
+		f();
+	g_Counting = false;
+	return (double)g_Allocations / Calls;
+}
+
+// The shell allocator
+void *Alloc(void *, unsigned Size)
+{
+	if (g_Counting)
+		g_Allocations++;
+	return malloc(Size);
+}
+
+void Free(void *, void *Block)
+{
+	free(Block);
+}
+
+std::vector<OWCHAR> Text(const char *s)
+{
+	std::vector<OWCHAR> t;
+	while (*s)
+		t.push_back((OWCHAR)*s++);
+	t.push_back(0);
+	return t;
+}
+
+// A snapshot's worth of items and their pidls, made before anything is counted
+class AllocBudgetTest : public ::testing::Test
+{
+protected:
+	enum { COUNT = 1000 };
+
+	void SetUp()
+	{
+		char Buffer[64];
+		int i;
+
+		for (i = 0; i < COUNT; i++)
+		{
+			snprintf(Buffer, sizeof(Buffer), "C:\\Users\\user%d\\Folder %d", i % 7, i);
+			Paths.push_back(Text(Buffer));
+			snprintf(Buffer, sizeof(Buffer), "Folder %d", i);
+			Names.push_back(Text(Buffer));
+		}
+		for (i = 0; i < COUNT; i++)
+		{
+			OWItemData d;
+			memset(&d, 0, sizeof(d));
+			d.Rank = (unsigned short)i;
+			d.Path = &Paths[i][0];
+			d.PathLength = (unsigned short)(Paths[i].size() - 1);
+			d.Name = &Names[i][0];
+			d.NameLength = (unsigned short)(Names[i].size() - 1);
+			d.PathALength = OW_NO_ANSI;
+			d.NameALength = OW_NO_ANSI;
+			Data.push_back(d);
+		}
+		for (i = 0; i < COUNT; i++)
+		{
+			unsigned Size = 2 + OWItemGetSize(&Data[i]);
+			std::vector<unsigned char> pidl(Size + 2);
+			unsigned short cb = (unsigned short)Size;
+			memcpy(&pidl[0], &cb, 2);
+			OWItemEncode(&Data[i], &pidl[2]);
+			Pidls.push_back(pidl);
+		}
+		for (i = 0; i < COUNT; i++)
+			List.push_back(&Pidls[i][0]);
+	}
+
+	std::vector<std::vector<OWCHAR> > Paths, Names;
+	std::vector<OWItemData> Data;
+	std::vector<std::vector<unsigned char> > Pidls;
+	std::vector<const void*> List;
+};
+
+} // namespace
+
+//========================================================================================
+// Items
+
+TEST_F(AllocBudgetTest, ItemEncode)
+{
+	std::vector<unsigned char> Target(1024);
+	int i = 0;
+	EXPECT_LE(PerCall(COUNT, [&]() { OWItemEncode(&Data[i], &Target[0]); i++; }), OW_BUDGET_ITEM_ENCODE);
+}
+
+TEST_F(AllocBudgetTest, ItemRead)
+{
+	int i = 0;
+	size_t Total = 0;
+	EXPECT_LE(PerCall(COUNT, [&]()
+	{
+		Total += OWItemGetNameLength(List[i]) + OWItemGetPathLength(List[i]) + OWItemGetRank(List[i]);
+		Total += OWItemGetName(List[i])[0] + OWItemGetPath(List[i])[0];
+		i++;
+	}), OW_BUDGET_ITEM_READ);
+	EXPECT_GT(Total, 0u);
+}
+
+TEST_F(AllocBudgetTest, CompareIDs)
+{
+	int i = 0, Sum = 0;
+	EXPECT_LE(PerCall(COUNT - 1, [&]()
+	{
+		Sum += OWItemCompare(List[i], List[i+1], OW_FIELD_NAME);
+		Sum += OWItemCompare(List[i], List[i+1], OW_FIELD_PATH);
+		Sum += OWItemCompare(List[i], List[i+1], OW_FIELD_RANK);
+		i++;
+	}), OW_BUDGET_COMPARE);
+	EXPECT_NE(0, Sum);
+}
+
+TEST_F(AllocBudgetTest, Cida)
+{
+	unsigned short Terminator = 0;
+	std::vector<unsigned char> Target(OWShellIDListGetSize(&Terminator, &List[0], COUNT));
+	EXPECT_LE(PerCall(10, [&]()
+	{
+		OWShellIDListGetSize(&Terminator, &List[0], COUNT);
+		OWShellIDListBuild(&Target[0], &Terminator, &List[0], COUNT);
+	}), OW_BUDGET_CIDA);
+}
+
+TEST_F(AllocBudgetTest, EnumNext)
+{
+	std::vector<unsigned char> Images(OWItemImagesGetSize(&Data[0], COUNT));
+	std::vector<unsigned> Offsets(COUNT + 1);
+	OWItemImagesBuild(&Data[0], COUNT, &Images[0], &Offsets[0]);
+
+	const int Celt = 64;
+	std::vector<void*> Out(Celt);
+	int First = 0;
+	double PerNext = PerCall(COUNT / Celt, [&]()
+	{
+		ASSERT_EQ(Celt, OWItemImagesToPidls(&Images[0], &Offsets[0], First, Celt, &Out[0], Alloc, Free, NULL));
+		for (int i = 0; i < Celt; i++)
+			free(Out[i]);
+		First += Celt;
+	});
+	EXPECT_LE(PerNext / Celt, OW_BUDGET_ENUM_PER_ITEM);
+}
+
+TEST_F(AllocBudgetTest, SnapshotDiff)
+{
+	std::vector<OWItemData> New(Data.rbegin(), Data.rend());
+	std::vector<int> Matches(COUNT);
+	EXPECT_LE(PerCall(10, [&]()
+	{
+		OWSnapshotDiff(&Data[0], COUNT, &New[0], COUNT, &Matches[0]);
+	}), OW_BUDGET_SNAPSHOT_DIFF);
+}
+
+//========================================================================================
+// Search
+
+TEST_F(AllocBudgetTest, Search)
+{
+	COWSearchIndex Index;
+	std::vector<OWCHAR> D = Text("f"), Do = Text("fo"), Doc = Text("fol"), Docs = Text("fold");
+
+	// Also shows the counting works
+	double Builds = PerCall(3, [&]() { Index.Build(&Data[0], COUNT); });
+	EXPECT_GT(Builds, 0);
+	EXPECT_LE(Builds, OW_BUDGET_SEARCH_BUILD);
+
+	EXPECT_LE(PerCall(1, [&]()
+	{
+		Index.Query(&D[0]);
+		Index.Query(&Do[0]);
+		Index.Query(&Doc[0]);
+		Index.Query(&Docs[0]);
+	}) / 4, OW_BUDGET_SEARCH_QUERY);
+	EXPECT_EQ(COUNT, Index.GetResultCount());
+
+	EXPECT_LE(PerCall(1, [&]()
+	{
+		Index.QueryFuzzy(&D[0]);
+		Index.QueryFuzzy(&Do[0]);
+		Index.QueryFuzzy(&Doc[0]);
+		Index.QueryFuzzy(&Docs[0]);
+	}) / 4, OW_BUDGET_SEARCH_FUZZY);
+}
+
+TEST_F(AllocBudgetTest, FuzzyBatch)
+{
+	std::vector<OWCHAR> Pattern = Text("F1");
+	std::vector<const OWCHAR*> Texts;
+	std::vector<OWUINT64> Masks;
+	std::vector<int> Candidates, Scores(COUNT);
+	int i;
+
+	for (i = 0; i < COUNT; i++)
+	{
+		Texts.push_back(&Paths[i][0]);
+		Masks.push_back(OWFuzzyCharMask(Texts[i]));
+		Candidates.push_back(i);
+	}
+	EXPECT_LE(PerCall(10, [&]()
+	{
+		OWFuzzyScoreBatch(&Pattern[0], &Texts[0], &Masks[0], &Candidates[0], COUNT, &Scores[0]);
+	}), OW_BUDGET_FUZZY_BATCH);
+}
+
+//========================================================================================
+// Background jobs, activation and history
+
+TEST_F(AllocBudgetTest, TaskQueue)
+{
+	COWTaskQueue Queue(64, 4, NULL);
+	int Owner;
+	unsigned Key = 0;
+
+	EXPECT_LE(PerCall(1000, [&]()
+	{
+		Queue.Push(&Owner, Key++, NULL);
+		Queue.Push(&Owner, Key++, NULL);
+		OWTask *Task = Queue.Next();
+		if (Task != NULL)
+			Queue.Done(Task);
+		Queue.Cancel(&Owner);
+	}), OW_BUDGET_TASK_QUEUE);
+}
+
+TEST_F(AllocBudgetTest, Timeline)
+{
+	OWTimeline *Timeline = new OWTimeline;
+	OWUINT64 Time = 0;
+
+	OWTimelineInit(Timeline);
+	EXPECT_LE(PerCall(10000, [&]()
+	{
+		OWTimelineTouch(Timeline, (Time % 300) << 4, Time);
+		if (Time % 7 == 0)
+			OWTimelineRemove(Timeline, ((Time / 7) % 300) << 4);
+		Time++;
+	}), OW_BUDGET_TIMELINE);
+	delete Timeline;
+}
+
+TEST_F(AllocBudgetTest, History)
+{
+	std::vector<unsigned char> Buffer(OW_HISTORY_SIZE);
+	OWHistoryFormat(&Buffer[0], OW_HISTORY_SIZE);
+	int i = 0;
+
+	EXPECT_LE(PerCall(100, [&]()
+	{
+		OWHistoryRecord Record;
+		memset(&Record, 0, sizeof(Record));
+		Record.Kind = OW_HISTORY_CLOSED;
+		Record.Path = &Paths[i][0];
+		Record.PathLength = (unsigned short)(Paths[i].size() - 1);
+		Record.Name = &Names[i][0];
+		Record.NameLength = (unsigned short)(Names[i].size() - 1);
+		OWHistoryAppend(&Buffer[0], &Record);
+		i++;
+	}), OW_BUDGET_HISTORY_APPEND);
+
+	OWHistoryRecord Records[OW_HISTORY_KEEP];
+	EXPECT_LE(PerCall(10, [&]()
+	{
+		OWHistoryRecent(&Buffer[0], Records, OW_HISTORY_KEEP);
+	}), OW_BUDGET_HISTORY_RECENT);
+}
@@ -0,0 +1,536 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+//========================================================================================
+// Benchmarks of the folder's hot paths, over the portable core (OWCore), so they run
+// headless anywhere Google Benchmark does. Build and run with the CMakeLists.txt at the
+// top, or by hand:
+//
+//   g++ -O2 -I../OpenWindows CoreBenchmarks.cpp ../OpenWindows/OWCore.cpp ../OpenWindows/DetailTable.cpp -lbenchmark -lpthread -o CoreBenchmarks
+//   ./CoreBenchmarks --benchmark_format=json --benchmark_out=results.json
+//
+// Runs take (item count, string length). The COM side is modelled with what it does
+// around the core: the shell allocator is malloc, and a Next() creates a pidl per item
+// the way CPidlMgr::Create does.
+
+#include <benchmark/benchmark.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "OWCore.h"
+#include "DetailTable.h"
+
+//========================================================================================
+// Fixtures
+
+namespace
+{
+
+struct Item
+{
+	std::vector<OWCHAR> Path, Name;
+	std::vector<char> PathA, NameA;
+
+	OWItemData Data() const
+	{
+		OWItemData d;
+		d.Rank = Rank;
+		d.Path = &Path[0];
+		d.PathLength = (unsigned short)(Path.size() - 1);
+		d.Name = &Name[0];
+		d.NameLength = (unsigned short)(Name.size() - 1);
+		d.PathA = &PathA[0];
+		d.PathALength = (unsigned short)(PathA.size() - 1);
+		d.NameA = &NameA[0];
+		d.NameALength = (unsigned short)(NameA.size() - 1);
+		return d;
+	}
+
+	unsigned short Rank;
+};
+
+// A path of about Length chars, that differs between items early and late, like
+// real folders do.
+Item MakeItem(int i, int Length)
+{
+	Item item;
+	char Buffer[64];
+	int j;
+
+	item.Rank = (unsigned short)i;
+
+	int Prefix = snprintf(Buffer, sizeof(Buffer), "C:\\Users\\user%d\\", i % 7);
+	for (j = 0; j < Prefix && j < Length; j++)
+		item.PathA.push_back(Buffer[j]);
+	for (; j < Length; j++)
+		item.PathA.push_back((j % 12 == 11) ? '\\' : (char)('a' + (i * 31 + j) % 26));
+	snprintf(Buffer, sizeof(Buffer), "Folder %d", i);
+	item.NameA.assign(Buffer, Buffer + strlen(Buffer));
+
+	item.PathA.push_back('\0');
+	item.NameA.push_back('\0');
+	for (j = 0; j < (int)item.PathA.size(); j++)
+		item.Path.push_back((OWCHAR)(unsigned char)item.PathA[j]);
+	for (j = 0; j < (int)item.NameA.size(); j++)
+		item.Name.push_back((OWCHAR)(unsigned char)item.NameA[j]);
+	return item;
+}
+
+std::vector<Item> MakeItems(int Count, int Length)
+{
+	std::vector<Item> Items;
+	for (int i = 0; i < Count; i++)
+		Items.push_back(MakeItem(i, Length));
+	return Items;
+}
+
+// What CPidlMgr::Create() does: cb, the data, and a terminating cb.
+unsigned char *CreatePidl(const OWItemData &Data)
+{
+	unsigned Size = 2 + OWItemGetSize(&Data);
+	unsigned char *pidl = (unsigned char*)malloc(Size + 2);
+	unsigned short cb = (unsigned short)Size;
+
+	memcpy(pidl, &cb, 2);
+	OWItemEncode(&Data, pidl + 2);
+	memset(pidl + Size, 0, 2);
+	return pidl;
+}
+
+struct Pidls
+{
+	Pidls(int Count, int Length) : Items(MakeItems(Count, Length))
+	{
+		for (size_t i = 0; i < Items.size(); i++)
+			List.push_back(CreatePidl(Items[i].Data()));
+	}
+	~Pidls()
+	{
+		for (size_t i = 0; i < List.size(); i++)
+			free(List[i]);
+	}
+
+	std::vector<Item> Items;
+	std::vector<unsigned char*> List;
+};
+
+void ItemArgs(benchmark::internal::Benchmark *b)
+{
+	static const int Counts[] = { 16, 256, 4096 };
+	static const int Lengths[] = { 16, 64, 200 };
+	for (int c = 0; c < 3; c++)
+		for (int l = 0; l < 3; l++)
+			b->Args({ Counts[c], Lengths[l] });
+	b->ArgNames({ "count", "length" });
+}
+
+} // namespace
+
+//========================================================================================
+// Pidls (CPidlMgr, COWItem)
+
+static void BM_PidlCreate(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < p.Items.size(); i++)
+		{
+			unsigned char *pidl = CreatePidl(p.Items[i].Data());
+			benchmark::DoNotOptimize(pidl);
+			free(pidl);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.Items.size());
+}
+BENCHMARK(BM_PidlCreate)->Apply(ItemArgs);
+
+static void BM_PidlCopy(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < p.List.size(); i++)
+		{
+			unsigned Size = OWIdListGetSize(p.List[i]);
+			void *Copy = malloc(Size);
+			memcpy(Copy, p.List[i], Size);
+			benchmark::DoNotOptimize(Copy);
+			free(Copy);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.List.size());
+}
+BENCHMARK(BM_PidlCopy)->Apply(ItemArgs);
+
+static void BM_PidlSize(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	for (auto _ : state)
+	{
+		unsigned Total = 0;
+		for (size_t i = 0; i < p.List.size(); i++)
+			Total += OWIdListGetSize(p.List[i]) + OWIdListIsSingle(p.List[i]);
+		benchmark::DoNotOptimize(Total);
+	}
+	state.SetItemsProcessed(state.iterations() * p.List.size());
+}
+BENCHMARK(BM_PidlSize)->Apply(ItemArgs);
+
+static void BM_ItemEncode(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	std::vector<unsigned char> Buffer(2048);
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < p.Items.size(); i++)
+		{
+			OWItemData Data = p.Items[i].Data();
+			OWItemEncode(&Data, &Buffer[2]);
+			benchmark::ClobberMemory();
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.Items.size());
+}
+BENCHMARK(BM_ItemEncode)->Apply(ItemArgs);
+
+//========================================================================================
+// CompareIDs, per column
+
+static void BM_CompareIDs(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	int Field = (int)state.range(2);
+	for (auto _ : state)
+	{
+		int Sum = 0;
+		for (size_t i = 1; i < p.List.size(); i++)
+			Sum += OWItemCompare(p.List[i-1], p.List[i], Field);
+		benchmark::DoNotOptimize(Sum);
+	}
+	state.SetItemsProcessed(state.iterations() * (p.List.size() - 1));
+}
+BENCHMARK(BM_CompareIDs)
+	->ArgsProduct({ { 256, 4096 }, { 16, 200 }, { OW_FIELD_NAME, OW_FIELD_PATH, OW_FIELD_RANK } })
+	->ArgNames({ "count", "length", "column" });
+
+// Clicking a column header: the view sorts every item with CompareIDs
+static void BM_SortByColumn(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), 64);
+	int Field = (int)state.range(1);
+	std::vector<const void*> Shuffled(p.List.begin(), p.List.end()), Sorted;
+	size_t i;
+
+	// Deterministic, so runs compare
+	for (i = Shuffled.size() - 1; i > 0; i--)
+		std::swap(Shuffled[i], Shuffled[(i * 7919) % (i + 1)]);
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		Sorted = Shuffled;
+		state.ResumeTiming();
+
+		std::sort(Sorted.begin(), Sorted.end(), [Field](const void *a, const void *b)
+		{
+			return OWItemCompare(a, b, Field) < 0;
+		});
+		benchmark::DoNotOptimize(Sorted[0]);
+	}
+	state.SetItemsProcessed(state.iterations() * Sorted.size());
+}
+BENCHMARK(BM_SortByColumn)
+	->ArgsProduct({ { 256, 4096 }, { OW_FIELD_NAME, OW_FIELD_PATH, OW_FIELD_RANK } })
+	->ArgNames({ "count", "column" });
+
+//========================================================================================
+// GetDisplayNameOf/GetDetailsOf string production: an allocated STRRET_WSTR copy
+// against a STRRET_OFFSET into the pidl.
+
+static void BM_DisplayNameWstr(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < p.List.size(); i++)
+		{
+			unsigned Length = OWItemGetPathLength(p.List[i]);
+			OWCHAR *Copy = (OWCHAR*)malloc((Length + 1) * sizeof(OWCHAR));
+			memcpy(Copy, OWItemGetPath(p.List[i]), (Length + 1) * sizeof(OWCHAR));
+			benchmark::DoNotOptimize(Copy);
+			free(Copy);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.List.size());
+}
+BENCHMARK(BM_DisplayNameWstr)->Apply(ItemArgs);
+
+static void BM_DisplayNameOffset(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < p.List.size(); i++)
+		{
+			const char *Text = OWItemGetPathA(p.List[i]);
+			unsigned Offset = (unsigned)(Text - (const char*)p.List[i]);
+			benchmark::DoNotOptimize(Offset);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.List.size());
+}
+BENCHMARK(BM_DisplayNameOffset)->Apply(ItemArgs);
+
+static void BM_DetailsOf(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), 64);
+	int Column = (int)state.range(1);
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < p.List.size(); i++)
+		{
+			const OWCHAR *Text;
+			unsigned Length;
+			char Rank[8];
+
+			switch (Column)
+			{
+			case OW_FIELD_NAME:
+				Text = OWItemGetName(p.List[i]);
+				Length = OWItemGetNameLength(p.List[i]);
+				break;
+			case OW_FIELD_PATH:
+				Text = OWItemGetPath(p.List[i]);
+				Length = OWItemGetPathLength(p.List[i]);
+				break;
+			default:
+				Length = snprintf(Rank, sizeof(Rank), "%d", OWItemGetRank(p.List[i]));
+				benchmark::DoNotOptimize(Rank);
+				continue;
+			}
+
+			OWCHAR *Copy = (OWCHAR*)malloc((Length + 1) * sizeof(OWCHAR));
+			memcpy(Copy, Text, (Length + 1) * sizeof(OWCHAR));
+			benchmark::DoNotOptimize(Copy);
+			free(Copy);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.List.size());
+}
+BENCHMARK(BM_DetailsOf)
+	->ArgsProduct({ { 256, 4096 }, { OW_FIELD_NAME, OW_FIELD_PATH, OW_FIELD_RANK } })
+	->ArgNames({ "count", "column" });
+
+// The same columns the way GetDetailsOf() gives them now: the name and path by offset
+// into the pidl, and the rank copied out of the snapshot's detail table.
+static void BM_DetailsOfTable(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), 64);
+	int Column = (int)state.range(1);
+	std::vector<OWItemData> Data;
+	COWDetailTable Details;
+
+	for (size_t i = 0; i < p.Items.size(); i++)
+		Data.push_back(p.Items[i].Data());
+	Details.Build(&Data[0], (int)Data.size());
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < p.List.size(); i++)
+		{
+			const char *Ansi;
+			const OWCHAR *Text;
+			unsigned long Length;
+
+			switch (Column)
+			{
+			case OW_FIELD_NAME:
+			case OW_FIELD_PATH:
+				Ansi = Column == OW_FIELD_NAME ? OWItemGetNameA(p.List[i]) : OWItemGetPathA(p.List[i]);
+				benchmark::DoNotOptimize((unsigned)(Ansi - (const char*)p.List[i]));
+				continue;
+			default:
+				Text = Details.GetRankText(OWItemGetRank(p.List[i]), &Length);
+				break;
+			}
+
+			OWCHAR *Copy = (OWCHAR*)malloc((Length + 1) * sizeof(OWCHAR));
+			memcpy(Copy, Text, (Length + 1) * sizeof(OWCHAR));
+			benchmark::DoNotOptimize(Copy);
+			free(Copy);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.List.size());
+}
+BENCHMARK(BM_DetailsOfTable)
+	->ArgsProduct({ { 256, 4096 }, { OW_FIELD_NAME, OW_FIELD_PATH, OW_FIELD_RANK } })
+	->ArgNames({ "count", "column" });
+
+// Rebuilding the table for a new snapshot, under the folder's lock
+static void BM_DetailTableBuild(benchmark::State &state)
+{
+	std::vector<Item> Items = MakeItems((int)state.range(0), 16);
+	std::vector<OWItemData> Data;
+
+	for (size_t i = 0; i < Items.size(); i++)
+		Data.push_back(Items[i].Data());
+
+	for (auto _ : state)
+	{
+		// A new table each time; an old one big enough would be kept as it is
+		COWDetailTable Details;
+		benchmark::DoNotOptimize(Details.Build(&Data[0], (int)Data.size()));
+	}
+	state.SetItemsProcessed(state.iterations() * Data.size());
+}
+BENCHMARK(BM_DetailTableBuild)->Arg(256)->Arg(4096)->ArgName("count");
+
+//========================================================================================
+// CIDA (CreateShellIDList)
+
+static void BM_CidaBuild(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), (int)state.range(1));
+	unsigned char Parent[2] = { 0, 0 };
+	std::vector<const void*> Items(p.List.begin(), p.List.end());
+	for (auto _ : state)
+	{
+		unsigned Size = OWShellIDListGetSize(Parent, &Items[0], (unsigned)Items.size());
+		void *Cida = malloc(Size);
+		OWShellIDListBuild(Cida, Parent, &Items[0], (unsigned)Items.size());
+		benchmark::DoNotOptimize(Cida);
+		free(Cida);
+	}
+	state.SetItemsProcessed(state.iterations() * p.List.size());
+}
+BENCHMARK(BM_CidaBuild)->Apply(ItemArgs);
+
+//========================================================================================
+// IEnumIDList::Next(): one pidl created per item handed out, against copying each run
+// of them out of the snapshot's item images (OWItemImagesToPidls)
+
+static void BM_EnumNext(benchmark::State &state)
+{
+	Pidls p((int)state.range(0), 64);
+	size_t Celt = (size_t)state.range(1);
+	std::vector<unsigned char*> Out(Celt);
+	for (auto _ : state)
+	{
+		for (size_t First = 0; First < p.Items.size(); First += Celt)
+		{
+			size_t Fetched = 0;
+			for (; Fetched < Celt && First + Fetched < p.Items.size(); Fetched++)
+				Out[Fetched] = CreatePidl(p.Items[First + Fetched].Data());
+			// The caller frees them
+			for (size_t i = 0; i < Fetched; i++)
+				free(Out[i]);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * p.Items.size());
+}
+BENCHMARK(BM_EnumNext)
+	->ArgsProduct({ { 256, 4096 }, { 1, 16, 64, 256 } })
+	->ArgNames({ "count", "celt" });
+
+static void *Alloc(void *, unsigned Size)
+{
+	return malloc(Size);
+}
+
+static void Free(void *, void *Block)
+{
+	free(Block);
+}
+
+static void BM_EnumNextBatch(benchmark::State &state)
+{
+	std::vector<Item> Items = MakeItems((int)state.range(0), 64);
+	std::vector<OWItemData> Data;
+	for (size_t i = 0; i < Items.size(); i++)
+		Data.push_back(Items[i].Data());
+	int Count = (int)Data.size();
+	std::vector<unsigned char> Images(OWItemImagesGetSize(&Data[0], Count));
+	std::vector<unsigned> Offsets(Count + 1);
+	OWItemImagesBuild(&Data[0], Count, &Images[0], &Offsets[0]);
+
+	int Celt = (int)state.range(1);
+	std::vector<void*> Out(Celt);
+	for (auto _ : state)
+	{
+		for (int First = 0; First < Count; First += Celt)
+		{
+			int Fetched = Celt < Count - First ? Celt : Count - First;
+			OWItemImagesToPidls(&Images[0], &Offsets[0], First, Fetched, &Out[0], Alloc, Free, NULL);
+			for (int i = 0; i < Fetched; i++)
+				free(Out[i]);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * Count);
+}
+BENCHMARK(BM_EnumNextBatch)
+	->ArgsProduct({ { 256, 4096 }, { 1, 16, 64, 256 } })
+	->ArgNames({ "count", "celt" });
+
+//========================================================================================
+// Snapshot diffing: unchanged, reversed, and one window gone
+
+static void BM_SnapshotDiff(benchmark::State &state)
+{
+	std::vector<Item> Items = MakeItems((int)state.range(0), (int)state.range(1));
+	std::vector<OWItemData> Old, New;
+	int Mode = (int)state.range(2);
+
+	for (size_t i = 0; i < Items.size(); i++)
+		Old.push_back(Items[i].Data());
+	New = Old;
+	if (Mode == 1)
+	{
+		for (size_t i = 0; i < New.size(); i++)
+		{
+			New[i] = Old[Old.size() - 1 - i];
+			New[i].Rank = (unsigned short)i;
+		}
+	}
+	else if (Mode == 2)
+	{
+		New.erase(New.begin() + New.size() / 2);
+	}
+
+	std::vector<int> Matches(New.size() + 1);
+	for (auto _ : state)
+	{
+		int Changes = OWSnapshotDiff(&Old[0], (int)Old.size(), &New[0], (int)New.size(), &Matches[0]);
+		benchmark::DoNotOptimize(Changes);
+	}
+	state.SetItemsProcessed(state.iterations() * New.size());
+}
+BENCHMARK(BM_SnapshotDiff)
+	->ArgsProduct({ { 16, 256, 1024 }, { 16, 200 }, { 0, 1, 2 } })
+	->ArgNames({ "count", "length", "mode" });
+
+BENCHMARK_MAIN();
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+
+
+//========================================================================================
+// Tests of the frecency table (OWFrecency): what visits add up to, the debounce, which
+// path gives way when the probes are full, and which spellings of a path are the same.
+// Times are FILETIMEs counted in hours from 2020, like the keys.
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "OWFrecency.h"
+
+namespace
+{
+
+// 2020-01-01, as a FILETIME
+const OWUINT64 EPOCH = (OWUINT64)13222310400 * 10000000;
+const OWUINT64 MINUTE = (OWUINT64)60 * 10000000;
+const OWUINT64 HOUR = 60 * MINUTE;
+
+unsigned Hash(const char *Path)
+{
+	std::vector<OWCHAR> Wide(Path, Path + strlen(Path));
+	return OWFrecencyHash(Wide.empty() ? NULL : &Wide[0], (unsigned)Wide.size());
+}
+
+// A hash Index slots along from First, in the same probe window
+unsigned Neighbour(unsigned First, unsigned Index)
+{
+	return First + Index * OW_FRECENCY_SLOTS;
+}
+
+class FrecencyTest : public ::testing::Test
+{
+protected:
+	void SetUp()
+	{
+		OWFrecencyFormat(&Table);
+		Now = EPOCH + 50000 * HOUR;
+	}
+
+	float Key(unsigned Hash)
+	{
+		return OWFrecencyGetKey(&Table, Hash);
+	}
+
+	double Score(unsigned Hash)
+	{
+		return OWFrecencyScore(Key(Hash), Now);
+	}
+
+	OWFrecencyTable Table;
+	OWUINT64 Now;
+};
+
+//========================================================================================
+// Scores
+
+TEST_F(FrecencyTest, NewTableHasNoKeys)
+{
+	EXPECT_TRUE(OWFrecencyCheck(&Table));
+	EXPECT_EQ(0, Key(Hash("C:\\Users")));
+	EXPECT_EQ(0, Score(Hash("C:\\Users")));
+}
+
+TEST_F(FrecencyTest, VisitHalvesEveryHalfLife)
+{
+	unsigned Path = Hash("C:\\Users");
+
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Path, Now));
+	EXPECT_NEAR(1.0, Score(Path), 1e-3);
+	Now += OW_FRECENCY_HALF_LIFE * HOUR;
+	EXPECT_NEAR(0.5, Score(Path), 1e-3);
+	Now += OW_FRECENCY_HALF_LIFE * HOUR;
+	EXPECT_NEAR(0.25, Score(Path), 1e-3);
+}
+
+TEST_F(FrecencyTest, VisitsAddUp)
+{
+	unsigned Path = Hash("C:\\Users");
+	int i;
+
+	// Back to back, each is worth about 1
+	for (i = 0; i < 4; i++)
+	{
+		ASSERT_TRUE(OWFrecencyTouch(&Table, Path, Now));
+		Now += OW_FRECENCY_DEBOUNCE * MINUTE;
+	}
+	EXPECT_NEAR(4.0, Score(Path), 0.01);
+	// Doubling the score is one half life more on the key
+	EXPECT_NEAR(50000.0 + 2 * OW_FRECENCY_HALF_LIFE, Key(Path), 0.1);
+}
+
+TEST_F(FrecencyTest, KeyIsLogSumOfVisits)
+{
+	unsigned Path = Hash("C:\\Users");
+	double Hours[] = { 50000, 50010, 50100, 50101, 50400 };
+	double Sum = 0;
+	int i;
+
+	for (i = 0; i < 5; i++)
+	{
+		Now = EPOCH + (OWUINT64)Hours[i] * HOUR;
+		ASSERT_TRUE(OWFrecencyTouch(&Table, Path, Now));
+		Sum += pow(2.0, (Hours[i] - Hours[4]) / OW_FRECENCY_HALF_LIFE);
+	}
+	EXPECT_NEAR(Hours[4] + OW_FRECENCY_HALF_LIFE * log(Sum) / log(2.0), Key(Path), 0.02);
+	EXPECT_NEAR(Sum, Score(Path), 1e-3);
+}
+
+TEST_F(FrecencyTest, OldVisitWeighsLittle)
+{
+	unsigned Old = Hash("C:\\Old"), New = Hash("C:\\New");
+	int i;
+
+	// Ten visits two weeks ago are outdone by one now
+	for (i = 0; i < 10; i++)
+		ASSERT_TRUE(OWFrecencyTouch(&Table, Old, Now + i * HOUR));
+	Now += 14 * 24 * HOUR;
+	ASSERT_TRUE(OWFrecencyTouch(&Table, New, Now));
+	EXPECT_GT(Key(New), Key(Old));
+}
+
+//========================================================================================
+// Debounce
+
+TEST_F(FrecencyTest, VisitsWithinDebounceCountOnce)
+{
+	unsigned Path = Hash("C:\\Users");
+
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Path, Now));
+	float First = Key(Path);
+	EXPECT_FALSE(OWFrecencyTouch(&Table, Path, Now));
+	EXPECT_FALSE(OWFrecencyTouch(&Table, Path, Now + MINUTE / 2));
+	EXPECT_EQ(First, Key(Path));
+
+	EXPECT_TRUE(OWFrecencyTouch(&Table, Path, Now + OW_FRECENCY_DEBOUNCE * MINUTE));
+	EXPECT_GT(Key(Path), First);
+}
+
+TEST_F(FrecencyTest, VisitBeforeLastIsIgnored)
+{
+	unsigned Path = Hash("C:\\Users");
+
+	// An activation told after a later pick, or by a second process
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Path, Now));
+	float First = Key(Path);
+	EXPECT_FALSE(OWFrecencyTouch(&Table, Path, Now - 10 * MINUTE));
+	EXPECT_FALSE(OWFrecencyTouch(&Table, Path, Now));
+	EXPECT_EQ(First, Key(Path));
+}
+
+//========================================================================================
+// Eviction
+
+TEST_F(FrecencyTest, FullProbesEvictLowest)
+{
+	unsigned First = Hash("C:\\Users"), i;
+
+	// Fill the window, each path visited later than the one before, except one
+	// visited at the start of it all
+	for (i = 0; i < OW_FRECENCY_PROBES; i++)
+		ASSERT_TRUE(OWFrecencyTouch(&Table, Neighbour(First, i), Now + (i == 5 ? 0 : (i + 1) * HOUR)));
+
+	unsigned Newcomer = Neighbour(First, OW_FRECENCY_PROBES);
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Newcomer, Now + 100 * HOUR));
+	EXPECT_NE(0, Key(Newcomer));
+	EXPECT_EQ(0, Key(Neighbour(First, 5)));
+	for (i = 0; i < OW_FRECENCY_PROBES; i++)
+	{
+		if (i == 5)
+			continue;
+		EXPECT_NE(0, Key(Neighbour(First, i))) << i;
+	}
+}
+
+TEST_F(FrecencyTest, EvictionWeighsVisits)
+{
+	unsigned First = Hash("C:\\Users"), i;
+
+	// Slot 0 is the oldest, but visited often enough to outweigh slot 1
+	for (i = 0; i < 4; i++)
+		ASSERT_TRUE(OWFrecencyTouch(&Table, Neighbour(First, 0), Now + i * MINUTE));
+	for (i = 1; i < OW_FRECENCY_PROBES; i++)
+		ASSERT_TRUE(OWFrecencyTouch(&Table, Neighbour(First, i), Now + i * HOUR));
+
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Neighbour(First, OW_FRECENCY_PROBES), Now + 100 * HOUR));
+	EXPECT_NE(0, Key(Neighbour(First, 0)));
+	EXPECT_EQ(0, Key(Neighbour(First, 1)));
+}
+
+TEST_F(FrecencyTest, EvictedPathStartsOver)
+{
+	unsigned First = Hash("C:\\Users"), i;
+
+	for (i = 0; i < OW_FRECENCY_PROBES; i++)
+		ASSERT_TRUE(OWFrecencyTouch(&Table, Neighbour(First, i), Now + i * HOUR));
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Neighbour(First, OW_FRECENCY_PROBES), Now + 100 * HOUR));
+	ASSERT_EQ(0, Key(First));
+
+	// Back, with one visit's worth, not its old ones
+	Now += 200 * HOUR;
+	ASSERT_TRUE(OWFrecencyTouch(&Table, First, Now));
+	EXPECT_NEAR(1.0, Score(First), 1e-3);
+}
+
+//========================================================================================
+// Hashing
+
+TEST_F(FrecencyTest, HashFoldsCase)
+{
+	EXPECT_EQ(Hash("C:\\Users\\Me"), Hash("c:\\users\\me"));
+	EXPECT_EQ(Hash("C:\\USERS\\ME"), Hash("c:\\Users\\mE"));
+	EXPECT_NE(Hash("C:\\Users\\Me"), Hash("C:\\Users\\Mi"));
+}
+
+TEST_F(FrecencyTest, HashFoldsSlashes)
+{
+	EXPECT_EQ(Hash("C:\\Users\\Me"), Hash("C:/Users/Me"));
+	EXPECT_EQ(Hash("\\\\host\\share"), Hash("//host/share"));
+	EXPECT_EQ(Hash("C:\\Users/Me"), Hash("c:/users\\ME"));
+}
+
+TEST_F(FrecencyTest, HashDropsTrailingSeparator)
+{
+	EXPECT_EQ(Hash("C:\\Users\\Me"), Hash("C:\\Users\\Me\\"));
+	EXPECT_EQ(Hash("C:\\Users\\Me"), Hash("C:/Users/Me/"));
+	// A drive's root keeps its own
+	EXPECT_EQ(Hash("C:\\"), Hash("c:/"));
+	EXPECT_NE(Hash("C:\\"), Hash("C:"));
+}
+
+TEST_F(FrecencyTest, HashIsNeverZero)
+{
+	std::string Path;
+	int i;
+
+	// 0 marks a free slot
+	EXPECT_NE(0u, Hash(""));
+	for (i = 0; i < 10000; i++)
+	{
+		Path = "C:\\" + std::to_string(i);
+		EXPECT_NE(0u, Hash(Path.c_str()));
+	}
+}
+
+TEST_F(FrecencyTest, SpellingsShareScore)
+{
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Hash("C:\\Users\\Me"), Now));
+	Now += OW_FRECENCY_DEBOUNCE * MINUTE;
+	ASSERT_TRUE(OWFrecencyTouch(&Table, Hash("c:/users/me/"), Now));
+	EXPECT_NEAR(2.0, Score(Hash("C:\\USERS\\ME")), 0.01);
+}
+
+} // namespace
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Tests of the fuzzy matcher (FuzzyMatch). Texts are allocated to their exact size, so
+// under ASan (OW_SANITIZE) any read past a terminator fails the run; the vectorized scan
+// is checked at every length and alignment around its block size.
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "FuzzyMatch.h"
+
+namespace
+{
+
+// A normalized text, in a heap block of exactly its size
+class Text
+{
+public:
+	Text(const char *s) : m_Length(strlen(s))
+	{
+		m_Text = new OWCHAR[m_Length + 1];
+		for (size_t i = 0; i <= m_Length; i++)
+			m_Text[i] = (OWCHAR)(unsigned char)s[i];
+	}
+	Text(const Text &Other) : m_Length(Other.m_Length)
+	{
+		m_Text = new OWCHAR[m_Length + 1];
+		memcpy(m_Text, Other.m_Text, (m_Length + 1) * sizeof(OWCHAR));
+	}
+	~Text() { delete [] m_Text; }
+
+	operator const OWCHAR *() const { return m_Text; }
+
+private:
+	Text &operator=(const Text &);
+
+	OWCHAR *m_Text;
+	size_t m_Length;
+};
+
+int Score(const char *s, const char *Pattern)
+{
+	return OWFuzzyScore(Text(s), Text(Pattern));
+}
+
+bool IsSubsequence(const char *s, const char *Pattern)
+{
+	for (; *s && *Pattern; s++)
+		if (*s == *Pattern)
+			Pattern++;
+	return *Pattern == '\0';
+}
+
+} // namespace
+
+//========================================================================================
+// Matching
+
+TEST(FuzzyMatchTest, MatchesSubsequences)
+{
+	EXPECT_NE(OW_FUZZY_NOMATCH, Score("C:\\WINDOWS\\SYSTEM32", "WSYS"));
+	EXPECT_NE(OW_FUZZY_NOMATCH, Score("DOCUMENTS", "DOCUMENTS"));
+	EXPECT_EQ(OW_FUZZY_NOMATCH, Score("DOCUMENTS", "DOCUMENTSX"));
+	EXPECT_EQ(OW_FUZZY_NOMATCH, Score("DOCUMENTS", "SD"));
+	EXPECT_EQ(OW_FUZZY_NOMATCH, Score("", "A"));
+	EXPECT_EQ(0, Score("ANYTHING", ""));
+	EXPECT_EQ(0, Score("", ""));
+}
+
+TEST(FuzzyMatchTest, ScoresLikeFzf)
+{
+	// After a separator beats the middle of a word
+	EXPECT_GT(Score("FOO BAR", "B"), Score("FOOBAR", "B"));
+	// Consecutive beats spread out
+	EXPECT_GT(Score("XABCX", "ABC"), Score("XAXBXCX", "ABC"));
+	// The name beats the path
+	EXPECT_GT(Score("ABC\1C:\\X", "ABC"), Score("X\1C:\\ABC", "ABC"));
+	// The tightest window is scored, not the first one
+	EXPECT_EQ(Score("______AB", "AB"), Score("A_____AB", "AB"));
+	// Never negative, so OW_FUZZY_NOMATCH stays unambiguous
+	EXPECT_GE(Score("A______________________________________________B", "AB"), 0);
+}
+
+TEST(FuzzyMatchTest, CharMask)
+{
+	OWUINT64 Mask = OWFuzzyCharMask(Text("AB"));
+	EXPECT_EQ(((OWUINT64)1 << ('A' & 63)) | ((OWUINT64)1 << ('B' & 63)), Mask);
+	EXPECT_EQ((OWUINT64)0, OWFuzzyCharMask(Text("")));
+}
+
+//========================================================================================
+// The scan at the edges of its blocks
+
+TEST(FuzzyMatchTest, EveryLengthAndPosition)
+{
+	char Buffer[80];
+	int Length, At, Skip;
+
+	for (Length = 0; Length < 40; Length++)
+	{
+		memset(Buffer, 'A', Length);
+		Buffer[Length] = '\0';
+
+		// Not there at all
+		EXPECT_EQ(OW_FUZZY_NOMATCH, Score(Buffer, "Z")) << Length;
+
+		for (At = 0; At < Length; At++)
+		{
+			Buffer[At] = 'Z';
+			EXPECT_NE(OW_FUZZY_NOMATCH, Score(Buffer, "Z")) << Length << " " << At;
+			EXPECT_EQ(At + 1 < Length, Score(Buffer, "ZA") != OW_FUZZY_NOMATCH) << Length << " " << At;
+			Buffer[At] = 'A';
+		}
+
+		// Starting at every alignment inside a longer block
+		Text Whole(Buffer);
+		for (Skip = 0; Skip <= Length; Skip++)
+		{
+			const OWCHAR *Tail = (const OWCHAR*)Whole + Skip;
+			Text Pattern("A");
+			EXPECT_EQ(Skip < Length, OWFuzzyScore(Tail, Pattern) != OW_FUZZY_NOMATCH);
+		}
+	}
+}
+
+TEST(FuzzyMatchTest, AgreesWithAPlainSubsequenceCheck)
+{
+	const char Alphabet[] = "ABC\\ 1";
+	char Buffer[64], Pattern[8];
+	int i, j;
+
+	srand(1);
+	for (i = 0; i < 20000; i++)
+	{
+		int Length = rand() % 48, PatternLength = 1 + rand() % 5;
+		for (j = 0; j < Length; j++)
+			Buffer[j] = Alphabet[rand() % 6];
+		Buffer[Length] = '\0';
+		for (j = 0; j < PatternLength; j++)
+			Pattern[j] = Alphabet[rand() % 6];
+		Pattern[PatternLength] = '\0';
+
+		int s = Score(Buffer, Pattern);
+		ASSERT_EQ(IsSubsequence(Buffer, Pattern), s != OW_FUZZY_NOMATCH) << Buffer << " / " << Pattern;
+		ASSERT_TRUE(s == OW_FUZZY_NOMATCH || s >= 0);
+	}
+}
+
+//========================================================================================
+// Batches
+
+TEST(FuzzyMatchTest, BatchMatchesSingleScores)
+{
+	const char *Strings[] = { "DOCUMENTS\1C:\\USERS\\ME\\DOCUMENTS", "DOWNLOADS\1C:\\USERS\\ME\\DOWNLOADS",
+		"SYSTEM32\1C:\\WINDOWS\\SYSTEM32", "D\1D:\\", "" };
+	const int Count = sizeof(Strings) / sizeof(Strings[0]);
+	std::vector<Text> Texts;
+	std::vector<const OWCHAR*> Pointers;
+	std::vector<OWUINT64> Masks;
+	int i;
+
+	for (i = 0; i < Count; i++)
+		Texts.push_back(Text(Strings[i]));
+	for (i = 0; i < Count; i++)
+	{
+		Pointers.push_back(Texts[i]);
+		Masks.push_back(OWFuzzyCharMask(Texts[i]));
+	}
+
+	const char *Patterns[] = { "DO", "DOC", "SYS", "D", "Q", "" };
+	for (size_t p = 0; p < sizeof(Patterns) / sizeof(Patterns[0]); p++)
+	{
+		Text Pattern(Patterns[p]);
+		// Backwards, and not all of them
+		int Candidates[] = { 4, 3, 2, 0 };
+		int Scores[4], Matched = 0;
+
+		int Returned = OWFuzzyScoreBatch(Pattern, &Pointers[0], &Masks[0], Candidates, 4, Scores);
+		for (i = 0; i < 4; i++)
+		{
+			EXPECT_EQ(OWFuzzyScore(Pointers[Candidates[i]], Pattern), Scores[i]) << Patterns[p] << " " << i;
+			if (Scores[i] != OW_FUZZY_NOMATCH)
+				Matched++;
+		}
+		EXPECT_EQ(Matched, Returned);
+	}
+}
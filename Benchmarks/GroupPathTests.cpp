@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+
+
+//========================================================================================
+// Tests of grouping the windows (OWGroupPath) and what it stands on: telling what kind
+// of place a path is (OWClassifyPath), and the folder items that carry a group's key,
+// including ones from before they had a key.
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "OWCore.h"
+
+namespace
+{
+
+std::vector<OWCHAR> Wide(const std::string &Text)
+{
+	std::vector<OWCHAR> w(Text.begin(), Text.end());
+	w.push_back(0);
+	return w;
+}
+
+std::string Narrow(const OWCHAR *Text)
+{
+	std::string s;
+	for (; *Text != 0; Text++)
+		s += (char)*Text;
+	return s;
+}
+
+int Classify(const std::string &Path, char *pDrive = NULL)
+{
+	std::vector<OWCHAR> w = Wide(Path);
+	char Drive;
+	int Class = OWClassifyPath(&w[0], &Drive);
+	if (pDrive != NULL)
+		*pDrive = Drive;
+	return Class;
+}
+
+class GroupPathTest : public ::testing::Test
+{
+protected:
+	void AddKnown(const std::string &Folder)
+	{
+		KnownText.push_back(Wide(Folder));
+	}
+
+	// The group kind, with its key and known folder in Key and Known
+	int Group(const std::string &Path)
+	{
+		std::vector<const OWCHAR*> Folders;
+		size_t i;
+		for (i = 0; i < KnownText.size(); i++)
+			Folders.push_back(&KnownText[i][0]);
+
+		std::vector<OWCHAR> w = Wide(Path);
+		// Filled, to catch a key not ended where it should be
+		std::vector<OWCHAR> Buffer(w.size(), 0x7F);
+		int Kind = OWGroupPath(&w[0], Folders.empty() ? NULL : &Folders[0], (int)Folders.size(), &Buffer[0], &Known);
+		Key = Narrow(&Buffer[0]);
+		// It's never longer than the path, which is what callers size it by
+		EXPECT_LE(Key.size(), Path.size());
+		return Kind;
+	}
+
+	std::vector<std::vector<OWCHAR> > KnownText;
+	std::string Key;
+	int Known;
+};
+
+//========================================================================================
+// Classifying
+
+TEST(ClassifyPath, Drives)
+{
+	char Drive;
+
+	EXPECT_EQ(OW_CLASS_DRIVE, Classify("C:\\", &Drive));
+	EXPECT_EQ('C', Drive);
+	EXPECT_EQ(OW_CLASS_DRIVE, Classify("d:/", &Drive));
+	EXPECT_EQ('D', Drive);
+	// Without its separator, still the drive
+	EXPECT_EQ(OW_CLASS_DRIVE, Classify("C:", &Drive));
+	EXPECT_EQ('C', Drive);
+}
+
+TEST(ClassifyPath, Folders)
+{
+	char Drive;
+
+	EXPECT_EQ(OW_CLASS_FOLDER, Classify("C:\\Users", &Drive));
+	EXPECT_EQ('C', Drive);
+	EXPECT_EQ(OW_CLASS_FOLDER, Classify("z:/a/b/", &Drive));
+	EXPECT_EQ('Z', Drive);
+	// Relative to the drive's current folder: no place of its own
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("C:Users"));
+}
+
+TEST(ClassifyPath, Shares)
+{
+	char Drive;
+
+	EXPECT_EQ(OW_CLASS_SHARE, Classify("\\\\server\\share", &Drive));
+	EXPECT_EQ(0, Drive);
+	EXPECT_EQ(OW_CLASS_SHARE, Classify("\\\\server\\share\\"));
+	EXPECT_EQ(OW_CLASS_SHARE, Classify("//server/share"));
+	EXPECT_EQ(OW_CLASS_NETWORK_FOLDER, Classify("\\\\server\\share\\folder"));
+	EXPECT_EQ(OW_CLASS_NETWORK_FOLDER, Classify("\\\\server\\share\\a\\b"));
+	// A server alone isn't a share
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("\\\\server"));
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("\\\\server\\"));
+}
+
+TEST(ClassifyPath, Others)
+{
+	char Drive;
+
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("", &Drive));
+	EXPECT_EQ(0, Drive);
+	EXPECT_EQ(OW_CLASS_OTHER, OWClassifyPath(NULL, &Drive));
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("::{20D04FE0-3AEA-1069-A2D8-08002B30309D}", &Drive));
+	EXPECT_EQ(0, Drive);
+	// Device and long paths aren't shares
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("\\\\?\\C:\\Users"));
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("\\\\?\\UNC\\server\\share"));
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("\\\\.\\pipe\\name"));
+	EXPECT_EQ(OW_CLASS_OTHER, Classify("1:\\"));
+}
+
+//========================================================================================
+// Grouping
+
+TEST_F(GroupPathTest, DeepestKnownFolderWins)
+{
+	AddKnown("C:\\Users\\me\\Documents");
+	AddKnown("C:\\Users");
+	AddKnown("C:\\Users\\me");
+
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("C:\\Users\\me\\Documents\\Letters"));
+	EXPECT_EQ(0, Known);
+	EXPECT_EQ("C:\\Users\\me\\Documents", Key);
+
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("C:\\Users\\me\\Music"));
+	EXPECT_EQ(2, Known);
+	EXPECT_EQ("C:\\Users\\me", Key);
+
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("C:\\Users\\you"));
+	EXPECT_EQ(1, Known);
+	EXPECT_EQ("C:\\Users", Key);
+}
+
+TEST_F(GroupPathTest, KnownFolderIsInItself)
+{
+	AddKnown("C:\\Users\\me");
+
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("C:\\Users\\me"));
+	EXPECT_EQ("C:\\Users\\me", Key);
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("C:\\Users\\me\\"));
+	EXPECT_EQ("C:\\Users\\me", Key);
+}
+
+TEST_F(GroupPathTest, KnownFolderEndsAtSeparator)
+{
+	AddKnown("C:\\Users\\m");
+
+	// "C:\Users\me" starts with "C:\Users\m", but isn't in it
+	EXPECT_EQ(OW_GROUP_DRIVE, Group("C:\\Users\\me"));
+	EXPECT_EQ(-1, Known);
+	EXPECT_EQ("C:\\", Key);
+	EXPECT_EQ(OW_GROUP_DRIVE, Group("C:\\Users\\me\\Music"));
+	EXPECT_EQ(-1, Known);
+
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("C:\\Users\\m\\Music"));
+	EXPECT_EQ(0, Known);
+}
+
+TEST_F(GroupPathTest, KnownFolderIgnoresCaseAndSlashes)
+{
+	AddKnown("C:\\Users\\Me");
+
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("c:/users/ME/Music"));
+	// The key is the known folder's, as given
+	EXPECT_EQ("C:\\Users\\Me", Key);
+}
+
+TEST_F(GroupPathTest, KnownRootHasItsSeparator)
+{
+	AddKnown("D:\\");
+
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("D:\\Games"));
+	EXPECT_EQ("D:\\", Key);
+	EXPECT_EQ(OW_GROUP_KNOWN, Group("d:\\"));
+}
+
+TEST_F(GroupPathTest, Drives)
+{
+	EXPECT_EQ(OW_GROUP_DRIVE, Group("C:\\"));
+	EXPECT_EQ(-1, Known);
+	EXPECT_EQ("C:\\", Key);
+	EXPECT_EQ(OW_GROUP_DRIVE, Group("e:/Photos/2020"));
+	EXPECT_EQ("E:\\", Key);
+}
+
+TEST_F(GroupPathTest, BareDriveHasNoGroup)
+{
+	// Its key, "C:\", would be longer than the path
+	EXPECT_EQ(OW_GROUP_NONE, Group("C:"));
+	EXPECT_EQ("", Key);
+	EXPECT_EQ(-1, Known);
+}
+
+TEST_F(GroupPathTest, SharesGoByHost)
+{
+	EXPECT_EQ(OW_GROUP_HOST, Group("\\\\server\\share"));
+	EXPECT_EQ("\\\\server", Key);
+	EXPECT_EQ(OW_GROUP_HOST, Group("\\\\server\\other\\folder"));
+	EXPECT_EQ("\\\\server", Key);
+	EXPECT_EQ(OW_GROUP_HOST, Group("//nas/media"));
+	EXPECT_EQ("\\\\nas", Key);
+	// A server alone is no share
+	EXPECT_EQ(OW_GROUP_NONE, Group("\\\\server"));
+}
+
+TEST_F(GroupPathTest, OthersStayInRoot)
+{
+	AddKnown("C:\\Users");
+
+	EXPECT_EQ(OW_GROUP_NONE, Group("\\\\?\\C:\\Users\\me"));
+	EXPECT_EQ("", Key);
+	EXPECT_EQ(OW_GROUP_NONE, Group("\\\\?\\UNC\\server\\share"));
+	EXPECT_EQ(OW_GROUP_NONE, Group("\\\\.\\pipe\\name"));
+	EXPECT_EQ(OW_GROUP_NONE, Group("::{20D04FE0-3AEA-1069-A2D8-08002B30309D}"));
+	EXPECT_EQ(OW_GROUP_NONE, Group(""));
+	EXPECT_EQ(-1, Known);
+}
+
+//========================================================================================
+// Folder items
+
+// A single item pidl, with its list terminator
+std::vector<unsigned char> EncodeFolder(int Kind, const std::string &Name, const std::string &Key)
+{
+	std::vector<OWCHAR> NameW = Wide(Name), KeyW = Wide(Key);
+	unsigned Size = OWFolderItemGetSize((unsigned)Name.size(), (unsigned)Key.size());
+	unsigned short cb = (unsigned short)(Size + 2);
+	std::vector<unsigned char> Bytes(Size + 4, 0xCD);
+
+	memcpy(&Bytes[0], &cb, sizeof(cb));
+	OWFolderItemEncode(Kind, &NameW[0], (unsigned)Name.size(), &KeyW[0], (unsigned)Key.size(), &Bytes[2]);
+	Bytes[cb] = Bytes[cb + 1] = 0;
+	return Bytes;
+}
+
+void Append(std::vector<unsigned char> &Bytes, const void *Data, size_t Size)
+{
+	Bytes.insert(Bytes.end(), (const unsigned char*)Data, (const unsigned char*)Data + Size);
+}
+
+TEST(FolderItem, RoundTripsKey)
+{
+	std::vector<unsigned char> Bytes = EncodeFolder(OW_FOLDER_GROUP, "Documents", "C:\\Users\\me\\Documents");
+	const void *pidl = &Bytes[0];
+
+	EXPECT_TRUE(OWFolderItemIsOwn(pidl));
+	EXPECT_FALSE(OWItemIsOwn(pidl));
+	EXPECT_TRUE(OWIdListIsSingle(pidl));
+	EXPECT_EQ(OW_FOLDER_GROUP, OWFolderItemGetKind(pidl));
+	EXPECT_EQ("Documents", Narrow(OWFolderItemGetName(pidl)));
+	EXPECT_EQ(9u, OWFolderItemGetNameLength(pidl));
+	EXPECT_EQ("C:\\Users\\me\\Documents", Narrow(OWFolderItemGetKey(pidl)));
+	EXPECT_EQ(21u, OWFolderItemGetKeyLength(pidl));
+}
+
+TEST(FolderItem, RoundTripsHostAndDriveKeys)
+{
+	std::vector<unsigned char> Host = EncodeFolder(OW_FOLDER_GROUP, "server", "\\\\server");
+	std::vector<unsigned char> Drive = EncodeFolder(OW_FOLDER_GROUP, "Local Disk (C:)", "C:\\");
+
+	EXPECT_EQ("\\\\server", Narrow(OWFolderItemGetKey(&Host[0])));
+	EXPECT_EQ("C:\\", Narrow(OWFolderItemGetKey(&Drive[0])));
+	EXPECT_EQ(3u, OWFolderItemGetKeyLength(&Drive[0]));
+}
+
+TEST(FolderItem, RoundTripsEmptyKey)
+{
+	std::vector<unsigned char> Bytes = EncodeFolder(OW_FOLDER_RECENT, "Recently closed", "");
+	const void *pidl = &Bytes[0];
+
+	EXPECT_EQ(OW_FOLDER_RECENT, OWFolderItemGetKind(pidl));
+	EXPECT_EQ("Recently closed", Narrow(OWFolderItemGetName(pidl)));
+	EXPECT_EQ("", Narrow(OWFolderItemGetKey(pidl)));
+	EXPECT_EQ(0u, OWFolderItemGetKeyLength(pidl));
+}
+
+TEST(FolderItem, ItemWithoutKeyReadsEmpty)
+{
+	// As written before folder items had a key: magic, kind, name length, name
+	std::vector<OWCHAR> Name = Wide("Recently closed");
+	unsigned int Magic = OW_FOLDER_MAGIC;
+	unsigned short Kind = OW_FOLDER_RECENT, NameLength = (unsigned short)(Name.size() - 1), cb = 0;
+	std::vector<unsigned char> Bytes;
+
+	Append(Bytes, &cb, sizeof(cb));
+	Append(Bytes, &Magic, sizeof(Magic));
+	Append(Bytes, &Kind, sizeof(Kind));
+	Append(Bytes, &NameLength, sizeof(NameLength));
+	Append(Bytes, &Name[0], Name.size() * sizeof(OWCHAR));
+	cb = (unsigned short)Bytes.size();
+	memcpy(&Bytes[0], &cb, sizeof(cb));
+	// The list ends right after, so a key would be read out of the terminator
+	Bytes.push_back(0);
+	Bytes.push_back(0);
+	const void *pidl = &Bytes[0];
+
+	EXPECT_TRUE(OWFolderItemIsOwn(pidl));
+	EXPECT_EQ(OW_FOLDER_RECENT, OWFolderItemGetKind(pidl));
+	EXPECT_EQ("Recently closed", Narrow(OWFolderItemGetName(pidl)));
+	EXPECT_EQ("", Narrow(OWFolderItemGetKey(pidl)));
+	EXPECT_EQ(0u, OWFolderItemGetKeyLength(pidl));
+}
+
+TEST(FolderItem, TooShortIsNotOurs)
+{
+	unsigned char Bytes[12] = { 0 };
+	unsigned int Magic = OW_FOLDER_MAGIC;
+	unsigned short cb = 8;
+
+	// The magic, but no room for even an empty name
+	memcpy(Bytes, &cb, sizeof(cb));
+	memcpy(Bytes + 2, &Magic, sizeof(Magic));
+	EXPECT_FALSE(OWFolderItemIsOwn(Bytes));
+	EXPECT_FALSE(OWFolderItemIsOwn(NULL));
+}
+
+} // namespace
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Tests of the closed window history (OWHistory), over a buffer instead of the mapped
+// file. Build with the CMakeLists.txt at the top, and run with ctest.
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "OWHistory.h"
+
+namespace
+{
+
+std::vector<OWCHAR> Text(const char *s)
+{
+	std::vector<OWCHAR> t;
+	while (*s)
+		t.push_back((OWCHAR)*s++);
+	t.push_back(0);
+	return t;
+}
+
+bool Equals(const OWCHAR *a, unsigned Length, const char *b)
+{
+	unsigned i;
+	if (strlen(b) != Length)
+		return false;
+	for (i = 0; i < Length; i++)
+		if (a[i] != (OWCHAR)b[i])
+			return false;
+	return a[Length] == 0;
+}
+
+class HistoryTest : public ::testing::Test
+{
+protected:
+	HistoryTest() : Buffer(OW_HISTORY_SIZE)
+	{
+		OWHistoryFormat(&Buffer[0], OW_HISTORY_SIZE);
+	}
+
+	bool Append(int Kind, const char *Path, const char *Name, OWUINT64 Time)
+	{
+		std::vector<OWCHAR> P = Text(Path), N = Text(Name);
+		OWHistoryRecord Record;
+		Record.Kind = Kind;
+		Record.Time = Time;
+		Record.Hash = 0;
+		Record.Path = &P[0];
+		Record.PathLength = (unsigned short)(P.size() - 1);
+		Record.Name = &N[0];
+		Record.NameLength = (unsigned short)(N.size() - 1);
+		return OWHistoryAppend(&Buffer[0], &Record);
+	}
+
+	unsigned Walk()
+	{
+		OWHistoryRecord Record;
+		unsigned Position = 0, Count = 0;
+		while (OWHistoryNext(&Buffer[0], &Position, &Record))
+			Count++;
+		return Count;
+	}
+
+	void SetUInt(unsigned Offset, unsigned Value)
+	{
+		memcpy(&Buffer[Offset], &Value, sizeof(Value));
+	}
+
+	std::vector<unsigned char> Buffer;
+};
+
+} // namespace
+
+//========================================================================================
+// Appending and walking
+
+TEST_F(HistoryTest, FormatIsEmpty)
+{
+	EXPECT_TRUE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+	EXPECT_EQ(0u, OWHistoryGetCount(&Buffer[0]));
+	EXPECT_EQ(0u, Walk());
+}
+
+TEST_F(HistoryTest, AppendThenNext)
+{
+	ASSERT_TRUE(Append(OW_HISTORY_CLOSED, "C:\\Windows", "Windows", 100));
+	ASSERT_TRUE(Append(OW_HISTORY_OPENED, "C:\\Users", "Users", 200));
+	EXPECT_EQ(2u, OWHistoryGetCount(&Buffer[0]));
+
+	OWHistoryRecord Record;
+	unsigned Position = 0;
+
+	ASSERT_TRUE(OWHistoryNext(&Buffer[0], &Position, &Record));
+	EXPECT_EQ(OW_HISTORY_CLOSED, Record.Kind);
+	EXPECT_EQ(100u, Record.Time);
+	EXPECT_TRUE(Equals(Record.Path, Record.PathLength, "C:\\Windows"));
+	EXPECT_TRUE(Equals(Record.Name, Record.NameLength, "Windows"));
+	EXPECT_EQ(OWHistoryHash(Record.Path, Record.PathLength), Record.Hash);
+	// Records are aligned, and point into the buffer
+	EXPECT_EQ(0u, Position & 3);
+	EXPECT_GE((const unsigned char*)Record.Path, &Buffer[0]);
+	EXPECT_LT((const unsigned char*)Record.Path, &Buffer[0] + OW_HISTORY_SIZE);
+
+	ASSERT_TRUE(OWHistoryNext(&Buffer[0], &Position, &Record));
+	EXPECT_EQ(OW_HISTORY_OPENED, Record.Kind);
+	EXPECT_TRUE(Equals(Record.Path, Record.PathLength, "C:\\Users"));
+
+	EXPECT_FALSE(OWHistoryNext(&Buffer[0], &Position, &Record));
+}
+
+TEST_F(HistoryTest, AppendFailsWhenFull)
+{
+	int Appended = 0;
+	while (Append(OW_HISTORY_CLOSED, "C:\\A rather long path\\to fill the history up", "Name", Appended))
+		Appended++;
+
+	EXPECT_GT(Appended, 0);
+	EXPECT_EQ((unsigned)Appended, OWHistoryGetCount(&Buffer[0]));
+	EXPECT_EQ((unsigned)Appended, Walk());
+	// A short one may still fit, but the header stays consistent either way
+	Append(OW_HISTORY_CLOSED, "C:\\", "C", 0);
+	EXPECT_TRUE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+	EXPECT_EQ(OWHistoryGetCount(&Buffer[0]), Walk());
+}
+
+TEST_F(HistoryTest, FindLatest)
+{
+	Append(OW_HISTORY_CLOSED, "C:\\Windows", "Windows", 100);
+	Append(OW_HISTORY_CLOSED, "C:\\Users", "Users", 200);
+	Append(OW_HISTORY_OPENED, "C:\\Windows", "Windows", 300);
+
+	std::vector<OWCHAR> Path = Text("C:\\Windows"), Missing = Text("C:\\Temp");
+	OWHistoryRecord Record;
+
+	ASSERT_TRUE(OWHistoryFindLatest(&Buffer[0], &Path[0], Path.size() - 1, &Record));
+	EXPECT_EQ(OW_HISTORY_OPENED, Record.Kind);
+	EXPECT_EQ(300u, Record.Time);
+	EXPECT_FALSE(OWHistoryFindLatest(&Buffer[0], &Missing[0], Missing.size() - 1, &Record));
+}
+
+//========================================================================================
+// Recent closed windows, and compacting
+
+TEST_F(HistoryTest, RecentIsLatestFirstAndSkipsReopened)
+{
+	Append(OW_HISTORY_CLOSED, "C:\\A", "A", 1);
+	Append(OW_HISTORY_CLOSED, "C:\\B", "B", 2);
+	Append(OW_HISTORY_CLOSED, "C:\\C", "C", 3);
+	Append(OW_HISTORY_OPENED, "C:\\B", "B", 4);
+	Append(OW_HISTORY_CLOSED, "C:\\A", "A", 5);
+
+	OWHistoryRecord Records[8];
+	int Count = OWHistoryRecent(&Buffer[0], Records, 8);
+
+	ASSERT_EQ(2, Count);
+	EXPECT_TRUE(Equals(Records[0].Path, Records[0].PathLength, "C:\\A"));
+	EXPECT_EQ(5u, Records[0].Time);
+	EXPECT_TRUE(Equals(Records[1].Path, Records[1].PathLength, "C:\\C"));
+
+	EXPECT_EQ(1, OWHistoryRecent(&Buffer[0], Records, 1));
+	EXPECT_EQ(5u, Records[0].Time);
+}
+
+TEST_F(HistoryTest, CompactKeepsTheLatestClosed)
+{
+	char Path[32];
+	int i;
+
+	for (i = 0; i < 10; i++)
+	{
+		sprintf(Path, "C:\\%d", i);
+		Append(OW_HISTORY_CLOSED, Path, "x", i);
+	}
+	Append(OW_HISTORY_OPENED, "C:\\9", "x", 10);
+
+	std::vector<unsigned char> Target(OW_HISTORY_SIZE);
+	OWHistoryCompact(&Buffer[0], &Target[0], OW_HISTORY_SIZE, 3);
+
+	ASSERT_TRUE(OWHistoryCheck(&Target[0], OW_HISTORY_SIZE));
+	EXPECT_EQ(3u, OWHistoryGetCount(&Target[0]));
+
+	// Oldest first again, and the reopened one is gone
+	OWHistoryRecord Record;
+	unsigned Position = 0;
+	const char *Expected[] = { "C:\\6", "C:\\7", "C:\\8" };
+	for (i = 0; i < 3; i++)
+	{
+		ASSERT_TRUE(OWHistoryNext(&Target[0], &Position, &Record));
+		EXPECT_TRUE(Equals(Record.Path, Record.PathLength, Expected[i]));
+		EXPECT_EQ(OW_HISTORY_CLOSED, Record.Kind);
+	}
+	EXPECT_FALSE(OWHistoryNext(&Target[0], &Position, &Record));
+}
+
+//========================================================================================
+// Damaged files
+
+TEST_F(HistoryTest, RejectsCorruptHeaders)
+{
+	EXPECT_FALSE(OWHistoryCheck(NULL, OW_HISTORY_SIZE));
+	EXPECT_FALSE(OWHistoryCheck(&Buffer[0], OW_HISTORY_HEADER_SIZE - 1));
+
+	std::vector<unsigned char> Good = Buffer;
+
+	SetUInt(0, 0x12345678);					// magic
+	EXPECT_FALSE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+	Buffer = Good;
+
+	SetUInt(4, OW_HISTORY_VERSION + 1);		// version
+	EXPECT_FALSE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+	Buffer = Good;
+
+	SetUInt(8, OW_HISTORY_SIZE * 2);		// bigger than the mapping
+	EXPECT_FALSE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+	Buffer = Good;
+
+	SetUInt(12, OW_HISTORY_HEADER_SIZE - 4);	// used inside the header
+	EXPECT_FALSE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+	Buffer = Good;
+
+	SetUInt(12, OW_HISTORY_SIZE + 4);		// used past the end
+	EXPECT_FALSE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+	Buffer = Good;
+
+	EXPECT_TRUE(OWHistoryCheck(&Buffer[0], OW_HISTORY_SIZE));
+}
+
+TEST_F(HistoryTest, DamagedRecordEndsTheWalk)
+{
+	Append(OW_HISTORY_CLOSED, "C:\\A", "A", 1);
+	Append(OW_HISTORY_CLOSED, "C:\\B", "B", 2);
+	Append(OW_HISTORY_CLOSED, "C:\\C", "C", 3);
+
+	OWHistoryRecord Record;
+	unsigned Position = 0;
+	ASSERT_TRUE(OWHistoryNext(&Buffer[0], &Position, &Record));
+	unsigned Second = Position;
+
+	// A path length that runs past the record
+	unsigned short Length = 0x7FFF;
+	memcpy(&Buffer[Second + 4], &Length, sizeof(Length));
+	EXPECT_EQ(1u, Walk());
+
+	OWHistoryRecord Records[4];
+	EXPECT_EQ(1, OWHistoryRecent(&Buffer[0], Records, 4));
+}
+
+TEST_F(HistoryTest, TornTailIsIgnored)
+{
+	Append(OW_HISTORY_CLOSED, "C:\\A", "A", 1);
+	Append(OW_HISTORY_CLOSED, "C:\\B", "B", 2);
+
+	// Claim the last record is there, but only part of it
+	unsigned Used;
+	memcpy(&Used, &Buffer[12], sizeof(Used));
+	SetUInt(12, Used - 8);
+	EXPECT_EQ(1u, Walk());
+}
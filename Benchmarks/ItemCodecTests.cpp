@@ -0,0 +1,439 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+
+
+//========================================================================================
+// Tests of the item pidl codec (OWItem*): pidls in the V0 and V1 layouts, built byte by
+// byte the way older versions wrote them, read back by today's code; V2 round trips,
+// with and without the ANSI copies; and the item images turned into pidls.
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "OWCore.h"
+
+namespace
+{
+
+std::vector<OWCHAR> Wide(const std::string &Text)
+{
+	std::vector<OWCHAR> w(Text.begin(), Text.end());
+	w.push_back(0);
+	return w;
+}
+
+std::string Narrow(const OWCHAR *Text)
+{
+	std::string s;
+	for (; *Text != 0; Text++)
+		s += (char)*Text;
+	return s;
+}
+
+// A pidl written field by field, in the native byte order: the cb, the item, and the
+// terminator of the list
+class Image
+{
+public:
+	Image() : Bytes(2, 0) {}
+
+	Image &UShort(unsigned short Value)
+	{
+		Bytes.insert(Bytes.end(), (unsigned char*)&Value, (unsigned char*)&Value + sizeof(Value));
+		return *this;
+	}
+
+	Image &UInt(unsigned int Value)
+	{
+		Bytes.insert(Bytes.end(), (unsigned char*)&Value, (unsigned char*)&Value + sizeof(Value));
+		return *this;
+	}
+
+	Image &String(const std::string &Text)
+	{
+		std::vector<OWCHAR> w = Wide(Text);
+		size_t i;
+		for (i = 0; i < w.size(); i++)
+			UShort(w[i]);
+		return *this;
+	}
+
+	const void *Pidl()
+	{
+		unsigned short cb = (unsigned short)Bytes.size();
+		memcpy(&Bytes[0], &cb, sizeof(cb));
+		Bytes.push_back(0);
+		Bytes.push_back(0);
+		return &Bytes[0];
+	}
+
+	std::vector<unsigned char> Bytes;
+};
+
+const void *V0(Image &i, unsigned short Rank, const std::string &Path, const std::string &Name)
+{
+	return i.UInt(OW_ITEM_MAGIC).UShort(OW_LAYOUT_V0).UShort(Rank).String(Path).String(Name).Pidl();
+}
+
+const void *V1(Image &i, unsigned short Rank, const std::string &Path, const std::string &Name)
+{
+	return i.UInt(OW_ITEM_MAGIC).UShort(OW_LAYOUT_V1).UShort(Rank)
+		.UShort((unsigned short)Path.size()).UShort((unsigned short)Name.size())
+		.String(Path).String(Name).Pidl();
+}
+
+// Encoded by today's code, as a single item pidl
+struct Item
+{
+	Item(unsigned short Rank, const std::string &Path, const std::string &Name, bool Ansi)
+		: PathW(Wide(Path)), NameW(Wide(Name)), PathA(Path), NameA(Name)
+	{
+		Data.Rank = Rank;
+		Data.Path = &PathW[0];
+		Data.PathLength = (unsigned short)Path.size();
+		Data.Name = &NameW[0];
+		Data.NameLength = (unsigned short)Name.size();
+		Data.PathA = PathA.c_str();
+		Data.PathALength = Ansi ? (unsigned short)Path.size() : (unsigned short)OW_NO_ANSI;
+		Data.NameA = NameA.c_str();
+		Data.NameALength = Ansi ? (unsigned short)Name.size() : (unsigned short)OW_NO_ANSI;
+	}
+
+	const void *Pidl()
+	{
+		unsigned Size = OWItemGetSize(&Data);
+		unsigned short cb = (unsigned short)(Size + 2);
+		Bytes.assign(Size + 4, 0xCD);
+		memcpy(&Bytes[0], &cb, sizeof(cb));
+		OWItemEncode(&Data, &Bytes[2]);
+		Bytes[cb] = Bytes[cb + 1] = 0;
+		return &Bytes[0];
+	}
+
+	std::vector<OWCHAR> PathW, NameW;
+	std::string PathA, NameA;
+	OWItemData Data;
+	std::vector<unsigned char> Bytes;
+};
+
+void ExpectItem(const void *pidl, unsigned short Rank, const std::string &Path, const std::string &Name)
+{
+	EXPECT_TRUE(OWItemIsOwn(pidl));
+	EXPECT_TRUE(OWIdListIsSingle(pidl));
+	EXPECT_EQ(Rank, OWItemGetRank(pidl));
+	EXPECT_EQ(Path, Narrow(OWItemGetPath(pidl)));
+	EXPECT_EQ(Name, Narrow(OWItemGetName(pidl)));
+	EXPECT_EQ(Path.size(), OWItemGetPathLength(pidl));
+	EXPECT_EQ(Name.size(), OWItemGetNameLength(pidl));
+}
+
+//========================================================================================
+// Older layouts
+
+TEST(ItemCodec, ReadsV0)
+{
+	Image i;
+	const void *pidl = V0(i, 7, "C:\\Users\\me", "me");
+
+	EXPECT_EQ(OW_LAYOUT_V0, OWItemGetLayout(pidl));
+	ExpectItem(pidl, 7, "C:\\Users\\me", "me");
+	EXPECT_TRUE(OWItemGetPathA(pidl) == NULL);
+	EXPECT_TRUE(OWItemGetNameA(pidl) == NULL);
+}
+
+TEST(ItemCodec, ReadsV1)
+{
+	Image i;
+	const void *pidl = V1(i, 300, "\\\\server\\share\\folder", "folder");
+
+	EXPECT_EQ(OW_LAYOUT_V1, OWItemGetLayout(pidl));
+	ExpectItem(pidl, 300, "\\\\server\\share\\folder", "folder");
+	EXPECT_TRUE(OWItemGetPathA(pidl) == NULL);
+	EXPECT_TRUE(OWItemGetNameA(pidl) == NULL);
+}
+
+TEST(ItemCodec, ReadsV1LengthsAsWritten)
+{
+	Image i;
+	// V1 has the lengths, so the name is found without scanning the path
+	const void *pidl = V1(i, 1, "C:\\", "Local Disk (C:)");
+
+	EXPECT_EQ(3u, OWItemGetPathLength(pidl));
+	EXPECT_EQ("Local Disk (C:)", Narrow(OWItemGetName(pidl)));
+}
+
+TEST(ItemCodec, ReadsEmptyStrings)
+{
+	Image i0, i1;
+	const void *pidl;
+
+	pidl = V0(i0, 0, "", "");
+	ExpectItem(pidl, 0, "", "");
+	pidl = V1(i1, 0, "", "");
+	ExpectItem(pidl, 0, "", "");
+}
+
+TEST(ItemCodec, ComparesAcrossLayouts)
+{
+	Image i0, i1;
+	Item i2(2, "C:\\B", "b", true);
+	const void *Old = V0(i0, 1, "C:\\A", "a");
+	const void *Middle = V1(i1, 2, "C:\\A", "b");
+	const void *New = i2.Pidl();
+
+	EXPECT_EQ(-1, OWItemCompare(Old, New, OW_FIELD_PATH));
+	EXPECT_EQ(0, OWItemCompare(Old, Middle, OW_FIELD_PATH));
+	EXPECT_EQ(0, OWItemCompare(Middle, New, OW_FIELD_NAME));
+	EXPECT_EQ(1, OWItemCompare(New, Old, OW_FIELD_NAME));
+	EXPECT_EQ(-1, OWItemCompare(Old, New, OW_FIELD_RANK));
+	EXPECT_EQ(0, OWItemCompare(Middle, New, OW_FIELD_RANK));
+}
+
+TEST(ItemCodec, TellsOthersApart)
+{
+	Image Short, Foreign, Folder;
+	const void *pidl;
+
+	EXPECT_FALSE(OWItemIsOwn(NULL));
+
+	// Too short to hold the magic
+	pidl = Short.UShort(0x5755).Pidl();
+	EXPECT_FALSE(OWItemIsOwn(pidl));
+
+	pidl = Foreign.UInt(0x12345678).UShort(OW_LAYOUT_V1).UShort(0).UShort(0).UShort(0).String("").String("").Pidl();
+	EXPECT_FALSE(OWItemIsOwn(pidl));
+
+	// One of our folders isn't one of our windows
+	pidl = Folder.UInt(OW_FOLDER_MAGIC).UShort(OW_FOLDER_RECENT).UShort(1).String("R").UShort(0).String("").Pidl();
+	EXPECT_FALSE(OWItemIsOwn(pidl));
+	EXPECT_TRUE(OWFolderItemIsOwn(pidl));
+}
+
+//========================================================================================
+// Today's layout
+
+TEST(ItemCodec, RoundTripsV2WithAnsi)
+{
+	Item i(42, "C:\\Program Files", "Program Files", true);
+	const void *pidl = i.Pidl();
+
+	EXPECT_EQ(OW_LAYOUT_V2, OWItemGetLayout(pidl));
+	EXPECT_EQ(OW_LAYOUT_CURRENT, OWItemGetLayout(pidl));
+	ExpectItem(pidl, 42, "C:\\Program Files", "Program Files");
+	ASSERT_TRUE(OWItemGetPathA(pidl) != NULL);
+	ASSERT_TRUE(OWItemGetNameA(pidl) != NULL);
+	EXPECT_STREQ("C:\\Program Files", OWItemGetPathA(pidl));
+	EXPECT_STREQ("Program Files", OWItemGetNameA(pidl));
+}
+
+TEST(ItemCodec, RoundTripsV2WithoutAnsi)
+{
+	Item i(42, "C:\\Program Files", "Program Files", false);
+	const void *pidl = i.Pidl();
+
+	EXPECT_EQ(OW_LAYOUT_V2, OWItemGetLayout(pidl));
+	ExpectItem(pidl, 42, "C:\\Program Files", "Program Files");
+	EXPECT_TRUE(OWItemGetPathA(pidl) == NULL);
+	EXPECT_TRUE(OWItemGetNameA(pidl) == NULL);
+	// The copies take no room when they're not there
+	Item WithAnsi(42, "C:\\Program Files", "Program Files", true);
+	EXPECT_EQ(OWItemGetSize(&i.Data) + 17 + 14, OWItemGetSize(&WithAnsi.Data));
+}
+
+TEST(ItemCodec, RoundTripsV2WithOneAnsiCopy)
+{
+	Item i(1, "C:\\Temp", "Temp", true);
+	i.Data.NameALength = OW_NO_ANSI;
+	const void *pidl = i.Pidl();
+
+	ExpectItem(pidl, 1, "C:\\Temp", "Temp");
+	ASSERT_TRUE(OWItemGetPathA(pidl) != NULL);
+	EXPECT_STREQ("C:\\Temp", OWItemGetPathA(pidl));
+	EXPECT_TRUE(OWItemGetNameA(pidl) == NULL);
+}
+
+TEST(ItemCodec, EncodesWholeSize)
+{
+	Item i(1, "C:\\Temp", "Temp", true);
+	const void *pidl = i.Pidl();
+
+	// Nothing is written past the item, and the list ends right after it
+	EXPECT_EQ(2 + OWItemGetSize(&i.Data) + 2, OWIdListGetSize(pidl));
+	EXPECT_EQ(OWItemGetSize(&i.Data) + 4, i.Bytes.size());
+}
+
+TEST(ItemCodec, RoundTripsRandomItems)
+{
+	int Run, i;
+
+	srand(1);
+	for (Run = 0; Run < 500; Run++)
+	{
+		std::vector<OWCHAR> Path, Name;
+		std::string PathA, NameA;
+		int PathLength = rand() % 260, NameLength = rand() % 80;
+		bool Ansi = rand() % 2 != 0;
+
+		// Any UTF-16 unit but the terminator, some past ASCII
+		for (i = 0; i < PathLength; i++)
+			Path.push_back((OWCHAR)(1 + rand() % 0xFFFE));
+		for (i = 0; i < NameLength; i++)
+			Name.push_back((OWCHAR)(1 + rand() % 0xFFFE));
+		for (i = 0; i < PathLength; i++)
+			PathA += (char)(1 + rand() % 255);
+		for (i = 0; i < NameLength; i++)
+			NameA += (char)(1 + rand() % 255);
+		Path.push_back(0);
+		Name.push_back(0);
+
+		OWItemData Data;
+		Data.Rank = (unsigned short)rand();
+		Data.Path = &Path[0];
+		Data.PathLength = (unsigned short)PathLength;
+		Data.Name = &Name[0];
+		Data.NameLength = (unsigned short)NameLength;
+		Data.PathA = PathA.c_str();
+		Data.PathALength = Ansi ? (unsigned short)PathLength : (unsigned short)OW_NO_ANSI;
+		Data.NameA = NameA.c_str();
+		Data.NameALength = Ansi ? (unsigned short)NameLength : (unsigned short)OW_NO_ANSI;
+
+		std::vector<unsigned char> Bytes(OWItemGetSize(&Data) + 4, 0);
+		unsigned short cb = (unsigned short)(OWItemGetSize(&Data) + 2);
+		memcpy(&Bytes[0], &cb, sizeof(cb));
+		OWItemEncode(&Data, &Bytes[2]);
+		const void *pidl = &Bytes[0];
+
+		ASSERT_TRUE(OWItemIsOwn(pidl));
+		ASSERT_EQ(Data.Rank, OWItemGetRank(pidl));
+		ASSERT_EQ((unsigned)PathLength, OWItemGetPathLength(pidl));
+		ASSERT_EQ((unsigned)NameLength, OWItemGetNameLength(pidl));
+		ASSERT_EQ(0, memcmp(&Path[0], OWItemGetPath(pidl), Path.size() * sizeof(OWCHAR)));
+		ASSERT_EQ(0, memcmp(&Name[0], OWItemGetName(pidl), Name.size() * sizeof(OWCHAR)));
+		if (Ansi)
+		{
+			ASSERT_TRUE(OWItemGetPathA(pidl) != NULL && OWItemGetNameA(pidl) != NULL);
+			ASSERT_EQ(PathA, OWItemGetPathA(pidl));
+			ASSERT_EQ(NameA, OWItemGetNameA(pidl));
+		}
+		else
+		{
+			ASSERT_TRUE(OWItemGetPathA(pidl) == NULL && OWItemGetNameA(pidl) == NULL);
+		}
+	}
+}
+
+//========================================================================================
+// Images
+
+struct Heap
+{
+	int Blocks;
+	int Fail;		// which allocation fails, or -1
+
+	static void *Alloc(void *Context, unsigned Size)
+	{
+		Heap *h = (Heap*)Context;
+		if (h->Fail-- == 0)
+			return NULL;
+		h->Blocks++;
+		return malloc(Size);
+	}
+
+	static void Free(void *Context, void *Block)
+	{
+		((Heap*)Context)->Blocks--;
+		free(Block);
+	}
+};
+
+class ItemImagesTest : public ::testing::Test
+{
+protected:
+	void SetUp()
+	{
+		int i;
+		Items.push_back(new Item(0, "C:\\", "Local Disk (C:)", true));
+		Items.push_back(new Item(1, "C:\\Users\\me", "me", false));
+		Items.push_back(new Item(2, "\\\\server\\share", "share", true));
+		for (i = 0; i < (int)Items.size(); i++)
+			Data.push_back(Items[i]->Data);
+
+		Images.resize(OWItemImagesGetSize(&Data[0], (int)Data.size()));
+		Offsets.resize(Data.size() + 1);
+		OWItemImagesBuild(&Data[0], (int)Data.size(), &Images[0], &Offsets[0]);
+	}
+
+	void TearDown()
+	{
+		size_t i;
+		for (i = 0; i < Items.size(); i++)
+			delete Items[i];
+	}
+
+	std::vector<Item*> Items;
+	std::vector<OWItemData> Data;
+	std::vector<unsigned char> Images;
+	std::vector<unsigned> Offsets;
+};
+
+TEST_F(ItemImagesTest, MakesSingleItemPidls)
+{
+	Heap h = { 0, -1 };
+	void *Pidls[2];
+
+	EXPECT_EQ(Images.size(), Offsets[3]);
+	ASSERT_EQ(2, OWItemImagesToPidls(&Images[0], &Offsets[0], 1, 2, Pidls, Heap::Alloc, Heap::Free, &h));
+	EXPECT_EQ(2, h.Blocks);
+
+	ExpectItem(Pidls[0], 1, "C:\\Users\\me", "me");
+	EXPECT_TRUE(OWItemGetPathA(Pidls[0]) == NULL);
+	ExpectItem(Pidls[1], 2, "\\\\server\\share", "share");
+	EXPECT_STREQ("share", OWItemGetNameA(Pidls[1]));
+
+	Heap::Free(&h, Pidls[0]);
+	Heap::Free(&h, Pidls[1]);
+	EXPECT_EQ(0, h.Blocks);
+}
+
+TEST_F(ItemImagesTest, FailsWholly)
+{
+	void *Pidls[3];
+	int Fail;
+
+	for (Fail = 0; Fail < 3; Fail++)
+	{
+		Heap h = { 0, Fail };
+		EXPECT_EQ(0, OWItemImagesToPidls(&Images[0], &Offsets[0], 0, 3, Pidls, Heap::Alloc, Heap::Free, &h));
+		EXPECT_EQ(0, h.Blocks) << Fail;
+	}
+}
+
+} // namespace
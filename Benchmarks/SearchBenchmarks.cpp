@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Benchmarks of searching the folder, the way typing in the search box does it: every
+// keystroke runs a query over the whole snapshot. Build with the CMakeLists.txt at the
+// top and run with:
+//
+//   ./SearchBenchmarks --benchmark_format=json --benchmark_out=results.json
+//
+// Items are what SearchIndex keeps for each window: "NAME\1PATH", upper case. The
+// index is built under the folder's lock when the snapshot changes, so its build time
+// counts as much as the queries'.
+
+#include <benchmark/benchmark.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "FuzzyMatch.h"
+#include "SearchIndex.h"
+
+//========================================================================================
+// Fixtures
+
+namespace
+{
+
+// About the paths of open folders: a few roots, a few levels, names that repeat.
+std::vector<OWCHAR> MakeText(int i)
+{
+	static const char *Roots[] = { "C:\\USERS\\USER\\", "C:\\PROGRAM FILES\\", "D:\\PROJECTS\\",
+		"\\\\SERVER\\SHARE\\", "C:\\WINDOWS\\" };
+	static const char *Words[] = { "DOCUMENTS", "SOURCE", "BUILD", "RELEASE", "PHOTOS", "2020",
+		"OPENWINDOWS", "TEMP", "DOWNLOADS", "ARCHIVE", "NOTES", "MUSIC" };
+	char Path[256], Name[64];
+	int Levels = 1 + i % 4, j;
+
+	strcpy(Path, Roots[i % 5]);
+	for (j = 0; j < Levels; j++)
+	{
+		strcat(Path, Words[(i / (j + 1) + j * 5) % 12]);
+		if (j + 1 < Levels)
+			strcat(Path, "\\");
+	}
+	snprintf(Name, sizeof(Name), "%s %d", Words[(i / Levels) % 12], i);
+
+	std::vector<OWCHAR> Text;
+	for (j = 0; Name[j]; j++)
+		Text.push_back((OWCHAR)Name[j]);
+	Text.push_back('\1');
+	for (j = 0; Path[j]; j++)
+		Text.push_back((OWCHAR)Path[j]);
+	Text.push_back(0);
+	return Text;
+}
+
+struct Texts
+{
+	Texts(int Count)
+	{
+		int i;
+		for (i = 0; i < Count; i++)
+			Storage.push_back(MakeText(i));
+		for (i = 0; i < Count; i++)
+		{
+			Pointers.push_back(&Storage[i][0]);
+			Masks.push_back(OWFuzzyCharMask(Pointers[i]));
+			All.push_back(i);
+		}
+	}
+
+	std::vector<std::vector<OWCHAR> > Storage;
+	std::vector<const OWCHAR*> Pointers;
+	std::vector<OWUINT64> Masks;
+	std::vector<int> All;
+};
+
+// The same items, as the folder hands them to the index: mixed case, name and path
+// apart.
+struct Items
+{
+	Items(int Count)
+	{
+		int i;
+		for (i = 0; i < Count; i++)
+		{
+			std::vector<OWCHAR> Text = MakeText(i);
+			size_t Separator = 0;
+			while (Text[Separator] != '\1')
+				Separator++;
+
+			std::vector<OWCHAR> Name(Text.begin(), Text.begin() + Separator);
+			std::vector<OWCHAR> Path(Text.begin() + Separator + 1, Text.end());
+			for (size_t j = 1; j < Name.size(); j++)
+			{
+				if (Name[j] >= 'A' && Name[j] <= 'Z' && Name[j-1] != ' ')
+					Name[j] += 'a' - 'A';
+			}
+			Name.push_back(0);
+			Names.push_back(Name);
+			Paths.push_back(Path);
+		}
+		for (i = 0; i < Count; i++)
+		{
+			OWItemData d;
+			memset(&d, 0, sizeof(d));
+			d.Rank = (unsigned short)i;
+			d.Name = &Names[i][0];
+			d.NameLength = (unsigned short)(Names[i].size() - 1);
+			d.Path = &Paths[i][0];
+			d.PathLength = (unsigned short)(Paths[i].size() - 1);
+			Data.push_back(d);
+		}
+	}
+
+	std::vector<std::vector<OWCHAR> > Names, Paths;
+	std::vector<OWItemData> Data;
+};
+
+// What's typed, one more char each keystroke
+const char Typed[] = "DOCSRC";
+
+// A substring query that nothing has, which is quick: between timed runs, it keeps the
+// next query from narrowing the last one.
+const OWCHAR Reset[] = { 'Q', 'Q', 'Q', 0 };
+
+std::vector<OWCHAR> Prefix(int Length)
+{
+	std::vector<OWCHAR> Pattern(Typed, Typed + Length);
+	Pattern.push_back(0);
+	return Pattern;
+}
+
+} // namespace
+
+//========================================================================================
+// Fuzzy scoring of every item, without narrowing: the first keystrokes, or a paste.
+
+static void BM_FuzzyScoreBatch(benchmark::State &state)
+{
+	Texts t((int)state.range(0));
+	std::vector<OWCHAR> Pattern = Prefix((int)state.range(1));
+	std::vector<int> Scores(t.All.size());
+
+	for (auto _ : state)
+	{
+		int Matched = OWFuzzyScoreBatch(&Pattern[0], &t.Pointers[0], &t.Masks[0], &t.All[0],
+			(int)t.All.size(), &Scores[0]);
+		benchmark::DoNotOptimize(Matched);
+	}
+	state.SetItemsProcessed(state.iterations() * t.All.size());
+}
+BENCHMARK(BM_FuzzyScoreBatch)
+	->ArgsProduct({ { 1000, 10000 }, { 1, 3, 6 } })
+	->ArgNames({ "count", "typed" })
+	->Unit(benchmark::kMicrosecond);
+
+// One text at a time, long ones, where the scan is most of the work
+static void BM_FuzzyScore(benchmark::State &state)
+{
+	std::vector<OWCHAR> Text((size_t)state.range(0), 'A');
+	Text.push_back('Z');
+	Text.push_back(0);
+	std::vector<OWCHAR> Pattern(1, 'Z');
+	Pattern.push_back(0);
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(OWFuzzyScore(&Text[0], &Pattern[0]));
+	state.SetBytesProcessed(state.iterations() * Text.size() * sizeof(OWCHAR));
+}
+BENCHMARK(BM_FuzzyScore)->Arg(16)->Arg(64)->Arg(256);
+
+//========================================================================================
+// The index
+
+static void BM_SearchBuild(benchmark::State &state)
+{
+	Items t((int)state.range(0));
+	COWSearchIndex Index;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(Index.Build(&t.Data[0], (int)t.Data.size()));
+	state.SetItemsProcessed(state.iterations() * t.Data.size());
+}
+BENCHMARK(BM_SearchBuild)
+	->Arg(1000)->Arg(10000)
+	->ArgName("count")
+	->Unit(benchmark::kMillisecond);
+
+// A query that can't narrow the previous one, i.e. going back to the index. Fuzzy is
+// 1, substring 0.
+static void BM_SearchQuery(benchmark::State &state)
+{
+	Items t((int)state.range(0));
+	std::vector<OWCHAR> Pattern = Prefix((int)state.range(1));
+	bool Fuzzy = state.range(2) != 0;
+	COWSearchIndex Index;
+
+	Index.Build(&t.Data[0], (int)t.Data.size());
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		Index.Query(Reset);
+		state.ResumeTiming();
+
+		if (Fuzzy)
+			Index.QueryFuzzy(&Pattern[0]);
+		else
+			Index.Query(&Pattern[0]);
+		benchmark::DoNotOptimize(Index.GetResultCount());
+	}
+}
+BENCHMARK(BM_SearchQuery)
+	->ArgsProduct({ { 1000, 10000 }, { 1, 3, 6 }, { 0, 1 } })
+	->ArgNames({ "count", "typed", "fuzzy" })
+	->Unit(benchmark::kMicrosecond);
+
+// Typing the whole query, a keystroke at a time; the time is per keystroke.
+static void BM_SearchTyping(benchmark::State &state)
+{
+	Items t((int)state.range(0));
+	bool Fuzzy = state.range(1) != 0;
+	const int Keystrokes = sizeof(Typed) - 1;
+	std::vector<std::vector<OWCHAR> > Patterns;
+	COWSearchIndex Index;
+	int i;
+
+	for (i = 1; i <= Keystrokes; i++)
+		Patterns.push_back(Prefix(i));
+	Index.Build(&t.Data[0], (int)t.Data.size());
+
+	for (auto _ : state)
+	{
+		for (i = 0; i < Keystrokes; i++)
+		{
+			if (Fuzzy)
+				Index.QueryFuzzy(&Patterns[i][0]);
+			else
+				Index.Query(&Patterns[i][0]);
+		}
+		benchmark::DoNotOptimize(Index.GetResultCount());
+
+		state.PauseTiming();
+		Index.Query(Reset);
+		state.ResumeTiming();
+	}
+	state.counters["per_keystroke"] = benchmark::Counter((double)state.iterations() * Keystrokes,
+		benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_SearchTyping)
+	->ArgsProduct({ { 1000, 10000 }, { 0, 1 } })
+	->ArgNames({ "count", "fuzzy" })
+	->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Tests of the search index (SearchIndex): substring queries against a plain scan of
+// every item, narrowing while typing against fresh queries, and the order of fuzzy
+// results.
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "FuzzyMatch.h"
+#include "SearchIndex.h"
+
+namespace
+{
+
+std::vector<OWCHAR> Text(const std::string &s)
+{
+	std::vector<OWCHAR> t(s.begin(), s.end());
+	t.push_back(0);
+	return t;
+}
+
+// Gets at the postings, to check their order
+class TestIndex : public COWSearchIndex
+{
+public:
+	bool PostingsSorted() const
+	{
+		int i;
+		for (i = 1; i < m_PostingCount; i++)
+		{
+			const Posting &a = m_Postings[i-1], &b = m_Postings[i];
+			if (a.Trigram > b.Trigram || (a.Trigram == b.Trigram && a.Item > b.Item))
+				return false;
+		}
+		return true;
+	}
+	int GetPostingCount() const { return m_PostingCount; }
+};
+
+class SearchIndexTest : public ::testing::Test
+{
+protected:
+	void Add(const std::string &Name, const std::string &Path)
+	{
+		Names.push_back(Name);
+		Paths.push_back(Path);
+	}
+
+	// Random folders over a small alphabet, so queries hit often
+	void AddRandom(int Count)
+	{
+		const char Alphabet[] = "abcABC\\ ";
+		int i, j;
+
+		srand(1);
+		for (i = 0; i < Count; i++)
+		{
+			std::string Name, Path = "C:\\";
+			for (j = rand() % 12; j >= 0; j--)
+				Name += Alphabet[rand() % 8];
+			for (j = rand() % 40; j >= 0; j--)
+				Path += Alphabet[rand() % 8];
+			Add(Name, Path);
+		}
+	}
+
+	void Build()
+	{
+		size_t i;
+		NameTexts.clear();
+		PathTexts.clear();
+		Data.clear();
+		for (i = 0; i < Names.size(); i++)
+		{
+			NameTexts.push_back(Text(Names[i]));
+			PathTexts.push_back(Text(Paths[i]));
+		}
+		for (i = 0; i < Names.size(); i++)
+		{
+			OWItemData d;
+			memset(&d, 0, sizeof(d));
+			d.Name = &NameTexts[i][0];
+			d.NameLength = (unsigned short)Names[i].size();
+			d.Path = &PathTexts[i][0];
+			d.PathLength = (unsigned short)Paths[i].size();
+			Data.push_back(d);
+		}
+		ASSERT_TRUE(Index.Build(Data.empty() ? NULL : &Data[0], (int)Data.size()));
+	}
+
+	std::vector<int> Query(const std::string &q)
+	{
+		Index.Query(&Text(q)[0]);
+		return Results();
+	}
+
+	std::vector<int> QueryFuzzy(const std::string &q)
+	{
+		Index.QueryFuzzy(&Text(q)[0]);
+		return Results();
+	}
+
+	std::vector<int> Results()
+	{
+		std::vector<int> r;
+		for (int i = 0; i < Index.GetResultCount(); i++)
+			r.push_back(Index.GetResult(i));
+		return r;
+	}
+
+	static std::string Upper(std::string s)
+	{
+		for (size_t i = 0; i < s.size(); i++)
+			if (s[i] >= 'a' && s[i] <= 'z')
+				s[i] = (char)(s[i] - 'a' + 'A');
+		return s;
+	}
+
+	// What a substring query should find, by looking at everything
+	std::vector<int> Scan(const std::string &q)
+	{
+		std::vector<int> r;
+		for (size_t i = 0; i < Names.size(); i++)
+		{
+			if ((Upper(Names[i]) + '\1' + Upper(Paths[i])).find(Upper(q)) != std::string::npos)
+				r.push_back((int)i);
+		}
+		return r;
+	}
+
+	std::vector<std::string> Names, Paths;
+	std::vector<std::vector<OWCHAR> > NameTexts, PathTexts;
+	std::vector<OWItemData> Data;
+	TestIndex Index;
+};
+
+} // namespace
+
+//========================================================================================
+// Substring queries
+
+TEST_F(SearchIndexTest, Empty)
+{
+	Build();
+	EXPECT_TRUE(Query("abc").empty());
+	EXPECT_TRUE(QueryFuzzy("abc").empty());
+	EXPECT_TRUE(Query("").empty());
+}
+
+TEST_F(SearchIndexTest, FindsNamesAndPaths)
+{
+	Add("Documents", "C:\\Users\\me\\Documents");
+	Add("System32", "C:\\Windows\\System32");
+	Add("me", "C:\\Users\\me");
+	Build();
+
+	EXPECT_EQ(std::vector<int>(1, 1), Query("system"));
+	EXPECT_EQ(3u, Query("c:\\").size());
+	EXPECT_EQ(2u, Query("USERS\\ME").size());
+	EXPECT_TRUE(Query("nothing").empty());
+	// The name and path are kept apart
+	EXPECT_TRUE(Query("meC:").empty());
+}
+
+TEST_F(SearchIndexTest, PostingsAreSorted)
+{
+	AddRandom(2000);
+	Build();
+	EXPECT_GT(Index.GetPostingCount(), 2000);
+	EXPECT_TRUE(Index.PostingsSorted());
+}
+
+TEST_F(SearchIndexTest, AgreesWithAScan)
+{
+	const char Alphabet[] = "abcABC\\ ";
+	int i, j;
+
+	AddRandom(1500);
+	Build();
+
+	for (i = 0; i < 400; i++)
+	{
+		std::string q;
+		for (j = rand() % 6; j >= 0; j--)
+			q += Alphabet[rand() % 8];
+
+		// Fresh, then typed a char at a time
+		Index.Query(&Text("\\\\\\\\")[0]);
+		ASSERT_EQ(Scan(q), Query(q)) << q;
+		for (j = 1; j <= (int)q.size(); j++)
+			ASSERT_EQ(Scan(q.substr(0, j)), Query(q.substr(0, j))) << q.substr(0, j);
+	}
+}
+
+//========================================================================================
+// Fuzzy queries
+
+TEST_F(SearchIndexTest, FuzzyBestFirst)
+{
+	Add("Downloads", "C:\\Users\\me\\Downloads");
+	Add("Documents", "C:\\Users\\me\\Documents");
+	Add("Old docs", "D:\\Archive\\Old docs");
+	Add("Windows", "C:\\Windows");
+	Build();
+
+	// They all match, with the C from "C:\", but a run at the start of the name wins
+	std::vector<int> r = QueryFuzzy("doc");
+	ASSERT_EQ(4u, r.size());
+	EXPECT_EQ(1, r[0]);
+	EXPECT_EQ(2, r[1]);
+	for (int i = 1; i < Index.GetResultCount(); i++)
+		EXPECT_GE(Index.GetScore(i-1), Index.GetScore(i));
+
+	// Everything scored the same is in snapshot order
+	r = QueryFuzzy("c");
+	for (int i = 1; i < Index.GetResultCount(); i++)
+	{
+		if (Index.GetScore(i-1) == Index.GetScore(i))
+		{
+			EXPECT_LT(r[i-1], r[i]);
+		}
+	}
+}
+
+TEST_F(SearchIndexTest, FuzzyNarrowingMatchesFresh)
+{
+	const char Alphabet[] = "abcABC\\ ";
+	int i, j;
+
+	AddRandom(800);
+	Build();
+
+	for (i = 0; i < 100; i++)
+	{
+		std::string q;
+		for (j = rand() % 5; j >= 0; j--)
+			q += Alphabet[rand() % 8];
+
+		for (j = 1; j <= (int)q.size(); j++)
+			QueryFuzzy(q.substr(0, j));
+		std::vector<int> Narrowed = Results();
+		std::vector<int> Scores;
+		for (j = 0; j < Index.GetResultCount(); j++)
+			Scores.push_back(Index.GetScore(j));
+
+		Query("");
+		ASSERT_EQ(Narrowed, QueryFuzzy(q)) << q;
+		for (j = 0; j < Index.GetResultCount(); j++)
+			ASSERT_EQ(Scores[j], Index.GetScore(j));
+	}
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Tests of the snapshot diff (OWSnapshotDiff): moves, renames, windows open on the same
+// folder twice, and a randomized run against the plain scan it replaced.
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "OWCore.h"
+
+namespace
+{
+
+struct Window
+{
+	std::vector<OWCHAR> Path, Name;
+	unsigned short Rank;
+};
+
+Window MakeWindow(const std::string &Path, const std::string &Name, int Rank)
+{
+	Window w;
+	w.Path.assign(Path.begin(), Path.end());
+	w.Path.push_back(0);
+	w.Name.assign(Name.begin(), Name.end());
+	w.Name.push_back(0);
+	w.Rank = (unsigned short)Rank;
+	return w;
+}
+
+std::vector<OWItemData> Data(const std::vector<Window> &Windows)
+{
+	std::vector<OWItemData> Items(Windows.size());
+	for (size_t i = 0; i < Windows.size(); i++)
+	{
+		OWItemData &d = Items[i];
+		d.Rank = Windows[i].Rank;
+		d.Path = &Windows[i].Path[0];
+		d.PathLength = (unsigned short)(Windows[i].Path.size() - 1);
+		d.Name = &Windows[i].Name[0];
+		d.NameLength = (unsigned short)(Windows[i].Name.size() - 1);
+		d.PathA = NULL;
+		d.PathALength = OW_NO_ANSI;
+		d.NameA = NULL;
+		d.NameALength = OW_NO_ANSI;
+	}
+	return Items;
+}
+
+// Runs the diff, Matches in *pMatches
+int Diff(const std::vector<Window> &Old, const std::vector<Window> &New, std::vector<int> *pMatches)
+{
+	std::vector<OWItemData> OldData = Data(Old), NewData = Data(New);
+	pMatches->assign(New.size() + 1, -2);
+	return OWSnapshotDiff(OldData.empty() ? NULL : &OldData[0], (int)OldData.size(),
+		NewData.empty() ? NULL : &NewData[0], (int)NewData.size(), &(*pMatches)[0]);
+}
+
+//========================================================================================
+
+TEST(SnapshotDiffTest, SameSnapshot)
+{
+	std::vector<Window> Old;
+	std::vector<int> Matches;
+	Old.push_back(MakeWindow("C:\\", "C:", 0));
+	Old.push_back(MakeWindow("C:\\Users", "Users", 1));
+	Old.push_back(MakeWindow("D:\\Work", "Work", 2));
+
+	EXPECT_EQ(0, Diff(Old, Old, &Matches));
+	EXPECT_EQ(0, Matches[0]);
+	EXPECT_EQ(1, Matches[1]);
+	EXPECT_EQ(2, Matches[2]);
+	EXPECT_EQ(-2, Matches[3]);
+}
+
+TEST(SnapshotDiffTest, Empty)
+{
+	std::vector<Window> Old, New;
+	std::vector<int> Matches;
+
+	EXPECT_EQ(0, Diff(Old, New, &Matches));
+
+	New.push_back(MakeWindow("C:\\", "C:", 0));
+	EXPECT_EQ(1, Diff(Old, New, &Matches));
+	EXPECT_EQ(-1, Matches[0]);
+	EXPECT_EQ(1, Diff(New, Old, &Matches));
+}
+
+TEST(SnapshotDiffTest, MovedWindowsAreMatched)
+{
+	std::vector<Window> Old, New;
+	std::vector<int> Matches;
+	Old.push_back(MakeWindow("C:\\A", "A", 0));
+	Old.push_back(MakeWindow("C:\\B", "B", 1));
+	Old.push_back(MakeWindow("C:\\C", "C", 2));
+	New.push_back(MakeWindow("C:\\C", "C", 0));
+	New.push_back(MakeWindow("C:\\A", "A", 1));
+	New.push_back(MakeWindow("C:\\B", "B", 2));
+
+	// Same windows, but the ranks all changed
+	EXPECT_EQ(3, Diff(Old, New, &Matches));
+	EXPECT_EQ(2, Matches[0]);
+	EXPECT_EQ(0, Matches[1]);
+	EXPECT_EQ(1, Matches[2]);
+
+	New[0].Rank = 2;
+	New[1].Rank = 0;
+	New[2].Rank = 1;
+	EXPECT_EQ(0, Diff(Old, New, &Matches));
+}
+
+TEST(SnapshotDiffTest, AddedRemovedAndRenamed)
+{
+	std::vector<Window> Old, New;
+	std::vector<int> Matches;
+	Old.push_back(MakeWindow("C:\\A", "A", 0));
+	Old.push_back(MakeWindow("C:\\B", "B", 1));
+	Old.push_back(MakeWindow("C:\\C", "C", 2));
+	New.push_back(MakeWindow("C:\\A", "A", 0));
+	New.push_back(MakeWindow("C:\\C", "Sea", 2));
+	New.push_back(MakeWindow("C:\\D", "D", 3));
+
+	// C renamed, D added, B gone
+	EXPECT_EQ(3, Diff(Old, New, &Matches));
+	EXPECT_EQ(0, Matches[0]);
+	EXPECT_EQ(2, Matches[1]);
+	EXPECT_EQ(-1, Matches[2]);
+}
+
+TEST(SnapshotDiffTest, PathsMatchExactly)
+{
+	std::vector<Window> Old, New;
+	std::vector<int> Matches;
+	Old.push_back(MakeWindow("C:\\Users", "Users", 0));
+	New.push_back(MakeWindow("C:\\USERS", "Users", 0));
+	New.push_back(MakeWindow("C:\\Users\\", "Users", 1));
+	New.push_back(MakeWindow("C:\\User", "Users", 2));
+
+	EXPECT_EQ(4, Diff(Old, New, &Matches));
+	EXPECT_EQ(-1, Matches[0]);
+	EXPECT_EQ(-1, Matches[1]);
+	EXPECT_EQ(-1, Matches[2]);
+}
+
+TEST(SnapshotDiffTest, SameFolderTwiceIsMatchedOnce)
+{
+	std::vector<Window> Old, New;
+	std::vector<int> Matches;
+	Old.push_back(MakeWindow("C:\\A", "A", 0));
+	Old.push_back(MakeWindow("C:\\B", "B", 1));
+	Old.push_back(MakeWindow("C:\\A", "A", 2));
+	New.push_back(MakeWindow("C:\\B", "B", 1));
+	New.push_back(MakeWindow("C:\\A", "A", 0));
+	New.push_back(MakeWindow("C:\\A", "A", 2));
+	New.push_back(MakeWindow("C:\\A", "A", 3));
+
+	// The first A takes the first old one, the second stays in place, the third is new
+	EXPECT_EQ(1, Diff(Old, New, &Matches));
+	EXPECT_EQ(1, Matches[0]);
+	EXPECT_EQ(0, Matches[1]);
+	EXPECT_EQ(2, Matches[2]);
+	EXPECT_EQ(-1, Matches[3]);
+}
+
+//========================================================================================
+// Against the plain scan over the old items, with paths that repeat
+
+int ScanDiff(const std::vector<Window> &Old, const std::vector<Window> &New, std::vector<int> *pMatches)
+{
+	std::vector<bool> Used(Old.size(), false);
+	int Changes = 0, Matched = 0;
+
+	pMatches->assign(New.size(), -1);
+	for (size_t i = 0; i < New.size(); i++)
+	{
+		int Match = -1;
+		if (i < Old.size() && !Used[i] && Old[i].Path == New[i].Path)
+			Match = (int)i;
+		for (size_t j = 0; Match < 0 && j < Old.size(); j++)
+			if (!Used[j] && Old[j].Path == New[i].Path)
+				Match = (int)j;
+
+		(*pMatches)[i] = Match;
+		if (Match < 0)
+		{
+			Changes++;
+			continue;
+		}
+		Used[Match] = true;
+		Matched++;
+		if (Old[Match].Rank != New[i].Rank || Old[Match].Name != New[i].Name)
+			Changes++;
+	}
+	return Changes + ((int)Old.size() - Matched);
+}
+
+std::vector<Window> RandomSnapshot()
+{
+	std::vector<Window> Windows;
+	int Count = rand() % 40, i;
+	char Path[32], Name[16];
+
+	for (i = 0; i < Count; i++)
+	{
+		snprintf(Path, sizeof(Path), "C:\\Folder%d", rand() % 30);
+		snprintf(Name, sizeof(Name), "%d", rand() % 3);
+		Windows.push_back(MakeWindow(Path, Name, rand() % 4));
+	}
+	return Windows;
+}
+
+TEST(SnapshotDiffTest, MatchesThePlainScan)
+{
+	std::vector<int> Matches, Expected;
+	int i;
+
+	srand(1);
+	for (i = 0; i < 2000; i++)
+	{
+		std::vector<Window> Old = RandomSnapshot(), New = RandomSnapshot();
+		int Changes = Diff(Old, New, &Matches);
+		ASSERT_EQ(ScanDiff(Old, New, &Expected), Changes);
+		Matches.resize(New.size());
+		ASSERT_EQ(Expected, Matches);
+
+		// And against itself, shuffled a little
+		New = Old;
+		if (New.size() > 1)
+			std::swap(New[0], New[New.size() - 1]);
+		ASSERT_EQ(ScanDiff(Old, New, &Expected), Diff(Old, New, &Matches));
+	}
+}
+
+} // namespace
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Tests of the background job queue (OWTaskQueue): the order jobs run in, cancelling an
+// owner's jobs, and what's freed when the queue goes away. The last ones drive it from
+// worker threads under one lock, the way the icon extraction does.
+
+#include <gtest/gtest.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "OWTaskQueue.h"
+
+namespace
+{
+
+// Counts what the queue frees, instead of freeing it
+int g_Freed;
+
+void CountFree(void *Data)
+{
+	g_Freed++;
+	delete (int*)Data;
+}
+
+class TaskQueueTest : public ::testing::Test
+{
+protected:
+	void SetUp() { g_Freed = 0; }
+};
+
+// Only their addresses matter
+int OwnerA, OwnerB;
+
+} // namespace
+
+//========================================================================================
+// Ordering
+
+TEST_F(TaskQueueTest, RunsInQueueOrder)
+{
+	COWTaskQueue Queue(8, 8, CountFree);
+	int i;
+
+	for (i = 0; i < 5; i++)
+		ASSERT_TRUE(Queue.Push(&OwnerA, i, new int(i)));
+	EXPECT_EQ(5, Queue.GetPending());
+
+	for (i = 0; i < 5; i++)
+	{
+		OWTask *Task = Queue.Next();
+		ASSERT_TRUE(Task != NULL);
+		EXPECT_EQ((unsigned)i, Task->Key);
+		EXPECT_EQ(i, *(int*)Task->Data);
+		delete (int*)Task->Data;
+		Queue.Done(Task);
+	}
+	EXPECT_TRUE(Queue.Next() == NULL);
+	EXPECT_EQ(0, Queue.GetPending());
+	EXPECT_EQ(0, Queue.GetRunning());
+}
+
+TEST_F(TaskQueueTest, ReusedSlotsKeepTheOrder)
+{
+	COWTaskQueue Queue(3, 1, CountFree);
+
+	Queue.Push(&OwnerA, 1, NULL);
+	Queue.Push(&OwnerA, 2, NULL);
+	OWTask *Task = Queue.Next();
+	ASSERT_EQ(1u, Task->Key);
+	Queue.Done(Task);
+
+	// Goes in the first slot, but was queued last
+	Queue.Push(&OwnerA, 3, NULL);
+	Task = Queue.Next();
+	EXPECT_EQ(2u, Task->Key);
+	Queue.Done(Task);
+	Task = Queue.Next();
+	EXPECT_EQ(3u, Task->Key);
+	Queue.Done(Task);
+}
+
+TEST_F(TaskQueueTest, RejectsDuplicatesAndOverflow)
+{
+	COWTaskQueue Queue(2, 1, CountFree);
+
+	EXPECT_TRUE(Queue.Push(&OwnerA, 1, NULL));
+	EXPECT_FALSE(Queue.Push(&OwnerA, 1, NULL));
+	// Same key, other owner
+	EXPECT_TRUE(Queue.Push(&OwnerB, 1, NULL));
+	EXPECT_FALSE(Queue.Push(&OwnerA, 2, NULL));
+	EXPECT_EQ(2, Queue.GetPending());
+}
+
+TEST_F(TaskQueueTest, CapsWhatRuns)
+{
+	COWTaskQueue Queue(8, 2, CountFree);
+	int i;
+
+	for (i = 0; i < 4; i++)
+		Queue.Push(&OwnerA, i, NULL);
+
+	OWTask *First = Queue.Next();
+	OWTask *Second = Queue.Next();
+	ASSERT_TRUE(First != NULL && Second != NULL);
+	EXPECT_TRUE(Queue.Next() == NULL);
+	EXPECT_EQ(2, Queue.GetRunning());
+
+	Queue.Done(First);
+	OWTask *Third = Queue.Next();
+	ASSERT_TRUE(Third != NULL);
+	EXPECT_EQ(2u, Third->Key);
+	Queue.Done(Second);
+	Queue.Done(Third);
+}
+
+//========================================================================================
+// Cancelling
+
+TEST_F(TaskQueueTest, CancelDropsPendingAndMarksRunning)
+{
+	COWTaskQueue Queue(8, 1, CountFree);
+
+	Queue.Push(&OwnerA, 1, new int(1));
+	Queue.Push(&OwnerB, 2, new int(2));
+	Queue.Push(&OwnerA, 3, new int(3));
+
+	OWTask *Running = Queue.Next();
+	ASSERT_EQ(1u, Running->Key);
+
+	EXPECT_EQ(1, Queue.Cancel(&OwnerA));
+	EXPECT_EQ(1, g_Freed);
+	EXPECT_TRUE(Running->Cancelled);
+	EXPECT_EQ(1, Queue.GetPending());
+
+	// The running one can be queued again while the old result is dropped
+	EXPECT_TRUE(Queue.Push(&OwnerA, 1, new int(4)));
+
+	delete (int*)Running->Data;
+	Queue.Done(Running);
+
+	OWTask *Task = Queue.Next();
+	EXPECT_EQ(2u, Task->Key);
+	EXPECT_FALSE(Task->Cancelled);
+	delete (int*)Task->Data;
+	Queue.Done(Task);
+
+	Task = Queue.Next();
+	EXPECT_EQ(1u, Task->Key);
+	EXPECT_FALSE(Task->Cancelled);
+	delete (int*)Task->Data;
+	Queue.Done(Task);
+}
+
+TEST_F(TaskQueueTest, CancelOfNothing)
+{
+	COWTaskQueue Queue(4, 1, CountFree);
+	Queue.Push(&OwnerA, 1, NULL);
+	EXPECT_EQ(0, Queue.Cancel(&OwnerB));
+	EXPECT_EQ(1, Queue.GetPending());
+}
+
+//========================================================================================
+// Shutting down
+
+TEST_F(TaskQueueTest, DestructorFreesOnlyPending)
+{
+	int *RunningData = new int(0);
+	{
+		COWTaskQueue Queue(8, 1, CountFree);
+		Queue.Push(&OwnerA, 0, RunningData);
+		Queue.Push(&OwnerA, 1, new int(1));
+		Queue.Push(&OwnerA, 2, new int(2));
+		ASSERT_TRUE(Queue.Next() != NULL);
+	}
+	EXPECT_EQ(2, g_Freed);
+	delete RunningData;
+}
+
+TEST_F(TaskQueueTest, WorkersDrainThenStop)
+{
+	const int Jobs = 2000, Workers = 4;
+	COWTaskQueue Queue(Jobs, 2, CountFree);
+	std::mutex Lock;
+	std::vector<int> Ran;
+	bool Stopping = false;
+	int MostRunning = 0, i;
+
+	for (i = 0; i < Jobs; i++)
+		ASSERT_TRUE(Queue.Push(i % 2 ? &OwnerA : &OwnerB, i, new int(i)));
+
+	std::vector<std::thread> Threads;
+	for (i = 0; i < Workers; i++)
+	{
+		Threads.push_back(std::thread([&]()
+		{
+			for (;;)
+			{
+				OWTask *Task;
+				{
+					std::lock_guard<std::mutex> Guard(Lock);
+					if (Stopping)
+						return;
+					Task = Queue.Next();
+					if (Task == NULL)
+					{
+						if (Queue.GetPending() == 0)
+							return;
+						continue;
+					}
+					if (Queue.GetRunning() > MostRunning)
+						MostRunning = Queue.GetRunning();
+				}
+
+				int Value = *(int*)Task->Data;
+				delete (int*)Task->Data;
+
+				std::lock_guard<std::mutex> Guard(Lock);
+				Ran.push_back(Value);
+				Queue.Done(Task);
+				if (Ran.size() == Jobs / 2)
+					Stopping = true;
+			}
+		}));
+	}
+	for (i = 0; i < Workers; i++)
+		Threads[i].join();
+
+	// Everything started ran once, in about queue order, and the rest is freed with
+	// the queue.
+	EXPECT_LE(MostRunning, 2);
+	EXPECT_EQ(0, Queue.GetRunning());
+	EXPECT_GE((int)Ran.size(), Jobs / 2);
+	std::vector<bool> Seen(Jobs);
+	for (i = 0; i < (int)Ran.size(); i++)
+	{
+		EXPECT_FALSE(Seen[Ran[i]]);
+		Seen[Ran[i]] = true;
+		EXPECT_LT(Ran[i], (int)Ran.size() + Workers);
+	}
+	EXPECT_EQ(Jobs - (int)Ran.size(), Queue.GetPending());
+	EXPECT_EQ(0, g_Freed);
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Tests of the window activation timeline (OWTimeline), driven with made up foreground
+// and destroy events instead of the WinEvent hook. Handles are numbers that look like
+// real ones: small multiples of 4, or large ones with the low bits clear.
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <list>
+#include <vector>
+
+#include "OWTimeline.h"
+
+namespace
+{
+
+class TimelineTest : public ::testing::Test
+{
+protected:
+	void SetUp()
+	{
+		OWTimelineInit(&Timeline);
+		Clock = 1000;
+	}
+
+	// EVENT_SYSTEM_FOREGROUND
+	void Foreground(OWUINT64 Window)
+	{
+		OWTimelineTouch(&Timeline, Window, Clock++);
+	}
+
+	// EVENT_OBJECT_DESTROY
+	void Destroy(OWUINT64 Window)
+	{
+		OWTimelineRemove(&Timeline, Window);
+	}
+
+	std::vector<OWUINT64> Walk()
+	{
+		std::vector<OWUINT64> Windows;
+		int Node;
+		for (Node = OWTimelineFirst(&Timeline); Node != OW_TIMELINE_NONE; Node = OWTimelineNext(&Timeline, Node))
+		{
+			Windows.push_back(Timeline.Nodes[Node].Key);
+			// Don't spin forever on a broken list
+			if (Windows.size() > OW_TIMELINE_CAPACITY)
+				break;
+		}
+		return Windows;
+	}
+
+	OWTimeline Timeline;
+	OWUINT64 Clock;
+};
+
+std::vector<OWUINT64> List(OWUINT64 a, OWUINT64 b, OWUINT64 c)
+{
+	std::vector<OWUINT64> v;
+	v.push_back(a);
+	v.push_back(b);
+	v.push_back(c);
+	return v;
+}
+
+} // namespace
+
+//========================================================================================
+// Focus order
+
+TEST_F(TimelineTest, StartsEmpty)
+{
+	EXPECT_TRUE(OWTimelineCheck(&Timeline));
+	EXPECT_EQ(0, Timeline.Count);
+	EXPECT_EQ(OW_TIMELINE_NONE, OWTimelineFirst(&Timeline));
+	EXPECT_EQ(OW_TIMELINE_NONE, OWTimelineFind(&Timeline, 0x10010));
+}
+
+TEST_F(TimelineTest, LatestFirst)
+{
+	Foreground(0x10010);
+	Foreground(0x20020);
+	Foreground(0x30030);
+
+	EXPECT_EQ(List(0x30030, 0x20020, 0x10010), Walk());
+	EXPECT_EQ(3, Timeline.Count);
+}
+
+TEST_F(TimelineTest, RefocusMovesToFront)
+{
+	Foreground(0x10010);
+	Foreground(0x20020);
+	Foreground(0x30030);
+	Foreground(0x10010);
+
+	EXPECT_EQ(List(0x10010, 0x30030, 0x20020), Walk());
+	EXPECT_EQ(3, Timeline.Count);
+
+	int Node = OWTimelineFind(&Timeline, 0x10010);
+	ASSERT_NE(OW_TIMELINE_NONE, Node);
+	EXPECT_EQ(Clock - 1, Timeline.Nodes[Node].Time);
+
+	// Focusing the front again changes nothing but the time
+	Foreground(0x10010);
+	EXPECT_EQ(List(0x10010, 0x30030, 0x20020), Walk());
+	EXPECT_EQ(Clock - 1, Timeline.Nodes[Node].Time);
+}
+
+TEST_F(TimelineTest, DestroyedWindowsGo)
+{
+	Foreground(0x10010);
+	Foreground(0x20020);
+	Foreground(0x30030);
+
+	Destroy(0x20020);
+	EXPECT_EQ(OW_TIMELINE_NONE, OWTimelineFind(&Timeline, 0x20020));
+	EXPECT_EQ(2, Timeline.Count);
+
+	// Head and tail too
+	Destroy(0x30030);
+	Destroy(0x10010);
+	EXPECT_TRUE(Walk().empty());
+	EXPECT_EQ(OW_TIMELINE_NONE, Timeline.Tail);
+
+	// Unknown windows are ignored, and freed nodes are reused
+	Destroy(0x40040);
+	Foreground(0x50050);
+	EXPECT_EQ(1, Timeline.Count);
+	EXPECT_EQ(1u, Walk().size());
+}
+
+TEST_F(TimelineTest, FullDropsTheOldest)
+{
+	OWUINT64 i;
+
+	for (i = 0; i < OW_TIMELINE_CAPACITY; i++)
+		Foreground((i + 1) * 4);
+	EXPECT_EQ(OW_TIMELINE_CAPACITY, Timeline.Count);
+
+	// The first one comes back, so the second is the oldest now
+	Foreground(4);
+	Foreground(0x123450);
+
+	EXPECT_EQ(OW_TIMELINE_CAPACITY, Timeline.Count);
+	EXPECT_EQ(OW_TIMELINE_NONE, OWTimelineFind(&Timeline, 8));
+	EXPECT_NE(OW_TIMELINE_NONE, OWTimelineFind(&Timeline, 4));
+	EXPECT_NE(OW_TIMELINE_NONE, OWTimelineFind(&Timeline, 0x123450));
+
+	std::vector<OWUINT64> Windows = Walk();
+	ASSERT_EQ((size_t)OW_TIMELINE_CAPACITY, Windows.size());
+	EXPECT_EQ(0x123450u, Windows[0]);
+	EXPECT_EQ(4u, Windows[1]);
+	EXPECT_EQ(12u, Windows.back());
+}
+
+//========================================================================================
+// Against a plain list, with handles that share buckets
+
+TEST_F(TimelineTest, MatchesAnLruList)
+{
+	std::list<OWUINT64> Expected;
+	int i;
+
+	srand(1);
+	for (i = 0; i < 20000; i++)
+	{
+		// More windows than fit, mostly reused, in 64 bits
+		OWUINT64 Window = ((OWUINT64)(rand() % 400) << 16) | ((OWUINT64)(rand() % 2) << 40);
+
+		if (rand() % 5 == 0)
+		{
+			Destroy(Window);
+			Expected.remove(Window);
+		}
+		else
+		{
+			Foreground(Window);
+			Expected.remove(Window);
+			Expected.push_front(Window);
+			if (Expected.size() > OW_TIMELINE_CAPACITY)
+				Expected.pop_back();
+		}
+
+		if (i % 97 == 0)
+		{
+			std::vector<OWUINT64> Windows = Walk();
+			ASSERT_EQ(std::vector<OWUINT64>(Expected.begin(), Expected.end()), Windows);
+			ASSERT_EQ((int)Expected.size(), Timeline.Count);
+		}
+	}
+
+	std::list<OWUINT64>::const_iterator it;
+	for (it = Expected.begin(); it != Expected.end(); ++it)
+		EXPECT_NE(OW_TIMELINE_NONE, OWTimelineFind(&Timeline, *it));
+}
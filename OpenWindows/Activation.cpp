@@ -0,0 +1,339 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include "stdafx.h"
+#include "Activation.h"
+#include "Common.h"
+#include "Frecency.h"
+#include "OWTimeline.h"
+
+//========================================================================================
+// The WinEvent API isn't in the headers of every SDK we build with, and isn't there at
+// all before 98 and NT 4 SP3, so it's looked up.
+
+typedef HANDLE OWWinEventHook;
+typedef void (CALLBACK *OWWinEventProc)(OWWinEventHook Hook, DWORD Event, HWND Window,
+	LONG Object, LONG Child, DWORD Thread, DWORD Time);
+typedef OWWinEventHook (WINAPI *SetWinEventHookProc)(DWORD Min, DWORD Max, HMODULE Module,
+	OWWinEventProc Proc, DWORD Process, DWORD Thread, DWORD Flags);
+typedef BOOL (WINAPI *UnhookWinEventProc)(OWWinEventHook Hook);
+
+enum
+{
+	FOREGROUND_EVENT = 0x0003,		// EVENT_SYSTEM_FOREGROUND
+	HOOK_OUT_OF_CONTEXT = 0x0000,	// WINEVENT_OUTOFCONTEXT
+	WINDOW_OBJECT = 0				// OBJID_WINDOW
+};
+
+//========================================================================================
+// The list
+
+// In the Local\ namespace when there is one
+#define OW_ACTIVATION_NAME "OpenWindowsActivation"
+#define OW_ACTIVATION_LOCK "OpenWindowsActivationLock"
+
+static bool s_SettingsLoaded = false;
+static bool s_Enabled = true;
+// Set once, after s_Timeline
+static volatile bool s_Opened = false;
+static OWTimeline * volatile s_Timeline = NULL;
+static HANDLE s_Mapping = NULL;
+// Guards the list between processes
+static HANDLE s_TimelineLock = NULL;
+// Guards opening it, and the folder count
+static CRITICAL_SECTION s_Lock;
+
+// How many folders there are, and the thread watching while there's any
+static int s_Folders = 0;
+static DWORD s_WatchThread = 0;
+// The thread sets it once it can take messages
+static HANDLE s_WatchReady = NULL;
+
+void OWActivationInit()
+{
+	InitializeCriticalSection(&s_Lock);
+}
+
+void OWActivationTerm()
+{
+	if (s_Timeline != NULL)
+		UnmapViewOfFile(s_Timeline);
+	if (s_Mapping != NULL)
+		CloseHandle(s_Mapping);
+	if (s_TimelineLock != NULL)
+		CloseHandle(s_TimelineLock);
+	if (s_WatchReady != NULL)
+		CloseHandle(s_WatchReady);
+	DeleteCriticalSection(&s_Lock);
+}
+
+// Not from DllMain: the registry can load other DLLs.
+static void LoadSettings()
+{
+	DWORD Value;
+
+	s_SettingsLoaded = true;
+	HKEY Key = OWOpenSettings();
+	if (Key == NULL)
+		return;
+
+	if (OWReadSetting(Key, _T("ActivationOrder"), &Value))
+		s_Enabled = Value != 0;
+
+	RegCloseKey(Key);
+}
+
+// Called with s_Lock, once
+static void Open()
+{
+	void *View;
+
+	if (!s_SettingsLoaded)
+		LoadSettings();
+	if (!s_Enabled)
+		return;
+
+	s_TimelineLock = OWCreateLocalMutex(OW_ACTIVATION_LOCK);
+	if (s_TimelineLock == NULL)
+		return;
+
+	s_Mapping = OWCreateLocalMapping(OW_ACTIVATION_NAME, sizeof(OWTimeline));
+	if (s_Mapping == NULL)
+		return;
+	View = MapViewOfFile(s_Mapping, FILE_MAP_WRITE, 0, 0, sizeof(OWTimeline));
+	if (View == NULL)
+		return;
+
+	// New (the pages start zeroed), or from another version
+	if (!OWTakeLock(s_TimelineLock))
+	{
+		UnmapViewOfFile(View);
+		return;
+	}
+	if (!OWTimelineCheck((OWTimeline*)View))
+		OWTimelineInit((OWTimeline*)View);
+	ReleaseMutex(s_TimelineLock);
+	s_Timeline = (OWTimeline*)View;
+}
+
+// NULL when there's no list to be had
+static OWTimeline *GetTimeline()
+{
+	if (s_Opened)
+		return s_Timeline;
+
+	EnterCriticalSection(&s_Lock);
+	if (!s_Opened)
+	{
+		Open();
+		s_Opened = true;
+	}
+	LeaveCriticalSection(&s_Lock);
+	return s_Timeline;
+}
+
+static OWUINT64 GetWindowKey(HWND Window)
+{
+	return (OWUINT64)(size_t)Window;
+}
+
+//========================================================================================
+// Watching
+
+static bool IsExplorerWindow(HWND Window)
+{
+	TCHAR Class[32];
+
+	if (GetClassName(Window, Class, sizeof(Class) / sizeof(TCHAR)) == 0)
+		return false;
+	return lstrcmp(Class, _T("CabinetWClass")) == 0 || lstrcmp(Class, _T("ExploreWClass")) == 0;
+}
+
+static void CALLBACK ForegroundChanged(OWWinEventHook Hook, DWORD Event, HWND Window,
+	LONG Object, LONG Child, DWORD Thread, DWORD Time)
+{
+	FILETIME Now;
+
+	if (Event != FOREGROUND_EVENT || Object != WINDOW_OBJECT || Window == NULL || !IsExplorerWindow(Window))
+		return;
+
+	OWTimeline *Timeline = GetTimeline();
+	if (Timeline == NULL)
+		return;
+
+	GetSystemTimeAsFileTime(&Now);
+	if (OWTakeLock(s_TimelineLock))
+	{
+		OWTimelineTouch(Timeline, GetWindowKey(Window), ((OWUINT64)Now.dwHighDateTime << 32) | Now.dwLowDateTime);
+		ReleaseMutex(s_TimelineLock);
+	}
+}
+
+// Out of context events come in as messages, so the thread only has to pump them
+// until it's told to quit.
+static DWORD WINAPI WatchThread(LPVOID Module)
+{
+	OWWinEventHook Hook = NULL;
+	MSG Msg;
+
+	HMODULE User = GetModuleHandle(_T("user32.dll"));
+	SetWinEventHookProc SetHook = (SetWinEventHookProc)GetProcAddress(User, "SetWinEventHook");
+	UnhookWinEventProc Unhook = (UnhookWinEventProc)GetProcAddress(User, "UnhookWinEvent");
+
+	// Make the message queue before saying it's there
+	PeekMessage(&Msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+	if (SetHook != NULL && Unhook != NULL)
+		Hook = SetHook(FOREGROUND_EVENT, FOREGROUND_EVENT, NULL, ForegroundChanged, 0, 0, HOOK_OUT_OF_CONTEXT);
+	SetEvent(s_WatchReady);
+
+	if (Hook != NULL)
+	{
+		while (GetMessage(&Msg, NULL, 0, 0) > 0)
+			DispatchMessage(&Msg);
+		Unhook(Hook);
+	}
+
+	FreeLibraryAndExitThread((HMODULE)Module, 0);
+	return 0;
+}
+
+// Called with s_Lock
+static void StartWatching()
+{
+	TCHAR Path[MAX_PATH];
+	HMODULE Module;
+	HANDLE Thread;
+	DWORD Id;
+
+	// Made here rather than in DllMain, like everything only a folder needs
+	if (s_WatchReady == NULL)
+		s_WatchReady = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (s_WatchReady == NULL)
+		return;
+
+	// The thread holds a reference to the DLL until it's done, so it can't be unloaded
+	// from under it
+	if (GetModuleFileName(_Module.GetModuleInstance(), Path, MAX_PATH) == 0)
+		return;
+	Module = LoadLibrary(Path);
+	if (Module == NULL)
+		return;
+
+	Thread = CreateThread(NULL, 0, WatchThread, Module, 0, &Id);
+	if (Thread == NULL)
+	{
+		FreeLibrary(Module);
+		return;
+	}
+	// It doesn't take s_Lock, so it can't be waiting on us
+	WaitForSingleObject(s_WatchReady, 5000);
+	CloseHandle(Thread);
+	s_WatchThread = Id;
+}
+
+// Called with s_Lock
+static void StopWatching()
+{
+	if (s_WatchThread == 0)
+		return;
+	PostThreadMessage(s_WatchThread, WM_QUIT, 0, 0);
+	s_WatchThread = 0;
+}
+
+void OWActivationAddFolder()
+{
+	if (GetTimeline() == NULL)
+		return;
+
+	EnterCriticalSection(&s_Lock);
+	if (s_Folders++ == 0)
+		StartWatching();
+	LeaveCriticalSection(&s_Lock);
+}
+
+void OWActivationReleaseFolder()
+{
+	if (s_Timeline == NULL)
+		return;
+
+	EnterCriticalSection(&s_Lock);
+	if (--s_Folders == 0)
+		StopWatching();
+	LeaveCriticalSection(&s_Lock);
+}
+
+//========================================================================================
+// Order
+
+void OWActivationOrder(COWItemList *Items)
+{
+	int Count = Items->GetSize(), i, j, Node;
+	bool Moved = false;
+
+	OWTimeline *Timeline = GetTimeline();
+	if (Timeline == NULL || Count == 0)
+		return;
+
+	OWUINT64 *Times = new OWUINT64[Count];
+	int *Order = new int[Count];
+	if (Times == NULL || Order == NULL || !OWTakeLock(s_TimelineLock))
+	{
+		delete [] Times;
+		delete [] Order;
+		return;
+	}
+
+	// Latest first, and stable. Windows never activated while we watched have a time
+	// of 0, so they stay where they are, after the others.
+	for (i = 0; i < Count; i++)
+	{
+		Node = OWTimelineFind(Timeline, GetWindowKey((*Items)[i].GetWindow()));
+		Times[i] = Node != OW_TIMELINE_NONE ? Timeline->Nodes[Node].Time : 0;
+	}
+	ReleaseMutex(s_TimelineLock);
+
+	// Switching to a window is a visit too, but only we know which window it was
+	OWFrecencyNoteActivations(*Items, Times);
+
+	for (i = 0; i < Count; i++)
+	{
+		OWUINT64 Time = Times[i];
+		for (j = i; j > 0 && Times[j - 1] < Time; j--)
+		{
+			Times[j] = Times[j - 1];
+			Order[j] = Order[j - 1];
+			Moved = true;
+		}
+		Times[j] = Time;
+		Order[j] = i;
+	}
+
+	if (Moved)
+		OWReorderItems(Items, Order);
+
+	delete [] Times;
+	delete [] Order;
+}
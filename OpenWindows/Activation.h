@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __ACTIVATION_H_
+#define __ACTIVATION_H_
+
+#include "ShellItems.h"
+
+//========================================================================================
+// Puts the windows last switched to first, the way Alt+Tab does. While any of our
+// folders is around, a thread watches the foreground change (a WinEvent hook, out of
+// context, so nothing gets injected in other processes) and notes when each Explorer
+// window was activated, in an LRU list (see OWTimeline.h).
+//
+// The list is kept in memory shared by the processes of the session, so a window
+// activated while another process was watching counts too. It's keyed by the window
+// handle, so it doesn't outlive the session, and a window gone just ages out of it.
+// Ordering also hands the activations to the frecency (see Frecency.h), where they last.
+//
+// Under HKCU\Software\OpenWindows:
+//  ActivationOrder (DWORD)	0 to leave the windows in frecency order (see Frecency.h)
+
+// Call once from DllMain, and once at the end.
+void OWActivationInit();
+void OWActivationTerm();
+
+// A folder was made, or went away. The watching goes on while there's one.
+void OWActivationAddFolder();
+void OWActivationReleaseFolder();
+
+// Put the windows activated first, latest first, and rank them in that order. The
+// others keep the order they're in, after them.
+void OWActivationOrder(COWItemList *Items);
+
+#endif // __ACTIVATION_H_
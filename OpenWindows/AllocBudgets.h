@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __ALLOCBUDGETS_H_
+#define __ALLOCBUDGETS_H_
+
+//========================================================================================
+// The allocation budgets: the most allocations each path may make per call, on
+// average. The core's are checked on Linux by Benchmarks/AllocBudgetTests.cpp; the COM
+// calls', which are built on them, by AllocProfile.cpp from what OW_ALLOC_PROFILE
+// counted (see AllocProfile.h). Both read them from here, and a COM call's budget is
+// the core path's it runs, plus what it adds of its own.
+//
+// Lowering a budget once a path gets leaner is the point; raising one needs a reason.
+// This doesn't include Windows headers, so the tests can have it.
+
+enum
+{
+	// The core
+	OW_BUDGET_ITEM_ENCODE = 0,
+	OW_BUDGET_ITEM_READ = 0,			// a pidl's fields are read in place
+	OW_BUDGET_COMPARE = 0,
+	OW_BUDGET_CIDA = 0,
+	OW_BUDGET_ENUM_PER_ITEM = 1,		// the pidl handed out, and nothing else
+	OW_BUDGET_SNAPSHOT_DIFF = 1,
+	OW_BUDGET_SEARCH_BUILD = 7,			// whatever the item count
+	OW_BUDGET_SEARCH_QUERY = 0,
+	OW_BUDGET_SEARCH_FUZZY = 1,
+	OW_BUDGET_FUZZY_BATCH = 0,
+	OW_BUDGET_TASK_QUEUE = 0,
+	OW_BUDGET_TIMELINE = 0,
+	OW_BUDGET_HISTORY_APPEND = 0,
+	OW_BUDGET_HISTORY_RECENT = 2,
+
+	// The COM calls. Those not here have no budget.
+	OW_BUDGET_COMPAREIDS = OW_BUDGET_COMPARE,
+	OW_BUDGET_GETATTRIBUTESOF = OW_BUDGET_ITEM_READ,
+	OW_BUDGET_GETDEFAULTCOLUMN = 0,
+	OW_BUDGET_GETDEFAULTCOLUMNSTATE = 0,
+	OW_BUDGET_MAPCOLUMNTOSCID = 0,
+	// A STRRET_WSTR when the text can't go by offset
+	OW_BUDGET_GETDISPLAYNAMEOF = OW_BUDGET_ITEM_READ + 1,
+	// Column headers load their name from the resources as well
+	OW_BUDGET_GETDETAILSOF = OW_BUDGET_ITEM_READ + 2,
+	// The app name, path and name BSTRs, and the item list growing now and then
+	OW_BUDGET_ENUM_PROBE = 4
+};
+
+#endif // __ALLOCBUDGETS_H_
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "AllocBudgets.h"
+#include "Metrics.h"
+
+#include <stdio.h>
+
+#if defined(OW_ALLOC_PROFILE)
+//========================================================================================
+// Counting
+
+// What's allocated outside of any timed operation, like in IEnumIDList::Next
+enum { OW_ALLOC_NO_OPERATION = OW_TIMER_MAX };
+
+struct OWAllocTotals
+{
+	volatile LONG Count;
+	volatile LONG Bytes;		// wraps after 4GB, which a profiling run won't reach
+};
+
+static OWAllocTotals s_Totals[OW_TIMER_MAX + 1][OW_ALLOC_SOURCE_MAX];
+
+// The thread's operation, plus one, so a thread that never set one reads as none
+static DWORD s_Tls = TLS_OUT_OF_INDEXES;
+
+static const char *s_SourceNames[OW_ALLOC_SOURCE_MAX] =
+{
+	"shell",
+	"pidl",
+	"cstring",
+	"bstr",
+	"array"
+};
+
+void OWAllocInit()
+{
+	s_Tls = TlsAlloc();
+}
+
+void OWAllocTerm()
+{
+	if (s_Tls != TLS_OUT_OF_INDEXES)
+		TlsFree(s_Tls);
+	s_Tls = TLS_OUT_OF_INDEXES;
+}
+
+static int CurrentOperation()
+{
+	if (s_Tls == TLS_OUT_OF_INDEXES)
+		return OW_ALLOC_NO_OPERATION;
+
+	int Operation = (int)(DWORD_PTR)TlsGetValue(s_Tls) - 1;
+	return (Operation < 0 || Operation > OW_TIMER_MAX) ? OW_ALLOC_NO_OPERATION : Operation;
+}
+
+void OWAllocNote(OWAllocSource Source, ULONG Bytes)
+{
+	OWAllocTotals &t = s_Totals[CurrentOperation()][Source];
+
+	InterlockedIncrement((LONG*)&t.Count);
+	InterlockedExchangeAdd((LONG*)&t.Bytes, (LONG)Bytes);
+}
+
+int OWAllocEnter(int Operation)
+{
+	int Outer = CurrentOperation();
+
+	if (s_Tls != TLS_OUT_OF_INDEXES)
+		TlsSetValue(s_Tls, (LPVOID)(DWORD_PTR)(Operation + 1));
+	return Outer;
+}
+
+void OWAllocLeave(int Outer)
+{
+	if (s_Tls != TLS_OUT_OF_INDEXES)
+		TlsSetValue(s_Tls, (LPVOID)(DWORD_PTR)(Outer + 1));
+}
+
+//========================================================================================
+// Budgets
+
+struct OWAllocBudget
+{
+	OWTimer Operation;
+	ULONG PerCall;
+};
+
+// Which operation each budget is for; the budgets are in AllocBudgets.h
+static const OWAllocBudget s_Budgets[] =
+{
+	{ OW_TIMER_COMPAREIDS, OW_BUDGET_COMPAREIDS },
+	{ OW_TIMER_GETATTRIBUTESOF, OW_BUDGET_GETATTRIBUTESOF },
+	{ OW_TIMER_GETDEFAULTCOLUMN, OW_BUDGET_GETDEFAULTCOLUMN },
+	{ OW_TIMER_GETDEFAULTCOLUMNSTATE, OW_BUDGET_GETDEFAULTCOLUMNSTATE },
+	{ OW_TIMER_MAPCOLUMNTOSCID, OW_BUDGET_MAPCOLUMNTOSCID },
+	{ OW_TIMER_GETDISPLAYNAMEOF, OW_BUDGET_GETDISPLAYNAMEOF },
+	{ OW_TIMER_GETDETAILSOF, OW_BUDGET_GETDETAILSOF },
+	{ OW_TIMER_ENUM_PROBE, OW_BUDGET_ENUM_PROBE }
+};
+
+static ULONG AllocationsOf(int Operation)
+{
+	ULONG Count = 0;
+	int i;
+
+	for (i = 0; i < OW_ALLOC_SOURCE_MAX; i++)
+		Count += (ULONG)s_Totals[Operation][i].Count;
+	return Count;
+}
+
+static ULONG BytesOf(int Operation)
+{
+	ULONG Bytes = 0;
+	int i;
+
+	for (i = 0; i < OW_ALLOC_SOURCE_MAX; i++)
+		Bytes += (ULONG)s_Totals[Operation][i].Bytes;
+	return Bytes;
+}
+
+#define APPEND(args) \
+	if (Length < Size - 1) \
+	{ \
+		Written = _snprintf args; \
+		Length = (Written < 0 || Written >= Size - Length) ? Size - 1 : Length + Written; \
+	}
+
+int OWAllocCheckBudgets(LPSTR Buffer, int Size)
+{
+	OWMetricsTotals *Totals;
+	int Length = 0, Written, Over = 0, i;
+
+	if (Size > 0)
+		Buffer[0] = '\0';
+
+	Totals = new OWMetricsTotals;
+	if (Totals == NULL)
+		return 0;
+	OWMetricsRead(Totals);
+
+	for (i = 0; i < (int)(sizeof(s_Budgets) / sizeof(s_Budgets[0])); i++)
+	{
+		const OWAllocBudget &b = s_Budgets[i];
+		ULONG Calls = Totals->Timers[b.Operation].Calls;
+		ULONG Count = AllocationsOf(b.Operation);
+
+		if (Count <= b.PerCall * Calls)
+			continue;
+
+		Over++;
+		APPEND((Buffer + Length, Size - Length, "%s over budget: %lu allocations in %lu calls, budget %lu per call\r\n",
+			OWMetricsTimerName(b.Operation), Count, Calls, b.PerCall));
+	}
+
+	if (Size > 0)
+		Buffer[Length] = '\0';
+	delete Totals;
+	return Over;
+}
+
+//========================================================================================
+// Report
+
+int OWAllocFormat(LPSTR Buffer, int Size)
+{
+	OWMetricsTotals *Totals;
+	int Length = 0, Written, i, j;
+
+	if (Size <= 0)
+		return 0;
+	Buffer[0] = '\0';
+
+	Totals = new OWMetricsTotals;
+	if (Totals == NULL)
+		return 0;
+	OWMetricsRead(Totals);
+
+	APPEND((Buffer + Length, Size - Length, "%-22s %10s %10s %10s", "allocations", "calls", "per_call", "bytes_call"));
+	for (j = 0; j < OW_ALLOC_SOURCE_MAX; j++)
+		APPEND((Buffer + Length, Size - Length, " %8s", s_SourceNames[j]));
+	APPEND((Buffer + Length, Size - Length, "\r\n"));
+
+	for (i = 0; i <= OW_TIMER_MAX; i++)
+	{
+		ULONG Count = AllocationsOf(i);
+		ULONG Calls = (i == OW_ALLOC_NO_OPERATION) ? 0 : Totals->Timers[i].Calls;
+		if (Count == 0)
+			continue;
+
+		// Per call figures are to a tenth, since most of them are well under ten
+		APPEND((Buffer + Length, Size - Length, "%-22s %10lu", (i == OW_ALLOC_NO_OPERATION) ? "(none)" : OWMetricsTimerName((OWTimer)i), Calls));
+		if (Calls != 0)
+		{
+			APPEND((Buffer + Length, Size - Length, " %8lu.%lu %10lu",
+				Count / Calls, (Count % Calls) * 10 / Calls, BytesOf(i) / Calls));
+		}
+		else
+		{
+			APPEND((Buffer + Length, Size - Length, " %10s %10s", "-", "-"));
+		}
+		for (j = 0; j < OW_ALLOC_SOURCE_MAX; j++)
+			APPEND((Buffer + Length, Size - Length, " %8lu", (ULONG)s_Totals[i][j].Count));
+		APPEND((Buffer + Length, Size - Length, "\r\n"));
+	}
+
+	// Then whatever is over budget, right under the table
+	OWAllocCheckBudgets(Buffer + Length, Size - Length);
+	Length += strlen(Buffer + Length);
+
+	delete Totals;
+	return Length;
+}
+
+#undef APPEND
+
+#endif // OW_ALLOC_PROFILE
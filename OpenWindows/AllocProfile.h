@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __ALLOCPROFILE_H_
+#define __ALLOCPROFILE_H_
+
+//========================================================================================
+// Opt-in allocation accounting, for driving the hot paths toward no allocations and
+// keeping them there. With OW_ALLOC_PROFILE defined (see stdafx.h), each allocation
+// from the sources below is counted, with its size, against the operation running on
+// the thread: the innermost COWMetricTimer scope, see Metrics.h. Without it, the hooks
+// are empty.
+//
+// The budgets, the most allocations an operation may make per call on average, are in
+// AllocBudgets.h. The metrics report flags operations over theirs, and the load
+// generator can fail on them (budgets=1).
+//
+// This is included by stdafx.h, between ATL and wtlstr.h, so the CString hooks see it.
+
+enum OWAllocSource
+{
+	OW_ALLOC_SHELL,			// OWGetMalloc(), for STRRET strings
+	OW_ALLOC_PIDL,			// CPidlMgr
+	OW_ALLOC_CSTRING,		// CString buffers (wtlstr.h)
+	OW_ALLOC_BSTR,			// BSTRs we make, or are handed to free
+	OW_ALLOC_ARRAY,			// COWSimpleArray growing
+
+	OW_ALLOC_SOURCE_MAX
+};
+
+#if defined(OW_ALLOC_PROFILE)
+
+// Call once from DllMain, before anything is counted, and once at the end.
+void OWAllocInit();
+void OWAllocTerm();
+
+void OWAllocNote(OWAllocSource Source, ULONG Bytes);
+
+// Make Operation (an OWTimer) the thread's, and return the one to put back after
+int OWAllocEnter(int Operation);
+void OWAllocLeave(int Outer);
+
+// The per-operation table for the metrics report. Returns the length, and writes at
+// most Size-1 chars.
+int OWAllocFormat(LPSTR Buffer, int Size);
+
+// Returns how many operations are over budget, and a line about each in Buffer.
+int OWAllocCheckBudgets(LPSTR Buffer, int Size);
+
+#define OW_ALLOC_NOTE(Source, Bytes) OWAllocNote(Source, (ULONG)(Bytes))
+
+#else
+
+#define OW_ALLOC_NOTE(Source, Bytes)
+
+#endif // OW_ALLOC_PROFILE
+
+//========================================================================================
+// CSimpleArray, counting each time it grows. It adds no members, so it can stand in for
+// one anywhere.
+
+template <class T>
+class COWSimpleArray : public CSimpleArray<T>
+{
+public:
+#if defined(OW_ALLOC_PROFILE)
+	BOOL Add(const T& t)
+	{
+		int OldAllocSize = this->m_nAllocSize;
+		// Older ATL takes a T&, it doesn't change it
+		BOOL Added = CSimpleArray<T>::Add((T&)t);
+		if (this->m_nAllocSize != OldAllocSize)
+			OW_ALLOC_NOTE(OW_ALLOC_ARRAY, this->m_nAllocSize * sizeof(T));
+		return Added;
+	}
+#endif
+};
+
+#endif // __ALLOCPROFILE_H_
@@ -1,146 +0,0 @@
-/*
- * Copyright (c) 2004 Pascal Hurni
- *
- * Permission is hereby granted, free of charge, to any person obtaining
- * a copy of this software and associated documentation files (the
- * "Software"), to deal in the Software without restriction, including
- * without limitation the rights to use, copy, modify, merge, publish,
- * distribute, sublicense, and/or sell copies of the Software, and to
- * permit persons to whom the Software is furnished to do so, subject to
- * the following conditions:
- * 
- * The above copyright notice and this permission notice shall be
- * included in all copies or substantial portions of the Software.
- * 
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
- * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
- * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
- * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
- * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
- * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
- * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
- */
-
-//----------------------------------------------------------------------------------------
-// An implementation for CComEnum that connects to a CSimpleArray<>
-// (much like CComEnumOnSTL works for STL collections)
-
-#ifdef __ATLBASE_H__
-
-template <class Base, const IID* piid, class T, class Copy, class CollType>
-class ATL_NO_VTABLE IEnumOnCArrayImpl : public Base
-{
-public:
-	HRESULT Init(IUnknown *pUnkForRelease, CollType& collection)
-	{
-		m_spUnk = pUnkForRelease;
-		m_pcollection = &collection;
-		m_iter = 0;
-		return S_OK;
-	}
-	STDMETHOD(Next)(ULONG celt, T* rgelt, ULONG* pceltFetched);
-	STDMETHOD(Skip)(ULONG celt);
-	STDMETHOD(Reset)(void)
-	{
-		if (m_pcollection == NULL)
-			return E_FAIL;
-		m_iter = 0;
-		return S_OK;
-	}
-	STDMETHOD(Clone)(Base** ppEnum);
-//Data
-	CComPtr<IUnknown> m_spUnk;
-	CollType* m_pcollection;
-	int m_iter;
-};
-
-template <class Base, const IID* piid, class T, class Copy, class CollType>
-STDMETHODIMP IEnumOnCArrayImpl<Base, piid, T, Copy, CollType>::Next(ULONG celt, T* rgelt, ULONG* pceltFetched)
-{
-	if (rgelt == NULL || (celt != 1 && pceltFetched == NULL))
-		return E_POINTER;
-	if (m_pcollection == NULL)
-		return E_FAIL;
-
-	ULONG nActual = 0;
-	HRESULT hr = S_OK;
-	T* pelt = rgelt;
-	while (SUCCEEDED(hr) && m_iter != m_pcollection->GetSize() && nActual < celt)
-	{
-		hr = Copy::copy(pelt, &m_pcollection->operator[](m_iter));
-		if (FAILED(hr))
-		{
-			while (rgelt < pelt)
-				Copy::destroy(rgelt++);
-			nActual = 0;
-		}
-		else
-		{
-			pelt++;
-			m_iter++;
-			nActual++;
-		}
-	}
-	if (pceltFetched)
-		*pceltFetched = nActual;
-	if (SUCCEEDED(hr) && (nActual < celt))
-		hr = S_FALSE;
-	return hr;
-}
-
-template <class Base, const IID* piid, class T, class Copy, class CollType>
-STDMETHODIMP IEnumOnCArrayImpl<Base, piid, T, Copy, CollType>::Skip(ULONG celt)
-{
-	HRESULT hr = S_OK;
-	while (celt--)
-	{
-		if (m_iter != m_pcollection->GetSize())
-			m_iter++;
-		else
-		{
-			hr = S_FALSE;
-			break;
-		}
-	}
-	return hr;
-}
-
-template <class Base, const IID* piid, class T, class Copy, class CollType>
-STDMETHODIMP IEnumOnCArrayImpl<Base, piid, T, Copy, CollType>::Clone(Base** ppEnum)
-{
-	typedef CComObject<CComEnumOnCArray<Base, piid, T, Copy, CollType> > _class;
-	HRESULT hRes = E_POINTER;
-	if (ppEnum != NULL)
-	{
-		*ppEnum = NULL;
-		_class* p;
-		hRes = _class::CreateInstance(&p);
-		if (SUCCEEDED(hRes))
-		{
-			hRes = p->Init(m_spUnk, *m_pcollection);
-			if (SUCCEEDED(hRes))
-			{
-				p->m_iter = m_iter;
-				hRes = p->_InternalQueryInterface(*piid, (void**)ppEnum);
-			}
-			if (FAILED(hRes))
-				delete p;
-		}
-	}
-	return hRes;
-}
-
-template <class Base, const IID* piid, class T, class Copy, class CollType, class ThreadModel = CComObjectThreadModel>
-class ATL_NO_VTABLE CComEnumOnCArray :
-	public IEnumOnCArrayImpl<Base, piid, T, Copy, CollType>,
-	public CComObjectRootEx< ThreadModel >
-{
-public:
-	typedef CComEnumOnCArray<Base, piid, T, Copy, CollType, ThreadModel > _CComEnum;
-	typedef IEnumOnCArrayImpl<Base, piid, T, Copy, CollType > _CComEnumBase;
-	BEGIN_COM_MAP(_CComEnum)
-		COM_INTERFACE_ENTRY_IID(*piid, _CComEnumBase)
-	END_COM_MAP()
-};
-
-#endif
\ No newline at end of file
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "CallLog.h"
+#include "Common.h"
+
+//========================================================================================
+// The log
+
+enum { OW_CALLLOG_BUFFER_SIZE = 65536 };
+
+volatile LONG g_OWCallLogOn = 0;
+
+static bool s_SettingsLoaded = false;
+static HANDLE s_File = INVALID_HANDLE_VALUE;
+static LONGLONG s_StartTicks = 0;
+// Guards the settings, the buffer and the file
+static CRITICAL_SECTION s_Lock;
+static BYTE *s_Buffer = NULL;
+static ULONG s_Used = 0;
+
+void OWCallLogInit()
+{
+	InitializeCriticalSection(&s_Lock);
+}
+
+void OWCallLogTerm()
+{
+	g_OWCallLogOn = 0;
+	OWCallLogFlush();
+
+	if (s_File != INVALID_HANDLE_VALUE)
+		CloseHandle(s_File);
+	s_File = INVALID_HANDLE_VALUE;
+	if (s_Buffer != NULL)
+		HeapFree(GetProcessHeap(), 0, s_Buffer);
+	s_Buffer = NULL;
+
+	DeleteCriticalSection(&s_Lock);
+}
+
+static bool WriteAll(HANDLE File, const void *Data, DWORD Size)
+{
+	DWORD Written;
+	return WriteFile(File, Data, Size, &Written, NULL) && Written == Size;
+}
+
+// Called with the lock held
+static bool Start(LPCTSTR Path)
+{
+	OWCallLogHeader Header;
+	char Host[MAX_PATH], *Name;
+
+	s_Buffer = (BYTE*)HeapAlloc(GetProcessHeap(), 0, OW_CALLLOG_BUFFER_SIZE);
+	if (s_Buffer == NULL)
+		return false;
+
+	s_File = CreateFile(Path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (s_File == INVALID_HANDLE_VALUE)
+		return false;
+
+	if (GetModuleFileNameA(NULL, Host, MAX_PATH) == 0)
+		strcpy(Host, "?");
+	Name = strrchr(Host, '\\');
+	Name = Name ? Name + 1 : Host;
+
+	memset(&Header, 0, sizeof(Header));
+	Header.Magic = OW_CALLLOG_MAGIC;
+	Header.Version = OW_CALLLOG_VERSION;
+	Header.RecordSize = sizeof(OWCallLogRecord);
+	Header.ProcessId = GetCurrentProcessId();
+	lstrcpynA(Header.Host, Name, OW_CALLLOG_HOST_LENGTH);
+
+	s_StartTicks = OWMetricsNow();
+	return WriteAll(s_File, &Header, sizeof(Header));
+}
+
+void OWCallLogLoadSettings()
+{
+	HKEY Key;
+	TCHAR Path[MAX_PATH];
+
+	if (s_SettingsLoaded)
+		return;
+
+	EnterCriticalSection(&s_Lock);
+	if (!s_SettingsLoaded)
+	{
+		s_SettingsLoaded = true;
+		if ((Key = OWOpenSettings()) != NULL)
+		{
+			OWReadSetting(Key, _T("CallLogFile"), Path, MAX_PATH);
+			RegCloseKey(Key);
+
+			if (Path[0] != _T('\0'))
+			{
+				if (Start(Path))
+					g_OWCallLogOn = 1;
+				else
+					ATLTRACE(_T("OWCallLogLoadSettings() can't record to %s\n"), Path);
+			}
+		}
+	}
+	LeaveCriticalSection(&s_Lock);
+}
+
+// Called with the lock held
+static void FlushLocked()
+{
+	if (s_Used == 0 || s_File == INVALID_HANDLE_VALUE)
+		return;
+
+	// Better to stop than to leave a log with a hole in it
+	if (!WriteAll(s_File, s_Buffer, s_Used))
+		g_OWCallLogOn = 0;
+	s_Used = 0;
+}
+
+void OWCallLogFlush()
+{
+	if (!s_SettingsLoaded)
+		return;
+
+	EnterCriticalSection(&s_Lock);
+	FlushLocked();
+	LeaveCriticalSection(&s_Lock);
+}
+
+// Room for Size bytes in the buffer, called with the lock held. NULL when it can't be
+// had, such as after the log was stopped.
+static BYTE *Reserve(ULONG Size)
+{
+	if (s_Buffer == NULL || Size > OW_CALLLOG_BUFFER_SIZE)
+		return NULL;
+	if (s_Used + Size > OW_CALLLOG_BUFFER_SIZE)
+		FlushLocked();
+	if (!g_OWCallLogOn)
+		return NULL;
+
+	BYTE *Target = s_Buffer + s_Used;
+	s_Used += Size;
+	return Target;
+}
+
+static OWUINT64 ToMicroseconds(LONGLONG Ticks)
+{
+	LONGLONG Frequency = OWMetricsFrequency();
+	if (Frequency <= 0 || Ticks < 0)
+		return 0;
+	return (OWUINT64)(Ticks / Frequency * 1000000 + Ticks % Frequency * 1000000 / Frequency);
+}
+
+static void FillRecord(OWCallLogRecord *Record, unsigned Type, unsigned Event, const void *Object, LONGLONG Start)
+{
+	memset(Record, 0, sizeof(*Record));
+	Record->Type = (unsigned short)Type;
+	Record->Event = (unsigned short)Event;
+	Record->Object = (unsigned)(size_t)Object;
+	Record->Start = ToMicroseconds(Start - s_StartTicks);
+}
+
+//========================================================================================
+// Records
+
+void OWCallLogWriteCall(unsigned Event, const void *Object, LONGLONG Start, LONGLONG End, const unsigned *Args)
+{
+	OWCallLogRecord Record;
+
+	FillRecord(&Record, OW_CALLLOG_CALL, Event, Object, Start);
+	Record.Duration = (unsigned)ToMicroseconds(End - Start);
+	Record.Args[0] = Args[0];
+	Record.Args[1] = Args[1];
+	Record.Args[2] = Args[2];
+
+	EnterCriticalSection(&s_Lock);
+	BYTE *Target = Reserve(sizeof(Record));
+	if (Target != NULL)
+		memcpy(Target, &Record, sizeof(Record));
+	LeaveCriticalSection(&s_Lock);
+}
+
+void OWCallLogWriteSnapshot(const void *Object, COWItemList &Items, bool Changed)
+{
+	OWCallLogRecord Record;
+	ULONG Size = 0;
+	int i;
+
+	if (Changed)
+	{
+		for (i = 0; i < Items.GetSize(); i++)
+			Size += sizeof(USHORT) + Items[i].GetSize();
+	}
+
+	FillRecord(&Record, OW_CALLLOG_SNAPSHOT, 0, Object, OWMetricsNow());
+	Record.Args[0] = Items.GetSize();
+	Record.Args[1] = Size;
+	Record.Args[2] = Changed ? 1 : 0;
+
+	EnterCriticalSection(&s_Lock);
+	BYTE *Target = Reserve(sizeof(Record));
+	if (Target != NULL)
+	{
+		memcpy(Target, &Record, sizeof(Record));
+
+		// Item by item, since the whole snapshot might not fit in the buffer
+		for (i = 0; Changed && i < Items.GetSize(); i++)
+		{
+			USHORT cb = (USHORT)(sizeof(USHORT) + Items[i].GetSize());
+			Target = Reserve(cb);
+			if (Target == NULL)
+				break;
+			memcpy(Target, &cb, sizeof(cb));
+			Items[i].CopyTo(Target + sizeof(cb));
+		}
+	}
+	LeaveCriticalSection(&s_Lock);
+}
+
+void OWCallLogWriteResults(const void *Object, const int *Results, int Count, int Mode)
+{
+	OWCallLogRecord Record;
+	int i;
+
+	FillRecord(&Record, OW_CALLLOG_RESULTS, 0, Object, OWMetricsNow());
+	Record.Args[0] = Count;
+	Record.Args[1] = Count * sizeof(USHORT);
+	Record.Args[2] = Mode;
+
+	EnterCriticalSection(&s_Lock);
+	BYTE *Target = Reserve(sizeof(Record));
+	if (Target != NULL)
+	{
+		memcpy(Target, &Record, sizeof(Record));
+		for (i = 0; i < Count; i++)
+		{
+			USHORT Index = (USHORT)Results[i];
+			Target = Reserve(sizeof(Index));
+			if (Target == NULL)
+				break;
+			memcpy(Target, &Index, sizeof(Index));
+		}
+	}
+	LeaveCriticalSection(&s_Lock);
+}
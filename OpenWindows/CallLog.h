@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __CALLLOG_H_
+#define __CALLLOG_H_
+
+#include "OWCallLog.h"
+#include "ShellItems.h"
+#include "Metrics.h"
+
+//========================================================================================
+// Records the calls made on the folder, with their arguments and timings, to a file
+// that Tools/CallReplay can replay (see OWCallLog.h). It's off unless asked for:
+//
+// Under HKCU\Software\OpenWindows:
+//  CallLogFile (string)	record to that file, from the first folder made on
+//
+// Records go through a buffer under a lock; the file is written when that fills up,
+// when a folder goes away, and when the DLL unloads. Only one process can record to a
+// file at a time; the others don't record.
+
+// Call once from DllMain, and once at the end.
+void OWCallLogInit();
+void OWCallLogTerm();
+
+// Not from DllMain. Loads the settings the first time; the folder calls it when made.
+void OWCallLogLoadSettings();
+
+extern volatile LONG g_OWCallLogOn;
+
+void OWCallLogWriteCall(unsigned Event, const void *Object, LONGLONG Start, LONGLONG End, const unsigned *Args);
+void OWCallLogWriteSnapshot(const void *Object, COWItemList &Items, bool Changed);
+void OWCallLogWriteResults(const void *Object, const int *Results, int Count, int Mode);
+
+void OWCallLogFlush();
+
+// Records a call when its scope ends
+class COWRecordedCall
+{
+public:
+	COWRecordedCall(unsigned Event, const void *Object) : m_On(g_OWCallLogOn != 0), m_Event(Event), m_Object(Object)
+	{
+		if (m_On)
+		{
+			m_Args[0] = m_Args[1] = m_Args[2] = 0;
+			m_Start = OWMetricsNow();
+		}
+	}
+	~COWRecordedCall()
+	{
+		if (m_On)
+			OWCallLogWriteCall(m_Event, m_Object, m_Start, OWMetricsNow(), m_Args);
+	}
+
+	bool IsOn() const { return m_On; }
+	void SetArgs(unsigned Arg1, unsigned Arg2, unsigned Arg3) { m_Args[0] = Arg1; m_Args[1] = Arg2; m_Args[2] = Arg3; }
+	void SetArg(int i, unsigned Arg) { if (m_On) m_Args[i] = Arg; }
+
+protected:
+	bool m_On;
+	unsigned m_Event;
+	const void *m_Object;
+	LONGLONG m_Start;
+	unsigned m_Args[3];
+};
+
+// Put at the top of a method. The arguments are only evaluated when recording.
+#define OW_RECORD_CALL(Event, Object, Arg1, Arg2, Arg3) \
+	COWRecordedCall RecordedCall(Event, Object); \
+	if (RecordedCall.IsOn()) \
+		RecordedCall.SetArgs((unsigned)(Arg1), (unsigned)(Arg2), (unsigned)(Arg3))
+
+#endif // __CALLLOG_H_
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "resource.h"
+#include "Columns.h"
+
+//========================================================================================
+// Columns
+
+// Seems that SHCOLSTATE_PREFER_VARCMP doesn't have any noticeable effect (if supplied or not) for Win2K, but don't
+// set it for WinXP, since it will not sort the column. (not setting it means that our CompareIDs() will be called)
+#if defined(OW_PKEYS_SUPPORT)
+// The keys are needed for the tile subtitles to display properly on Vista. We can
+// seemingly skip rank and let it fall through to the legacy impl.
+#define OW_COLUMN_KEY(Key) , Key
+#else
+#define OW_COLUMN_KEY(Key)
+#endif
+
+const OWColumn g_OWColumns[DETAILS_COLUMN_MAX] =
+{
+	{ IDS_COLUMN_NAME, LVCFMT_LEFT, 32, SHCOLSTATE_TYPE_STR | SHCOLSTATE_ONBYDEFAULT, OW_FIELD_NAME OW_COLUMN_KEY(&PKEY_ItemNameDisplay) },
+	{ IDS_COLUMN_PATH, LVCFMT_LEFT, 32, SHCOLSTATE_TYPE_STR | SHCOLSTATE_ONBYDEFAULT, OW_FIELD_PATH OW_COLUMN_KEY(&PKEY_ItemPathDisplay) },
+	{ IDS_COLUMN_RANK, LVCFMT_RIGHT, 6, SHCOLSTATE_TYPE_INT | SHCOLSTATE_ONBYDEFAULT, OW_FIELD_RANK OW_COLUMN_KEY(NULL) }
+};
+
+#if defined(OW_PKEYS_SUPPORT)
+//========================================================================================
+// Folder properties
+
+// Vista required. It appears ItemNameDisplay and ItemPathDisplay come from their real
+// FS representation.
+//
+// The keys are spread over the table by a perfect hash of the FMTID's first DWORD and
+// the PID, so a lookup is one compare. The keys aren't constants the compiler can
+// hash, so each entry is put in its slot by hand; a debug build checks them. A new
+// property that collides needs a bigger table or another hash.
+enum { OW_PROPERTY_SLOTS = 8 };
+
+#define OW_PROPERTY_HASH(Key) (((Key).fmtid.Data1 ^ (Key).pid) & (OW_PROPERTY_SLOTS - 1))
+#define OW_PROPERTY_TEXT(Text) Text, (sizeof(Text) / sizeof(WCHAR)) - 1
+
+static const OWFolderProperty s_FolderProperties[OW_PROPERTY_SLOTS] =
+{
+	/* 0 */ { &PKEY_PropList_ExtendedTileInfo, OW_PROPERTY_TEXT(L"prop:System.ItemPathDisplay") },
+	/* 1 */ { &PKEY_PropList_PreviewDetails, OW_PROPERTY_TEXT(L"prop:System.ItemPathDisplay") },
+	/* 2 */ { &PKEY_PropList_TileInfo, OW_PROPERTY_TEXT(L"prop:System.ItemPathDisplay") },
+	/* 3 */ { &PKEY_PropList_FullDetails, OW_PROPERTY_TEXT(L"prop:System.ItemNameDisplay;System.ItemPathDisplay") },
+	/* 4 */ { NULL, NULL, 0 },
+	/* 5 */ { &PKEY_ItemType, OW_PROPERTY_TEXT(L"Directory") },
+	/* 6 */ { NULL, NULL, 0 },
+	/* 7 */ { NULL, NULL, 0 }
+};
+
+#ifdef _DEBUG
+static bool CheckFolderProperties()
+{
+	for (int i = 0; i < OW_PROPERTY_SLOTS; i++)
+	{
+		const SHCOLUMNID *Key = s_FolderProperties[i].Key;
+		if (Key != NULL && OW_PROPERTY_HASH(*Key) != (DWORD)i)
+		{
+			ATLTRACE(_T("OWFindFolderProperty() slot %d has the wrong key\n"), i);
+			return false;
+		}
+	}
+	return true;
+}
+#endif
+
+const OWFolderProperty *OWFindFolderProperty(const SHCOLUMNID &Key)
+{
+#ifdef _DEBUG
+	static bool Checked = false;
+	if (!Checked)
+	{
+		ATLASSERT(CheckFolderProperties());
+		Checked = true;
+	}
+#endif
+
+	const OWFolderProperty *Property = &s_FolderProperties[OW_PROPERTY_HASH(Key)];
+	if (Property->Key == NULL || !IsEqualPropertyKey(*Property->Key, Key))
+		return NULL;
+	return Property;
+}
+#endif // OW_PKEYS_SUPPORT
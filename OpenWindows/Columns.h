@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __COLUMNS_H_
+#define __COLUMNS_H_
+
+#include "OWCore.h"
+
+//========================================================================================
+// The detail columns and the folder's properties, as tables. GetDetailsOf(),
+// GetDefaultColumnState(), MapColumnToSCID() and CompareIDs() all read the column
+// table, so a new column is a new entry (and its string resource).
+
+enum
+{
+	DETAILS_COLUMN_NAME,
+	DETAILS_COLUMN_PATH,
+	DETAILS_COLUMN_RANK,
+
+	DETAILS_COLUMN_MAX
+};
+
+struct OWColumn
+{
+	UINT NameId;			// string resource for the header
+	int Format;				// LVCFMT_
+	int Width;				// in chars, for the header and fixed width values
+	SHCOLSTATEF State;
+	int Field;				// OWItemField the column shows and sorts on
+#if defined(OW_PKEYS_SUPPORT)
+	const SHCOLUMNID *Key;	// the property it maps to on Vista, or NULL
+#endif
+};
+
+extern const OWColumn g_OWColumns[DETAILS_COLUMN_MAX];
+
+#if defined(OW_PKEYS_SUPPORT)
+//========================================================================================
+// Properties of the folder view itself, answered by GetDetailsEx(); they're the same
+// for every item.
+
+struct OWFolderProperty
+{
+	const SHCOLUMNID *Key;
+	LPCWSTR Value;
+	UINT Length;			// of Value, in chars
+};
+
+// The property for Key, or NULL if we don't have it
+const OWFolderProperty *OWFindFolderProperty(const SHCOLUMNID &Key);
+#endif // OW_PKEYS_SUPPORT
+
+#endif // __COLUMNS_H_
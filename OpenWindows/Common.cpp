@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include "stdafx.h"
+#include "Common.h"
+
+typedef BOOL (WINAPI *SHGetSpecialFolderPathProc)(HWND, LPTSTR, int, BOOL);
+
+//========================================================================================
+// Settings
+
+HKEY OWOpenSettings()
+{
+	HKEY Key;
+
+	if (RegOpenKeyEx(HKEY_CURRENT_USER, _T("Software\\OpenWindows"), 0, KEY_READ, &Key) != ERROR_SUCCESS)
+		return NULL;
+	return Key;
+}
+
+bool OWReadSetting(HKEY Key, LPCTSTR Name, DWORD *pValue)
+{
+	DWORD Type, Value, Size = sizeof(Value);
+
+	if (RegQueryValueEx(Key, Name, NULL, &Type, (LPBYTE)&Value, &Size) != ERROR_SUCCESS || Type != REG_DWORD)
+		return false;
+	*pValue = Value;
+	return true;
+}
+
+bool OWReadSetting(HKEY Key, LPCTSTR Name, LPTSTR Text, DWORD Size)
+{
+	DWORD Type, Bytes = (Size - 1) * sizeof(TCHAR);
+
+	// The stored string needn't be terminated
+	if (RegQueryValueEx(Key, Name, NULL, &Type, (LPBYTE)Text, &Bytes) != ERROR_SUCCESS || Type != REG_SZ)
+		Bytes = 0;
+	Text[Bytes / sizeof(TCHAR)] = _T('\0');
+	return Bytes != 0;
+}
+
+//========================================================================================
+// Named objects
+
+HANDLE OWCreateLocalMutex(LPCSTR Name)
+{
+	char LocalName[MAX_PATH];
+
+	wsprintfA(LocalName, "Local\\%s", Name);
+	HANDLE Mutex = CreateMutexA(NULL, FALSE, LocalName);
+	return Mutex != NULL ? Mutex : CreateMutexA(NULL, FALSE, Name);
+}
+
+HANDLE OWCreateLocalMapping(LPCSTR Name, DWORD Size)
+{
+	char LocalName[MAX_PATH];
+
+	wsprintfA(LocalName, "Local\\%s", Name);
+	HANDLE Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, Size, LocalName);
+	return Mapping != NULL ? Mapping : CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, Size, Name);
+}
+
+bool OWTakeLock(HANDLE Mutex)
+{
+	DWORD Wait = WaitForSingleObject(Mutex, 1000);
+	return Wait == WAIT_OBJECT_0 || Wait == WAIT_ABANDONED;
+}
+
+//========================================================================================
+// Files
+
+bool OWGetDataFile(LPCTSTR Name, LPTSTR Path)
+{
+	// Only there since the desktop update on 95 and NT 4
+	HMODULE Shell = GetModuleHandle(_T("shell32.dll"));
+	SHGetSpecialFolderPathProc GetFolderPath = NULL;
+	if (Shell != NULL)
+#ifdef _UNICODE
+		GetFolderPath = (SHGetSpecialFolderPathProc)GetProcAddress(Shell, "SHGetSpecialFolderPathW");
+#else
+		GetFolderPath = (SHGetSpecialFolderPathProc)GetProcAddress(Shell, "SHGetSpecialFolderPathA");
+#endif
+	if (GetFolderPath == NULL)
+		return false;
+
+	if (!GetFolderPath(NULL, Path, CSIDL_LOCAL_APPDATA, TRUE) && !GetFolderPath(NULL, Path, CSIDL_APPDATA, TRUE))
+		return false;
+	if (lstrlen(Path) + lstrlen(Name) + 14 > MAX_PATH)
+		return false;
+
+	lstrcat(Path, _T("\\OpenWindows"));
+	CreateDirectory(Path, NULL);
+	lstrcat(Path, _T("\\"));
+	lstrcat(Path, Name);
+	return true;
+}
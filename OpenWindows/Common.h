@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __COMMON_H_
+#define __COMMON_H_
+
+//========================================================================================
+// What the subsystems that keep something of their own (history, frecency, the
+// activation list, metrics, tracing...) have in common: their settings, the named
+// kernel objects they share between processes, and where their files go.
+
+//----------------------------------------------------------------------------------------
+// Settings, under HKCU\Software\OpenWindows. Each subsystem documents its own, and
+// reads them on first use, not from DllMain: the registry can load other DLLs.
+
+// NULL when there's no key; RegCloseKey() it otherwise
+HKEY OWOpenSettings();
+
+// A DWORD value. False, and *pValue untouched, when it isn't there or isn't a DWORD.
+bool OWReadSetting(HKEY Key, LPCTSTR Name, DWORD *pValue);
+
+// A string value, in Text of Size chars. Text is empty when it isn't there.
+bool OWReadSetting(HKEY Key, LPCTSTR Name, LPTSTR Text, DWORD Size);
+
+//----------------------------------------------------------------------------------------
+// Named objects, shared by the processes of the session. Kernel objects get a session
+// local name from Terminal Services on; before that, there is no Local\ namespace, and
+// the plain name is used.
+
+HANDLE OWCreateLocalMutex(LPCSTR Name);
+
+// Backed by the paging file; the pages start zeroed. GetLastError() is
+// ERROR_ALREADY_EXISTS when another process made it first.
+HANDLE OWCreateLocalMapping(LPCSTR Name, DWORD Size);
+
+// Wait for one of the mutexes above, for at most a second: they're only held for
+// short walks, so don't hold up the caller behind a stuck process. An abandoned mutex
+// is taken. Let go with ReleaseMutex().
+bool OWTakeLock(HANDLE Mutex);
+
+//----------------------------------------------------------------------------------------
+// InterlockedCompareExchange. VC6's headers declare it on pointers, and have no
+// pointer version of their own. Both return what Target held.
+
+inline LONG OWCompareExchange(LONG volatile *Target, LONG Exchange, LONG Comparand)
+{
+#if _MSC_VER > 1200
+	return InterlockedCompareExchange(Target, Exchange, Comparand);
+#else
+	return (LONG)InterlockedCompareExchange((PVOID*)Target, (PVOID)Exchange, (PVOID)Comparand);
+#endif
+}
+
+inline void *OWCompareExchangePointer(void * volatile *Target, void *Exchange, void *Comparand)
+{
+#if _MSC_VER > 1200
+	return InterlockedCompareExchangePointer(Target, Exchange, Comparand);
+#else
+	return InterlockedCompareExchange((PVOID*)Target, Exchange, Comparand);
+#endif
+}
+
+//----------------------------------------------------------------------------------------
+// Where our files go: OpenWindows\Name in the (local) application data folder, which is
+// made if it isn't there. Path has MAX_PATH chars.
+bool OWGetDataFile(LPCTSTR Name, LPTSTR Path);
+
+#endif // __COMMON_H_
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+// No stdafx.h here on purpose; this builds without Windows.
+#include <stddef.h>
+
+#include "DetailTable.h"
+
+//========================================================================================
+// COWDetailTable
+
+COWDetailTable::COWDetailTable() : m_Ranks(NULL)
+{
+}
+
+COWDetailTable::~COWDetailTable()
+{
+	RemoveAll();
+}
+
+void COWDetailTable::RemoveAll()
+{
+	RankTable *Ranks = m_Ranks, *Smaller;
+
+	m_Ranks = NULL;
+	for (; Ranks != NULL; Ranks = Smaller)
+	{
+		Smaller = Ranks->Smaller;
+		delete [] Ranks->Texts;
+		delete [] Ranks->Lengths;
+		delete Ranks;
+	}
+}
+
+bool COWDetailTable::Build(const OWItemData *Items, int ItemCount)
+{
+	RankTable *Old = m_Ranks;
+	int i, Count = ItemCount;
+
+	// Ranks are usually the snapshot order, but search results can renumber them
+	for (i = 0; i < ItemCount; i++)
+	{
+		if (Items[i].Rank >= Count)
+			Count = Items[i].Rank + 1;
+	}
+
+	// The texts don't depend on the windows, so a big enough table stays good
+	if (Old != NULL && Count <= Old->Count)
+		return true;
+	// Doubling, so the ones kept for readers add up to no more than the last
+	if (Old != NULL && Count < Old->Count * 2)
+		Count = Old->Count * 2;
+	if (Count > RANK_MAX_COUNT)
+		Count = RANK_MAX_COUNT;
+
+	RankTable *Ranks = new RankTable;
+	if (Ranks == NULL)
+		return false;
+	Ranks->Texts = new OWCHAR[Count * RANK_TEXT_SIZE];
+	Ranks->Lengths = new unsigned char[Count];
+	if (Ranks->Texts == NULL || Ranks->Lengths == NULL)
+	{
+		delete [] Ranks->Texts;
+		delete [] Ranks->Lengths;
+		delete Ranks;
+		return false;
+	}
+
+	for (i = 0; i < Count; i++)
+	{
+		OWCHAR *Text = Ranks->Texts + i * RANK_TEXT_SIZE;
+		OWCHAR Digits[RANK_TEXT_SIZE];
+		int Length = 0, Value = i;
+
+		do
+		{
+			Digits[Length++] = (OWCHAR)('0' + Value % 10);
+			Value /= 10;
+		} while (Value != 0);
+
+		Ranks->Lengths[i] = (unsigned char)Length;
+		while (Length > 0)
+			*Text++ = Digits[--Length];
+		*Text = 0;
+	}
+
+	// Filled in before it's seen
+	Ranks->Count = Count;
+	Ranks->Smaller = Old;
+	m_Ranks = Ranks;
+	return true;
+}
+
+const OWCHAR *COWDetailTable::GetRankText(unsigned short Rank, unsigned long *pLength) const
+{
+	const RankTable *Ranks = m_Ranks;
+
+	if (Ranks == NULL || Rank >= Ranks->Count)
+		return NULL;
+
+	*pLength = Ranks->Lengths[Rank];
+	return Ranks->Texts + Rank * RANK_TEXT_SIZE;
+}
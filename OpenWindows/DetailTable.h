@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __DETAILTABLE_H_
+#define __DETAILTABLE_H_
+
+#include "OWCore.h"
+
+//========================================================================================
+// Strings for the detail columns, made once per snapshot instead of on every
+// GetDetailsOf() call. The name and path are already in the pidl along with their
+// lengths, so only the rank needs formatting. Like OWCore.h, this doesn't include
+// Windows headers, so it's benchmarked with the core.
+//
+// The rank texts don't depend on the windows, so the table only ever grows. A bigger
+// one is filled in first, then published with one pointer store, and the smaller ones
+// are kept until RemoveAll(). Reading takes no lock; building takes the caller's.
+
+class COWDetailTable
+{
+public:
+	COWDetailTable();
+	~COWDetailTable();
+
+	// Make sure every rank of the snapshot has its text. One at a time.
+	bool Build(const OWItemData *Items, int Count);
+
+	// The text of a rank and its length, or NULL if the rank isn't in the table. The
+	// text stays until RemoveAll().
+	const OWCHAR *GetRankText(unsigned short Rank, unsigned long *pLength) const;
+
+	// Once nothing reads the table anymore
+	void RemoveAll();
+
+protected:
+	// Ranks are USHORTs, so at most 5 digits and the null
+	enum { RANK_TEXT_SIZE = 6, RANK_MAX_COUNT = 65536 };
+
+	struct RankTable
+	{
+		OWCHAR *Texts;
+		unsigned char *Lengths;
+		int Count;
+		RankTable *Smaller;		// the one this replaced
+	};
+
+	RankTable * volatile m_Ranks;
+};
+
+#endif // __DETAILTABLE_H_
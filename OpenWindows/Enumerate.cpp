@@ -25,6 +25,10 @@
 #include "stdafx.h"
 
 #include "ShellItems.h"
+#include "OWCore.h"
+#include "WindowSource.h"
+#include "Metrics.h"
+#include "FlightRecorder.h"
 
 CString PhysicalManifestationPath(void)
 {
@@ -36,18 +40,6 @@ CString PhysicalManifestationPath(void)
 	return str;
 }
 
-BOOL IsExplorerWindow(IWebBrowserApp *wba)
-{
-	BSTR appName;
-	wba->get_FullName(&appName);
-	CString appNameNormalized = CString(appName);
-	/* sep step because wtlstr doesn't return CString for mutators */
-	appNameNormalized.MakeUpper();
-	BOOL res = appNameNormalized.Find(_T("EXPLORER.EXE")) > -1;
-	SysFreeString(appName);
-	return res;
-}
-
 #if _DEBUG
 void TraceHwndInner(HWND tracedWindow, TCHAR *desc)
 {
@@ -62,163 +54,76 @@ void TraceHwndInner(HWND tracedWindow, TCHAR *desc)
 #define TraceHwnd(x, y)
 #endif
 
-static BOOL FolderItemStrategy(IWebBrowserApp *wba, int i, BSTR *pathBStr)
+long EnumerateWindows(COWWindowSource *source, COWItemList *list, HWND callerWindow)
 {
-	IDispatch *sfvd_disp;
-	IShellFolderViewDual *sfvd;
-	Folder *folder;
-	Folder2 *folder2;
-	FolderItem *selfItem;
-	BOOL ok;
-
-	ok = TRUE;
-
-	// This huge involved process boils down to:
-	// - get the scriptable shell view from the browser object (thank IE)
-	// - get the active folder from that, cast it into a newer interface
-	// - get the folder as an item from the casted version
-	// - get the name and path from the item
-	// Unfortunately, this requires quite a bit of COM casting :/
-	if (FAILED(wba->get_Document(&sfvd_disp))) {
-		ATLTRACE(_T(" ** Enumerate can't get document dispatch for i=%ld"), i);
-		ok = FALSE;
-		goto fail2;
-	}
-	if (FAILED(sfvd_disp->QueryInterface(IID_IShellFolderViewDual, (void**)&sfvd))) {
-		ATLTRACE(_T(" ** Enumerate isn't an IShellFolderViewDual i=%ld"), i);
-		ok = FALSE;
-		goto fail3;
-	}
-	if (FAILED(sfvd->get_Folder(&folder))) {
-		ATLTRACE(_T(" ** Enumerate can't get folder i=%ld"), i);
-		ok = FALSE;
-		goto fail4;
-	}
-	if (FAILED(folder->QueryInterface(IID_Folder2, (void**)&folder2))) {
-		ATLTRACE(_T(" ** Enumerate isn't a Folder2 i=%ld"), i);
-		ok = FALSE;
-		goto fail5;
-	}
-	// This part seems to fail on Me, possibly other 9x with 0xC0000005.
-	if (FAILED(folder2->get_Self(&selfItem))) {
-		ATLTRACE(_T(" ** Enumerate can't get FolderItem i=%ld"), i);
-		ok = FALSE;
-		goto fail6;
-	}
-	if (FAILED(selfItem->get_Path(pathBStr))) {
-		ATLTRACE(_T(" ** Enumerate doesn't have folder path i=%ld"), i);
-		ok = FALSE;
-		goto fail7;
-	}
-fail7:
-	selfItem->Release();
-fail6:
-	folder2->Release();
-fail5:
-	folder->Release();
-fail4:
-	sfvd->Release();
-fail3:
-	sfvd_disp->Release();
-fail2:
-	return ok;
-}
-
-static BSTR UriToDosPath(BSTR uri)
-{
-	DWORD size = INTERNET_MAX_URL_LENGTH;
-#pragma comment(lib, "urlmon")
-	// Using the SHLWAPI function is tempting, but it's broken with fancy
-	// characters even with Unicode
-	wchar_t strW[INTERNET_MAX_URL_LENGTH];
-	CoInternetParseUrl(uri, PARSE_PATH_FROM_URL, 0, strW, size, &size, 0);
-	return SysAllocString(strW);
-}
-
-static BOOL FileUriStrategy(IWebBrowserApp *wba, int i, BSTR *pathBStr)
-{
-	BSTR locationUrl, path;
-	BOOL ok;
-
-	ok = TRUE;
-
-	if (FAILED(wba->get_LocationURL(&locationUrl))) {
-		ATLTRACE(_T(" ** Enumerate can't get location for i=%ld"), i);
-		ok = FALSE;
-		goto fail2;
-	}
-
-	path = UriToDosPath(locationUrl);
-	*pathBStr = path;
-
-	SysFreeString(locationUrl);
-fail2:
-	return ok;
-}
-
-/* TODO: Convert to ATL wrappers */
-long EnumerateExplorerWindows(COWItemList *list, HWND callerWindow)
-{
-	IShellWindows *windows;
 	long count, realCount, i;
 	CString physPath;
+	wchar_t physPathW[MAX_PATH];
 	physPath = PhysicalManifestationPath();
+#ifdef _UNICODE
+	wcsncpy(physPathW, physPath, MAX_PATH);
+	physPathW[MAX_PATH-1] = L'\0';
+#else
+	if (MultiByteToWideChar(CP_ACP, 0, physPath, -1, physPathW, MAX_PATH) == 0)
+		physPathW[0] = L'\0';
+#endif
 	realCount = 0;
-	if (FAILED(CoInitialize(NULL))) {
-		ATLTRACE(_T(" ** Enumerate can't init COM"));
-		return 1;
-	}
-	if (FAILED(CoCreateInstance(CLSID_ShellWindows, NULL, CLSCTX_ALL, IID_IShellWindows, (void**)&windows))) {
-		ATLTRACE(_T(" ** Enumerate can't create IShellWindows"));
-		return 2;
+	// The slowest passes are kept in detail, see FlightRecorder.h
+	COWFlightTimeline flight(callerWindow);
+	source->SetFlight(&flight);
+	{
+		// Starting up the shell windows object can be slow by itself
+		COWMetricTimer activationTimer(OW_TIMER_ENUM_ACTIVATION);
+		count = source->Begin();
 	}
-	if (FAILED(windows->get_Count(&count))) {
-		count = 0;
+	flight.Activated(count);
+	if (count < 0) {
+		source->SetFlight(NULL);
+		flight.End(0);
+		return 0;
 	}
 	for (i = 0; i < count; i++) {
-		VARIANT v ;
-		v.vt = VT_I4 ;
-		V_I4(&v) = i;
-
-		IDispatch *wba_disp;
-		IWebBrowserApp *wba;
-		
-		BSTR pathBStr, nameBStr;
-		CString pathStr, nameStr;
+		BSTR appNameBStr, pathBStr, nameBStr;
 		COWItem item;
 		HWND window, parent;
-		SHANDLE_PTR windowPtr;
+		BOOL isExplorer;
+		bool gotPath;
+		// Each window is a few cross-process calls, and a hung one costs the most
+		COWMetricTimer probeTimer(OW_TIMER_ENUM_PROBE);
+		flight.BeginWindow(i);
 
-		if (FAILED(windows->Item(v, &wba_disp))) {
-			ATLTRACE(_T(" ** Enumerate isn't an item i=%ld"), i);
+		// Is this even a Windows Explorer window?
+		if (!source->GetAppName(i, &appNameBStr)) {
+			ATLTRACE(_T(" ** Enumerate can't get the app name i=%ld"), i);
+			flight.Skip(OW_FLIGHT_NO_APP_NAME);
 			continue;
 		}
-		if (FAILED(wba_disp->QueryInterface(IID_IWebBrowserApp, (void**)&wba))) {
-			ATLTRACE(_T(" ** Enumerate isn't an IWebBrowserApp i=%ld"), i);
-			goto fail1;
-		}
-		// Is this even a Windows Explorer window?
-		if (!IsExplorerWindow(wba)) {
+		OW_ALLOC_NOTE(OW_ALLOC_BSTR, SysStringByteLen(appNameBStr));
+		isExplorer = OWIsExplorerApp(appNameBStr);
+		SysFreeString(appNameBStr);
+		if (!isExplorer) {
 			ATLTRACE(_T(" ** Enumerate isn't an explorer window i=%ld"), i);
-			goto fail1;
+			flight.Skip(OW_FLIGHT_NOT_EXPLORER);
+			continue;
 		}
 
 		// Otherwise, we could have the window containing the the enumeration
 		// be included. (It'll display the path of the previous folder, or
 		// display this NSE when you refresh.)
 		TraceHwnd(callerWindow, _T("caller"));
-		if (FAILED(wba->get_HWND(&windowPtr))) {
+		if (!source->GetWindow(i, &window)) {
 			ATLTRACE(_T(" ** Enumerate failed to get the HWND for i=%ld"), i);
-			goto fail1;
+			flight.Skip(OW_FLIGHT_NO_HWND);
+			continue;
 		}
-		window = (HWND)windowPtr;
 		TraceHwnd((HWND)window, _T("received"));
 
 		ATLTRACE(_T(" ** Enumerate i=%ld callerHwnd=%ld vs. receivedHwnd %ld"),
 			i, (long)callerWindow, window);
 		if (callerWindow == window) {
 			ATLTRACE(_T(" ** Enumerate windows are the same i=%ld"), i);
-			goto fail1;
+			flight.Skip(OW_FLIGHT_CALLER);
+			continue;
 		}
 		// On Vista, we don't get a CabinetWClass as the caller, but a
 		// ShellTabWindowClass. Depending on if the sidebar or caller
@@ -229,35 +134,43 @@ long EnumerateExplorerWindows(COWItemList *list, HWND callerWindow)
 			TraceHwnd(parent, _T("parent of caller"));
 			if (parent == window) {
 				ATLTRACE(_T(" ** Enumerate windows are the same (checking parent of caller) i=%ld"), i);
-				goto fail1;
+				flight.Skip(OW_FLIGHT_CALLER);
+				continue;
 			}
 		}
 
 		// Unfortunately, while the folder item strategy is preferred,
 		// it has issues on Me. Fall back to the file:// URI strategy
 		// if it fails.
-		if (!FolderItemStrategy(wba, i, &pathBStr)) {
+		if (!source->GetPath(i, OW_STRATEGY_FOLDER_ITEM, &pathBStr)) {
 			ATLTRACE(_T(" ** Enumerate folder item strat failed i=%ld"), i);
-			if (!FileUriStrategy(wba, i, &pathBStr)) {
+			{
+				COWMetricTimer fallbackTimer(OW_TIMER_ENUM_FALLBACK);
+				gotPath = source->GetPath(i, OW_STRATEGY_FILE_URI, &pathBStr);
+			}
+			if (!gotPath) {
 				ATLTRACE(_T(" ** Enumerate file URI strat failed (bail) i=%ld"), i);
-				goto fail2;
+				flight.Skip(OW_FLIGHT_NO_PATH);
+				continue;
 			}
 		}
+		OW_ALLOC_NOTE(OW_ALLOC_BSTR, SysStringByteLen(pathBStr));
 
 		// A common way to get the name, with any special flair Windows tends
 		// to put on it (like drive labels or the system a remote dir is on).
-		if (FAILED(wba->get_LocationName(&nameBStr))) {
+		if (!source->GetName(i, &nameBStr)) {
 			ATLTRACE(_T(" ** Enumerate can't get name for i=%ld"), i);
+			flight.Skip(OW_FLIGHT_NO_NAME);
 			goto fail3;
 		}
+		OW_ALLOC_NOTE(OW_ALLOC_BSTR, SysStringByteLen(nameBStr));
 
-		nameStr = CString(nameBStr);
-		pathStr = CString(pathBStr);
-		if (pathStr.GetLength() == 0) {
+		switch (OWCheckWindowPath(pathBStr, physPathW)) {
+		case OW_PATH_EMPTY:
 			ATLTRACE(_T(" ** Enumerate empty path string i=%ld"), i);
+			flight.Skip(OW_FLIGHT_EMPTY_PATH);
 			goto fail4;
-		}
-		else if (pathBStr[0] == L':' && pathBStr[1] == L':') {
+		case OW_PATH_NAMESPACE:
 			// This path is some shell namespace world stuff. This on its own
 			// isn't inherently wrong, but it seems a bit random (or not, but
 			// maybe just finicky about path syntax) if it'll actually point
@@ -265,32 +178,38 @@ long EnumerateExplorerWindows(COWItemList *list, HWND callerWindow)
 			// to deal with this, for now, we can just ignore them.
 			// (Or make it toggleable?)
 			ATLTRACE(_T(" ** Enumerate skipping shell namespace i=%ld"), i);
+			flight.Skip(OW_FLIGHT_NAMESPACE);
 			goto fail4;
-		}
-		else if (pathStr == physPath) {
+		case OW_PATH_MANIFESTATION:
 			// I hate this workaround around a workaround. The manifestation
 			// path is used to give a (fake) real FS location for programs silly
 			// enough to require one. This means if you have multiple of our NSE
 			// though, you get ugly "Temp/" entries. Skip them if we encounter one.
 			ATLTRACE(_T(" ** Enumerate path is the manifestation path i=%ld"), i);
+			flight.Skip(OW_FLIGHT_MANIFESTATION);
 			goto fail4;
 		}
 
-		ATLTRACE(_T(" ** Enumerate caught i=%ld # %ld: %s <- %s"), i, realCount, nameStr, pathStr);
+		ATLTRACE(_T(" ** Enumerate caught i=%ld # %ld: %ls <- %ls"), i, realCount, nameBStr, pathBStr);
 		item.SetRank(realCount++);
 		item.SetName(nameBStr);
 		item.SetPath(pathBStr);
+		item.SetWindow(window);
 		list->Add(item);
 
 fail4:
 		SysFreeString(nameBStr);
 fail3:
 		SysFreeString(pathBStr);
-fail2:
-		wba->Release();
-fail1:
-		wba_disp->Release();
 	}
-	windows->Release();
+	source->End();
+	source->SetFlight(NULL);
+	flight.End(realCount);
 	return realCount;
 }
+
+long EnumerateExplorerWindows(COWItemList *list, HWND callerWindow)
+{
+	COWShellWindowSource source;
+	return EnumerateWindows(&source, list, callerWindow);
+}
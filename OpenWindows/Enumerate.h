@@ -23,5 +23,9 @@
 
 
 #include "RootShellFolder.h"
+#include "WindowSource.h"
 
+// Lists the windows from source, skipping the caller's own window.
+long EnumerateWindows(COWWindowSource *source, COWItemList *list, HWND callerWindow);
+// Same, from the shell's open windows
 long EnumerateExplorerWindows(COWItemList *list, HWND callerWindow);
\ No newline at end of file
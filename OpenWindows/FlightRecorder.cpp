@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "FlightRecorder.h"
+#include "Common.h"
+#include "Metrics.h"
+
+//========================================================================================
+// The recorder
+
+// The slowest enumerations, and a min-heap of indexes into them by duration, so the
+// fastest one kept is at the root and is the one to go.
+static OWFlightRecord s_Kept[OW_FLIGHT_KEPT];
+static int s_Heap[OW_FLIGHT_KEPT];
+static int s_KeptCount = 0;
+// The duration to beat once they're all taken; checked before taking the lock
+static volatile LONG s_Floor = 0;
+
+static bool s_SettingsLoaded = false;
+static DWORD s_Threshold = 0;		// microseconds
+static TCHAR s_FlightFile[MAX_PATH];
+// Guards all of the above
+static CRITICAL_SECTION s_Lock;
+
+static const char *s_PhaseNames[OW_FLIGHT_PHASE_MAX] =
+{
+	"Browser", "FullName", "HWND", "Document", "Folder", "Self", "Path", "FileURI", "LocName"
+};
+
+static const char *s_OutcomeNames[OW_FLIGHT_OUTCOME_MAX] =
+{
+	"listed", "no app name", "not explorer", "no HWND", "caller", "no path", "no name",
+	"empty path", "namespace", "manifestation"
+};
+
+void OWFlightInit()
+{
+	InitializeCriticalSection(&s_Lock);
+}
+
+void OWFlightTerm()
+{
+	DeleteCriticalSection(&s_Lock);
+}
+
+// Not from DllMain, the registry might not be ready for us there. Called with the
+// lock held.
+static void LoadSettings()
+{
+	DWORD Value;
+
+	s_SettingsLoaded = true;
+	s_FlightFile[0] = _T('\0');
+	HKEY Key = OWOpenSettings();
+	if (Key == NULL)
+		return;
+
+	if (OWReadSetting(Key, _T("FlightThreshold"), &Value))
+		s_Threshold = Value < 0xFFFFFFFF / 1000 ? Value * 1000 : 0xFFFFFFFF;
+	OWReadSetting(Key, _T("FlightFile"), s_FlightFile, MAX_PATH);
+
+	RegCloseKey(Key);
+}
+
+static inline bool Faster(int a, int b)
+{
+	return s_Kept[s_Heap[a]].Duration < s_Kept[s_Heap[b]].Duration;
+}
+
+static inline void Swap(int a, int b)
+{
+	int t = s_Heap[a];
+	s_Heap[a] = s_Heap[b];
+	s_Heap[b] = t;
+}
+
+static void SiftUp(int i)
+{
+	while (i > 0 && Faster(i, (i - 1) / 2))
+	{
+		Swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void SiftDown(int i)
+{
+	for (;;)
+	{
+		int Child = 2 * i + 1;
+		if (Child >= s_KeptCount)
+			break;
+		if (Child + 1 < s_KeptCount && Faster(Child + 1, Child))
+			Child++;
+		if (!Faster(Child, i))
+			break;
+		Swap(i, Child);
+		i = Child;
+	}
+}
+
+// Keep Record if it's among the slowest. Returns true when it should be saved now.
+static bool Keep(const OWFlightRecord &Record)
+{
+	bool Save;
+
+	if (s_SettingsLoaded && Record.Duration <= (ULONG)s_Floor
+		&& (s_Threshold == 0 || Record.Duration < s_Threshold))
+		return false;
+
+	EnterCriticalSection(&s_Lock);
+	if (!s_SettingsLoaded)
+		LoadSettings();
+
+	if (s_KeptCount < OW_FLIGHT_KEPT)
+	{
+		s_Heap[s_KeptCount] = s_KeptCount;
+		s_Kept[s_KeptCount] = Record;
+		SiftUp(s_KeptCount++);
+	}
+	else if (Record.Duration > s_Kept[s_Heap[0]].Duration)
+	{
+		s_Kept[s_Heap[0]] = Record;
+		SiftDown(0);
+	}
+	if (s_KeptCount == OW_FLIGHT_KEPT)
+		s_Floor = (LONG)s_Kept[s_Heap[0]].Duration;
+
+	Save = s_Threshold != 0 && Record.Duration >= s_Threshold && s_FlightFile[0] != _T('\0');
+	LeaveCriticalSection(&s_Lock);
+	return Save;
+}
+
+//----------------------------------------------------------------------------------------
+// Saving
+
+static bool WriteText(HANDLE File, const char *Text, int Length)
+{
+	DWORD Written;
+	return WriteFile(File, Text, Length, &Written, NULL) && (int)Written == Length;
+}
+
+// Milliseconds with three places, since wsprintf doesn't do floats
+static int FormatMilliseconds(char *Target, ULONG Microseconds)
+{
+	return wsprintfA(Target, "%lu.%03lu ms", Microseconds / 1000, Microseconds % 1000);
+}
+
+static bool WriteRecord(HANDLE File, int Rank, const OWFlightRecord &Record)
+{
+	char Line[512], Total[32], Activation[32];
+	int Length, w, p;
+
+	FormatMilliseconds(Total, Record.Duration);
+	FormatMilliseconds(Activation, Record.Activation);
+	Length = wsprintfA(Line, "#%d  %04u-%02u-%02u %02u:%02u:%02u.%03u  thread %lu  caller 0x%08lX\r\n"
+		"    took %s, %s of it getting %ld windows, listed %ld\r\n",
+		Rank, Record.Time.wYear, Record.Time.wMonth, Record.Time.wDay, Record.Time.wHour,
+		Record.Time.wMinute, Record.Time.wSecond, Record.Time.wMilliseconds,
+		Record.ThreadId, (DWORD)(ULONG_PTR)Record.Caller, Total, Activation,
+		Record.WindowCount, Record.Listed);
+	if (!WriteText(File, Line, Length))
+		return false;
+	if (Record.Timed < Record.WindowCount)
+	{
+		Length = wsprintfA(Line, "    only the slowest %ld windows are here\r\n", Record.Timed);
+		if (!WriteText(File, Line, Length))
+			return false;
+	}
+
+	// A column of microseconds per phase, - when it wasn't called
+	Length = wsprintfA(Line, "    %6s %9s", "window", "total");
+	for (p = 0; p < OW_FLIGHT_PHASE_MAX; p++)
+		Length += wsprintfA(Line + Length, " %9s", s_PhaseNames[p]);
+	Length += wsprintfA(Line + Length, "  (us)\r\n");
+	if (!WriteText(File, Line, Length))
+		return false;
+
+	for (w = 0; w < Record.Timed; w++)
+	{
+		const OWFlightWindow &Window = Record.Windows[w];
+
+		Length = wsprintfA(Line, "    %6u %9lu", Window.Index, Window.Total);
+		for (p = 0; p < OW_FLIGHT_PHASE_MAX; p++)
+		{
+			if (Window.Reached & (1UL << p))
+				Length += wsprintfA(Line + Length, " %9lu", Window.Phases[p]);
+			else
+				Length += wsprintfA(Line + Length, " %9s", "-");
+		}
+		Length += wsprintfA(Line + Length, "  %s\r\n",
+			Window.Outcome < OW_FLIGHT_OUTCOME_MAX ? s_OutcomeNames[Window.Outcome] : "?");
+		if (!WriteText(File, Line, Length))
+			return false;
+	}
+	return WriteText(File, "\r\n", 2);
+}
+
+bool OWFlightSave(LPCTSTR Path)
+{
+	int Order[OW_FLIGHT_KEPT];
+	int Count, i, j;
+	char Line[128];
+	bool Result;
+
+	HANDLE File = CreateFile(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+
+	EnterCriticalSection(&s_Lock);
+
+	// Slowest first; there's only a handful, so insertion sort does
+	Count = s_KeptCount;
+	for (i = 0; i < Count; i++)
+	{
+		int Slot = s_Heap[i];
+		for (j = i; j > 0 && s_Kept[Order[j - 1]].Duration < s_Kept[Slot].Duration; j--)
+			Order[j] = Order[j - 1];
+		Order[j] = Slot;
+	}
+
+	Result = WriteText(File, Line, wsprintfA(Line,
+		"OpenWindows flight record, process %lu, the %d slowest enumerations\r\n\r\n",
+		GetCurrentProcessId(), Count));
+	for (i = 0; Result && i < Count; i++)
+		Result = WriteRecord(File, i + 1, s_Kept[Order[i]]);
+
+	LeaveCriticalSection(&s_Lock);
+
+	CloseHandle(File);
+	return Result;
+}
+
+//========================================================================================
+// COWFlightTimeline
+
+static ULONG ToMicroseconds(LONGLONG Ticks)
+{
+	LONGLONG Frequency = OWMetricsFrequency();
+	if (Frequency <= 0 || Ticks <= 0)
+		return 0;
+	LONGLONG Microseconds = Ticks / Frequency * 1000000 + Ticks % Frequency * 1000000 / Frequency;
+	return Microseconds < 0xFFFFFFFF ? (ULONG)Microseconds : 0xFFFFFFFF;
+}
+
+COWFlightTimeline::COWFlightTimeline(HWND Caller) : m_InWindow(false)
+{
+	memset(&m_Record, 0, sizeof(m_Record));
+	GetLocalTime(&m_Record.Time);
+	m_Record.ThreadId = GetCurrentThreadId();
+	m_Record.Caller = Caller;
+	m_Start = m_WindowStart = m_Last = OWMetricsNow();
+}
+
+void COWFlightTimeline::Activated(long WindowCount)
+{
+	m_Last = OWMetricsNow();
+	m_Record.Activation = ToMicroseconds(m_Last - m_Start);
+	m_Record.WindowCount = WindowCount;
+}
+
+void COWFlightTimeline::BeginWindow(long i)
+{
+	EndWindow();
+
+	memset(&m_Window, 0, sizeof(m_Window));
+	m_Window.Index = (USHORT)i;
+	m_Window.Outcome = OW_FLIGHT_LISTED;
+	m_WindowStart = m_Last = OWMetricsNow();
+	m_InWindow = true;
+}
+
+void COWFlightTimeline::Skip(OWFlightOutcome Outcome)
+{
+	m_Window.Outcome = (USHORT)Outcome;
+}
+
+void COWFlightTimeline::Mark()
+{
+	m_Last = OWMetricsNow();
+}
+
+void COWFlightTimeline::Lap(OWFlightPhase Phase)
+{
+	LONGLONG Now = OWMetricsNow();
+
+	if (m_InWindow)
+	{
+		// Phases can be called more than once, i.e. both path strategies
+		m_Window.Phases[Phase] += ToMicroseconds(Now - m_Last);
+		m_Window.Reached |= 1UL << Phase;
+	}
+	m_Last = Now;
+}
+
+void COWFlightTimeline::EndWindow()
+{
+	int w, Fastest;
+
+	if (!m_InWindow)
+		return;
+	m_InWindow = false;
+	m_Window.Total = ToMicroseconds(OWMetricsNow() - m_WindowStart);
+
+	if (m_Record.Timed < OW_FLIGHT_WINDOWS)
+	{
+		m_Record.Windows[m_Record.Timed++] = m_Window;
+		return;
+	}
+
+	// Full; the fast ones aren't what anyone's looking for
+	Fastest = 0;
+	for (w = 1; w < OW_FLIGHT_WINDOWS; w++)
+	{
+		if (m_Record.Windows[w].Total < m_Record.Windows[Fastest].Total)
+			Fastest = w;
+	}
+	if (m_Window.Total > m_Record.Windows[Fastest].Total)
+	{
+		// Keep them in window order
+		memmove(&m_Record.Windows[Fastest], &m_Record.Windows[Fastest + 1],
+			sizeof(OWFlightWindow) * (OW_FLIGHT_WINDOWS - Fastest - 1));
+		m_Record.Windows[OW_FLIGHT_WINDOWS - 1] = m_Window;
+	}
+}
+
+void COWFlightTimeline::End(long Listed)
+{
+	EndWindow();
+
+	m_Record.Duration = ToMicroseconds(OWMetricsNow() - m_Start);
+	m_Record.Listed = Listed;
+
+	if (Keep(m_Record))
+		OWFlightSave(s_FlightFile);
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __FLIGHTRECORDER_H_
+#define __FLIGHTRECORDER_H_
+
+//========================================================================================
+// Keeps a detailed timeline of the slowest enumerations, for when someone reports that
+// a dialog froze: how long each window took in each call we made to it, and why it
+// wasn't listed, if it wasn't. Only the OW_FLIGHT_KEPT slowest are kept, in a min-heap
+// by duration, so a new one costs O(log K) to keep, and nothing when it's faster than
+// all of them.
+//
+// They're written out as text by SaveFlightRecord, or on their own when an enumeration
+// takes longer than a threshold. Under HKCU\Software\OpenWindows:
+//  FlightThreshold (DWORD)	milliseconds, 0 (the default) to never save on our own
+//  FlightFile (string)		where to save then
+
+enum
+{
+	OW_FLIGHT_KEPT = 8,			// enumerations kept
+	OW_FLIGHT_WINDOWS = 64		// windows per enumeration; the fastest go past that
+};
+
+// The calls made for a window, in order
+enum OWFlightPhase
+{
+	OW_FLIGHT_BROWSER,			// IShellWindows::Item, and the IWebBrowserApp from it
+	OW_FLIGHT_FULL_NAME,		// get_FullName
+	OW_FLIGHT_HWND,				// get_HWND
+	OW_FLIGHT_DOCUMENT,			// the folder item strategy: get_Document,
+	OW_FLIGHT_FOLDER,			// get_Folder,
+	OW_FLIGHT_SELF,				// get_Self,
+	OW_FLIGHT_PATH,				// get_Path
+	OW_FLIGHT_FILE_URI,			// the file URI strategy, get_LocationURL and parsing it
+	OW_FLIGHT_LOCATION_NAME,	// get_LocationName
+
+	OW_FLIGHT_PHASE_MAX
+};
+
+// What became of a window
+enum OWFlightOutcome
+{
+	OW_FLIGHT_LISTED,
+	OW_FLIGHT_NO_APP_NAME,
+	OW_FLIGHT_NOT_EXPLORER,
+	OW_FLIGHT_NO_HWND,
+	OW_FLIGHT_CALLER,			// the window asking, or the one it's in
+	OW_FLIGHT_NO_PATH,			// neither strategy worked
+	OW_FLIGHT_NO_NAME,
+	OW_FLIGHT_EMPTY_PATH,
+	OW_FLIGHT_NAMESPACE,
+	OW_FLIGHT_MANIFESTATION,
+
+	OW_FLIGHT_OUTCOME_MAX
+};
+
+struct OWFlightWindow
+{
+	USHORT Index;				// in the shell's window list
+	USHORT Outcome;
+	ULONG Reached;				// bit per phase that was called
+	ULONG Phases[OW_FLIGHT_PHASE_MAX];	// microseconds
+	ULONG Total;				// microseconds, with our own work in between
+};
+
+struct OWFlightRecord
+{
+	SYSTEMTIME Time;			// local time it started, for matching up with reports
+	DWORD ThreadId;
+	HWND Caller;
+	ULONG Duration;				// microseconds
+	ULONG Activation;			// microseconds to get the window list
+	long WindowCount;
+	long Listed;
+	long Timed;					// windows in Windows, at most OW_FLIGHT_WINDOWS
+	OWFlightWindow Windows[OW_FLIGHT_WINDOWS];
+};
+
+// Call once from DllMain, and once at the end.
+void OWFlightInit();
+void OWFlightTerm();
+
+// Write what's kept, slowest first
+bool OWFlightSave(LPCTSTR Path);
+
+//========================================================================================
+// Recording one enumeration. EnumerateWindows() drives it, and the window source marks
+// the calls it makes.
+
+class COWFlightTimeline
+{
+public:
+	COWFlightTimeline(HWND Caller);
+
+	// After the window list was had
+	void Activated(long WindowCount);
+
+	// Start timing window i; the window before it is done.
+	void BeginWindow(long i);
+	// Why the current window isn't listed
+	void Skip(OWFlightOutcome Outcome);
+
+	// Start a phase now, leaving what came before out of it
+	void Mark();
+	// End Phase now, counting from the last Mark() or Lap()
+	void Lap(OWFlightPhase Phase);
+
+	// Keep the timeline, if it's among the slowest
+	void End(long Listed);
+
+protected:
+	void EndWindow();
+
+	OWFlightRecord m_Record;
+	LONGLONG m_Start;
+	LONGLONG m_WindowStart;
+	LONGLONG m_Last;
+	OWFlightWindow m_Window;
+	bool m_InWindow;
+};
+
+// The window source's calls go through these, since it might not have a timeline
+#define OW_FLIGHT_MARK(Flight) \
+	do { if ((Flight) != NULL) (Flight)->Mark(); } while (0)
+#define OW_FLIGHT_LAP(Flight, Phase) \
+	do { if ((Flight) != NULL) (Flight)->Lap(Phase); } while (0)
+
+#endif // __FLIGHTRECORDER_H_
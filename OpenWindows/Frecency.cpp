@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "Frecency.h"
+#include "Common.h"
+#include "OWFrecency.h"
+
+//========================================================================================
+// The file
+
+// In the Local\ namespace when there is one
+#define OW_FRECENCY_LOCK "OpenWindowsFrecencyLock"
+
+static bool s_SettingsLoaded = false;
+static bool s_Enabled = true;
+static TCHAR s_FrecencyFile[MAX_PATH];
+// Set once, after s_Table, and then the table is read without s_Lock
+static volatile bool s_Opened = false;
+static OWFrecencyTable * volatile s_Table = NULL;
+static HANDLE s_File = INVALID_HANDLE_VALUE;
+static HANDLE s_Mapping = NULL;
+// Guards writing to the table between processes
+static HANDLE s_FileLock = NULL;
+// Guards opening it
+static CRITICAL_SECTION s_Lock;
+
+void OWFrecencyInit()
+{
+	InitializeCriticalSection(&s_Lock);
+}
+
+void OWFrecencyTerm()
+{
+	if (s_Table != NULL)
+		UnmapViewOfFile(s_Table);
+	if (s_Mapping != NULL)
+		CloseHandle(s_Mapping);
+	if (s_File != INVALID_HANDLE_VALUE)
+		CloseHandle(s_File);
+	if (s_FileLock != NULL)
+		CloseHandle(s_FileLock);
+	DeleteCriticalSection(&s_Lock);
+}
+
+// Not from DllMain: the registry can load other DLLs.
+static void LoadSettings()
+{
+	DWORD Value;
+
+	s_SettingsLoaded = true;
+	s_FrecencyFile[0] = _T('\0');
+	HKEY Key = OWOpenSettings();
+	if (Key == NULL)
+		return;
+
+	if (OWReadSetting(Key, _T("Frecency"), &Value))
+		s_Enabled = Value != 0;
+	OWReadSetting(Key, _T("FrecencyFile"), s_FrecencyFile, MAX_PATH);
+
+	RegCloseKey(Key);
+}
+
+// Called with s_Lock, once
+static void Open()
+{
+	TCHAR Path[MAX_PATH];
+	void *View;
+
+	if (!s_SettingsLoaded)
+		LoadSettings();
+	if (!s_Enabled)
+		return;
+
+	if (s_FrecencyFile[0] != _T('\0'))
+		lstrcpyn(Path, s_FrecencyFile, MAX_PATH);
+	else if (!OWGetDataFile(_T("Frecency.owf"), Path))
+		return;
+
+	s_FileLock = OWCreateLocalMutex(OW_FRECENCY_LOCK);
+	if (s_FileLock == NULL)
+		return;
+
+	s_File = CreateFile(Path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (s_File == INVALID_HANDLE_VALUE)
+		return;
+
+	// A new file grows to the size of the mapping
+	s_Mapping = CreateFileMapping(s_File, NULL, PAGE_READWRITE, 0, sizeof(OWFrecencyTable), NULL);
+	if (s_Mapping == NULL)
+		return;
+	View = MapViewOfFile(s_Mapping, FILE_MAP_WRITE, 0, 0, sizeof(OWFrecencyTable));
+	if (View == NULL)
+		return;
+
+	// New, or from another version
+	if (OWTakeLock(s_FileLock))
+	{
+		if (!OWFrecencyCheck((OWFrecencyTable*)View))
+			OWFrecencyFormat((OWFrecencyTable*)View);
+		ReleaseMutex(s_FileLock);
+	}
+	s_Table = (OWFrecencyTable*)View;
+}
+
+// NULL when there's no table to be had
+static OWFrecencyTable *GetTable()
+{
+	if (s_Opened)
+		return s_Table;
+
+	EnterCriticalSection(&s_Lock);
+	if (!s_Opened)
+	{
+		Open();
+		s_Opened = true;
+	}
+	LeaveCriticalSection(&s_Lock);
+	return s_Table;
+}
+
+//========================================================================================
+// Scores
+
+void OWFrecencyNoteVisit(LPCWSTR Path)
+{
+	FILETIME Now;
+
+	OWFrecencyTable *Table = GetTable();
+	if (Table == NULL)
+		return;
+
+	GetSystemTimeAsFileTime(&Now);
+	unsigned Hash = OWFrecencyHash(Path, wcslen(Path));
+	if (OWTakeLock(s_FileLock))
+	{
+		OWFrecencyTouch(Table, Hash, ((OWUINT64)Now.dwHighDateTime << 32) | Now.dwLowDateTime);
+		ReleaseMutex(s_FileLock);
+	}
+}
+
+void OWFrecencyNoteActivations(const COWItemList &Items, const OWUINT64 *Times)
+{
+	int Count = Items.GetSize(), i;
+
+	OWFrecencyTable *Table = GetTable();
+	if (Table == NULL || !OWTakeLock(s_FileLock))
+		return;
+
+	// OWFrecencyTouch turns down a time not past the slot's last visit
+	for (i = 0; i < Count; i++)
+	{
+		if (Times[i] == 0)
+			continue;
+		LPCWSTR Path = Items[i].GetPath();
+		OWFrecencyTouch(Table, OWFrecencyHash(Path, wcslen(Path)), Times[i]);
+	}
+	ReleaseMutex(s_FileLock);
+}
+
+void OWFrecencyOrder(COWItemList *Items)
+{
+	int Count = Items->GetSize(), i, j;
+	bool Moved = false;
+
+	OWFrecencyTable *Table = GetTable();
+	if (Table == NULL || Count < 2)
+		return;
+
+	float *Keys = new float[Count];
+	int *Order = new int[Count];
+	if (Keys == NULL || Order == NULL)
+	{
+		delete [] Keys;
+		delete [] Order;
+		return;
+	}
+
+	// Best first, and stable. Few windows have been picked, so few move.
+	for (i = 0; i < Count; i++)
+	{
+		LPCWSTR Path = (*Items)[i].GetPath();
+		float Key = OWFrecencyGetKey(Table, OWFrecencyHash(Path, wcslen(Path)));
+		for (j = i; j > 0 && Keys[j - 1] < Key; j--)
+		{
+			Keys[j] = Keys[j - 1];
+			Order[j] = Order[j - 1];
+			Moved = true;
+		}
+		Keys[j] = Key;
+		Order[j] = i;
+	}
+
+	if (Moved)
+		OWReorderItems(Items, Order);
+
+	delete [] Keys;
+	delete [] Order;
+}
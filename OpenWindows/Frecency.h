@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __FRECENCY_H_
+#define __FRECENCY_H_
+
+#include "ShellItems.h"
+
+//========================================================================================
+// Puts the windows most worth having first: the ones picked from us most, and most
+// lately (see OWFrecency.h for the score). A pick is a bind to the item, which is what
+// browsing into it does, or the file dialogs asking for its data object. Switching to
+// the window counts as well: the activations are watched without a path (see
+// Activation.h), so they're counted late, when the windows are next listed, each once.
+//
+// The scores are kept in one file per user, next to the history (see History.h), that
+// every process hosting us maps on first use. Picks take a mutex; ordering the windows
+// only reads the mapping, without any lock.
+//
+// Under HKCU\Software\OpenWindows:
+//  Frecency (DWORD)		0 to list the windows in the order the shell gives them
+//  FrecencyFile (string)	where the file is, instead of OpenWindows\Frecency.owf
+
+// Call once from DllMain, and once at the end.
+void OWFrecencyInit();
+void OWFrecencyTerm();
+
+// The window at Path was picked
+void OWFrecencyNoteVisit(LPCWSTR Path);
+
+// Each window was activated at its time in Times, a FILETIME, or never if 0. The ones
+// counted already, by us or by another process, are left alone.
+void OWFrecencyNoteActivations(const COWItemList &Items, const OWUINT64 *Times);
+
+// Put the windows best scored first, and rank them in that order. The ones never
+// picked keep the order they're in, after the others.
+void OWFrecencyOrder(COWItemList *Items);
+
+#endif // __FRECENCY_H_
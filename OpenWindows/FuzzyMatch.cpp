@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// No stdafx.h here on purpose; this builds without Windows.
+#include "FuzzyMatch.h"
+
+// SSE2 is always there on x64. VC++6 doesn't know about it at all, and we still
+// want the x86 build to run on whatever 9x box it's thrown at.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define OW_FUZZY_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//========================================================================================
+// Scoring constants, after fzf
+
+enum
+{
+	SCORE_MATCH = 16,
+	SCORE_GAP_START = -3,
+	SCORE_GAP_EXTENSION = -1,
+	BONUS_BOUNDARY = 8,			// match right after a separator, or at the start
+	BONUS_CONSECUTIVE = 4,		// match right after another match
+	BONUS_NAME = 2,				// match in the display name rather than the path
+	BONUS_FIRST_CHAR_MULTIPLIER = 2
+};
+
+// The separator the search index puts between the name and the path
+#define NAME_PATH_SEPARATOR '\1'
+
+static bool IsBoundary(OWCHAR c)
+{
+	return c == '\\' || c == '/' || c == ' ' || c == '_' || c == '-'
+		|| c == '.' || c == '(' || c == NAME_PATH_SEPARATOR;
+}
+
+//========================================================================================
+// Helpers
+
+OWUINT64 OWFuzzyCharMask(const OWCHAR *Text)
+{
+	OWUINT64 Mask = 0;
+	while (*Text)
+		Mask |= (OWUINT64)1 << (*Text++ & 63);
+	return Mask;
+}
+
+// Returns the first occurence of c before End, or End.
+static const OWCHAR *FindChar(const OWCHAR *Text, const OWCHAR *End, OWCHAR c)
+{
+#ifdef OW_FUZZY_SSE2
+	// Only whole blocks of 8 chars before End are loaded, so nothing past the
+	// terminator is read (ASan would rightly complain); the tail is done a char at
+	// a time below.
+	const __m128i Wanted = _mm_set1_epi16((short)c);
+
+	for (; End - Text >= 8; Text += 8)
+	{
+		__m128i Chars = _mm_loadu_si128((const __m128i*)Text);
+		int Mask = _mm_movemask_epi8(_mm_cmpeq_epi16(Chars, Wanted));
+		if (Mask != 0)
+		{
+#ifdef _MSC_VER
+			unsigned long Bit;
+			_BitScanForward(&Bit, Mask);
+#else
+			int Bit = __builtin_ctz(Mask);
+#endif
+			return Text + Bit / sizeof(OWCHAR);
+		}
+	}
+#endif
+	while (Text < End && *Text != c)
+		Text++;
+	return Text;
+}
+
+//========================================================================================
+// Scoring
+
+int OWFuzzyScore(const OWCHAR *Text, const OWCHAR *Pattern)
+{
+	size_t PatternLength = OWStrLen(Pattern);
+	const OWCHAR *TextEnd = Text + OWStrLen(Text);
+	size_t i;
+
+	if (PatternLength == 0)
+		return 0;
+
+	// Forward pass: the earliest place where the whole pattern has been seen
+	const OWCHAR *Scan = Text;
+	for (i = 0; i < PatternLength; i++)
+	{
+		Scan = FindChar(Scan, TextEnd, Pattern[i]);
+		if (Scan == TextEnd)
+			return OW_FUZZY_NOMATCH;
+		Scan++;
+	}
+	int End = Scan - Text;
+
+	// Backward pass: the latest start for that end, which is the tightest match
+	int Start = End - 1;
+	int p = PatternLength - 1;
+	for (; Start >= 0; Start--)
+	{
+		if (Text[Start] == Pattern[p])
+		{
+			if (p == 0)
+				break;
+			p--;
+		}
+	}
+
+	// Score the window
+	int Score = 0;
+	int Position;
+	bool InGap = false, PreviousMatched = false;
+	const OWCHAR *Separator = FindChar(Text, TextEnd, NAME_PATH_SEPARATOR);
+	bool InName = Text + Start < Separator;
+	p = 0;
+
+	for (Position = Start; Position < End; Position++)
+	{
+		OWCHAR c = Text[Position];
+
+		if (c == NAME_PATH_SEPARATOR)
+			InName = false;
+
+		if (p < (int)PatternLength && c == Pattern[p])
+		{
+			int Bonus = 0;
+			if (Position == 0 || IsBoundary(Text[Position-1]))
+				Bonus = BONUS_BOUNDARY;
+			if (PreviousMatched && Bonus < BONUS_CONSECUTIVE)
+				Bonus = BONUS_CONSECUTIVE;
+			if (p == 0)
+				Bonus *= BONUS_FIRST_CHAR_MULTIPLIER;
+
+			Score += SCORE_MATCH + Bonus;
+			if (InName)
+				Score += BONUS_NAME;
+
+			p++;
+			InGap = false;
+			PreviousMatched = true;
+		}
+		else
+		{
+			Score += InGap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+			InGap = true;
+			PreviousMatched = false;
+		}
+	}
+
+	// A score of zero is still a match; keep OW_FUZZY_NOMATCH unambiguous
+	return Score < 0 ? 0 : Score;
+}
+
+int OWFuzzyScoreBatch(const OWCHAR *Pattern, const OWCHAR * const *Texts, const OWUINT64 *Masks,
+	const int *Candidates, int Count, int *Scores)
+{
+	OWUINT64 PatternMask = OWFuzzyCharMask(Pattern);
+	int i, Matched = 0;
+
+	// First reject everything missing one of the pattern's chars. This is a tight
+	// loop over the masks only, and usually eliminates most candidates without
+	// touching their text.
+	for (i = 0; i < Count; i++)
+		Scores[i] = (PatternMask & ~Masks[Candidates[i]]) ? OW_FUZZY_NOMATCH : 0;
+
+	for (i = 0; i < Count; i++)
+	{
+		if (Scores[i] == OW_FUZZY_NOMATCH)
+			continue;
+
+		Scores[i] = OWFuzzyScore(Texts[Candidates[i]], Pattern);
+		if (Scores[i] != OW_FUZZY_NOMATCH)
+			Matched++;
+	}
+
+	return Matched;
+}
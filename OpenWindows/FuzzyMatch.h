@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __FUZZYMATCH_H_
+#define __FUZZYMATCH_H_
+
+//========================================================================================
+// Subsequence ("fuzzy") matching, scored the way fzf does it: every matched char is
+// worth something, runs of consecutive chars and chars starting a word are worth more,
+// and gaps cost. Both the text and the pattern must be normalized (upper case).
+//
+// Like OWCore.h, this doesn't include Windows headers, so it's tested and timed with
+// the rest of the core.
+
+#include "OWCore.h"
+
+// Returned for texts that don't contain the pattern as a subsequence
+#define OW_FUZZY_NOMATCH (-1)
+
+// Which chars (folded to 6 bits) appear in the string. A text can only match a
+// pattern if it has every bit of the pattern's mask.
+OWUINT64 OWFuzzyCharMask(const OWCHAR *Text);
+
+// Score a single text. Higher is better, OW_FUZZY_NOMATCH when it doesn't match.
+int OWFuzzyScore(const OWCHAR *Text, const OWCHAR *Pattern);
+
+// Score Count candidates at once. Candidates are rejected in bulk with their
+// precomputed masks before any of them is scanned. Returns how many matched.
+int OWFuzzyScoreBatch(const OWCHAR *Pattern, const OWCHAR * const *Texts, const OWUINT64 *Masks,
+	const int *Candidates, int Count, int *Scores);
+
+#endif // __FUZZYMATCH_H_
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include "stdafx.h"
+#include "Groups.h"
+#include "Common.h"
+
+//========================================================================================
+// Settings
+
+typedef BOOL (WINAPI *SHGetSpecialFolderPathProc)(HWND, LPTSTR, int, BOOL);
+
+// The known folders that get a group. The user's own folder comes last, for the ones
+// in it that aren't in another.
+static const int s_KnownIds[] =
+{
+	0x0010,		// CSIDL_DESKTOPDIRECTORY
+	0x0005,		// CSIDL_PERSONAL
+	0x0027,		// CSIDL_MYPICTURES
+	0x000d,		// CSIDL_MYMUSIC
+	0x000e,		// CSIDL_MYVIDEO
+	0x0028		// CSIDL_PROFILE
+};
+
+enum { KNOWN_MAX = sizeof(s_KnownIds) / sizeof(s_KnownIds[0]) };
+
+static bool s_SettingsLoaded = false;
+static bool s_Enabled = false;
+static wchar_t s_Known[KNOWN_MAX][MAX_PATH];
+static int s_KnownCount = 0;
+// Guards all of the above
+static CRITICAL_SECTION s_Lock;
+
+void OWGroupsInit()
+{
+	InitializeCriticalSection(&s_Lock);
+}
+
+void OWGroupsTerm()
+{
+	DeleteCriticalSection(&s_Lock);
+}
+
+// Not from DllMain: the registry can load other DLLs, and so can the shell.
+static void LoadSettings()
+{
+	HKEY Key;
+	DWORD Value;
+	TCHAR Path[MAX_PATH];
+	int i;
+
+	s_SettingsLoaded = true;
+	if ((Key = OWOpenSettings()) != NULL)
+	{
+		if (OWReadSetting(Key, _T("Grouping"), &Value))
+			s_Enabled = Value != 0;
+		RegCloseKey(Key);
+	}
+	if (!s_Enabled)
+		return;
+
+	// Only there since the desktop update on 95 and NT 4, and the older ones don't
+	// know all of the folders
+	HMODULE Shell = GetModuleHandle(_T("shell32.dll"));
+	SHGetSpecialFolderPathProc GetFolderPath = NULL;
+	if (Shell != NULL)
+#ifdef _UNICODE
+		GetFolderPath = (SHGetSpecialFolderPathProc)GetProcAddress(Shell, "SHGetSpecialFolderPathW");
+#else
+		GetFolderPath = (SHGetSpecialFolderPathProc)GetProcAddress(Shell, "SHGetSpecialFolderPathA");
+#endif
+	if (GetFolderPath == NULL)
+		return;
+
+	for (i = 0; i < KNOWN_MAX; i++)
+	{
+		if (!GetFolderPath(NULL, Path, s_KnownIds[i], FALSE) || Path[0] == _T('\0'))
+			continue;
+#ifdef _UNICODE
+		wcsncpy(s_Known[s_KnownCount], Path, MAX_PATH);
+		s_Known[s_KnownCount][MAX_PATH-1] = L'\0';
+#else
+		if (MultiByteToWideChar(CP_ACP, 0, Path, -1, s_Known[s_KnownCount], MAX_PATH) == 0)
+			continue;
+#endif
+		s_KnownCount++;
+	}
+}
+
+bool OWGroupingEnabled()
+{
+	EnterCriticalSection(&s_Lock);
+	if (!s_SettingsLoaded)
+		LoadSettings();
+	bool Enabled = s_Enabled;
+	LeaveCriticalSection(&s_Lock);
+	return Enabled;
+}
+
+// The known folders don't change once loaded
+static int GetKnownFolders(const OWCHAR **Known)
+{
+	int i;
+
+	if (!OWGroupingEnabled())
+		return 0;
+	for (i = 0; i < s_KnownCount; i++)
+		Known[i] = s_Known[i];
+	return s_KnownCount;
+}
+
+//========================================================================================
+// COWGroupIndex
+
+COWGroupIndex::COWGroupIndex() : m_Members(NULL), m_Ungrouped(0), m_UngroupedCount(0)
+{
+}
+
+COWGroupIndex::~COWGroupIndex()
+{
+	delete [] m_Members;
+}
+
+void COWGroupIndex::RemoveAll()
+{
+	m_Keys.RemoveAll();
+	m_Groups.RemoveAll();
+	delete [] m_Members;
+	m_Members = NULL;
+	m_Ungrouped = 0;
+	m_UngroupedCount = 0;
+}
+
+// Known folders go by their own name, drives and servers by their key
+void COWGroupIndex::MakeName(int Kind, LPCWSTR Key, LPWSTR Name)
+{
+	LPCWSTR Last = Key;
+	LPCWSTR p;
+
+	if (Kind == OW_GROUP_KNOWN)
+	{
+		for (p = Key; *p != L'\0'; p++)
+		{
+			if ((*p == L'\\' || *p == L'/') && p[1] != L'\0')
+				Last = p + 1;
+		}
+	}
+	wcsncpy(Name, Last, MAX_PATH);
+	Name[MAX_PATH-1] = L'\0';
+}
+
+bool COWGroupIndex::Build(COWItemList &Items)
+{
+	const OWCHAR *Known[KNOWN_MAX];
+	wchar_t Key[MAX_PATH], Normalized[MAX_PATH];
+	int Count = Items.GetSize(), KnownCount, Kind, Index, i;
+	int Position = 0, Ungrouped = 0;
+
+	RemoveAll();
+	KnownCount = GetKnownFolders(Known);
+
+	int *ItemGroups = new int[Count + 1];
+	m_Members = new int[Count + 1];
+	if (ItemGroups == NULL || m_Members == NULL)
+	{
+		delete [] ItemGroups;
+		RemoveAll();
+		return false;
+	}
+
+	// Which group each item is in, making the groups as they come
+	m_Keys.BeginUpdate();
+	for (i = 0; i < Count; i++)
+	{
+		ItemGroups[i] = -1;
+		Kind = OWGroupPath(Items[i].GetPath(), Known, KnownCount, Key, &Index);
+		if (Kind == OW_GROUP_NONE)
+		{
+			m_UngroupedCount++;
+			continue;
+		}
+
+		COWStringIndex::Normalize(Key, Normalized, false);
+		int Found = m_Keys.Find(Normalized);
+		if (Found < 0)
+		{
+			Group New;
+			wcsncpy(New.Key, Key, MAX_PATH);
+			New.Key[MAX_PATH-1] = L'\0';
+			MakeName(Kind, Key, New.Name);
+			New.First = 0;
+			New.Count = 0;
+
+			Found = m_Groups.GetSize();
+			if (!m_Groups.Add(New) || !m_Keys.Set(Normalized, Found))
+			{
+				delete [] ItemGroups;
+				RemoveAll();
+				return false;
+			}
+		}
+		m_Groups[Found].Count++;
+		ItemGroups[i] = Found;
+	}
+	m_Keys.EndUpdate();
+
+	// Then lay them out a group after the other
+	for (i = 0; i < m_Groups.GetSize(); i++)
+	{
+		m_Groups[i].First = Position;
+		Position += m_Groups[i].Count;
+		m_Groups[i].Count = 0;
+	}
+	m_Ungrouped = Position;
+	for (i = 0; i < Count; i++)
+	{
+		if (ItemGroups[i] < 0)
+			m_Members[m_Ungrouped + Ungrouped++] = i;
+		else
+		{
+			Group &Into = m_Groups[ItemGroups[i]];
+			m_Members[Into.First + Into.Count++] = i;
+		}
+	}
+
+	delete [] ItemGroups;
+	return true;
+}
+
+int COWGroupIndex::Find(LPCWSTR Key) const
+{
+	return m_Keys.Find(Key);
+}
+
+int COWGroupIndex::FindName(LPCWSTR Name) const
+{
+	int i;
+
+	// There are few groups
+	for (i = 0; i < m_Groups.GetSize(); i++)
+	{
+		if (_wcsicmp(m_Groups[i].Name, Name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+const int *COWGroupIndex::GetMembers(int Group, int *pCount) const
+{
+	*pCount = m_Groups[Group].Count;
+	return m_Members + m_Groups[Group].First;
+}
+
+const int *COWGroupIndex::GetUngrouped(int *pCount) const
+{
+	*pCount = m_UngroupedCount;
+	return m_Members != NULL ? m_Members + m_Ungrouped : NULL;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef __GROUPS_H_
+#define __GROUPS_H_
+
+#include "ShellItems.h"
+#include "WindowIndex.h"
+
+//========================================================================================
+// Optional grouping of the windows in folders of their own below the root: one for each
+// drive, each server, and each known folder (Desktop, Documents, and so on) that has
+// windows in it, see OWGroupPath(). Windows in none stay in the root.
+//
+// Under HKCU\Software\OpenWindows:
+//  Grouping (DWORD)		1 to group the windows, instead of listing them all in the root
+
+// Call once from DllMain, and once at the end.
+void OWGroupsInit();
+void OWGroupsTerm();
+
+bool OWGroupingEnabled();
+
+//========================================================================================
+// Which items of a snapshot are in which group. Each group's items are kept together,
+// so listing a group costs as much as the items in it, and groups are found by key
+// with a single hash lookup.
+
+class COWGroupIndex
+{
+public:
+	COWGroupIndex();
+	~COWGroupIndex();
+
+	// Group the items. false when out of memory, and then there are no groups.
+	bool Build(COWItemList &Items);
+	void RemoveAll();
+
+	int GetCount() const { return m_Groups.GetSize(); }
+	LPCWSTR GetKey(int Group) const { return m_Groups[Group].Key; }
+	LPCWSTR GetName(int Group) const { return m_Groups[Group].Name; }
+
+	// The group, or -1
+	int Find(LPCWSTR Key) const;
+	int FindName(LPCWSTR Name) const;
+
+	// The items of the group, in the order of the snapshot
+	const int *GetMembers(int Group, int *pCount) const;
+	// The items in no group, in the order of the snapshot
+	const int *GetUngrouped(int *pCount) const;
+
+protected:
+	struct Group
+	{
+		wchar_t Key[MAX_PATH];
+		wchar_t Name[MAX_PATH];
+		int First;				// in m_Members
+		int Count;
+	};
+
+	static void MakeName(int Kind, LPCWSTR Key, LPWSTR Name);
+
+	// Normalized keys to their group
+	COWStringIndex m_Keys;
+	COWSimpleArray<Group> m_Groups;
+	// Item indexes, a group after the other, and the ungrouped ones last
+	int *m_Members;
+	int m_Ungrouped;
+	int m_UngroupedCount;
+};
+
+#endif // __GROUPS_H_
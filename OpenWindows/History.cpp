@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "History.h"
+#include "Common.h"
+
+//========================================================================================
+// The file
+
+// In the Local\ namespace when there is one
+#define OW_HISTORY_LOCK "OpenWindowsHistoryLock"
+
+static bool s_SettingsLoaded = false;
+static bool s_Enabled = true;
+static TCHAR s_HistoryFile[MAX_PATH];
+// Opened on first use, then kept
+static bool s_Opened = false;
+static HANDLE s_File = INVALID_HANDLE_VALUE;
+static HANDLE s_Mapping = NULL;
+static void *s_View = NULL;
+// Guards the file between processes
+static HANDLE s_FileLock = NULL;
+// Guards all of the above
+static CRITICAL_SECTION s_Lock;
+
+void OWHistoryInit()
+{
+	InitializeCriticalSection(&s_Lock);
+}
+
+void OWHistoryTerm()
+{
+	if (s_View != NULL)
+		UnmapViewOfFile(s_View);
+	if (s_Mapping != NULL)
+		CloseHandle(s_Mapping);
+	if (s_File != INVALID_HANDLE_VALUE)
+		CloseHandle(s_File);
+	if (s_FileLock != NULL)
+		CloseHandle(s_FileLock);
+	DeleteCriticalSection(&s_Lock);
+}
+
+// Not from DllMain: the registry can load other DLLs.
+static void LoadSettings()
+{
+	DWORD Value;
+
+	s_SettingsLoaded = true;
+	s_HistoryFile[0] = _T('\0');
+	HKEY Key = OWOpenSettings();
+	if (Key == NULL)
+		return;
+
+	if (OWReadSetting(Key, _T("History"), &Value))
+		s_Enabled = Value != 0;
+	OWReadSetting(Key, _T("HistoryFile"), s_HistoryFile, MAX_PATH);
+
+	RegCloseKey(Key);
+}
+
+// Map the file, the first time. Called with s_Lock.
+static bool Open()
+{
+	TCHAR Path[MAX_PATH];
+
+	if (s_Opened)
+		return s_View != NULL;
+	s_Opened = true;
+
+	if (!s_SettingsLoaded)
+		LoadSettings();
+	if (!s_Enabled)
+		return false;
+
+	if (s_HistoryFile[0] != _T('\0'))
+		lstrcpyn(Path, s_HistoryFile, MAX_PATH);
+	else if (!OWGetDataFile(_T("History.owh"), Path))
+		return false;
+
+	s_FileLock = OWCreateLocalMutex(OW_HISTORY_LOCK);
+	if (s_FileLock == NULL)
+		return false;
+
+	s_File = CreateFile(Path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (s_File == INVALID_HANDLE_VALUE)
+		return false;
+
+	// A new file grows to the size of the mapping
+	s_Mapping = CreateFileMapping(s_File, NULL, PAGE_READWRITE, 0, OW_HISTORY_SIZE, NULL);
+	if (s_Mapping == NULL)
+		return false;
+	s_View = MapViewOfFile(s_Mapping, FILE_MAP_WRITE, 0, 0, OW_HISTORY_SIZE);
+	if (s_View == NULL)
+		return false;
+
+	// New, from another version, or damaged beyond reading
+	if (OWTakeLock(s_FileLock))
+	{
+		if (!OWHistoryCheck(s_View, OW_HISTORY_SIZE))
+			OWHistoryFormat(s_View, OW_HISTORY_SIZE);
+		ReleaseMutex(s_FileLock);
+	}
+	return true;
+}
+
+//========================================================================================
+// Records
+
+// Called with both locks
+static void Compact()
+{
+	unsigned char *Compacted = new unsigned char[OW_HISTORY_SIZE];
+	if (Compacted == NULL)
+		return;
+
+	OWHistoryCompact(s_View, Compacted, OW_HISTORY_SIZE, OW_HISTORY_KEEP);
+	memcpy(s_View, Compacted, OW_HISTORY_SIZE);
+	delete [] Compacted;
+}
+
+// Called with both locks
+static void Append(int Kind, const COWItem &Item, OWUINT64 Time)
+{
+	OWItemData Data;
+	OWHistoryRecord Record;
+
+	Item.GetData(&Data);
+	Record.Kind = Kind;
+	Record.Time = Time;
+	Record.Path = Data.Path;
+	Record.PathLength = Data.PathLength;
+	Record.Name = Data.Name;
+	Record.NameLength = Data.NameLength;
+
+	if (OWHistoryGetCount(s_View) < OW_HISTORY_COMPACT_AT && OWHistoryAppend(s_View, &Record))
+		return;
+
+	Compact();
+	OWHistoryAppend(s_View, &Record);
+}
+
+// Is the latest record about Path of this kind?
+static bool LatestIs(const COWItem &Item, int Kind)
+{
+	OWHistoryRecord Latest;
+
+	if (!OWHistoryFindLatest(s_View, Item.GetPath(), wcslen(Item.GetPath()), &Latest))
+		return false;
+	return Latest.Kind == Kind;
+}
+
+static int FindPath(const COWItemList &Items, LPCWSTR Path)
+{
+	int i;
+
+	for (i = 0; i < Items.GetSize(); i++)
+	{
+		if (OWStrCmp(Items[i].GetPath(), Path) == 0)
+			return i;
+	}
+	return -1;
+}
+
+bool OWHistoryEnabled()
+{
+	EnterCriticalSection(&s_Lock);
+	if (!s_SettingsLoaded)
+		LoadSettings();
+	bool Enabled = s_Enabled;
+	LeaveCriticalSection(&s_Lock);
+	return Enabled;
+}
+
+void OWHistoryNoteWindows(const COWItemList *Previous, const COWItemList &Windows)
+{
+	FILETIME Now;
+	OWUINT64 Time;
+	int i;
+
+	GetSystemTimeAsFileTime(&Now);
+	Time = ((OWUINT64)Now.dwHighDateTime << 32) | Now.dwLowDateTime;
+
+	EnterCriticalSection(&s_Lock);
+	if (Open() && OWTakeLock(s_FileLock))
+	{
+		// Other processes' folders saw the same windows go, so they can be in already
+		if (Previous != NULL)
+		{
+			for (i = 0; i < Previous->GetSize(); i++)
+			{
+				const COWItem &Item = (*Previous)[i];
+				if (FindPath(Windows, Item.GetPath()) < 0 && !LatestIs(Item, OW_HISTORY_CLOSED))
+					Append(OW_HISTORY_CLOSED, Item, Time);
+			}
+		}
+
+		// Windows that are back are taken off the list
+		for (i = 0; i < Windows.GetSize(); i++)
+		{
+			const COWItem &Item = Windows[i];
+			if ((Previous == NULL || FindPath(*Previous, Item.GetPath()) < 0) && LatestIs(Item, OW_HISTORY_CLOSED))
+				Append(OW_HISTORY_OPENED, Item, Time);
+		}
+
+		ReleaseMutex(s_FileLock);
+	}
+	LeaveCriticalSection(&s_Lock);
+}
+
+void OWHistoryGetRecent(COWItemList *Items, int Max)
+{
+	OWHistoryRecord *Records = new OWHistoryRecord[Max];
+	int Count = 0, i;
+
+	if (Records == NULL)
+		return;
+
+	EnterCriticalSection(&s_Lock);
+	if (Open() && OWTakeLock(s_FileLock))
+	{
+		// The records point into the mapping, so they're only good until it's let go
+		Count = OWHistoryRecent(s_View, Records, Max);
+		for (i = 0; i < Count; i++)
+		{
+			COWItem Item;
+			Item.SetRank(i);
+			Item.SetPath(Records[i].Path);
+			Item.SetName(Records[i].NameLength != 0 ? Records[i].Name : Records[i].Path);
+			Items->Add(Item);
+		}
+		ReleaseMutex(s_FileLock);
+	}
+	LeaveCriticalSection(&s_Lock);
+
+	delete [] Records;
+}
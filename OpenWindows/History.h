@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __HISTORY_H_
+#define __HISTORY_H_
+
+#include "ShellItems.h"
+#include "OWHistory.h"
+
+//========================================================================================
+// The windows that were closed recently, for the folder to offer them again (see
+// OWHistory.h for the file). The windows are only ever enumerated, so a window a folder
+// found before and doesn't find anymore is taken as closed; that catches windows that
+// went to another folder too, and where they were is as likely to be wanted back.
+//
+// There's one file per user, mapped by every process hosting us on first use and kept
+// until we're unloaded, with a mutex around every use of it. Reading it only walks the
+// mapping, so listing the closed windows costs no file I/O.
+//
+// Under HKCU\Software\OpenWindows:
+//  History (DWORD)			0 to keep no history, and show no folder for it
+//  HistoryFile (string)	where the file is, instead of OpenWindows\History.owh in the
+//							local application data folder
+
+// Call once from DllMain, and once at the end.
+void OWHistoryInit();
+void OWHistoryTerm();
+
+bool OWHistoryEnabled();
+
+// Tell it what a folder found, when that changed. Previous is what it found before,
+// NULL the first time.
+void OWHistoryNoteWindows(const COWItemList *Previous, const COWItemList &Windows);
+
+// The closed windows, latest first, ranked in that order
+void OWHistoryGetRecent(COWItemList *Items, int Max);
+
+#endif // __HISTORY_H_
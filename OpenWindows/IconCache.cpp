@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "IconCache.h"
+#include "ShellItems.h"
+#include "OWCore.h"
+#include "OWTaskQueue.h"
+#include "Metrics.h"
+
+//========================================================================================
+// The cache
+
+// Stock icons, as indexes into shell32. They're the same since 95 (and are what the
+// SIID_ stock icon numbers were later named after).
+enum
+{
+	OW_ICON_FOLDER = 3,
+	OW_ICON_FOLDER_OPEN = 4,
+	OW_ICON_REMOVABLE = 7,
+	OW_ICON_FIXED = 8,
+	OW_ICON_NETWORK = 9,
+	OW_ICON_CDROM = 11,
+	OW_ICON_RAMDISK = 12
+};
+
+enum
+{
+	OW_ICON_PATHS = 128,		// folders whose icon was looked up, by a hash of the path
+	OW_ICON_QUEUE = 64,			// lookups waiting
+	OW_ICON_WORKERS = 2,		// lookups running at once, each on its own thread
+	OW_ICON_IDLE_MS = 10000		// how long a thread waits for more before it ends
+};
+
+struct OWPathIcon
+{
+	bool Used;
+	bool Own;				// not the stock icon
+	WCHAR Path[MAX_PATH];
+	OWIconLocation Icon;
+};
+
+static bool s_Loaded = false;
+static WCHAR s_Shell32[MAX_PATH];
+// GetDriveType() + 1 for each letter, 0 until it's asked for
+static UINT s_DriveTypes[26];
+// Looked up icons; a new one replaces whatever had its slot
+static OWPathIcon *s_Paths = NULL;
+static COWTaskQueue *s_Queue = NULL;
+static HANDLE s_Wake = NULL;		// a semaphore, released once per queued lookup
+static int s_Workers = 0;
+// Guards all of the above
+static CRITICAL_SECTION s_Lock;
+
+struct OWIconJob
+{
+	WCHAR Path[MAX_PATH];
+	LPITEMIDLIST pidl;
+};
+
+static void FreeJob(void *Data)
+{
+	OWIconJob *Job = (OWIconJob*)Data;
+	ILFree(Job->pidl);
+	delete Job;
+}
+
+void OWIconCacheInit()
+{
+	InitializeCriticalSection(&s_Lock);
+}
+
+// The threads keep the DLL loaded, so there are none left by now.
+void OWIconCacheTerm()
+{
+	delete s_Queue;
+	s_Queue = NULL;
+	if (s_Wake != NULL)
+		CloseHandle(s_Wake);
+	s_Wake = NULL;
+	if (s_Paths != NULL)
+		HeapFree(GetProcessHeap(), 0, s_Paths);
+	s_Paths = NULL;
+	DeleteCriticalSection(&s_Lock);
+}
+
+static void ToWide(LPCTSTR Source, WCHAR *Target)
+{
+#ifdef _UNICODE
+	wcsncpy(Target, Source, MAX_PATH);
+	Target[MAX_PATH-1] = L'\0';
+#else
+	if (MultiByteToWideChar(CP_ACP, 0, Source, -1, Target, MAX_PATH) == 0)
+		Target[0] = L'\0';
+#endif
+}
+
+static void FromWide(LPCWSTR Source, TCHAR *Target)
+{
+#ifdef _UNICODE
+	wcsncpy(Target, Source, MAX_PATH);
+	Target[MAX_PATH-1] = L'\0';
+#else
+	if (WideCharToMultiByte(CP_ACP, 0, Source, -1, Target, MAX_PATH, NULL, NULL) == 0)
+		Target[0] = '\0';
+#endif
+}
+
+// Paths are compared without case, so they're hashed without it too
+static unsigned HashPath(LPCWSTR Path)
+{
+	unsigned Hash = 2166136261U;
+	for (; *Path != L'\0'; Path++)
+	{
+		WCHAR c = *Path;
+		if (c >= L'a' && c <= L'z')
+			c = (WCHAR)(c - L'a' + L'A');
+		Hash = (Hash ^ c) * 16777619U;
+	}
+	return Hash;
+}
+
+// Called with the lock held
+static UINT DriveType(char Drive)
+{
+	UINT &Type = s_DriveTypes[Drive - 'A'];
+	if (Type == 0)
+	{
+		TCHAR Root[4] = { (TCHAR)Drive, _T(':'), _T('\\'), _T('\0') };
+		Type = GetDriveType(Root) + 1;
+	}
+	return Type - 1;
+}
+
+// Not from DllMain, the shell might not be ready for us there. Nor is the queue made
+// there: most processes loading us never show an icon. Called with the lock held.
+static void Load()
+{
+	TCHAR Path[MAX_PATH];
+
+	s_Loaded = true;
+
+	UINT Length = GetSystemDirectory(Path, MAX_PATH - 12);
+	if (Length == 0 || Length >= MAX_PATH - 12)
+		Path[0] = _T('\0');
+	else
+		lstrcat(Path, _T("\\shell32.dll"));
+	ToWide(Path, s_Shell32);
+
+	s_Paths = (OWPathIcon*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(OWPathIcon) * OW_ICON_PATHS);
+
+	s_Wake = CreateSemaphore(NULL, 0, OW_ICON_QUEUE, NULL);
+	s_Queue = new COWTaskQueue(OW_ICON_QUEUE, OW_ICON_WORKERS, FreeJob);
+}
+
+bool OWGetIconLocation(LPCWSTR Path, UINT uFlags, OWIconLocation *Location)
+{
+	int Index = (uFlags & GIL_OPENICON) ? OW_ICON_FOLDER_OPEN : OW_ICON_FOLDER;
+	bool Final = true;
+	char Drive;
+
+	int Class = OWClassifyPath(Path, &Drive);
+
+	EnterCriticalSection(&s_Lock);
+	if (!s_Loaded)
+		Load();
+
+	switch (Class)
+	{
+	case OW_CLASS_DRIVE:
+		switch (DriveType(Drive))
+		{
+		case DRIVE_REMOVABLE:	Index = OW_ICON_REMOVABLE;	break;
+		case DRIVE_REMOTE:		Index = OW_ICON_NETWORK;	break;
+		case DRIVE_CDROM:		Index = OW_ICON_CDROM;		break;
+		case DRIVE_RAMDISK:		Index = OW_ICON_RAMDISK;	break;
+		default:				Index = OW_ICON_FIXED;		break;
+		}
+		break;
+
+	case OW_CLASS_SHARE:
+		Index = OW_ICON_NETWORK;
+		break;
+
+	case OW_CLASS_FOLDER:
+		if (DriveType(Drive) != DRIVE_REMOTE && s_Paths != NULL)
+		{
+			OWPathIcon &Cached = s_Paths[HashPath(Path) % OW_ICON_PATHS];
+			if (!Cached.Used || _wcsicmp(Cached.Path, Path) != 0)
+				Final = false;
+			else if (Cached.Own)
+			{
+				*Location = Cached.Icon;
+				LeaveCriticalSection(&s_Lock);
+				return true;
+			}
+		}
+		break;
+	}
+	LeaveCriticalSection(&s_Lock);
+
+	OWMetricsCount(OW_COUNTER_ICON_STOCK);
+	wcscpy(Location->File, s_Shell32);
+	Location->Index = Index;
+	Location->Flags = GIL_PERCLASS;
+	return Final;
+}
+
+bool OWLookupIcon(LPCWSTR Path)
+{
+	TCHAR PathT[MAX_PATH];
+	SHFILEINFO Info;
+	OWIconLocation Icon;
+	bool Own = false;
+
+	OWMetricsCount(OW_COUNTER_ICON_LOOKUP);
+
+	// This can read its desktop.ini, but it's on a local drive
+	FromWide(Path, PathT);
+	if (SHGetFileInfo(PathT, 0, &Info, sizeof(Info), SHGFI_ICONLOCATION) && Info.szDisplayName[0] != _T('\0'))
+	{
+		ToWide(Info.szDisplayName, Icon.File);
+		Icon.Index = Info.iIcon;
+		Icon.Flags = GIL_PERINSTANCE;
+		// Plain folders can come back as the stock icon
+		Own = Icon.Index != OW_ICON_FOLDER || _wcsicmp(Icon.File, s_Shell32) != 0;
+	}
+
+	EnterCriticalSection(&s_Lock);
+	if (s_Paths != NULL)
+	{
+		OWPathIcon &Cached = s_Paths[HashPath(Path) % OW_ICON_PATHS];
+		Cached.Used = true;
+		Cached.Own = Own;
+		wcsncpy(Cached.Path, Path, MAX_PATH);
+		Cached.Path[MAX_PATH-1] = L'\0';
+		if (Own)
+			Cached.Icon = Icon;
+	}
+	LeaveCriticalSection(&s_Lock);
+	return Own;
+}
+
+//----------------------------------------------------------------------------------------
+// Lookup threads
+
+static DWORD WINAPI LookupThread(LPVOID Module)
+{
+	OWTask *Task;
+	OWIconJob *Job;
+	bool Idle, Changed, Cancelled;
+
+	// SHGetFileInfo() can need COM for some folders
+	CoInitialize(NULL);
+
+	for (;;)
+	{
+		Idle = WaitForSingleObject(s_Wake, OW_ICON_IDLE_MS) == WAIT_TIMEOUT;
+
+		EnterCriticalSection(&s_Lock);
+		Task = s_Queue->Next();
+		if (Task == NULL && Idle)
+		{
+			s_Workers--;
+			LeaveCriticalSection(&s_Lock);
+			break;
+		}
+		LeaveCriticalSection(&s_Lock);
+		if (Task == NULL)
+			continue;
+
+		Job = (OWIconJob*)Task->Data;
+		Changed = OWLookupIcon(Job->Path);
+
+		EnterCriticalSection(&s_Lock);
+		Cancelled = Task->Cancelled;
+		s_Queue->Done(Task);
+		LeaveCriticalSection(&s_Lock);
+
+		// The shell asks for the location again, and gets the new one
+		if (Changed && !Cancelled)
+			SHChangeNotify(SHCNE_UPDATEITEM, SHCNF_IDLIST, Job->pidl, NULL);
+		FreeJob(Job);
+	}
+
+	CoUninitialize();
+	FreeLibraryAndExitThread((HMODULE)Module, 0);
+	return 0;
+}
+
+static bool StartWorker()
+{
+	TCHAR Path[MAX_PATH];
+	HMODULE Module;
+	HANDLE Thread;
+	DWORD Id;
+
+	// The thread holds a reference to the DLL until it's done, so it can't be unloaded
+	// from under it
+	if (GetModuleFileName(_Module.GetModuleInstance(), Path, MAX_PATH) == 0)
+		return false;
+	Module = LoadLibrary(Path);
+	if (Module == NULL)
+		return false;
+
+	Thread = CreateThread(NULL, 0, LookupThread, Module, 0, &Id);
+	if (Thread == NULL)
+	{
+		FreeLibrary(Module);
+		return false;
+	}
+	CloseHandle(Thread);
+	return true;
+}
+
+bool OWQueueIconLookup(const void *Owner, LPCWSTR Path, LPCITEMIDLIST pidl)
+{
+	bool Ready, Queued, Start = false;
+
+	// Both stay as Load() left them until the end
+	EnterCriticalSection(&s_Lock);
+	if (!s_Loaded)
+		Load();
+	Ready = s_Queue != NULL && s_Wake != NULL;
+	LeaveCriticalSection(&s_Lock);
+	if (!Ready)
+		return false;
+
+	OWIconJob *Job = new OWIconJob;
+	if (Job == NULL)
+		return false;
+	wcsncpy(Job->Path, Path, MAX_PATH);
+	Job->Path[MAX_PATH-1] = L'\0';
+	Job->pidl = ILClone(pidl);
+	if (Job->pidl == NULL)
+	{
+		delete Job;
+		return false;
+	}
+
+	EnterCriticalSection(&s_Lock);
+	Queued = s_Queue->Push(Owner, HashPath(Path), Job);
+	if (Queued && s_Workers < OW_ICON_WORKERS && s_Workers < s_Queue->GetPending() + s_Queue->GetRunning())
+	{
+		s_Workers++;
+		Start = true;
+	}
+	LeaveCriticalSection(&s_Lock);
+
+	if (!Queued)
+	{
+		// Full, or it's already on its way
+		FreeJob(Job);
+		return false;
+	}
+
+	if (Start && !StartWorker())
+	{
+		EnterCriticalSection(&s_Lock);
+		s_Workers--;
+		LeaveCriticalSection(&s_Lock);
+	}
+	ReleaseSemaphore(s_Wake, 1, NULL);
+	return true;
+}
+
+void OWCancelIconLookups(const void *Owner)
+{
+	// Nothing was queued before there was a queue
+	EnterCriticalSection(&s_Lock);
+	if (s_Queue != NULL)
+		s_Queue->Cancel(Owner);
+	LeaveCriticalSection(&s_Lock);
+}
+
+//========================================================================================
+// COWExtractIcon
+
+COWExtractIcon::COWExtractIcon() : m_Owner(NULL), m_pidl(NULL)
+#if defined(OW_ASYNC_ICONS)
+	, m_TaskState(IRTIR_TASK_NOT_RUNNING), m_Killed(0)
+#endif
+{
+	m_Path[0] = L'\0';
+}
+
+COWExtractIcon::~COWExtractIcon()
+{
+	if (m_pidl != NULL)
+		ILFree(m_pidl);
+}
+
+void COWExtractIcon::Init(const void *Owner, LPCITEMIDLIST pidlRoot, LPCITEMIDLIST pidl)
+{
+	m_Owner = Owner;
+	m_pidl = ILCombine(pidlRoot, pidl);
+	// Our own folders have no path, and get the stock folder icon
+	if (COWItem::IsOwn(pidl))
+		wcsncpy(m_Path, COWItem::GetPath(pidl), MAX_PATH);
+	else
+		m_Path[0] = L'\0';
+	m_Path[MAX_PATH-1] = L'\0';
+}
+
+HRESULT COWExtractIcon::Locate(UINT uFlags, OWIconLocation *Location)
+{
+	if (OWGetIconLocation(m_Path, uFlags, Location))
+		return S_OK;
+
+#if defined(OW_ASYNC_ICONS)
+	// The shell runs us as a task on its own thread, then asks again
+	if (uFlags & GIL_ASYNC)
+		return E_PENDING;
+#endif
+
+	// Otherwise it gets the stock icon for now, and is told to repaint the item when
+	// its own is known
+	if (m_pidl != NULL)
+		OWQueueIconLookup(m_Owner, m_Path, m_pidl);
+	Location->Flags |= GIL_DONTCACHE;
+	return S_OK;
+}
+
+//-------------------------------------------------------------------------------
+// IExtractIconW
+
+STDMETHODIMP COWExtractIcon::GetIconLocation(UINT uFlags, LPWSTR szIconFile, UINT cchMax, int *piIndex, UINT *pwFlags)
+{
+	OWIconLocation Location;
+	HRESULT hr;
+
+	if (szIconFile == NULL || piIndex == NULL || pwFlags == NULL)
+		return E_POINTER;
+
+	hr = Locate(uFlags, &Location);
+	if (hr != S_OK)
+		return hr;
+	// S_FALSE has the shell use its default icon
+	if (Location.File[0] == L'\0')
+		return S_FALSE;
+	if (wcslen(Location.File) >= cchMax)
+		return E_FAIL;
+
+	wcscpy(szIconFile, Location.File);
+	*piIndex = Location.Index;
+	*pwFlags = Location.Flags;
+	return S_OK;
+}
+
+STDMETHODIMP COWExtractIcon::Extract(LPCWSTR, UINT, HICON*, HICON*, UINT)
+{
+	// The location is a real file, so the shell can extract (and cache) it
+	return S_FALSE;
+}
+
+//-------------------------------------------------------------------------------
+// IExtractIconA
+
+STDMETHODIMP COWExtractIcon::GetIconLocation(UINT uFlags, LPSTR szIconFile, UINT cchMax, int *piIndex, UINT *pwFlags)
+{
+	OWIconLocation Location;
+	HRESULT hr;
+
+	if (szIconFile == NULL || piIndex == NULL || pwFlags == NULL)
+		return E_POINTER;
+
+	hr = Locate(uFlags, &Location);
+	if (hr != S_OK)
+		return hr;
+	if (Location.File[0] == L'\0')
+		return S_FALSE;
+	if (WideCharToMultiByte(CP_ACP, 0, Location.File, -1, szIconFile, cchMax, NULL, NULL) == 0)
+		return E_FAIL;
+
+	*piIndex = Location.Index;
+	*pwFlags = Location.Flags;
+	return S_OK;
+}
+
+STDMETHODIMP COWExtractIcon::Extract(LPCSTR, UINT, HICON*, HICON*, UINT)
+{
+	return S_FALSE;
+}
+
+#if defined(OW_ASYNC_ICONS)
+//-------------------------------------------------------------------------------
+// IRunnableTask
+
+STDMETHODIMP COWExtractIcon::Run()
+{
+	if (m_Killed)
+		return E_FAIL;
+
+	InterlockedExchange(&m_TaskState, IRTIR_TASK_RUNNING);
+	OWLookupIcon(m_Path);
+	InterlockedExchange(&m_TaskState, IRTIR_TASK_FINISHED);
+	return S_OK;
+}
+
+STDMETHODIMP COWExtractIcon::Kill(BOOL)
+{
+	// A lookup that started can't be stopped, but one that didn't won't
+	InterlockedExchange(&m_Killed, 1);
+	return S_OK;
+}
+
+STDMETHODIMP COWExtractIcon::Suspend()
+{
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP COWExtractIcon::Resume()
+{
+	return E_NOTIMPL;
+}
+
+STDMETHODIMP_(ULONG) COWExtractIcon::IsRunning()
+{
+	return (ULONG)m_TaskState;
+}
+#endif // OW_ASYNC_ICONS
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __ICONCACHE_H_
+#define __ICONCACHE_H_
+
+//========================================================================================
+// Item icons, without asking the target's folder for them. That meant parsing the path,
+// binding to its parent and having it extract the icon on every repaint, which goes
+// over the network for shares, and hangs on gone ones.
+//
+// Instead, the icon comes from what kind of place the path is (see OWClassifyPath):
+// drives by their type, shares and folders by the stock shell32 icons. Folders on
+// local drives can have icons of their own (the known folders, desktop.ini), so they
+// show the stock one until theirs is looked up on a background thread, then the view
+// is told to repaint them. Nothing on a network drive or share is looked up.
+
+// The asynchronous extraction protocol (GIL_ASYNC, E_PENDING and IRunnableTask) needs
+// a newer SDK than VC6's. Without it, the lookups only run on our own threads.
+#if defined(__IRunnableTask_INTERFACE_DEFINED__)
+#define OW_ASYNC_ICONS
+#ifndef GIL_ASYNC
+#define GIL_ASYNC 0x0020
+#endif
+#endif
+
+struct OWIconLocation
+{
+	WCHAR File[MAX_PATH];	// empty when there's no icon to give
+	int Index;
+	UINT Flags;				// GIL_PERCLASS for stock icons, GIL_PERINSTANCE otherwise
+};
+
+// Call once from DllMain, and once at the end.
+void OWIconCacheInit();
+void OWIconCacheTerm();
+
+// Where the icon for Path is. uFlags are the GIL_ ones given to GetIconLocation. When
+// the path's own icon is still to be looked up, Location is a stock one to show in the
+// meantime, and it returns false.
+bool OWGetIconLocation(LPCWSTR Path, UINT uFlags, OWIconLocation *Location);
+
+// Look up the icon of Path now, and keep it. Returns true when it isn't the stock one.
+bool OWLookupIcon(LPCWSTR Path);
+
+// Look it up on a background thread instead, then have the shell repaint the item
+// (pidl is absolute) if that changed its icon. A few run at a time at most; the rest
+// wait in a bounded queue.
+bool OWQueueIconLookup(const void *Owner, LPCWSTR Path, LPCITEMIDLIST pidl);
+
+// Drop the lookups Owner queued, such as when its view is closed. Ones already running
+// finish, but the item isn't repainted.
+void OWCancelIconLookups(const void *Owner);
+
+//========================================================================================
+// IExtractIcon for one of our items, from GetUIObjectOf(). It only gives the location;
+// the shell extracts and caches the icon itself. The shell can run it as a task on its
+// own threads, so it's thread safe.
+
+class ATL_NO_VTABLE COWExtractIcon :
+	public CComObjectRootEx<CComMultiThreadModel>,
+#if defined(OW_ASYNC_ICONS)
+	public IRunnableTask,
+#endif
+	public IExtractIconW, public IExtractIconA
+{
+public:
+	BEGIN_COM_MAP(COWExtractIcon)
+		COM_INTERFACE_ENTRY_IID(IID_IExtractIconW, IExtractIconW)
+		COM_INTERFACE_ENTRY_IID(IID_IExtractIconA, IExtractIconA)
+#if defined(OW_ASYNC_ICONS)
+		COM_INTERFACE_ENTRY_IID(IID_IRunnableTask, IRunnableTask)
+#endif
+	END_COM_MAP()
+
+	//-------------------------------------------------------------------------------
+
+	COWExtractIcon();
+	~COWExtractIcon();
+
+	// Owner is who the lookups are queued for, pidlRoot our folder, and pidl the item
+	void Init(const void *Owner, LPCITEMIDLIST pidlRoot, LPCITEMIDLIST pidl);
+
+	//-------------------------------------------------------------------------------
+	// IExtractIconW methods
+
+	STDMETHOD(GetIconLocation) (UINT uFlags, LPWSTR szIconFile, UINT cchMax, int *piIndex, UINT *pwFlags);
+	STDMETHOD(Extract) (LPCWSTR pszFile, UINT nIconIndex, HICON *phiconLarge, HICON *phiconSmall, UINT nIconSize);
+
+	//-------------------------------------------------------------------------------
+	// IExtractIconA methods, for shells that aren't Unicode
+
+	STDMETHOD(GetIconLocation) (UINT uFlags, LPSTR szIconFile, UINT cchMax, int *piIndex, UINT *pwFlags);
+	STDMETHOD(Extract) (LPCSTR pszFile, UINT nIconIndex, HICON *phiconLarge, HICON *phiconSmall, UINT nIconSize);
+
+#if defined(OW_ASYNC_ICONS)
+	//-------------------------------------------------------------------------------
+	// IRunnableTask methods, for after GetIconLocation returned E_PENDING
+
+	STDMETHOD(Run) ();
+	STDMETHOD(Kill) (BOOL fWait);
+	STDMETHOD(Suspend) ();
+	STDMETHOD(Resume) ();
+	STDMETHOD_(ULONG, IsRunning) ();
+#endif
+
+protected:
+	HRESULT Locate(UINT uFlags, OWIconLocation *Location);
+
+	const void *m_Owner;
+	LPITEMIDLIST m_pidl;
+	WCHAR m_Path[MAX_PATH];
+#if defined(OW_ASYNC_ICONS)
+	volatile LONG m_TaskState;	// IRTIR_TASK_
+	volatile LONG m_Killed;
+#endif
+};
+
+#endif // __ICONCACHE_H_
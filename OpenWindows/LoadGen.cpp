@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "stdafx.h"
+#if _MSC_VER > 1200
+#include "OpenWindows_h.h"
+#else
+// the IDL compiler on VC++6 puts it here instead. weird!
+#include "OpenWindows.h"
+#endif
+#include "RootShellFolder.h"
+
+#include <stdio.h>
+
+#if defined(OW_LOADGEN_SUPPORT)
+//========================================================================================
+// Load generator
+
+void OWRunLoadGenerator(const OWSyntheticSettings &Settings, int Runs,
+	double *pP50, double *pP99, double *pMean, long *pListed)
+{
+	COWSyntheticWindowSource Source(Settings);
+	LARGE_INTEGER Frequency, Start, End;
+	int i, j, Gap;
+
+	*pP50 = *pP99 = *pMean = 0;
+	*pListed = 0;
+
+	if (Runs <= 0 || !QueryPerformanceFrequency(&Frequency))
+		return;
+
+	double *Times = new double[Runs];
+	if (Times == NULL)
+		return;
+
+	double Total = 0;
+	for (i = 0; i < Runs; i++)
+	{
+		COWItemList Items;
+
+		QueryPerformanceCounter(&Start);
+		*pListed = EnumerateWindows(&Source, &Items, NULL);
+		QueryPerformanceCounter(&End);
+
+		Times[i] = (double)(End.QuadPart - Start.QuadPart) * 1000000.0 / (double)Frequency.QuadPart;
+		Total += Times[i];
+	}
+
+	for (Gap = Runs / 2; Gap > 0; Gap /= 2)
+	{
+		for (i = Gap; i < Runs; i++)
+		{
+			double t = Times[i];
+			for (j = i; j >= Gap && Times[j-Gap] > t; j -= Gap)
+				Times[j] = Times[j-Gap];
+			Times[j] = t;
+		}
+	}
+
+	// Nearest rank
+	*pP50 = Times[(Runs * 50 + 99) / 100 - 1];
+	*pP99 = Times[(Runs * 99 + 99) / 100 - 1];
+	*pMean = Total / Runs;
+
+	delete [] Times;
+}
+
+// name=value, as unsigned. Returns false if Token isn't about Name.
+static bool ParseSetting(LPCSTR Token, LPCSTR Name, DWORD *pValue)
+{
+	size_t Length = strlen(Name);
+	if (strncmp(Token, Name, Length) != 0 || Token[Length] != '=')
+		return false;
+	*pValue = strtoul(Token + Length + 1, NULL, 10);
+	return true;
+}
+
+//========================================================================================
+// rundll32 entry point, only exported from builds with the load generator, so normal
+// ones don't have it in their export table (it isn't in OpenWindows.def):
+//   rundll32 OpenWindows.dll,RunLoadGenerator windows=500 runs=100 latency=200 ...
+// Settings are name=value, separated by spaces:
+//   windows, runs, unc, namespace, duplicate, depth (paths), latency, jitter (us),
+//   failfolder, failuri, hung (percent), hungms, seed, and out=file to append the
+//   results to instead of showing them.
+// With OW_ALLOC_PROFILE, budgets=1 also checks the allocation budgets, and exits with
+// 1 when any is over, for scripts to fail on.
+
+#if defined(_WIN64)
+#pragma comment(linker, "/EXPORT:RunLoadGenerator")
+#else
+#pragma comment(linker, "/EXPORT:RunLoadGenerator=_RunLoadGenerator@16")
+#endif
+
+extern "C" void CALLBACK RunLoadGenerator(HWND hwnd, HINSTANCE hinst, LPSTR lpszCmdLine, int nCmdShow)
+{
+	OWSyntheticSettings Settings;
+	char CommandLine[1024], Result[1024];
+	char *Token, *OutFile = NULL;
+	DWORD Value, Runs = 100, CheckBudgets = 0;
+	int OverBudget = 0;
+
+	OWDefaultSyntheticSettings(&Settings);
+
+	strncpy(CommandLine, lpszCmdLine ? lpszCmdLine : "", sizeof(CommandLine)-1);
+	CommandLine[sizeof(CommandLine)-1] = '\0';
+
+	for (Token = strtok(CommandLine, " \t"); Token != NULL; Token = strtok(NULL, " \t"))
+	{
+		if (ParseSetting(Token, "windows", &Value))			Settings.WindowCount = Value;
+		else if (ParseSetting(Token, "runs", &Value))		Runs = Value;
+		else if (ParseSetting(Token, "unc", &Value))		Settings.UncPercent = Value;
+		else if (ParseSetting(Token, "namespace", &Value))	Settings.NamespacePercent = Value;
+		else if (ParseSetting(Token, "duplicate", &Value))	Settings.DuplicatePercent = Value;
+		else if (ParseSetting(Token, "depth", &Value))		Settings.PathDepth = Value;
+		else if (ParseSetting(Token, "latency", &Value))	Settings.LatencyMicroseconds = Value;
+		else if (ParseSetting(Token, "jitter", &Value))		Settings.JitterMicroseconds = Value;
+		else if (ParseSetting(Token, "failfolder", &Value))	Settings.FailPercent[OW_STRATEGY_FOLDER_ITEM] = Value;
+		else if (ParseSetting(Token, "failuri", &Value))	Settings.FailPercent[OW_STRATEGY_FILE_URI] = Value;
+		else if (ParseSetting(Token, "hung", &Value))		Settings.HungPercent = Value;
+		else if (ParseSetting(Token, "hungms", &Value))		Settings.HungMilliseconds = Value;
+		else if (ParseSetting(Token, "seed", &Value))		Settings.Seed = Value;
+		else if (ParseSetting(Token, "budgets", &Value))	CheckBudgets = Value;
+		else if (strncmp(Token, "out=", 4) == 0)			OutFile = Token + 4;
+	}
+
+	double P50, P99, Mean;
+	long Listed;
+	OWRunLoadGenerator(Settings, Runs, &P50, &P99, &Mean, &Listed);
+
+	sprintf(Result, "windows=%ld listed=%ld runs=%lu p50=%.1fus p99=%.1fus mean=%.1fus\n",
+		Settings.WindowCount, Listed, Runs, P50, P99, Mean);
+
+#if defined(OW_ALLOC_PROFILE)
+	if (CheckBudgets)
+	{
+		size_t Length = strlen(Result);
+		OverBudget = OWAllocCheckBudgets(Result + Length, sizeof(Result) - Length);
+	}
+#endif
+
+	FILE *Out;
+	if (OutFile != NULL && (Out = fopen(OutFile, "a")) != NULL)
+	{
+		fputs(Result, Out);
+		fclose(Out);
+	}
+	else
+	{
+		MessageBoxA(hwnd, Result, "OpenWindows load generator", MB_OK);
+	}
+
+	if (OverBudget)
+		ExitProcess(1);
+}
+#endif // OW_LOADGEN_SUPPORT
@@ -31,6 +31,12 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
+#include "OWCore.h"
+
+// The shell allocator, got the first time it's needed rather than when the DLL is
+// loaded (see ShellItems.cpp). NULL if it can't be had.
+IMalloc *OWGetMalloc();
+
 //========================================================================================
 // encapsulate these classes in a namespace
 
@@ -56,21 +62,20 @@ public:
 class CPidlMgr
 {
 public:
-	CPidlMgr()
-	{
-		HRESULT hr = SHGetMalloc(&m_MallocPtr);
-		ATLASSERT(SUCCEEDED(hr));
-	}
-
 	LPITEMIDLIST Create(CPidlData &Data)
 	{
 		// Total size of the PIDL, including SHITEMID
 		UINT TotalSize = sizeof(ITEMIDLIST) + Data.GetSize();
 
 		// Also allocate memory for the final null SHITEMID.
-		LPITEMIDLIST pidlNew = (LPITEMIDLIST) m_MallocPtr->Alloc(TotalSize + sizeof(ITEMIDLIST));
+		IMalloc *Malloc = OWGetMalloc();
+		if (Malloc == NULL)
+			return NULL;
+		LPITEMIDLIST pidlNew = (LPITEMIDLIST) Malloc->Alloc(TotalSize + sizeof(ITEMIDLIST));
 		if (pidlNew)
 		{
+			OW_ALLOC_NOTE(OW_ALLOC_PIDL, TotalSize + sizeof(ITEMIDLIST));
+
 			LPITEMIDLIST pidlTemp = pidlNew;
 
 			// Prepares the PIDL to be filled with actual data
@@ -90,8 +95,9 @@ public:
 
 	void Delete(LPITEMIDLIST pidl)
 	{
-		if (pidl)
-			m_MallocPtr->Free(pidl);
+		IMalloc *Malloc = OWGetMalloc();
+		if (pidl && Malloc)
+			Malloc->Free(pidl);
 	}
 
 	LPITEMIDLIST GetNextItem(LPCITEMIDLIST pidl)
@@ -100,7 +106,7 @@ public:
 		if (!pidl)
 			return NULL;
 
-		return LPITEMIDLIST(LPBYTE(pidl) + pidl->mkid.cb);
+		return (LPITEMIDLIST)OWIdListGetNext(pidl);
 	}
 
 	LPITEMIDLIST GetLastItem(LPCITEMIDLIST pidl)
@@ -127,10 +133,14 @@ public:
 
 		// Allocate memory for the new PIDL.
 		Size = GetSize(pidlSrc);
-		pidlTarget = (LPITEMIDLIST) m_MallocPtr->Alloc(Size);
+		IMalloc *Malloc = OWGetMalloc();
+		if (Malloc == NULL)
+			return NULL;
+		pidlTarget = (LPITEMIDLIST) Malloc->Alloc(Size);
 
 		if (pidlTarget == NULL)
 			return NULL;
+		OW_ALLOC_NOTE(OW_ALLOC_PIDL, Size);
 
 		// Copy the source PIDL to the target PIDL.
 		CopyMemory(pidlTarget, pidlSrc, Size);
@@ -140,29 +150,17 @@ public:
 
 	UINT GetSize(LPCITEMIDLIST pidl)
 	{
-		UINT Size = 0;
-		LPITEMIDLIST pidlTemp = (LPITEMIDLIST) pidl;
-
 		ATLASSERT(pidl != NULL);
 		if (!pidl)
 			return 0;
 
-		while (pidlTemp->mkid.cb != 0)
-		{
-			Size += pidlTemp->mkid.cb;
-			pidlTemp = GetNextItem(pidlTemp);
-		}  
-
-		// add the size of the NULL terminating ITEMIDLIST
-		Size += sizeof(ITEMIDLIST);
-
-		return Size;
+		// Includes the NULL terminating ITEMIDLIST
+		return OWIdListGetSize(pidl);
 	}
 
 	bool IsSingle(LPCITEMIDLIST pidl)
 	{
-		LPITEMIDLIST pidlTemp = GetNextItem(pidl);
-		return pidlTemp->mkid.cb == 0;
+		return OWIdListIsSingle(pidl);
 	}
 
 	CString StrRetToCString(STRRET *pStrRet, LPCITEMIDLIST pidl)
@@ -219,14 +217,13 @@ public:
 		// Release the OLESTR
 		if (pStrRet->uType == STRRET_WSTR)
 		{
-			m_MallocPtr->Free(pStrRet->pOleStr);
+			IMalloc *Malloc = OWGetMalloc();
+			if (Malloc != NULL)
+				Malloc->Free(pStrRet->pOleStr);
 		}
 
 		return Target;
 	}
-
-protected:
-	CComPtr<IMalloc> m_MallocPtr;
 };
 
 
@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "stdafx.h"
+#include "Metrics.h"
+#include "Common.h"
+
+#include <stdio.h>
+
+//========================================================================================
+// The slot
+
+// The region, when we could map it, and our slot in it or a private one. Opened on
+// first use; s_Slot is set before s_Opened, and then read without s_Lock.
+static HANDLE s_Mapping = NULL;
+static OWSharedMetrics *s_Shared = NULL;
+static OWSharedSlot * volatile s_Slot = NULL;
+static volatile bool s_Opened = false;
+// Guards opening the slot, and handing out its lanes
+static CRITICAL_SECTION s_Lock;
+
+// Which lane each thread writes, plus one, once it has one. Lanes from 1 up belong to
+// a thread each, whose handle is kept to see when it exits; the next thread to come
+// along then takes the lane over, and adds to what it left. The threads that come when
+// all of them are taken share lane 0.
+static DWORD s_Tls = TLS_OUT_OF_INDEXES;
+static HANDLE s_LaneThreads[OW_SHARED_LANES];
+static LONGLONG s_Frequency = 0;
+static bool s_HasCounter = false;
+
+static const char *s_TimerNames[OW_TIMER_MAX] =
+{
+	"GetClassID",
+	"Initialize",
+	"GetCurFolder",
+	"BindToObject",
+	"CompareIDs",
+	"CreateViewObject",
+	"EnumObjects",
+	"GetAttributesOf",
+	"GetUIObjectOf",
+	"BindToStorage",
+	"GetDisplayNameOf",
+	"ParseDisplayName",
+	"SetNameOf",
+	"ColumnClick",
+	"GetDetailsOf",
+	"EnumSearches",
+	"GetDefaultColumn",
+	"GetDefaultColumnState",
+	"GetDefaultSearchGUID",
+	"GetDetailsEx",
+	"MapColumnToSCID",
+	"SetSearchQuery",
+	"SetSearchMode",
+	"Enum.Activation",
+	"Enum.Probe",
+	"Enum.Fallback"
+};
+
+static const char *s_CounterNames[OW_COUNTER_MAX] =
+{
+	"StrRet.Alloc",
+	"StrRet.Offset",
+	"Pidl.Alloc",
+	"Snapshot",
+	"Snapshot.Unchanged",
+	"Icon.Stock",
+	"Icon.Lookup"
+};
+
+// Every name must fit in the shared layout
+typedef char OWTimersFit[OW_TIMER_MAX <= OW_SHARED_TIMERS ? 1 : -1];
+typedef char OWCountersFit[OW_COUNTER_MAX <= OW_SHARED_COUNTERS ? 1 : -1];
+
+static bool IsProcessAlive(DWORD ProcessId)
+{
+	HANDLE Process = OpenProcess(SYNCHRONIZE, FALSE, ProcessId);
+	if (Process == NULL)
+		return GetLastError() == ERROR_ACCESS_DENIED;
+
+	bool Alive = WaitForSingleObject(Process, 0) == WAIT_TIMEOUT;
+	CloseHandle(Process);
+	return Alive;
+}
+
+// Take a free slot, or else the one of a process that went away. Called with the lock.
+static OWSharedSlot *ClaimSlot(OWSharedMetrics *Shared)
+{
+	int Free = -1, Exited = -1, Dead = -1, i;
+	char Host[MAX_PATH];
+	FILETIME Now;
+
+	for (i = 0; i < OW_SHARED_SLOTS; i++)
+	{
+		OWSharedSlot &Slot = Shared->Slots[i];
+		if (Slot.State == OW_SLOT_FREE && Free < 0)
+			Free = i;
+		else if (Slot.State == OW_SLOT_EXITED && Exited < 0)
+			Exited = i;
+		else if (Slot.State == OW_SLOT_LIVE && Dead < 0 && !IsProcessAlive(Slot.ProcessId))
+			Dead = i;
+	}
+
+	i = Free >= 0 ? Free : Exited >= 0 ? Exited : Dead;
+	if (i < 0)
+		return NULL;
+
+	OWSharedSlot *Slot = &Shared->Slots[i];
+	memset(Slot, 0, sizeof(*Slot));
+	Slot->ProcessId = GetCurrentProcessId();
+	GetSystemTimeAsFileTime(&Now);
+	Slot->StartedAt = ((OWUINT64)Now.dwHighDateTime << 32) | Now.dwLowDateTime;
+
+	if (GetModuleFileNameA(NULL, Host, MAX_PATH) == 0)
+		strcpy(Host, "?");
+	LPCSTR Name = strrchr(Host, '\\');
+	lstrcpynA(Slot->Host, Name != NULL ? Name + 1 : Host, OW_SHARED_HOST_LENGTH);
+
+	Slot->State = OW_SLOT_LIVE;
+	return Slot;
+}
+
+// Called with s_Lock, once
+static bool OpenShared()
+{
+	HANDLE Lock = OWCreateLocalMutex(OW_SHARED_METRICS_LOCK);
+	if (Lock == NULL)
+		return false;
+
+	// Only held by processes opening their slot or letting it go
+	if (!OWTakeLock(Lock))
+	{
+		CloseHandle(Lock);
+		return false;
+	}
+
+	s_Mapping = OWCreateLocalMapping(OW_SHARED_METRICS_NAME, sizeof(OWSharedMetrics));
+	bool Created = GetLastError() != ERROR_ALREADY_EXISTS;
+	if (s_Mapping != NULL)
+		s_Shared = (OWSharedMetrics*)MapViewOfFile(s_Mapping, FILE_MAP_WRITE, 0, 0, sizeof(OWSharedMetrics));
+
+	if (s_Shared != NULL && Created)
+	{
+		int i;
+
+		// The pages start zeroed
+		s_Shared->Magic = OW_SHARED_METRICS_MAGIC;
+		s_Shared->Version = OW_SHARED_METRICS_VERSION;
+		s_Shared->Size = sizeof(OWSharedMetrics);
+		s_Shared->SlotCount = OW_SHARED_SLOTS;
+		s_Shared->TimerCount = OW_TIMER_MAX;
+		s_Shared->CounterCount = OW_COUNTER_MAX;
+		s_Shared->BucketCount = OW_METRICS_BUCKETS;
+		for (i = 0; i < OW_TIMER_MAX; i++)
+			lstrcpynA(s_Shared->TimerNames[i], s_TimerNames[i], OW_SHARED_NAME_LENGTH);
+		for (i = 0; i < OW_COUNTER_MAX; i++)
+			lstrcpynA(s_Shared->CounterNames[i], s_CounterNames[i], OW_SHARED_NAME_LENGTH);
+	}
+
+	// Made by another version of us; leave it to them
+	if (s_Shared != NULL && (s_Shared->Magic != OW_SHARED_METRICS_MAGIC
+		|| s_Shared->Version != OW_SHARED_METRICS_VERSION || s_Shared->Size != sizeof(OWSharedMetrics)))
+	{
+		UnmapViewOfFile(s_Shared);
+		s_Shared = NULL;
+	}
+
+	if (s_Shared != NULL)
+		s_Slot = ClaimSlot(s_Shared);
+
+	ReleaseMutex(Lock);
+	CloseHandle(Lock);
+
+	if (s_Slot == NULL)
+	{
+		if (s_Shared != NULL)
+			UnmapViewOfFile(s_Shared);
+		if (s_Mapping != NULL)
+			CloseHandle(s_Mapping);
+		s_Shared = NULL;
+		s_Mapping = NULL;
+		return false;
+	}
+	return true;
+}
+
+void OWMetricsInit()
+{
+	LARGE_INTEGER Frequency;
+
+	s_HasCounter = QueryPerformanceFrequency(&Frequency) && Frequency.QuadPart != 0;
+	s_Frequency = s_HasCounter ? Frequency.QuadPart : 1000;
+	InitializeCriticalSection(&s_Lock);
+}
+
+void OWMetricsTerm()
+{
+	int i;
+
+	OWSharedSlot *Slot = s_Slot;
+	s_Slot = NULL;
+
+	if (s_Shared != NULL)
+	{
+		// The numbers stay readable until another process needs the slot
+		Slot->State = OW_SLOT_EXITED;
+		UnmapViewOfFile(s_Shared);
+		CloseHandle(s_Mapping);
+		s_Shared = NULL;
+		s_Mapping = NULL;
+	}
+	else if (Slot != NULL)
+		HeapFree(GetProcessHeap(), 0, Slot);
+
+	for (i = 0; i < OW_SHARED_LANES; i++)
+	{
+		if (s_LaneThreads[i] != NULL)
+			CloseHandle(s_LaneThreads[i]);
+		s_LaneThreads[i] = NULL;
+	}
+	if (s_Tls != TLS_OUT_OF_INDEXES)
+		TlsFree(s_Tls);
+	s_Tls = TLS_OUT_OF_INDEXES;
+	DeleteCriticalSection(&s_Lock);
+}
+
+// Not from DllMain: that would take the lock and map the region in every process
+// loading us, under the loader lock, whether it ever calls us or not. NULL when
+// there's no slot to be had.
+static OWSharedSlot *GetSlot()
+{
+	if (s_Opened)
+		return s_Slot;
+
+	EnterCriticalSection(&s_Lock);
+	if (!s_Opened)
+	{
+		s_Tls = TlsAlloc();
+		if (!OpenShared())
+			s_Slot = (OWSharedSlot*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(OWSharedSlot));
+		s_Opened = true;
+	}
+	LeaveCriticalSection(&s_Lock);
+	return s_Slot;
+}
+
+// The first time a thread records something
+static int ClaimLane(OWSharedSlot *Slot)
+{
+	HANDLE Thread;
+	int Lane = 0, i;
+
+	EnterCriticalSection(&s_Lock);
+	for (i = 1; i < OW_SHARED_LANES && Lane == 0; i++)
+	{
+		if (s_LaneThreads[i] != NULL && WaitForSingleObject(s_LaneThreads[i], 0) == WAIT_OBJECT_0)
+		{
+			CloseHandle(s_LaneThreads[i]);
+			s_LaneThreads[i] = NULL;
+		}
+		if (s_LaneThreads[i] == NULL && DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
+			GetCurrentProcess(), &Thread, SYNCHRONIZE, FALSE, 0))
+		{
+			s_LaneThreads[i] = Thread;
+			Lane = i;
+		}
+	}
+	LeaveCriticalSection(&s_Lock);
+
+	if (Lane != 0)
+		Slot->Lanes[Lane].ThreadId = GetCurrentThreadId();
+	TlsSetValue(s_Tls, (LPVOID)(size_t)(Lane + 1));
+	return Lane;
+}
+
+// The lane this thread writes, and whether it's the only one to. NULL when there's no
+// slot.
+static OWSharedLane *GetLane(bool *pOwned)
+{
+	OWSharedSlot *Slot = GetSlot();
+	if (Slot == NULL)
+		return NULL;
+
+	int Lane = 0;
+	if (s_Tls != TLS_OUT_OF_INDEXES)
+	{
+		Lane = (int)(size_t)TlsGetValue(s_Tls) - 1;
+		if (Lane < 0)
+			Lane = ClaimLane(Slot);
+	}
+	*pOwned = Lane != 0;
+	return &Slot->Lanes[Lane];
+}
+
+//========================================================================================
+// Recording
+
+LONGLONG OWMetricsNow()
+{
+	LARGE_INTEGER Now;
+
+	if (s_HasCounter && QueryPerformanceCounter(&Now))
+		return Now.QuadPart;
+	return GetTickCount();
+}
+
+LONGLONG OWMetricsFrequency()
+{
+	return s_Frequency;
+}
+
+void OWMetricsRecord(OWTimer Timer, LONGLONG Ticks)
+{
+	bool Owned;
+	OWSharedLane *Lane = GetLane(&Owned);
+	if (Lane == NULL)
+		return;
+
+	LONGLONG Microseconds = Ticks > 0 ? Ticks * 1000000 / s_Frequency : 0;
+	ULONG Value = Microseconds > 0xFFFFFFFF ? 0xFFFFFFFFUL : (ULONG)Microseconds;
+	OWSharedTimer &t = Lane->Timers[Timer];
+
+	// Nothing orders these against each other; readers only want the numbers to
+	// add up eventually. Aligned 32-bit stores don't tear.
+	if (Owned)
+	{
+		t.Calls++;
+		ULONG Low = t.TotalLow + Value;
+		if (Low < Value)
+			t.TotalHigh++;
+		t.TotalLow = Low;
+		t.Buckets[OWMetricsBucketOf(Value)]++;
+		if (Value > t.MaxMicroseconds)
+			t.MaxMicroseconds = Value;
+		return;
+	}
+
+	InterlockedIncrement((LONG*)&t.Calls);
+	ULONG Low = (ULONG)InterlockedExchangeAdd((LONG*)&t.TotalLow, (LONG)Value);
+	if (Low + Value < Low)
+		InterlockedIncrement((LONG*)&t.TotalHigh);
+	InterlockedIncrement((LONG*)&t.Buckets[OWMetricsBucketOf(Value)]);
+
+	ULONG Max = t.MaxMicroseconds;
+	while (Value > Max)
+	{
+		ULONG Seen = (ULONG)OWCompareExchange((LONG*)&t.MaxMicroseconds, (LONG)Value, (LONG)Max);
+		if (Seen == Max)
+			break;
+		Max = Seen;
+	}
+}
+
+void OWMetricsCount(OWCounter Counter)
+{
+	OWMetricsCount(Counter, 1);
+}
+
+void OWMetricsCount(OWCounter Counter, ULONG Amount)
+{
+	bool Owned;
+	OWSharedLane *Lane = GetLane(&Owned);
+	if (Lane == NULL)
+		return;
+
+	if (Owned)
+		Lane->Counters[Counter] += Amount;
+	else
+		InterlockedExchangeAdd((LONG*)&Lane->Counters[Counter], (LONG)Amount);
+}
+
+//========================================================================================
+// Reading
+
+void OWMetricsRead(OWMetricsTotals *Totals)
+{
+	int l, i, b;
+
+	memset(Totals, 0, sizeof(*Totals));
+
+	OWSharedSlot *Slot = s_Slot;
+	if (Slot == NULL)
+		return;
+
+	// Aligned 32-bit reads don't tear, so at worst this is a call behind
+	for (l = 0; l < OW_SHARED_LANES; l++)
+	{
+		const OWSharedLane &Lane = Slot->Lanes[l];
+
+		for (i = 0; i < OW_TIMER_MAX; i++)
+		{
+			const OWSharedTimer &From = Lane.Timers[i];
+			OWTimerTotals &To = Totals->Timers[i];
+
+			To.Calls += From.Calls;
+			To.TotalMicroseconds += ((ULONGLONG)From.TotalHigh << 32) | From.TotalLow;
+			if (From.MaxMicroseconds > To.MaxMicroseconds)
+				To.MaxMicroseconds = From.MaxMicroseconds;
+			for (b = 0; b < OW_METRICS_BUCKETS; b++)
+				To.Buckets[b] += From.Buckets[b];
+		}
+		for (i = 0; i < OW_COUNTER_MAX; i++)
+			Totals->Counters[i] += Lane.Counters[i];
+	}
+}
+
+ULONG OWMetricsPercentile(const OWTimerTotals *Timer, int Percentile)
+{
+	ULONGLONG Wanted, Seen = 0;
+	int b;
+
+	if (Timer->Calls == 0)
+		return 0;
+
+	Wanted = ((ULONGLONG)Timer->Calls * Percentile + 99) / 100;
+	if (Wanted == 0)
+		Wanted = 1;
+
+	for (b = 0; b < OW_METRICS_BUCKETS; b++)
+	{
+		Seen += Timer->Buckets[b];
+		if (Seen >= Wanted)
+		{
+			ULONG Upper = OWMetricsBucketUpperBound(b);
+			return Upper < Timer->MaxMicroseconds ? Upper : Timer->MaxMicroseconds;
+		}
+	}
+	return Timer->MaxMicroseconds;
+}
+
+LPCSTR OWMetricsTimerName(OWTimer Timer)
+{
+	return s_TimerNames[Timer];
+}
+
+LPCSTR OWMetricsCounterName(OWCounter Counter)
+{
+	return s_CounterNames[Counter];
+}
+
+int OWMetricsFormat(LPSTR Buffer, int Size)
+{
+	OWMetricsTotals *Totals;
+	char Host[MAX_PATH];
+	int Length = 0, Written, i;
+
+	if (Size <= 0)
+		return 0;
+	Buffer[0] = '\0';
+
+	// Too big for the stack of whatever thread asks
+	Totals = new OWMetricsTotals;
+	if (Totals == NULL)
+		return 0;
+	OWMetricsRead(Totals);
+
+	if (GetModuleFileNameA(NULL, Host, MAX_PATH) == 0)
+		strcpy(Host, "?");
+
+#define APPEND(args) \
+	if (Length < Size - 1) \
+	{ \
+		Written = _snprintf args; \
+		Length = (Written < 0 || Written >= Size - Length) ? Size - 1 : Length + Written; \
+	}
+
+	APPEND((Buffer + Length, Size - Length, "host=%s pid=%lu\r\n", Host, GetCurrentProcessId()));
+	APPEND((Buffer + Length, Size - Length, "%-22s %10s %10s %10s %10s %10s\r\n",
+		"timer", "calls", "mean_us", "p50_us", "p99_us", "max_us"));
+
+	for (i = 0; i < OW_TIMER_MAX; i++)
+	{
+		const OWTimerTotals &t = Totals->Timers[i];
+		if (t.Calls == 0)
+			continue;
+
+		APPEND((Buffer + Length, Size - Length, "%-22s %10lu %10lu %10lu %10lu %10lu\r\n",
+			s_TimerNames[i], t.Calls, (ULONG)(t.TotalMicroseconds / t.Calls),
+			OWMetricsPercentile(&t, 50), OWMetricsPercentile(&t, 99), t.MaxMicroseconds));
+	}
+
+	for (i = 0; i < OW_COUNTER_MAX; i++)
+	{
+		APPEND((Buffer + Length, Size - Length, "%-22s %10lu\r\n", s_CounterNames[i], Totals->Counters[i]));
+	}
+
+#undef APPEND
+
+#if defined(OW_ALLOC_PROFILE)
+	Length += OWAllocFormat(Buffer + Length, Size - Length);
+#endif
+
+	Buffer[Length] = '\0';
+	delete Totals;
+	return Length;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __METRICS_H_
+#define __METRICS_H_
+
+//========================================================================================
+// Always-on call counts, latency histograms and counters.
+//
+// They live in this process' slot of a shared memory region (see OWSharedMetrics.h),
+// so they can be read from outside; Tools/MetricsReader does that for every process
+// hosting us. Recording is a few plain increments, in a lane of the slot that only the
+// thread recording writes, or interlocked ones when it has none. Latencies go in
+// log-linear buckets (four per power of two of microseconds), which keeps the relative
+// error of a percentile under 25%. Without the region, the slot is private to the
+// process. The region is only opened, and the slot taken, when the first thing is
+// recorded.
+
+#include "OWSharedMetrics.h"
+
+enum OWTimer
+{
+	// IShellFolder, IShellFolder2, IShellDetails, IPersistFolder2
+	OW_TIMER_GETCLASSID,
+	OW_TIMER_INITIALIZE,
+	OW_TIMER_GETCURFOLDER,
+	OW_TIMER_BINDTOOBJECT,
+	OW_TIMER_COMPAREIDS,
+	OW_TIMER_CREATEVIEWOBJECT,
+	OW_TIMER_ENUMOBJECTS,
+	OW_TIMER_GETATTRIBUTESOF,
+	OW_TIMER_GETUIOBJECTOF,
+	OW_TIMER_BINDTOSTORAGE,
+	OW_TIMER_GETDISPLAYNAMEOF,
+	OW_TIMER_PARSEDISPLAYNAME,
+	OW_TIMER_SETNAMEOF,
+	OW_TIMER_COLUMNCLICK,
+	OW_TIMER_GETDETAILSOF,
+	OW_TIMER_ENUMSEARCHES,
+	OW_TIMER_GETDEFAULTCOLUMN,
+	OW_TIMER_GETDEFAULTCOLUMNSTATE,
+	OW_TIMER_GETDEFAULTSEARCHGUID,
+	OW_TIMER_GETDETAILSEX,
+	OW_TIMER_MAPCOLUMNTOSCID,
+	OW_TIMER_SETSEARCHQUERY,
+	OW_TIMER_SETSEARCHMODE,
+
+	// Enumeration phases
+	OW_TIMER_ENUM_ACTIVATION,		// getting the window list from the source
+	OW_TIMER_ENUM_PROBE,			// asking one window about itself
+	OW_TIMER_ENUM_FALLBACK,			// the file URI strategy, after the folder item one failed
+
+	OW_TIMER_MAX
+};
+
+enum OWCounter
+{
+	OW_COUNTER_STRRET_ALLOC,		// STRRET_WSTR strings allocated for the shell
+	OW_COUNTER_STRRET_OFFSET,		// returned by offset instead
+	OW_COUNTER_PIDL_ALLOC,			// item pidls made for the shell
+	OW_COUNTER_SNAPSHOT,			// window snapshots taken
+	OW_COUNTER_SNAPSHOT_UNCHANGED,	// ... that turned out to be the same as the last one
+	OW_COUNTER_ICON_STOCK,			// item icons picked from the path alone
+	OW_COUNTER_ICON_LOOKUP,			// icon locations looked up for the cache
+
+	OW_COUNTER_MAX
+};
+
+// Call once from DllMain, before anything is recorded, and once at the end. Only the
+// clock is set up there.
+void OWMetricsInit();
+void OWMetricsTerm();
+
+void OWMetricsRecord(OWTimer Timer, LONGLONG Ticks);
+void OWMetricsCount(OWCounter Counter);
+void OWMetricsCount(OWCounter Counter, ULONG Amount);
+
+// The clock used for everything, and its ticks per second
+LONGLONG OWMetricsNow();
+LONGLONG OWMetricsFrequency();
+
+// Times a scope, like a method. When profiling allocations, it's also what they're
+// counted against, see AllocProfile.h.
+class COWMetricTimer
+{
+public:
+#if defined(OW_ALLOC_PROFILE)
+	COWMetricTimer(OWTimer Timer) : m_Timer(Timer), m_Start(OWMetricsNow()), m_Outer(OWAllocEnter(Timer)) {}
+	~COWMetricTimer() { OWMetricsRecord(m_Timer, OWMetricsNow() - m_Start); OWAllocLeave(m_Outer); }
+#else
+	COWMetricTimer(OWTimer Timer) : m_Timer(Timer), m_Start(OWMetricsNow()) {}
+	~COWMetricTimer() { OWMetricsRecord(m_Timer, OWMetricsNow() - m_Start); }
+#endif
+
+protected:
+	OWTimer m_Timer;
+	LONGLONG m_Start;
+#if defined(OW_ALLOC_PROFILE)
+	int m_Outer;
+#endif
+};
+
+//----------------------------------------------------------------------------------------
+// Reading
+
+struct OWTimerTotals
+{
+	ULONG Calls;
+	ULONGLONG TotalMicroseconds;
+	ULONG MaxMicroseconds;
+	ULONG Buckets[OW_METRICS_BUCKETS];
+};
+
+struct OWMetricsTotals
+{
+	OWTimerTotals Timers[OW_TIMER_MAX];
+	ULONG Counters[OW_COUNTER_MAX];
+};
+
+// Copy this process' slot
+void OWMetricsRead(OWMetricsTotals *Totals);
+
+// Percentile (0-100) of a timer, in microseconds; the upper bound of its bucket
+ULONG OWMetricsPercentile(const OWTimerTotals *Timer, int Percentile);
+
+LPCSTR OWMetricsTimerName(OWTimer Timer);
+LPCSTR OWMetricsCounterName(OWCounter Counter);
+
+// A text report of everything, with the host process, for people to read.
+// Returns the length, and writes at most Size-1 chars.
+int OWMetricsFormat(LPSTR Buffer, int Size);
+
+#endif // __METRICS_H_
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __OWCALLLOG_H_
+#define __OWCALLLOG_H_
+
+//========================================================================================
+// The call log format: the calls the shell made on each folder, with their arguments
+// and how long they took, and the snapshots they were about. The folder writes it (see
+// CallLog.h), and Tools/CallReplay drives the portable core with the same calls, so
+// real sequences from defview, the file dialogs and Office's dialogs can be measured
+// anywhere. Like OWTrace.h, this doesn't include Windows headers.
+//
+// Everything is in the native (little endian) byte order, without padding.
+
+#include "OWTrace.h"
+
+enum
+{
+	OW_CALLLOG_MAGIC = 0x4C43574F,	// "OWCL"
+	OW_CALLLOG_VERSION = 1,
+
+	OW_CALLLOG_HOST_LENGTH = 64
+};
+
+// A file is this header, then records in the order the calls finished.
+struct OWCallLogHeader
+{
+	unsigned int Magic;
+	unsigned short Version;
+	unsigned short RecordSize;	// sizeof(OWCallLogRecord)
+	unsigned int ProcessId;
+	unsigned int Reserved;
+	char Host[OW_CALLLOG_HOST_LENGTH];	// file name of the process' executable
+};
+
+enum OWCallLogType
+{
+	OW_CALLLOG_CALL = 1,
+	// Args: item count, payload size, changed (0/1). The payload is the items, each
+	// as an item id (a USHORT cb, then the item, see OWCore.h) without a terminator.
+	// Unchanged snapshots have none; the folder still compared them.
+	OW_CALLLOG_SNAPSHOT,
+	// Args: result count, payload size, mode. The payload is a USHORT snapshot
+	// index for each result, best first.
+	OW_CALLLOG_RESULTS
+};
+
+// Every record is this, then its payload, if any
+struct OWCallLogRecord
+{
+	unsigned short Type;
+	unsigned short Event;		// the OWTraceEvent of the method, for calls
+	unsigned int Object;		// low 32 bits of the folder's address
+	OWUINT64 Start;				// microseconds since the log was started
+	unsigned int Duration;		// microseconds
+	unsigned int Args[3];		// as in OWTrace.h, except for items
+};
+
+// Calls have the same arguments as their trace events, with items given as below.
+// EnumObjects also has how many items it handed out, and ParseDisplayName has the
+// item it found, or FOREIGN.
+
+// Items in the arguments of a call. Ours are given by their index in the folder's
+// last snapshot; the ones that aren't in it anymore are stale.
+enum
+{
+	OW_CALLLOG_ITEM_NULL = 0,
+	OW_CALLLOG_ITEM_ROOT = 1,		// the empty pidl, meaning the folder itself
+	OW_CALLLOG_ITEM_FOREIGN = 2,	// not one of ours
+	OW_CALLLOG_ITEM_STALE = 3,
+	OW_CALLLOG_ITEM_FIRST = 16		// plus the snapshot index
+};
+
+#endif // __OWCALLLOG_H_
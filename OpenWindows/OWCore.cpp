@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+// No stdafx.h here on purpose; this builds without Windows.
+#include <string.h>
+#include "OWCore.h"
+
+//========================================================================================
+// Helpers
+
+static unsigned short ReadUShort(const void *p, size_t Offset)
+{
+	unsigned short Value;
+	memcpy(&Value, (const unsigned char*)p + Offset, sizeof(Value));
+	return Value;
+}
+
+static void WriteUShort(void *p, size_t Offset, unsigned short Value)
+{
+	memcpy((unsigned char*)p + Offset, &Value, sizeof(Value));
+}
+
+size_t OWStrLen(const OWCHAR *s)
+{
+	const OWCHAR *End = s;
+	while (*End)
+		End++;
+	return End - s;
+}
+
+int OWStrCmp(const OWCHAR *a, const OWCHAR *b)
+{
+	while (*a && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return (int)*a - (int)*b;
+}
+
+//========================================================================================
+// Item id lists
+
+const void *OWIdListGetNext(const void *pidl)
+{
+	return (const unsigned char*)pidl + ReadUShort(pidl, 0);
+}
+
+unsigned OWIdListGetSize(const void *pidl)
+{
+	unsigned Size = 0;
+	unsigned short cb;
+
+	while ((cb = ReadUShort(pidl, 0)) != 0)
+	{
+		Size += cb;
+		pidl = (const unsigned char*)pidl + cb;
+	}
+
+	// The terminating cb
+	return Size + sizeof(unsigned short);
+}
+
+bool OWIdListIsSingle(const void *pidl)
+{
+	return ReadUShort(OWIdListGetNext(pidl), 0) == 0;
+}
+
+//========================================================================================
+// Item codec
+
+// Byte offsets from the cb
+enum
+{
+	OFFSET_MAGIC = 2,
+	OFFSET_LAYOUT = 6,
+	OFFSET_RANK = 8,
+	OFFSET_PATH_LENGTH = 10,
+	OFFSET_NAME_LENGTH = 12,
+	OFFSET_PATH_ANSI = 14,
+	OFFSET_NAME_ANSI = 16,
+
+	OFFSET_STRINGS_V0 = 10,
+	OFFSET_STRINGS_V1 = 14,
+	OFFSET_STRINGS_V2 = 18
+};
+
+unsigned OWItemGetSize(const OWItemData *Item)
+{
+	return   OFFSET_STRINGS_V2 - 2
+		   + (Item->PathLength+1)*sizeof(OWCHAR)
+		   + (Item->NameLength+1)*sizeof(OWCHAR)
+		   + (Item->PathALength != OW_NO_ANSI ? Item->PathALength+1 : 0)
+		   + (Item->NameALength != OW_NO_ANSI ? Item->NameALength+1 : 0)
+		   ;
+}
+
+void OWItemEncode(const OWItemData *Item, void *Target)
+{
+	// Everything is laid out from the cb, which is right before Target
+	unsigned char *pidl = (unsigned char*)Target - 2;
+	unsigned int Magic = OW_ITEM_MAGIC;
+	unsigned Offset = OFFSET_STRINGS_V2;
+
+	memcpy(pidl + OFFSET_MAGIC, &Magic, 4);
+	WriteUShort(pidl, OFFSET_LAYOUT, OW_LAYOUT_CURRENT);
+	WriteUShort(pidl, OFFSET_RANK, Item->Rank);
+	WriteUShort(pidl, OFFSET_PATH_LENGTH, Item->PathLength);
+	WriteUShort(pidl, OFFSET_NAME_LENGTH, Item->NameLength);
+
+	memcpy(pidl + Offset, Item->Path, Item->PathLength*sizeof(OWCHAR));
+	Offset += Item->PathLength*sizeof(OWCHAR);
+	memset(pidl + Offset, 0, sizeof(OWCHAR));
+	Offset += sizeof(OWCHAR);
+
+	memcpy(pidl + Offset, Item->Name, Item->NameLength*sizeof(OWCHAR));
+	Offset += Item->NameLength*sizeof(OWCHAR);
+	memset(pidl + Offset, 0, sizeof(OWCHAR));
+	Offset += sizeof(OWCHAR);
+
+	WriteUShort(pidl, OFFSET_PATH_ANSI, 0);
+	if (Item->PathALength != OW_NO_ANSI)
+	{
+		WriteUShort(pidl, OFFSET_PATH_ANSI, (unsigned short)Offset);
+		memcpy(pidl + Offset, Item->PathA, Item->PathALength);
+		Offset += Item->PathALength;
+		pidl[Offset++] = '\0';
+	}
+
+	WriteUShort(pidl, OFFSET_NAME_ANSI, 0);
+	if (Item->NameALength != OW_NO_ANSI)
+	{
+		WriteUShort(pidl, OFFSET_NAME_ANSI, (unsigned short)Offset);
+		memcpy(pidl + Offset, Item->NameA, Item->NameALength);
+		Offset += Item->NameALength;
+		pidl[Offset++] = '\0';
+	}
+}
+
+bool OWItemIsOwn(const void *pidl)
+{
+	unsigned int Magic;
+
+	if (pidl == NULL || ReadUShort(pidl, 0) < OFFSET_LAYOUT)
+		return false;
+
+	memcpy(&Magic, (const unsigned char*)pidl + OFFSET_MAGIC, 4);
+	return Magic == OW_ITEM_MAGIC;
+}
+
+unsigned short OWItemGetLayout(const void *pidl)
+{
+	return ReadUShort(pidl, OFFSET_LAYOUT);
+}
+
+unsigned short OWItemGetRank(const void *pidl)
+{
+	return ReadUShort(pidl, OFFSET_RANK);
+}
+
+const OWCHAR *OWItemGetPath(const void *pidl)
+{
+	switch (OWItemGetLayout(pidl))
+	{
+	case OW_LAYOUT_V0:	return (const OWCHAR*)((const unsigned char*)pidl + OFFSET_STRINGS_V0);
+	case OW_LAYOUT_V1:	return (const OWCHAR*)((const unsigned char*)pidl + OFFSET_STRINGS_V1);
+	}
+
+	return (const OWCHAR*)((const unsigned char*)pidl + OFFSET_STRINGS_V2);
+}
+
+const OWCHAR *OWItemGetName(const void *pidl)
+{
+	return OWItemGetPath(pidl) + OWItemGetPathLength(pidl) + 1;
+}
+
+unsigned OWItemGetPathLength(const void *pidl)
+{
+	if (OWItemGetLayout(pidl) == OW_LAYOUT_V0)
+		return OWStrLen(OWItemGetPath(pidl));
+
+	return ReadUShort(pidl, OFFSET_PATH_LENGTH);
+}
+
+unsigned OWItemGetNameLength(const void *pidl)
+{
+	if (OWItemGetLayout(pidl) == OW_LAYOUT_V0)
+		return OWStrLen(OWItemGetName(pidl));
+
+	return ReadUShort(pidl, OFFSET_NAME_LENGTH);
+}
+
+const char *OWItemGetPathA(const void *pidl)
+{
+	unsigned short Offset;
+
+	if (OWItemGetLayout(pidl) < OW_LAYOUT_V2 || (Offset = ReadUShort(pidl, OFFSET_PATH_ANSI)) == 0)
+		return NULL;
+
+	return (const char*)pidl + Offset;
+}
+
+const char *OWItemGetNameA(const void *pidl)
+{
+	unsigned short Offset;
+
+	if (OWItemGetLayout(pidl) < OW_LAYOUT_V2 || (Offset = ReadUShort(pidl, OFFSET_NAME_ANSI)) == 0)
+		return NULL;
+
+	return (const char*)pidl + Offset;
+}
+
+//========================================================================================
+// Folder items
+
+enum
+{
+	OFFSET_FOLDER_KIND = 6,
+	OFFSET_FOLDER_NAME_LENGTH = 8,
+	OFFSET_FOLDER_NAME = 10
+};
+
+unsigned OWFolderItemGetSize(unsigned NameLength, unsigned KeyLength)
+{
+	return OFFSET_FOLDER_NAME - 2 + (NameLength+1)*sizeof(OWCHAR) + 2 + (KeyLength+1)*sizeof(OWCHAR);
+}
+
+void OWFolderItemEncode(int Kind, const OWCHAR *Name, unsigned NameLength,
+	const OWCHAR *Key, unsigned KeyLength, void *Target)
+{
+	unsigned char *pidl = (unsigned char*)Target - 2;
+	unsigned int Magic = OW_FOLDER_MAGIC;
+	size_t KeyOffset = OFFSET_FOLDER_NAME + (NameLength+1)*sizeof(OWCHAR);
+
+	memcpy(pidl + OFFSET_MAGIC, &Magic, 4);
+	WriteUShort(pidl, OFFSET_FOLDER_KIND, (unsigned short)Kind);
+	WriteUShort(pidl, OFFSET_FOLDER_NAME_LENGTH, (unsigned short)NameLength);
+	memcpy(pidl + OFFSET_FOLDER_NAME, Name, NameLength*sizeof(OWCHAR));
+	memset(pidl + OFFSET_FOLDER_NAME + NameLength*sizeof(OWCHAR), 0, sizeof(OWCHAR));
+	WriteUShort(pidl, KeyOffset, (unsigned short)KeyLength);
+	memcpy(pidl + KeyOffset + 2, Key, KeyLength*sizeof(OWCHAR));
+	memset(pidl + KeyOffset + 2 + KeyLength*sizeof(OWCHAR), 0, sizeof(OWCHAR));
+}
+
+bool OWFolderItemIsOwn(const void *pidl)
+{
+	unsigned int Magic;
+
+	if (pidl == NULL || ReadUShort(pidl, 0) < OFFSET_FOLDER_NAME + sizeof(OWCHAR))
+		return false;
+
+	memcpy(&Magic, (const unsigned char*)pidl + OFFSET_MAGIC, 4);
+	return Magic == OW_FOLDER_MAGIC;
+}
+
+int OWFolderItemGetKind(const void *pidl)
+{
+	return ReadUShort(pidl, OFFSET_FOLDER_KIND);
+}
+
+const OWCHAR *OWFolderItemGetName(const void *pidl)
+{
+	return (const OWCHAR*)((const unsigned char*)pidl + OFFSET_FOLDER_NAME);
+}
+
+unsigned OWFolderItemGetNameLength(const void *pidl)
+{
+	return ReadUShort(pidl, OFFSET_FOLDER_NAME_LENGTH);
+}
+
+// Where the key length is, or 0 when the item is too short to have a key
+static size_t GetFolderKeyOffset(const void *pidl)
+{
+	size_t Offset = OFFSET_FOLDER_NAME + (OWFolderItemGetNameLength(pidl)+1)*sizeof(OWCHAR);
+	if (ReadUShort(pidl, 0) < Offset + 2 + sizeof(OWCHAR))
+		return 0;
+	return Offset;
+}
+
+const OWCHAR *OWFolderItemGetKey(const void *pidl)
+{
+	static const OWCHAR Empty[1] = { 0 };
+
+	size_t Offset = GetFolderKeyOffset(pidl);
+	return Offset != 0 ? (const OWCHAR*)((const unsigned char*)pidl + Offset + 2) : Empty;
+}
+
+unsigned OWFolderItemGetKeyLength(const void *pidl)
+{
+	size_t Offset = GetFolderKeyOffset(pidl);
+	return Offset != 0 ? ReadUShort(pidl, Offset) : 0;
+}
+
+//========================================================================================
+// Item images
+
+unsigned OWItemImagesGetSize(const OWItemData *Items, int Count)
+{
+	unsigned Size = 0;
+	int i;
+
+	for (i = 0; i < Count; i++)
+		Size += sizeof(unsigned short) + OWItemGetSize(&Items[i]);
+	return Size;
+}
+
+void OWItemImagesBuild(const OWItemData *Items, int Count, void *Target, unsigned *Offsets)
+{
+	unsigned char *Images = (unsigned char*)Target;
+	unsigned Position = 0, Size;
+	int i;
+
+	for (i = 0; i < Count; i++)
+	{
+		Size = sizeof(unsigned short) + OWItemGetSize(&Items[i]);
+		Offsets[i] = Position;
+		WriteUShort(Images, Position, (unsigned short)Size);
+		OWItemEncode(&Items[i], Images + Position + sizeof(unsigned short));
+		Position += Size;
+	}
+	Offsets[Count] = Position;
+}
+
+int OWItemImagesToPidls(const void *Images, const unsigned *Offsets, int First, int Count,
+	void **Pidls, OWAllocProc Alloc, OWFreeProc Free, void *Context)
+{
+	const unsigned char *Base = (const unsigned char*)Images;
+	unsigned Size;
+	int i;
+
+	// Allocate them all first, so a failure has nothing half copied to undo
+	for (i = 0; i < Count; i++)
+	{
+		Size = Offsets[First + i + 1] - Offsets[First + i];
+		Pidls[i] = Alloc(Context, Size + sizeof(unsigned short));
+		if (Pidls[i] == NULL)
+		{
+			while (i-- > 0)
+				Free(Context, Pidls[i]);
+			return 0;
+		}
+	}
+
+	for (i = 0; i < Count; i++)
+	{
+		Size = Offsets[First + i + 1] - Offsets[First + i];
+		memcpy(Pidls[i], Base + Offsets[First + i], Size);
+		WriteUShort(Pidls[i], Size, 0);
+	}
+	return Count;
+}
+
+//========================================================================================
+// Ordering
+
+int OWItemCompare(const void *pidl1, const void *pidl2, int Field)
+{
+	int Result;
+
+	switch (Field)
+	{
+	case OW_FIELD_NAME:	Result = OWStrCmp(OWItemGetName(pidl1), OWItemGetName(pidl2));	break;
+	case OW_FIELD_PATH:	Result = OWStrCmp(OWItemGetPath(pidl1), OWItemGetPath(pidl2));	break;
+	case OW_FIELD_RANK:	Result = (int)OWItemGetRank(pidl1) - (int)OWItemGetRank(pidl2);	break;
+	default:			return 0;
+	}
+
+	return Result < 0 ? -1 : (Result > 0 ? 1 : 0);
+}
+
+//========================================================================================
+// Shell ID lists
+
+unsigned OWShellIDListGetSize(const void *Parent, const void * const *Items, unsigned Count)
+{
+	unsigned Size = (Count + 2) * sizeof(unsigned);
+	unsigned i;
+
+	Size += OWIdListGetSize(Parent);
+	for (i = 0; i < Count; i++)
+		Size += OWIdListGetSize(Items[i]);
+
+	return Size;
+}
+
+void OWShellIDListBuild(void *Target, const void *Parent, const void * const *Items, unsigned Count)
+{
+	unsigned *Header = (unsigned*)Target;
+	unsigned Position = (Count + 2) * sizeof(unsigned);
+	unsigned Size, i;
+
+	Header[0] = Count;
+
+	Size = OWIdListGetSize(Parent);
+	Header[1] = Position;
+	memcpy((unsigned char*)Target + Position, Parent, Size);
+	Position += Size;
+
+	for (i = 0; i < Count; i++)
+	{
+		Size = OWIdListGetSize(Items[i]);
+		Header[i + 2] = Position;
+		memcpy((unsigned char*)Target + Position, Items[i], Size);
+		Position += Size;
+	}
+}
+
+//========================================================================================
+// Enumeration policy
+
+static OWCHAR FoldAscii(OWCHAR c)
+{
+	return (c >= 'a' && c <= 'z') ? (OWCHAR)(c - 'a' + 'A') : c;
+}
+
+bool OWIsExplorerApp(const OWCHAR *FullName)
+{
+	static const char Wanted[] = "EXPLORER.EXE";
+	const size_t WantedLength = sizeof(Wanted) - 1;
+	size_t Length = OWStrLen(FullName);
+	size_t i, j;
+
+	for (i = 0; i + WantedLength <= Length; i++)
+	{
+		for (j = 0; j < WantedLength; j++)
+		{
+			if (FoldAscii(FullName[i + j]) != (OWCHAR)Wanted[j])
+				break;
+		}
+		if (j == WantedLength)
+			return true;
+	}
+	return false;
+}
+
+int OWCheckWindowPath(const OWCHAR *Path, const OWCHAR *ManifestationPath)
+{
+	// An empty BSTR is usually NULL
+	if (Path == NULL || Path[0] == 0)
+		return OW_PATH_EMPTY;
+	if (Path[0] == ':' && Path[1] == ':')
+		return OW_PATH_NAMESPACE;
+	if (ManifestationPath != NULL && OWStrCmp(Path, ManifestationPath) == 0)
+		return OW_PATH_MANIFESTATION;
+	return OW_PATH_OK;
+}
+
+//========================================================================================
+// Icons
+
+static bool IsSeparator(OWCHAR c)
+{
+	return c == '\\' || c == '/';
+}
+
+int OWClassifyPath(const OWCHAR *Path, char *pDrive)
+{
+	OWCHAR Letter;
+	size_t i;
+	int Parts;
+
+	*pDrive = 0;
+	if (Path == NULL || Path[0] == 0)
+		return OW_CLASS_OTHER;
+
+	Letter = FoldAscii(Path[0]);
+	if (Letter >= 'A' && Letter <= 'Z' && Path[1] == ':')
+	{
+		*pDrive = (char)Letter;
+		if (Path[2] == 0 || (IsSeparator(Path[2]) && Path[3] == 0))
+			return OW_CLASS_DRIVE;
+		return IsSeparator(Path[2]) ? OW_CLASS_FOLDER : OW_CLASS_OTHER;
+	}
+
+	// \\server\share\..., but not \\?\ or \\.\ paths
+	if (!IsSeparator(Path[0]) || !IsSeparator(Path[1]) || Path[2] == '?' || Path[2] == '.')
+		return OW_CLASS_OTHER;
+
+	Parts = 0;
+	for (i = 2; Path[i] != 0; i++)
+	{
+		if (!IsSeparator(Path[i]) && (i == 2 || IsSeparator(Path[i - 1])))
+			Parts++;
+	}
+	if (Parts < 2)
+		return OW_CLASS_OTHER;
+	return Parts == 2 ? OW_CLASS_SHARE : OW_CLASS_NETWORK_FOLDER;
+}
+
+//========================================================================================
+// Groups
+
+// How long Folder is when Path is in it (or is it), else 0
+static size_t MatchFolder(const OWCHAR *Path, const OWCHAR *Folder)
+{
+	size_t i;
+
+	for (i = 0; Folder[i] != 0; i++)
+	{
+		if (IsSeparator(Folder[i]) ? !IsSeparator(Path[i]) : FoldAscii(Folder[i]) != FoldAscii(Path[i]))
+			return 0;
+	}
+	// "C:\Users\me" isn't in "C:\Users\m", but "C:\" has its separator already
+	if (i == 0 || (Path[i] != 0 && !IsSeparator(Path[i]) && !IsSeparator(Folder[i - 1])))
+		return 0;
+	return i;
+}
+
+int OWGroupPath(const OWCHAR *Path, const OWCHAR * const *Known, int KnownCount, OWCHAR *Key, int *pKnown)
+{
+	size_t Best = 0, Length, i;
+	int Class, k;
+	char Drive;
+
+	*pKnown = -1;
+	Key[0] = 0;
+	for (k = 0; k < KnownCount; k++)
+	{
+		Length = MatchFolder(Path, Known[k]);
+		if (Length > Best)
+		{
+			Best = Length;
+			*pKnown = k;
+		}
+	}
+	if (*pKnown >= 0)
+	{
+		memcpy(Key, Known[*pKnown], Best*sizeof(OWCHAR));
+		Key[Best] = 0;
+		return OW_GROUP_KNOWN;
+	}
+
+	Class = OWClassifyPath(Path, &Drive);
+	if (Class == OW_CLASS_DRIVE || Class == OW_CLASS_FOLDER)
+	{
+		// "C:" alone is a drive too, but one char short of its key
+		if (Path[2] == 0)
+			return OW_GROUP_NONE;
+		Key[0] = (OWCHAR)Drive;
+		Key[1] = ':';
+		Key[2] = '\\';
+		Key[3] = 0;
+		return OW_GROUP_DRIVE;
+	}
+	if (Class == OW_CLASS_SHARE || Class == OW_CLASS_NETWORK_FOLDER)
+	{
+		Key[0] = '\\';
+		Key[1] = '\\';
+		for (i = 2; Path[i] != 0 && !IsSeparator(Path[i]); i++)
+			Key[i] = Path[i];
+		Key[i] = 0;
+		return OW_GROUP_HOST;
+	}
+	return OW_GROUP_NONE;
+}
+
+//========================================================================================
+// Snapshots
+
+static bool SameText(const OWCHAR *a, unsigned short aLength, const OWCHAR *b, unsigned short bLength)
+{
+	return aLength == bLength && memcmp(a, b, aLength*sizeof(OWCHAR)) == 0;
+}
+
+// FNV-1a over the length and the last few UTF-16 units, exactly as they are; paths
+// are matched exactly too. Folders open side by side mostly differ at the end, and the
+// whole path would cost more to hash than the old scan did to compare.
+#define OW_PATH_HASH_TAIL	24
+
+static unsigned PathHash(const OWCHAR *Path, unsigned short Length)
+{
+	unsigned Hash = (2166136261u ^ Length) * 16777619u;
+	unsigned short i = Length > OW_PATH_HASH_TAIL ? Length - OW_PATH_HASH_TAIL : 0;
+
+	for (; i < Length; i++)
+	{
+		Hash ^= Path[i];
+		Hash *= 16777619u;
+	}
+	return Hash;
+}
+
+int OWSnapshotDiff(const OWItemData *Old, int OldCount, const OWItemData *New, int NewCount, int *Matches)
+{
+	int Changes = 0, Matched = 0;
+	int i, j;
+
+	// The old items by path, chained per bucket: Buckets[] has the first of each,
+	// Next[] the one after. It's only filled in once a window has moved. Two windows
+	// can be open on the same folder, so an old item is only matched once, and Used[]
+	// says which were. All in one block.
+	bool Hashed = false;
+	int BucketCount = 1;
+	while (BucketCount < OldCount*2)
+		BucketCount <<= 1;
+
+	int *Block = new int[BucketCount + OldCount*2];
+	if (Block == NULL)
+	{
+		for (i = 0; i < NewCount; i++)
+			Matches[i] = -1;
+		return NewCount + OldCount;
+	}
+	int *Buckets = Block, *Next = Block + BucketCount, *Used = Next + OldCount;
+
+	for (j = 0; j < OldCount; j++)
+		Used[j] = 0;
+
+	for (i = 0; i < NewCount; i++)
+	{
+		const OWItemData &n = New[i];
+		Matches[i] = -1;
+
+		// Windows mostly stay in place, so look there first
+		if (i < OldCount && !Used[i] && SameText(Old[i].Path, Old[i].PathLength, n.Path, n.PathLength))
+		{
+			Matches[i] = i;
+		}
+		else
+		{
+			if (!Hashed)
+			{
+				for (j = 0; j < BucketCount; j++)
+					Buckets[j] = -1;
+				// Backwards, so each chain is in order and the first old item of a path wins
+				for (j = OldCount - 1; j >= 0; j--)
+				{
+					unsigned Bucket = PathHash(Old[j].Path, Old[j].PathLength) & (BucketCount - 1);
+					Next[j] = Buckets[Bucket];
+					Buckets[Bucket] = j;
+				}
+				Hashed = true;
+			}
+
+			for (j = Buckets[PathHash(n.Path, n.PathLength) & (BucketCount - 1)]; j >= 0; j = Next[j])
+			{
+				if (!Used[j] && SameText(Old[j].Path, Old[j].PathLength, n.Path, n.PathLength))
+				{
+					Matches[i] = j;
+					break;
+				}
+			}
+		}
+
+		if (Matches[i] < 0)
+		{
+			Changes++;
+			continue;
+		}
+
+		const OWItemData &o = Old[Matches[i]];
+		Used[Matches[i]] = 1;
+		Matched++;
+		if (o.Rank != n.Rank || !SameText(o.Name, o.NameLength, n.Name, n.NameLength))
+			Changes++;
+	}
+
+	delete [] Block;
+
+	// Whatever wasn't matched went away
+	return Changes + (OldCount - Matched);
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __OWCORE_H_
+#define __OWCORE_H_
+
+//========================================================================================
+// The parts of the folder that don't need the shell: the item pidl codec, walking id
+// lists, the CIDA layout, item ordering, which windows get listed, and comparing
+// snapshots. Nothing in here includes Windows or ATL headers, so it builds (and can
+// be profiled) anywhere; the COM classes are adapters over it.
+//
+// Pidls are read and written with memcpy, in the native byte order.
+
+#include <stddef.h>
+
+// UTF-16 text, as in OLECHAR. wchar_t is 32 bits outside of Windows.
+#ifdef _WIN32
+typedef wchar_t OWCHAR;
+#else
+typedef unsigned short OWCHAR;
+#endif
+
+#if defined(_MSC_VER)
+typedef unsigned __int64 OWUINT64;
+#else
+typedef unsigned long long OWUINT64;
+#endif
+
+size_t OWStrLen(const OWCHAR *s);
+int OWStrCmp(const OWCHAR *a, const OWCHAR *b);
+
+//========================================================================================
+// Item id lists: a USHORT cb counting itself and the data after it, ended by a cb of 0.
+
+// Size of the whole list, with the terminator
+unsigned OWIdListGetSize(const void *pidl);
+const void *OWIdListGetNext(const void *pidl);
+bool OWIdListIsSingle(const void *pidl);
+
+//========================================================================================
+// Our items. After the cb:
+//  MAGIC (4), layout (2), then
+//  LAYOUT_V0: rank (2), path, name
+//  LAYOUT_V1: rank (2), path length (2), name length (2), path, name
+//  LAYOUT_V2: like V1, then ANSI path offset (2), ANSI name offset (2), path, name,
+//             and the ANSI copies. The offsets count from the cb, 0 means no copy.
+// Strings are null terminated UTF-16, ANSI copies are in the Windows code page.
+
+enum
+{
+	OW_ITEM_MAGIC = 0xAA4F5755,		// 0xAA000055 | ('OW'<<8)
+
+	OW_LAYOUT_V0 = 0,
+	OW_LAYOUT_V1 = 1,
+	OW_LAYOUT_V2 = 2,
+	OW_LAYOUT_CURRENT = OW_LAYOUT_V2,
+
+	// An ANSI copy length for when there's no copy
+	OW_NO_ANSI = 0xFFFF
+};
+
+struct OWItemData
+{
+	unsigned short Rank;
+	const OWCHAR *Path;
+	unsigned short PathLength;
+	const OWCHAR *Name;
+	unsigned short NameLength;
+	const char *PathA;
+	unsigned short PathALength;		// or OW_NO_ANSI
+	const char *NameA;
+	unsigned short NameALength;		// or OW_NO_ANSI
+};
+
+// Size of the encoded item, not counting the cb
+unsigned OWItemGetSize(const OWItemData *Item);
+// Write the item right after the cb
+void OWItemEncode(const OWItemData *Item, void *Target);
+
+// These take the pidl itself (its cb), in any layout
+bool OWItemIsOwn(const void *pidl);
+unsigned short OWItemGetLayout(const void *pidl);
+unsigned short OWItemGetRank(const void *pidl);
+const OWCHAR *OWItemGetPath(const void *pidl);
+const OWCHAR *OWItemGetName(const void *pidl);
+unsigned OWItemGetPathLength(const void *pidl);
+unsigned OWItemGetNameLength(const void *pidl);
+// NULL when the pidl has no ANSI copy
+const char *OWItemGetPathA(const void *pidl);
+const char *OWItemGetNameA(const void *pidl);
+
+//========================================================================================
+// Folder items: folders of our own below the root, like the recently closed windows.
+// After the cb: MAGIC (4), kind (2), name length (2), name, key length (2), key. The
+// strings are null terminated UTF-16. The key tells folders of the same kind apart;
+// items from before it was there have none, which reads as an empty one.
+
+enum
+{
+	OW_FOLDER_MAGIC = 0xAA465755		// 0xAA000055 | ('FW'<<8)
+};
+
+enum OWFolderKind
+{
+	OW_FOLDER_RECENT = 1,		// the recently closed windows, see OWHistory.h
+	OW_FOLDER_GROUP = 2			// the windows of a group, see OWGroupPath()
+};
+
+// Size of the encoded item, not counting the cb
+unsigned OWFolderItemGetSize(unsigned NameLength, unsigned KeyLength);
+// Write the item right after the cb
+void OWFolderItemEncode(int Kind, const OWCHAR *Name, unsigned NameLength,
+	const OWCHAR *Key, unsigned KeyLength, void *Target);
+
+// These take the pidl itself (its cb)
+bool OWFolderItemIsOwn(const void *pidl);
+int OWFolderItemGetKind(const void *pidl);
+const OWCHAR *OWFolderItemGetName(const void *pidl);
+unsigned OWFolderItemGetNameLength(const void *pidl);
+const OWCHAR *OWFolderItemGetKey(const void *pidl);
+unsigned OWFolderItemGetKeyLength(const void *pidl);
+
+//========================================================================================
+// Item images: items encoded back to back as whole pidl items (the cb, then the data),
+// without terminators. Offsets[i] is where item i starts and Offsets[Count] where the
+// last one ends, so any run of them turns into pidls with a size, an allocation and a
+// copy each.
+
+unsigned OWItemImagesGetSize(const OWItemData *Items, int Count);
+// Offsets has Count+1 entries
+void OWItemImagesBuild(const OWItemData *Items, int Count, void *Target, unsigned *Offsets);
+
+// The allocator pidls are made with; Alloc returns NULL when out of memory
+typedef void *(*OWAllocProc)(void *Context, unsigned Size);
+typedef void (*OWFreeProc)(void *Context, void *Block);
+
+// Make single item pidls of images First to First+Count-1, into Pidls. All or nothing:
+// returns Count, or 0 with nothing left allocated.
+int OWItemImagesToPidls(const void *Images, const unsigned *Offsets, int First, int Count,
+	void **Pidls, OWAllocProc Alloc, OWFreeProc Free, void *Context);
+
+//========================================================================================
+// Ordering
+
+enum OWItemField
+{
+	OW_FIELD_NAME,
+	OW_FIELD_PATH,
+	OW_FIELD_RANK
+};
+
+// <0, 0 or >0, like strcmp. Both must be our items.
+int OWItemCompare(const void *pidl1, const void *pidl2, int Field);
+
+//========================================================================================
+// Shell ID lists (CIDA): a UINT count, Count+1 UINT offsets, then the parent folder's
+// id list and the item ones, the offsets counting from the start.
+
+unsigned OWShellIDListGetSize(const void *Parent, const void * const *Items, unsigned Count);
+void OWShellIDListBuild(void *Target, const void *Parent, const void * const *Items, unsigned Count);
+
+//========================================================================================
+// Enumeration policy
+
+// Only windows of the shell itself get listed, not IE or other browser hosts.
+bool OWIsExplorerApp(const OWCHAR *FullName);
+
+enum OWPathCheck
+{
+	OW_PATH_OK,
+	OW_PATH_EMPTY,
+	OW_PATH_NAMESPACE,		// "::{GUID}" paths; they're hit and miss
+	OW_PATH_MANIFESTATION	// the fake path we hand to file dialogs, see GetDisplayNameOf
+};
+
+int OWCheckWindowPath(const OWCHAR *Path, const OWCHAR *ManifestationPath);
+
+//========================================================================================
+// Icons
+
+// What kind of place a path is, which is most of what its icon depends on. It's worked
+// out from the text alone, so it's safe for paths on slow or gone network shares.
+enum OWPathClass
+{
+	OW_CLASS_FOLDER,			// a folder on a drive
+	OW_CLASS_DRIVE,				// a drive root, "C:\"
+	OW_CLASS_SHARE,				// a share root, "\\server\share"
+	OW_CLASS_NETWORK_FOLDER,	// a folder in a share
+	OW_CLASS_OTHER				// anything else, i.e. "::{GUID}" paths
+};
+
+// *pDrive gets the upper case drive letter, or 0 when the path isn't on one.
+int OWClassifyPath(const OWCHAR *Path, char *pDrive);
+
+//========================================================================================
+// Groups
+
+enum OWGroupKind
+{
+	OW_GROUP_NONE,			// "::{GUID}" paths and such, which stay in the root
+	OW_GROUP_DRIVE,			// key "C:\"
+	OW_GROUP_HOST,			// key "\\server"
+	OW_GROUP_KNOWN			// key the known folder's path, as given
+};
+
+// Which group the window at Path goes in: the deepest of the Known folders it's in or
+// is, else its drive or its server. Key gets the group's key, null terminated; it's
+// never longer than Path. *pKnown gets which known folder, or -1. Paths compare
+// without regard to ASCII case.
+int OWGroupPath(const OWCHAR *Path, const OWCHAR * const *Known, int KnownCount, OWCHAR *Key, int *pKnown);
+
+//========================================================================================
+// Snapshots
+
+// Match the items of a new snapshot against the old one, by path, through a hash of
+// the old paths. Matches[i] is the old item with the same path as New[i], or -1.
+// Returns how many items were added, removed, or changed name or rank; 0 means the
+// snapshots are the same.
+int OWSnapshotDiff(const OWItemData *Old, int OldCount, const OWItemData *New, int NewCount, int *Matches);
+
+#endif // __OWCORE_H_
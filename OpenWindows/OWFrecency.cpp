@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+// No stdafx.h here on purpose; this builds without Windows.
+#include <math.h>
+#include <string.h>
+#include "OWFrecency.h"
+
+//========================================================================================
+// Time
+
+// 2020-01-01, as a FILETIME (100ns since 1601)
+static const OWUINT64 EPOCH = (OWUINT64)13222310400 * 10000000;
+static const OWUINT64 TICKS_PER_MINUTE = (OWUINT64)60 * 10000000;
+
+static unsigned Minutes(OWUINT64 Now)
+{
+	return Now > EPOCH ? (unsigned)((Now - EPOCH) / TICKS_PER_MINUTE) : 0;
+}
+
+static double Hours(OWUINT64 Now)
+{
+	// Keys of 0 mean none, so a clock from before 2020 still gives a real one
+	double Hours = Now > EPOCH ? (double)(Now - EPOCH) / (TICKS_PER_MINUTE * 60) : 0;
+	return Hours > 1 ? Hours : 1;
+}
+
+// HALF_LIFE * log2(2^(a/HALF_LIFE) + 2^(b/HALF_LIFE)), without overflowing
+static float AddVisit(float Key, double Hours)
+{
+	double High = Key > Hours ? Key : Hours, Low = Key > Hours ? Hours : Key;
+	return (float)(High + OW_FRECENCY_HALF_LIFE * log(1 + pow(2.0, (Low - High) / OW_FRECENCY_HALF_LIFE)) / log(2.0));
+}
+
+//========================================================================================
+// The table
+
+bool OWFrecencyCheck(const OWFrecencyTable *Table)
+{
+	return Table->Magic == OW_FRECENCY_MAGIC && Table->Version == OW_FRECENCY_VERSION
+		&& Table->SlotCount == OW_FRECENCY_SLOTS;
+}
+
+void OWFrecencyFormat(OWFrecencyTable *Table)
+{
+	memset(Table, 0, sizeof(*Table));
+	Table->Magic = OW_FRECENCY_MAGIC;
+	Table->Version = OW_FRECENCY_VERSION;
+	Table->SlotCount = OW_FRECENCY_SLOTS;
+}
+
+unsigned OWFrecencyHash(const OWCHAR *Path, unsigned Length)
+{
+	// FNV-1a over the folded UTF-16 units
+	unsigned Hash = 2166136261u;
+	unsigned i;
+	OWCHAR c;
+
+	// "C:\" keeps its slash, "C:\Users\" doesn't
+	if (Length > 3 && (Path[Length - 1] == '\\' || Path[Length - 1] == '/'))
+		Length--;
+
+	for (i = 0; i < Length; i++)
+	{
+		c = Path[i];
+		if (c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		else if (c == '/')
+			c = '\\';
+		Hash ^= c;
+		Hash *= 16777619u;
+	}
+	return Hash != 0 ? Hash : 1;
+}
+
+float OWFrecencyGetKey(const OWFrecencyTable *Table, unsigned Hash)
+{
+	const volatile OWFrecencySlot *Slots = Table->Slots;
+	unsigned Start = Hash % OW_FRECENCY_SLOTS, i;
+	float Key;
+
+	for (i = 0; i < OW_FRECENCY_PROBES; i++)
+	{
+		const volatile OWFrecencySlot &Slot = Slots[(Start + i) % OW_FRECENCY_SLOTS];
+		if (Slot.Hash == Hash)
+		{
+			Key = Slot.Key;
+			// It can have been taken over meanwhile
+			return Slot.Hash == Hash ? Key : 0;
+		}
+	}
+	return 0;
+}
+
+bool OWFrecencyTouch(OWFrecencyTable *Table, unsigned Hash, OWUINT64 Now)
+{
+	volatile OWFrecencySlot *Slots = Table->Slots;
+	unsigned Start = Hash % OW_FRECENCY_SLOTS, Minute = Minutes(Now), i;
+	int Free = -1, Lowest = -1;
+
+	for (i = 0; i < OW_FRECENCY_PROBES; i++)
+	{
+		int Index = (Start + i) % OW_FRECENCY_SLOTS;
+		volatile OWFrecencySlot &Slot = Slots[Index];
+
+		if (Slot.Hash == Hash)
+		{
+			// Activations are told late, and by every process that asks (see
+			// Frecency.h), so one that isn't past the last visit was counted already
+			if (Slot.Visits != 0 && (Minute < Slot.LastMinute || Minute - Slot.LastMinute < OW_FRECENCY_DEBOUNCE))
+				return false;
+			Slot.Key = AddVisit(Slot.Key, Hours(Now));
+			Slot.LastMinute = Minute;
+			Slot.Visits++;
+			return true;
+		}
+		if (Slot.Hash == 0)
+		{
+			if (Free < 0)
+				Free = Index;
+		}
+		else if (Lowest < 0 || Slot.Key < Slots[Lowest].Key)
+			Lowest = Index;
+	}
+
+	// A new path, in a free slot, or in place of the one worth the least
+	volatile OWFrecencySlot &Slot = Slots[Free >= 0 ? Free : Lowest];
+	Slot.Hash = 0;
+	Slot.Key = (float)Hours(Now);
+	Slot.LastMinute = Minute;
+	Slot.Visits = 1;
+	Slot.Hash = Hash;
+	return true;
+}
+
+double OWFrecencyScore(float Key, OWUINT64 Now)
+{
+	if (Key == 0)
+		return 0;
+	return pow(2.0, (Key - Hours(Now)) / OW_FRECENCY_HALF_LIFE);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __OWFRECENCY_H_
+#define __OWFRECENCY_H_
+
+//========================================================================================
+// How often and how recently each folder was picked or switched to, as one number per path,
+// for putting the most useful windows first. A visit is worth 1 when it happens, and
+// half that every OW_FRECENCY_HALF_LIFE hours after; a path's score is the sum over its
+// visits.
+//
+// Rather than the score, what's kept is its logarithm, shifted by the time:
+//   Key = HALF_LIFE * log2(sum of 2^(t/HALF_LIFE)), t in hours since 2020
+// Every score decays at the same rate, so keys order paths the same way their scores
+// do at any time, and never need to be brought up to date; a visit only adds to its
+// own (log2 of 2^a + 2^b), which is O(1). The score now is 2^((Key - now)/HALF_LIFE).
+//
+// The table is a fixed, open addressed hash of path hashes, meant to be shared between
+// processes (see Frecency.h). Writers are kept to one at a time by the caller; readers
+// take no lock. Every field a reader looks at is 32 bits, written in one go, and a new
+// slot gets its hash last, so a reader sees a whole slot or no slot. When a probe finds
+// no room, the slot with the lowest score goes. Like OWCore.h, this doesn't include
+// Windows headers.
+
+#include "OWCore.h"
+
+enum
+{
+	OW_FRECENCY_MAGIC = 0x4657574F,		// "OWWF"
+	OW_FRECENCY_VERSION = 1,
+
+	OW_FRECENCY_SLOTS = 1024,
+	OW_FRECENCY_PROBES = 8,
+
+	OW_FRECENCY_HALF_LIFE = 72,			// hours
+	// Visits closer than this to the last one of the same path don't count; opening
+	// a folder tends to bind to it more than once.
+	OW_FRECENCY_DEBOUNCE = 1			// minutes
+};
+
+struct OWFrecencySlot
+{
+	unsigned int Hash;				// 0 when free
+	float Key;
+	unsigned int LastMinute;		// of the last visit, since 2020
+	unsigned int Visits;
+};
+
+struct OWFrecencyTable
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int SlotCount;
+	unsigned int Reserved;
+	OWFrecencySlot Slots[OW_FRECENCY_SLOTS];
+};
+
+bool OWFrecencyCheck(const OWFrecencyTable *Table);
+void OWFrecencyFormat(OWFrecencyTable *Table);
+
+// Of the path as the same folder however it's written: ASCII case, either slash, and a
+// trailing one don't matter. Never 0.
+unsigned OWFrecencyHash(const OWCHAR *Path, unsigned Length);
+
+// The key of a path, 0 when it has none (never a real key). Takes no lock.
+float OWFrecencyGetKey(const OWFrecencyTable *Table, unsigned Hash);
+
+// A visit, Now being a FILETIME. false when it's too close to the last one, or before
+// it.
+bool OWFrecencyTouch(OWFrecencyTable *Table, unsigned Hash, OWUINT64 Now);
+
+// What a key is worth at Now, a FILETIME
+double OWFrecencyScore(float Key, OWUINT64 Now);
+
+#endif // __OWFRECENCY_H_
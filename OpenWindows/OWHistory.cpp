@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+// No stdafx.h here on purpose; this builds without Windows.
+#include <string.h>
+#include "OWHistory.h"
+
+//========================================================================================
+// Layout, see OWHistory.h
+
+enum
+{
+	OFFSET_MAGIC = 0,
+	OFFSET_VERSION = 4,
+	OFFSET_SIZE = 8,
+	OFFSET_USED = 12,		// where the next record goes, counting from the start
+	OFFSET_COUNT = 16,
+
+	RECORD_SIZE = 0,
+	RECORD_KIND = 2,
+	RECORD_PATH_LENGTH = 4,
+	RECORD_NAME_LENGTH = 6,
+	RECORD_HASH = 8,
+	RECORD_TIME = 12,
+	RECORD_STRINGS = OW_HISTORY_RECORD_SIZE
+};
+
+static unsigned ReadUInt(const void *p, unsigned Offset)
+{
+	unsigned Value;
+	memcpy(&Value, (const unsigned char*)p + Offset, sizeof(Value));
+	return Value;
+}
+
+static void WriteUInt(void *p, unsigned Offset, unsigned Value)
+{
+	memcpy((unsigned char*)p + Offset, &Value, sizeof(Value));
+}
+
+static unsigned short ReadUShort(const void *p, unsigned Offset)
+{
+	unsigned short Value;
+	memcpy(&Value, (const unsigned char*)p + Offset, sizeof(Value));
+	return Value;
+}
+
+static void WriteUShort(void *p, unsigned Offset, unsigned short Value)
+{
+	memcpy((unsigned char*)p + Offset, &Value, sizeof(Value));
+}
+
+static unsigned GetRecordSize(unsigned PathLength, unsigned NameLength)
+{
+	return (RECORD_STRINGS + (PathLength + 1 + NameLength + 1) * sizeof(OWCHAR) + 3) & ~3u;
+}
+
+static bool SamePath(const OWHistoryRecord &a, const OWHistoryRecord &b)
+{
+	return a.Hash == b.Hash && a.PathLength == b.PathLength
+		&& memcmp(a.Path, b.Path, a.PathLength * sizeof(OWCHAR)) == 0;
+}
+
+//========================================================================================
+// The history
+
+bool OWHistoryCheck(const void *Base, unsigned Size)
+{
+	if (Base == NULL || Size < OW_HISTORY_HEADER_SIZE)
+		return false;
+
+	return ReadUInt(Base, OFFSET_MAGIC) == OW_HISTORY_MAGIC
+		&& ReadUInt(Base, OFFSET_VERSION) == OW_HISTORY_VERSION
+		&& ReadUInt(Base, OFFSET_SIZE) <= Size
+		&& ReadUInt(Base, OFFSET_USED) >= OW_HISTORY_HEADER_SIZE
+		&& ReadUInt(Base, OFFSET_USED) <= ReadUInt(Base, OFFSET_SIZE);
+}
+
+void OWHistoryFormat(void *Base, unsigned Size)
+{
+	memset(Base, 0, OW_HISTORY_HEADER_SIZE);
+	WriteUInt(Base, OFFSET_MAGIC, OW_HISTORY_MAGIC);
+	WriteUInt(Base, OFFSET_VERSION, OW_HISTORY_VERSION);
+	WriteUInt(Base, OFFSET_SIZE, Size);
+	WriteUInt(Base, OFFSET_USED, OW_HISTORY_HEADER_SIZE);
+	WriteUInt(Base, OFFSET_COUNT, 0);
+}
+
+unsigned OWHistoryGetCount(const void *Base)
+{
+	return ReadUInt(Base, OFFSET_COUNT);
+}
+
+unsigned OWHistoryHash(const OWCHAR *Path, unsigned Length)
+{
+	// FNV-1a over the UTF-16 units
+	unsigned Hash = 2166136261u;
+	unsigned i;
+
+	for (i = 0; i < Length; i++)
+	{
+		Hash ^= Path[i];
+		Hash *= 16777619u;
+	}
+	return Hash;
+}
+
+bool OWHistoryAppend(void *Base, const OWHistoryRecord *Record)
+{
+	unsigned Size = GetRecordSize(Record->PathLength, Record->NameLength);
+	unsigned Used = ReadUInt(Base, OFFSET_USED);
+	unsigned char *p = (unsigned char*)Base + Used;
+	unsigned Offset;
+
+	if (Size > 0xFFFF || Used + Size > ReadUInt(Base, OFFSET_SIZE))
+		return false;
+
+	WriteUShort(p, RECORD_SIZE, (unsigned short)Size);
+	WriteUShort(p, RECORD_KIND, (unsigned short)Record->Kind);
+	WriteUShort(p, RECORD_PATH_LENGTH, Record->PathLength);
+	WriteUShort(p, RECORD_NAME_LENGTH, Record->NameLength);
+	WriteUInt(p, RECORD_HASH, OWHistoryHash(Record->Path, Record->PathLength));
+	memcpy(p + RECORD_TIME, &Record->Time, sizeof(Record->Time));
+
+	Offset = RECORD_STRINGS;
+	memcpy(p + Offset, Record->Path, Record->PathLength * sizeof(OWCHAR));
+	Offset += Record->PathLength * sizeof(OWCHAR);
+	memset(p + Offset, 0, sizeof(OWCHAR));
+	Offset += sizeof(OWCHAR);
+	memcpy(p + Offset, Record->Name, Record->NameLength * sizeof(OWCHAR));
+	Offset += Record->NameLength * sizeof(OWCHAR);
+	memset(p + Offset, 0, Size - Offset);
+
+	// The record is all there before the header counts it
+	WriteUInt(Base, OFFSET_USED, Used + Size);
+	WriteUInt(Base, OFFSET_COUNT, ReadUInt(Base, OFFSET_COUNT) + 1);
+	return true;
+}
+
+bool OWHistoryNext(const void *Base, unsigned *Position, OWHistoryRecord *Record)
+{
+	unsigned Used = ReadUInt(Base, OFFSET_USED);
+	unsigned At = *Position != 0 ? *Position : (unsigned)OW_HISTORY_HEADER_SIZE;
+	const unsigned char *p = (const unsigned char*)Base + At;
+	unsigned Size, PathLength, NameLength;
+
+	if (At + RECORD_STRINGS > Used)
+		return false;
+
+	Size = ReadUShort(p, RECORD_SIZE);
+	PathLength = ReadUShort(p, RECORD_PATH_LENGTH);
+	NameLength = ReadUShort(p, RECORD_NAME_LENGTH);
+	if (Size < GetRecordSize(PathLength, NameLength) || (Size & 3) != 0 || At + Size > Used)
+		return false;
+
+	Record->Path = (const OWCHAR*)(p + RECORD_STRINGS);
+	Record->Name = Record->Path + PathLength + 1;
+	if (Record->Path[PathLength] != 0 || Record->Name[NameLength] != 0)
+		return false;
+
+	Record->Kind = ReadUShort(p, RECORD_KIND);
+	Record->Hash = ReadUInt(p, RECORD_HASH);
+	memcpy(&Record->Time, p + RECORD_TIME, sizeof(Record->Time));
+	Record->PathLength = (unsigned short)PathLength;
+	Record->NameLength = (unsigned short)NameLength;
+
+	*Position = At + Size;
+	return true;
+}
+
+bool OWHistoryFindLatest(const void *Base, const OWCHAR *Path, unsigned Length, OWHistoryRecord *Record)
+{
+	OWHistoryRecord Wanted, Current;
+	unsigned Position = 0;
+	bool Found = false;
+
+	Wanted.Path = Path;
+	Wanted.PathLength = (unsigned short)Length;
+	Wanted.Hash = OWHistoryHash(Path, Length);
+
+	while (OWHistoryNext(Base, &Position, &Current))
+	{
+		if (SamePath(Current, Wanted))
+		{
+			*Record = Current;
+			Found = true;
+		}
+	}
+	return Found;
+}
+
+int OWHistoryRecent(const void *Base, OWHistoryRecord *Records, int Max)
+{
+	// Records only point forward, so find where they all are first, then go back
+	// from the latest. A path counts by its latest record only.
+	unsigned Count = OWHistoryGetCount(Base), Position = 0, Walked = 0;
+	unsigned *Positions = Count ? new unsigned[Count] : NULL;
+	OWHistoryRecord *Seen = Count ? new OWHistoryRecord[Count] : NULL;
+	OWHistoryRecord Record;
+	int SeenCount = 0, Found = 0, i, j;
+
+	if (Count == 0 || Positions == NULL || Seen == NULL)
+	{
+		delete [] Positions;
+		delete [] Seen;
+		return 0;
+	}
+
+	while (Walked < Count)
+	{
+		Positions[Walked] = Position;
+		if (!OWHistoryNext(Base, &Position, &Record))
+			break;
+		Walked++;
+	}
+
+	for (i = (int)Walked - 1; i >= 0 && Found < Max; i--)
+	{
+		Position = Positions[i];
+		OWHistoryNext(Base, &Position, &Record);
+
+		for (j = 0; j < SeenCount; j++)
+			if (SamePath(Seen[j], Record))
+				break;
+		if (j < SeenCount)
+			continue;
+
+		Seen[SeenCount++] = Record;
+		if (Record.Kind == OW_HISTORY_CLOSED)
+			Records[Found++] = Record;
+	}
+
+	delete [] Positions;
+	delete [] Seen;
+	return Found;
+}
+
+void OWHistoryCompact(const void *Base, void *Target, unsigned Size, int Keep)
+{
+	OWHistoryRecord *Kept = Keep > 0 ? new OWHistoryRecord[Keep] : NULL;
+	int Count = Kept != NULL ? OWHistoryRecent(Base, Kept, Keep) : 0;
+	int i;
+
+	// Back in the order they happened
+	OWHistoryFormat(Target, Size);
+	for (i = Count - 1; i >= 0; i--)
+		OWHistoryAppend(Target, &Kept[i]);
+
+	delete [] Kept;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __OWHISTORY_H_
+#define __OWHISTORY_H_
+
+//========================================================================================
+// The history of the windows that were closed, so the folder can offer them again. It's
+// a file of fixed size that every process hosting us maps (see History.h), holding a
+// header, then records appended one after the other: a window was closed, or a closed
+// one was opened again. Nothing is ever changed in place, except by compacting, which
+// writes the records that still matter (the latest of each path, if it's a closing)
+// back from the start.
+//
+// Like OWCore.h, this doesn't include Windows headers, and only works on a buffer the
+// caller maps, so the Tools/ reader builds anywhere. Reading hands out pointers into
+// the buffer; nothing is copied or parsed up front. It's checked as it's walked, and
+// a record that doesn't fit ends the walk, so a torn or damaged file only loses its
+// tail. The caller keeps writers (and readers) to one at a time.
+//
+// Header: MAGIC (4), VERSION (4), size (4), used (4), count (4), reserved (4).
+// Records, 4 byte aligned: size (2), kind (2), path length (2), name length (2),
+// path hash (4), time (8, a FILETIME), then the path and name, null terminated UTF-16.
+
+#include "OWCore.h"
+
+enum
+{
+	OW_HISTORY_MAGIC = 0x4857574F,		// "OWWH"
+	OW_HISTORY_VERSION = 1,
+
+	OW_HISTORY_SIZE = 65536,			// what the file is made with
+	OW_HISTORY_HEADER_SIZE = 24,
+	OW_HISTORY_RECORD_SIZE = 20,		// without the strings
+
+	// Compact once there are this many records, down to the latest KEEP closed windows
+	OW_HISTORY_COMPACT_AT = 256,
+	OW_HISTORY_KEEP = 64
+};
+
+enum OWHistoryKind
+{
+	OW_HISTORY_CLOSED = 0,
+	OW_HISTORY_OPENED = 1
+};
+
+struct OWHistoryRecord
+{
+	int Kind;
+	OWUINT64 Time;
+	unsigned Hash;				// OWHistoryHash of the path, filled in by Append
+	const OWCHAR *Path;
+	unsigned short PathLength;
+	const OWCHAR *Name;
+	unsigned short NameLength;
+};
+
+// Is Base (Size bytes) a history we can read?
+bool OWHistoryCheck(const void *Base, unsigned Size);
+// Start an empty one over Size bytes
+void OWHistoryFormat(void *Base, unsigned Size);
+
+unsigned OWHistoryGetCount(const void *Base);
+unsigned OWHistoryHash(const OWCHAR *Path, unsigned Length);
+
+// false when there's no room left; compact and try again
+bool OWHistoryAppend(void *Base, const OWHistoryRecord *Record);
+
+// Walk the records oldest first. *Position starts at 0; false at the end. Record
+// points into Base.
+bool OWHistoryNext(const void *Base, unsigned *Position, OWHistoryRecord *Record);
+
+// The latest record about Path, false when there's none
+bool OWHistoryFindLatest(const void *Base, const OWCHAR *Path, unsigned Length, OWHistoryRecord *Record);
+
+// The windows closed and not opened again since, latest first, each path once. Returns
+// how many went in Records, at most Max.
+int OWHistoryRecent(const void *Base, OWHistoryRecord *Records, int Max);
+
+// Write what's left of Base after compacting it (the Keep latest closed windows) as a
+// new history of Size bytes into Target, which can't be Base.
+void OWHistoryCompact(const void *Base, void *Target, unsigned Size, int Keep);
+
+#endif // __OWHISTORY_H_
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __OWSHAREDMETRICS_H_
+#define __OWSHAREDMETRICS_H_
+
+//========================================================================================
+// The layout of the metrics every process hosting us publishes (see Metrics.h), in a
+// named shared memory region, so a monitor can read them from outside. Each process
+// gets a slot, split in lanes: each of the threads that record the most has one of its
+// own, which only it writes, without interlocked operations or sharing cache lines;
+// lane 0 is for the others, which update it with interlocked operations. A reader maps
+// the region and adds up the lanes of the slots it wants. Like OWCore.h, this doesn't include
+// Windows headers, so the reader in Tools/ builds anywhere.
+//
+// The layout is fixed: the tables have room to spare, and the counts in the header say
+// how much is used. Bump the version on any change to it, or to what the timers and
+// counters mean; processes with another version then keep their metrics to themselves.
+
+#include "OWCore.h"
+
+// Region and lock names. On Windows, in the Local\ namespace when there is one.
+#define OW_SHARED_METRICS_NAME "OpenWindowsMetrics"
+#define OW_SHARED_METRICS_LOCK "OpenWindowsMetricsLock"
+
+enum
+{
+	OW_SHARED_METRICS_MAGIC = 0x534D574F,	// "OWMS"
+	OW_SHARED_METRICS_VERSION = 2,
+
+	OW_SHARED_SLOTS = 16,
+	OW_SHARED_LANES = 8,
+	OW_SHARED_TIMERS = 32,
+	OW_SHARED_COUNTERS = 16,
+	OW_SHARED_NAME_LENGTH = 32,
+	OW_SHARED_HOST_LENGTH = 64,
+
+	// Latency buckets, four per power of two of microseconds
+	OW_METRICS_BUCKETS = 124
+};
+
+enum
+{
+	OW_SLOT_FREE = 0,
+	OW_SLOT_LIVE = 1,
+	OW_SLOT_EXITED = 2		// kept until the slot is needed again
+};
+
+struct OWSharedTimer
+{
+	unsigned int Calls;
+	// A 64-bit total, in two halves; a reader can catch the high half a call late
+	unsigned int TotalLow;
+	unsigned int TotalHigh;
+	unsigned int MaxMicroseconds;
+	unsigned int Buckets[OW_METRICS_BUCKETS];
+};
+
+struct OWSharedLane
+{
+	unsigned int ThreadId;				// the last thread to own it; 0 for lane 0
+	unsigned int Reserved;
+	unsigned int Counters[OW_SHARED_COUNTERS];
+	OWSharedTimer Timers[OW_SHARED_TIMERS];
+};
+
+struct OWSharedSlot
+{
+	unsigned int State;
+	unsigned int ProcessId;
+	OWUINT64 StartedAt;					// FILETIME
+	char Host[OW_SHARED_HOST_LENGTH];	// file name of the process' executable
+	// Add them up for the process' numbers, and take the largest maximum
+	OWSharedLane Lanes[OW_SHARED_LANES];
+};
+
+struct OWSharedMetrics
+{
+	unsigned int Magic;
+	unsigned int Version;
+	unsigned int Size;				// sizeof(OWSharedMetrics)
+	unsigned int SlotCount;
+	unsigned int TimerCount;		// used entries of the tables below
+	unsigned int CounterCount;
+	unsigned int BucketCount;
+	unsigned int Reserved;
+	char TimerNames[OW_SHARED_TIMERS][OW_SHARED_NAME_LENGTH];
+	char CounterNames[OW_SHARED_COUNTERS][OW_SHARED_NAME_LENGTH];
+	OWSharedSlot Slots[OW_SHARED_SLOTS];
+};
+
+//----------------------------------------------------------------------------------------
+// Buckets. Values under 4 get their own; then bucket 4*(b-1)+s holds values with their
+// top bit at b, and s as the next two bits.
+
+inline int OWMetricsBucketOf(unsigned int Value)
+{
+	int Bit = 2;
+
+	if (Value < 4)
+		return (int)Value;
+
+	while (Bit < 31 && (Value >> (Bit + 1)) != 0)
+		Bit++;
+
+	return (Bit - 1) * 4 + (int)((Value >> (Bit - 2)) & 3);
+}
+
+inline unsigned int OWMetricsBucketUpperBound(int Bucket)
+{
+	if (Bucket < 4)
+		return (unsigned int)Bucket;
+
+	int Bit = Bucket / 4 + 1;
+	unsigned int Sub = (unsigned int)(Bucket % 4);
+	OWUINT64 Upper = ((OWUINT64)(4 + Sub + 1) << (Bit - 2)) - 1;
+	return Upper > 0xFFFFFFFFUL ? 0xFFFFFFFFUL : (unsigned int)Upper;
+}
+
+#endif // __OWSHAREDMETRICS_H_
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include <stddef.h>
+
+#include "OWTaskQueue.h"
+
+COWTaskQueue::COWTaskQueue(int Capacity, int MaxRunning, OWTaskFree Free)
+	: m_MaxRunning(MaxRunning), m_Pending(0), m_Running(0), m_Sequence(0), m_Free(Free)
+{
+	int i;
+
+	// VC6's new returns NULL, which leaves a queue that's always full
+	m_Tasks = new OWTask[Capacity];
+	m_Capacity = m_Tasks != NULL ? Capacity : 0;
+	for (i = 0; i < m_Capacity; i++)
+		m_Tasks[i].State = FREE;
+}
+
+COWTaskQueue::~COWTaskQueue()
+{
+	int i;
+
+	// Running jobs are the caller's to finish
+	for (i = 0; i < m_Capacity; i++)
+	{
+		if (m_Tasks[i].State == PENDING && m_Free != NULL)
+			m_Free(m_Tasks[i].Data);
+	}
+	delete [] m_Tasks;
+}
+
+bool COWTaskQueue::Push(const void *Owner, unsigned Key, void *Data)
+{
+	OWTask *Slot = NULL;
+	int i;
+
+	for (i = 0; i < m_Capacity; i++)
+	{
+		OWTask &Task = m_Tasks[i];
+		if (Task.State == FREE)
+		{
+			if (Slot == NULL)
+				Slot = &Task;
+		}
+		else if (Task.Owner == Owner && Task.Key == Key && !Task.Cancelled)
+			return false;
+	}
+	if (Slot == NULL)
+		return false;
+
+	Slot->Owner = Owner;
+	Slot->Key = Key;
+	Slot->Data = Data;
+	Slot->Cancelled = false;
+	Slot->State = PENDING;
+	Slot->Sequence = m_Sequence++;
+	m_Pending++;
+	return true;
+}
+
+OWTask *COWTaskQueue::Next()
+{
+	OWTask *Oldest = NULL;
+	int i;
+
+	if (m_Pending == 0 || m_Running >= m_MaxRunning)
+		return NULL;
+
+	for (i = 0; i < m_Capacity; i++)
+	{
+		OWTask &Task = m_Tasks[i];
+		// Compared as a difference, so the sequence can wrap
+		if (Task.State == PENDING && (Oldest == NULL || (int)(Task.Sequence - Oldest->Sequence) < 0))
+			Oldest = &Task;
+	}
+
+	Oldest->State = RUNNING;
+	m_Pending--;
+	m_Running++;
+	return Oldest;
+}
+
+void COWTaskQueue::Done(OWTask *Task)
+{
+	Task->State = FREE;
+	Task->Data = NULL;
+	m_Running--;
+}
+
+int COWTaskQueue::Cancel(const void *Owner)
+{
+	int i, Dropped = 0;
+
+	for (i = 0; i < m_Capacity; i++)
+	{
+		OWTask &Task = m_Tasks[i];
+		if (Task.Owner != Owner)
+			continue;
+
+		if (Task.State == PENDING)
+		{
+			if (m_Free != NULL)
+				m_Free(Task.Data);
+			Task.State = FREE;
+			Task.Data = NULL;
+			m_Pending--;
+			Dropped++;
+		}
+		else if (Task.State == RUNNING)
+			Task.Cancelled = true;
+	}
+	return Dropped;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __OWTASKQUEUE_H_
+#define __OWTASKQUEUE_H_
+
+//========================================================================================
+// A bounded queue of background jobs, with a cap on how many run at once, and
+// cancellation of everything an owner queued. There are no threads or locks in here,
+// like the rest of the core it builds anywhere: the caller holds one lock around every
+// call, and has its own threads take jobs with Next().
+//
+// Jobs run in the order they were queued. The queue is small (it's for the items of a
+// view), so it's a fixed array of slots that's scanned.
+
+struct OWTask
+{
+	const void *Owner;
+	unsigned Key;				// queued once per owner and key at a time
+	void *Data;					// the caller's
+	bool Cancelled;				// while running; the caller should drop the result
+	// The queue's
+	int State;
+	unsigned Sequence;
+};
+
+// Frees the Data of jobs that are dropped without running
+typedef void (*OWTaskFree)(void *Data);
+
+class COWTaskQueue
+{
+public:
+	COWTaskQueue(int Capacity, int MaxRunning, OWTaskFree Free);
+	~COWTaskQueue();
+
+	// Queue a job. false when it's full, or the owner has one with the same key
+	// already, and then Data is still the caller's.
+	bool Push(const void *Owner, unsigned Key, void *Data);
+
+	// The oldest queued job, or NULL when there's none or MaxRunning are running. It
+	// belongs to the caller until it's given to Done().
+	OWTask *Next();
+	void Done(OWTask *Task);
+
+	// Drop the owner's queued jobs, and mark its running ones cancelled. Returns how
+	// many were dropped.
+	int Cancel(const void *Owner);
+
+	int GetPending() const { return m_Pending; }
+	int GetRunning() const { return m_Running; }
+
+protected:
+	enum { FREE, PENDING, RUNNING };
+
+	OWTask *m_Tasks;
+	int m_Capacity;
+	int m_MaxRunning;
+	int m_Pending;
+	int m_Running;
+	unsigned m_Sequence;
+	OWTaskFree m_Free;
+};
+
+#endif // __OWTASKQUEUE_H_
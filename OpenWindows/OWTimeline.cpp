@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+// No stdafx.h here on purpose; this builds without Windows.
+#include "OWTimeline.h"
+
+//========================================================================================
+// Helpers
+
+static unsigned Bucket(OWUINT64 Key)
+{
+	// Handles are multiples of small powers of two, so mix the low bits up
+	unsigned Hash = (unsigned)(Key ^ (Key >> 32));
+	Hash ^= Hash >> 16;
+	Hash *= 0x45D9F3Bu;
+	Hash ^= Hash >> 16;
+	return Hash % OW_TIMELINE_BUCKETS;
+}
+
+// Take the node out of the list, leaving it in its bucket
+static void Unlink(OWTimeline *Timeline, int Node)
+{
+	OWTimelineNode &n = Timeline->Nodes[Node];
+
+	if (n.Prev != OW_TIMELINE_NONE)
+		Timeline->Nodes[n.Prev].Next = n.Next;
+	else
+		Timeline->Head = n.Next;
+
+	if (n.Next != OW_TIMELINE_NONE)
+		Timeline->Nodes[n.Next].Prev = n.Prev;
+	else
+		Timeline->Tail = n.Prev;
+}
+
+static void PushFront(OWTimeline *Timeline, int Node)
+{
+	OWTimelineNode &n = Timeline->Nodes[Node];
+
+	n.Prev = OW_TIMELINE_NONE;
+	n.Next = Timeline->Head;
+	if (Timeline->Head != OW_TIMELINE_NONE)
+		Timeline->Nodes[Timeline->Head].Prev = Node;
+	else
+		Timeline->Tail = Node;
+	Timeline->Head = Node;
+}
+
+static void Unchain(OWTimeline *Timeline, int Node)
+{
+	int *Link = &Timeline->Buckets[Bucket(Timeline->Nodes[Node].Key)];
+
+	while (*Link != OW_TIMELINE_NONE && *Link != Node)
+		Link = &Timeline->Nodes[*Link].Chain;
+	if (*Link == Node)
+		*Link = Timeline->Nodes[Node].Chain;
+}
+
+//========================================================================================
+// The timeline
+
+void OWTimelineInit(OWTimeline *Timeline)
+{
+	int i;
+
+	Timeline->Magic = OW_TIMELINE_MAGIC;
+	Timeline->Version = OW_TIMELINE_VERSION;
+	Timeline->Head = OW_TIMELINE_NONE;
+	Timeline->Tail = OW_TIMELINE_NONE;
+	Timeline->Count = 0;
+
+	for (i = 0; i < OW_TIMELINE_BUCKETS; i++)
+		Timeline->Buckets[i] = OW_TIMELINE_NONE;
+
+	for (i = 0; i < OW_TIMELINE_CAPACITY; i++)
+		Timeline->Nodes[i].Next = i + 1 < OW_TIMELINE_CAPACITY ? i + 1 : OW_TIMELINE_NONE;
+	Timeline->Free = 0;
+}
+
+bool OWTimelineCheck(const OWTimeline *Timeline)
+{
+	return Timeline->Magic == OW_TIMELINE_MAGIC && Timeline->Version == OW_TIMELINE_VERSION;
+}
+
+int OWTimelineFind(const OWTimeline *Timeline, OWUINT64 Key)
+{
+	int Node = Timeline->Buckets[Bucket(Key)];
+
+	while (Node != OW_TIMELINE_NONE && Timeline->Nodes[Node].Key != Key)
+		Node = Timeline->Nodes[Node].Chain;
+	return Node;
+}
+
+void OWTimelineTouch(OWTimeline *Timeline, OWUINT64 Key, OWUINT64 Time)
+{
+	int Node = OWTimelineFind(Timeline, Key);
+
+	if (Node != OW_TIMELINE_NONE)
+	{
+		Timeline->Nodes[Node].Time = Time;
+		if (Timeline->Head != Node)
+		{
+			Unlink(Timeline, Node);
+			PushFront(Timeline, Node);
+		}
+		return;
+	}
+
+	// A new one, in a free node or else the oldest one's
+	if (Timeline->Free != OW_TIMELINE_NONE)
+	{
+		Node = Timeline->Free;
+		Timeline->Free = Timeline->Nodes[Node].Next;
+		Timeline->Count++;
+	}
+	else
+	{
+		Node = Timeline->Tail;
+		Unlink(Timeline, Node);
+		Unchain(Timeline, Node);
+	}
+
+	OWTimelineNode &n = Timeline->Nodes[Node];
+	n.Key = Key;
+	n.Time = Time;
+	n.Chain = Timeline->Buckets[Bucket(Key)];
+	Timeline->Buckets[Bucket(Key)] = Node;
+	PushFront(Timeline, Node);
+}
+
+void OWTimelineRemove(OWTimeline *Timeline, OWUINT64 Key)
+{
+	int Node = OWTimelineFind(Timeline, Key);
+	if (Node == OW_TIMELINE_NONE)
+		return;
+
+	Unlink(Timeline, Node);
+	Unchain(Timeline, Node);
+	Timeline->Nodes[Node].Next = Timeline->Free;
+	Timeline->Free = Node;
+	Timeline->Count--;
+}
+
+int OWTimelineFirst(const OWTimeline *Timeline)
+{
+	return Timeline->Head;
+}
+
+int OWTimelineNext(const OWTimeline *Timeline, int Node)
+{
+	return Timeline->Nodes[Node].Next;
+}
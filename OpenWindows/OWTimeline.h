@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __OWTIMELINE_H_
+#define __OWTIMELINE_H_
+
+//========================================================================================
+// When each window was last activated, latest first: an LRU list threaded through a
+// fixed array of nodes, with a hash of the window handles into it. Activating a window
+// moves (or puts) its node at the front in O(1), and walking the list goes from the
+// latest to the longest ago. Once it's full, the window activated longest ago goes.
+//
+// The links are indexes rather than pointers, so it can live in memory shared between
+// processes (see Activation.h); the caller keeps it to one user at a time. Like
+// OWCore.h, this doesn't include Windows headers. Windows are keys, their handles as
+// a number.
+
+#include "OWCore.h"
+
+enum
+{
+	OW_TIMELINE_MAGIC = 0x4154574F,		// "OWTA"
+	OW_TIMELINE_VERSION = 1,
+
+	OW_TIMELINE_CAPACITY = 256,
+	OW_TIMELINE_BUCKETS = 512,
+
+	// No node; ends lists and chains
+	OW_TIMELINE_NONE = -1
+};
+
+struct OWTimelineNode
+{
+	OWUINT64 Key;
+	OWUINT64 Time;				// the caller's, i.e. a FILETIME
+	int Prev;					// towards the latest
+	int Next;					// towards the oldest; in the free list too
+	int Chain;					// the next node in the same bucket
+	int Reserved;
+};
+
+struct OWTimeline
+{
+	unsigned int Magic;
+	unsigned int Version;
+	int Head;					// the latest
+	int Tail;					// the oldest
+	int Free;
+	int Count;
+	int Buckets[OW_TIMELINE_BUCKETS];
+	OWTimelineNode Nodes[OW_TIMELINE_CAPACITY];
+};
+
+void OWTimelineInit(OWTimeline *Timeline);
+bool OWTimelineCheck(const OWTimeline *Timeline);
+
+// Key was activated at Time
+void OWTimelineTouch(OWTimeline *Timeline, OWUINT64 Key, OWUINT64 Time);
+void OWTimelineRemove(OWTimeline *Timeline, OWUINT64 Key);
+
+// The node of Key, or OW_TIMELINE_NONE
+int OWTimelineFind(const OWTimeline *Timeline, OWUINT64 Key);
+
+// Latest first; OW_TIMELINE_NONE at the end
+int OWTimelineFirst(const OWTimeline *Timeline);
+int OWTimelineNext(const OWTimeline *Timeline, int Node);
+
+#endif // __OWTIMELINE_H_
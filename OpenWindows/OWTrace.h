@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __OWTRACE_H_
+#define __OWTRACE_H_
+
+//========================================================================================
+// The binary trace format: what the folder writes into its trace rings (see Trace.h),
+// and what OWTraceSave() puts in a file. Nothing is formatted when tracing; the
+// decoder in Tools/ turns the events back into text. Like OWCore.h, this doesn't
+// include Windows headers, so the decoder builds anywhere.
+//
+// Everything is in the native (little endian) byte order, without padding.
+
+#include "OWCore.h"
+
+// The category is the high byte of the event; OW_TRACE_CATEGORY() makes it a bit for
+// the trace mask.
+#define OW_TRACE_CATEGORY(Event) (1UL << ((Event) >> 8))
+
+enum
+{
+	OW_TRACE_FOLDER = 1,
+	OW_TRACE_VIEW = 2,
+	OW_TRACE_ENUM = 3
+};
+
+// Arg 0 is always the object (the low 32 bits of its address). Items are given by
+// OWTraceItemKey(), see Trace.h. Never renumber these; old trace files use them.
+enum OWTraceEvent
+{
+	OW_EVENT_NONE = 0,
+
+	// COWRootShellFolder methods
+	OW_EVENT_GETCLASSID = OW_TRACE_FOLDER << 8,
+	OW_EVENT_INITIALIZE,				// item
+	OW_EVENT_GETCURFOLDER,
+	OW_EVENT_BINDTOOBJECT,				// item
+	OW_EVENT_COMPAREIDS,				// lParam, item, item
+	OW_EVENT_CREATEVIEWOBJECT,			// first DWORD of the IID
+	OW_EVENT_ENUMOBJECTS,				// flags
+	OW_EVENT_ENUMOBJECTS_ITEMS,			// item count
+	OW_EVENT_GETATTRIBUTESOF,			// count, first item
+	OW_EVENT_GETUIOBJECTOF,				// count, first item, first DWORD of the IID
+	OW_EVENT_BINDTOSTORAGE,
+	OW_EVENT_GETDISPLAYNAMEOF,			// flags, item
+	OW_EVENT_PARSEDISPLAYNAME,
+	OW_EVENT_PARSEDISPLAYNAME_FOUND,	// snapshot index
+	OW_EVENT_SETNAMEOF,
+	OW_EVENT_COLUMNCLICK,				// column
+	OW_EVENT_GETDETAILSOF,				// column, item
+	OW_EVENT_ENUMSEARCHES,
+	OW_EVENT_GETDEFAULTCOLUMN,
+	OW_EVENT_GETDEFAULTCOLUMNSTATE,		// column
+	OW_EVENT_GETDEFAULTSEARCHGUID,
+	OW_EVENT_GETDETAILSEX,				// first DWORD of the FMTID, PID, item
+	OW_EVENT_MAPCOLUMNTOSCID,			// column
+	OW_EVENT_SETSEARCHQUERY,			// query length
+	OW_EVENT_SETSEARCHMODE,				// mode
+	OW_EVENT_GETMETRICSREPORT,
+	OW_EVENT_SAVETRACE,
+	OW_EVENT_SAVEFLIGHTRECORD,
+
+	// COWRootShellView
+	OW_EVENT_VIEW_CREATED = OW_TRACE_VIEW << 8,
+	OW_EVENT_VIEW_DESTROYED,
+	OW_EVENT_VIEW_MESSAGE,				// SFVM_/SFVCB_ message, wParam, lParam
+	OW_EVENT_VIEW_DEFVIEWMODE,
+	OW_EVENT_VIEW_COLUMNCLICK,			// column
+	OW_EVENT_VIEW_GETDETAILSOF,			// column
+
+	// Snapshots; arg 0 is the folder
+	OW_EVENT_SNAPSHOT = OW_TRACE_ENUM << 8,	// window count, changed (0/1)
+	OW_EVENT_SEARCH					// result count, mode
+};
+
+// Item keys: the rank in the low 16 bits and a hash of the path in the high 16 bits,
+// which is never 0 for a real item. These are for the others.
+enum
+{
+	OW_TRACE_ITEM_NULL = 0,
+	OW_TRACE_ITEM_ROOT = 1,		// the empty pidl, meaning the folder itself
+	OW_TRACE_ITEM_FOREIGN = 2	// not one of ours
+};
+
+// Every event is the same size
+struct OWTraceRecord
+{
+	OWUINT64 Ticks;				// see OWTraceFileHeader::Frequency
+	unsigned int Sequence;		// per thread, counting the events that weren't sampled
+	unsigned short Event;
+	unsigned short Reserved;
+	unsigned int Args[4];
+};
+
+enum
+{
+	OW_TRACE_MAGIC = 0x5254574F,	// "OWTR"
+	OW_TRACE_VERSION = 1
+};
+
+// A file is this header, then for each thread an OWTraceRingHeader and its records,
+// oldest first.
+struct OWTraceFileHeader
+{
+	unsigned int Magic;
+	unsigned short Version;
+	unsigned short RecordSize;	// sizeof(OWTraceRecord)
+	unsigned int ProcessId;
+	unsigned int RingCount;
+	OWUINT64 Frequency;			// ticks per second
+	OWUINT64 SavedAt;			// in ticks
+};
+
+struct OWTraceRingHeader
+{
+	unsigned int ThreadId;
+	unsigned int RecordCount;
+	unsigned int SampleRate;	// 1 in this many events were written
+	unsigned int Reserved;
+};
+
+#endif // __OWTRACE_H_
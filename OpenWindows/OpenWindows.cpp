@@ -33,6 +33,15 @@
 #endif
 #include "OpenWindows_i.c"
 #include "RootShellFolder.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "CallLog.h"
+#include "FlightRecorder.h"
+#include "IconCache.h"
+#include "History.h"
+#include "Frecency.h"
+#include "Activation.h"
+#include "Groups.h"
 
 CComModule _Module;
 
@@ -47,11 +56,38 @@ BOOL APIENTRY DllMain( HINSTANCE hInstance,
 {
 	if (ul_reason_for_call == DLL_PROCESS_ATTACH)
     {
+#if defined(OW_ALLOC_PROFILE)
+        OWAllocInit();
+#endif
+        OWMetricsInit();
+        OWTraceInit();
+        OWCallLogInit();
+        OWFlightInit();
+        OWIconCacheInit();
+        OWHistoryInit();
+        OWFrecencyInit();
+        OWActivationInit();
+        OWGroupsInit();
         _Module.Init(ObjectMap, hInstance, &LIBID_OPENWINDOWSLib);
         DisableThreadLibraryCalls(hInstance);
     }
     else if (ul_reason_for_call == DLL_PROCESS_DETACH)
+    {
         _Module.Term();
+        OWReleaseMalloc();
+        OWGroupsTerm();
+        OWActivationTerm();
+        OWFrecencyTerm();
+        OWHistoryTerm();
+        OWIconCacheTerm();
+        OWFlightTerm();
+        OWCallLogTerm();
+        OWTraceTerm();
+        OWMetricsTerm();
+#if defined(OW_ALLOC_PROFILE)
+        OWAllocTerm();
+#endif
+    }
     return TRUE;
 }
 
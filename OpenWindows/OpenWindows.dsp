@@ -90,10 +90,66 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\Activation.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\AllocProfile.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\CallLog.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\Columns.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\Common.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\DetailTable.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\Enumerate.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\FlightRecorder.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\Frecency.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\FuzzyMatch.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\Groups.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\History.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\IconCache.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\LoadGen.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\Metrics.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\OpenWindows.cpp
 # End Source File
 # Begin Source File
@@ -111,23 +167,83 @@ SOURCE=.\OpenWindows.rc
 # End Source File
 # Begin Source File
 
+SOURCE=.\OWCore.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWFrecency.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWHistory.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWTaskQueue.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWTimeline.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\RootShellFolder.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\SearchIndex.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\ShellItems.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=.\Snapshot.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\stdafx.cpp
 # End Source File
+# Begin Source File
+
+SOURCE=.\Trace.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\WindowIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\WindowSource.cpp
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
-SOURCE=.\CComEnumOnCArray.h
+SOURCE=.\Activation.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\AllocBudgets.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\AllocProfile.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\CallLog.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\Columns.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\Common.h
 # End Source File
 # Begin Source File
 
@@ -135,14 +251,78 @@ SOURCE=.\CStringCopyTo.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\DetailTable.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\Enumerate.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\FlightRecorder.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\Frecency.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\FuzzyMatch.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\Groups.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\History.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\IconCache.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\Metrics.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\MPidlMgr.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\OWCallLog.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWCore.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWFrecency.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWHistory.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWSharedMetrics.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWTaskQueue.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWTimeline.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\OWTrace.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\resource.h
 # End Source File
 # Begin Source File
@@ -155,6 +335,10 @@ SOURCE=.\RootShellView.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\SearchIndex.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\ShellFolderView.h
 # End Source File
 # Begin Source File
@@ -163,6 +347,10 @@ SOURCE=.\ShellItems.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\Snapshot.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\stdafx.h
 # End Source File
 # Begin Source File
@@ -171,6 +359,18 @@ SOURCE=.\targetver.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\Trace.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\WindowIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\WindowSource.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\wtlstr.h
 # End Source File
 # End Group
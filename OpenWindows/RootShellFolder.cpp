@@ -32,110 +32,371 @@
 #include "RootShellFolder.h"
 
 #include "RootShellView.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "CallLog.h"
+#include "FlightRecorder.h"
+#include "IconCache.h"
+#include "History.h"
+#include "Frecency.h"
+#include "Activation.h"
+#include "Groups.h"
 
 
 //========================================================================================
-// Helpers
+// The searches we offer through IShellFolder2::EnumSearches.
+typedef CComEnum<IEnumExtraSearch, &IID_IEnumExtraSearch, EXTRASEARCH, _Copy<EXTRASEARCH> > CEnumExtraSearch;
 
-#ifdef _DEBUG
+// The type-ahead search over the window names and paths
+// {836486C0-B3F0-4093-84A3-AC44FAB2BB63}
+static const GUID GUID_OpenWindowsSearch =
+	{0x836486C0, 0xB3F0, 0x4093, {0x84, 0xA3, 0xAC, 0x44, 0xFA, 0xB2, 0xBB, 0x63}};
 
-LPTSTR PidlToString(LPCITEMIDLIST pidl)
+// Return a string of the item, by offset when the pidl has an exact ANSI copy of it.
+// Otherwise (chars outside the code page, pidls from older versions), make a copy.
+static bool SetItemReturnString(LPCITEMIDLIST pidl, LPCSTR AnsiText, LPCWSTR Text, ULONG Length, STRRET &str)
 {
-	static int which = 0;
-	static TCHAR str1[200];
-	static TCHAR str2[200];
-	TCHAR *str;
-	which ^= 1;
-	str = which ? str1 : str2;
-
-	str[0] = '\0';
-
-	if (pidl == NULL)
+	if (AnsiText != NULL)
 	{
-		_tcscpy(str, _T("<null>"));
-		return str;
+		SetReturnStringOffset(pidl, AnsiText, str);
+		return true;
 	}
 
-	while (pidl->mkid.cb != 0)
-	{
-		if (*((DWORD*)(pidl->mkid.abID)) == COWItem::MAGIC)
-		{
-#ifndef _UNICODE
-			char tmp[128];
-			mbstowcs((wchar_t*)(pidl->mkid.abID)+4, tmp, 128);
-			_tcscat(str, tmp);
+	return SetReturnStringW(Text, Length, str);
+}
+
+// A string from our resources, in UTF-16 whatever the build. Text has MAX_PATH chars.
+static void LoadWideString(UINT Id, LPWSTR Text)
+{
+	CString String(MAKEINTRESOURCE(Id));
+#ifdef _UNICODE
+	wcsncpy(Text, String, MAX_PATH-1);
+	Text[MAX_PATH-1] = L'\0';
 #else
-			_tcscat(str, (wchar_t*)(pidl->mkid.abID)+4);
+	if (MultiByteToWideChar(CP_ACP, 0, String, -1, Text, MAX_PATH) == 0)
+		Text[0] = L'\0';
 #endif
-			_tcscat(str, _T("::"));
-		}
-		else
-		{
-			TCHAR tmp[16];
-			_stprintf(tmp, _T("<unk-%02d>::"), pidl->mkid.cb);
-			_tcscat(str, tmp);
-		}
+}
+
+// Has anything changed between two snapshots?
+static bool SnapshotChanged(COWItemList &Old, COWItemList &New)
+{
+	int i;
+
+	if (Old.GetSize() != New.GetSize())
+		return true;
+	if (New.GetSize() == 0)
+		return false;
+
+	OWItemData *OldData = new OWItemData[Old.GetSize()];
+	OWItemData *NewData = new OWItemData[New.GetSize()];
+	int *Matches = new int[New.GetSize()];
+	bool Changed = true;
 
-		pidl = LPITEMIDLIST(LPBYTE(pidl) + pidl->mkid.cb);
+	if (OldData != NULL && NewData != NULL && Matches != NULL)
+	{
+		for (i = 0; i < Old.GetSize(); i++)
+			Old[i].GetData(&OldData[i]);
+		for (i = 0; i < New.GetSize(); i++)
+			New[i].GetData(&NewData[i]);
+
+		Changed = OWSnapshotDiff(OldData, Old.GetSize(), NewData, New.GetSize(), Matches) != 0;
 	}
-	return str;
+
+	delete [] OldData;
+	delete [] NewData;
+	delete [] Matches;
+	return Changed;
 }
 
-inline LPOLESTR iidToString(REFIID iid)
+// The search index and the detail table are portable, so they're built from the
+// items' data rather than the items.
+static void BuildTables(COWItemList &Items, COWSearchIndex &Search, COWDetailTable &Details)
 {
-	LPOLESTR str;
-	StringFromIID(iid, &str);
-	return str;						// TODO: BUG: This string SHOULD be freed, but it isn't !
-}
+	int i;
 
-#define DUMPIID(iid) AtlDumpIID(iid, NULL, S_OK)
+	OWItemData *Data = new OWItemData[Items.GetSize() + 1];
+	if (Data == NULL)
+	{
+		// The detail table is read without the lock, and its texts are still right
+		Search.RemoveAll();
+		return;
+	}
 
-#else
-#define PidlToString
-#define iidToString
-#define DUMPIID
-#endif
+	for (i = 0; i < Items.GetSize(); i++)
+		Items[i].GetData(&Data[i]);
+	Search.Build(Data, Items.GetSize());
+	Details.Build(Data, Items.GetSize());
+
+	delete [] Data;
+}
 
 //========================================================================================
-// Helper class for the CComEnumOnCArray
+// COWRootShellFolder
+
+COWRootShellFolder::COWRootShellFolder() : m_pidlRoot(NULL), m_Kind(ROOT), m_Parent(NULL), m_RefreshTime(0), m_Snapshot(NULL), m_SearchMode(OWSEARCH_SUBSTRING), m_SearchResults(NULL)
+{
+	m_Key[0] = L'\0';
+	m_SearchQuery[0] = L'\0';
+	OWCallLogLoadSettings();
+	OWActivationAddFolder();
+}
+
+void COWRootShellFolder::FinalRelease()
+{
+	// Whoever is recording most likely wants this folder's calls now
+	OWCallLogFlush();
+	m_PidlMgr.Delete(m_pidlRoot);
+	m_pidlRoot = NULL;
+	// Enumerators still out keep their own
+	Publish(&m_Snapshot, NULL);
+	Publish(&m_SearchResults, NULL);
+	if (m_Parent != NULL)
+		m_Parent->GetUnknown()->Release();
+	m_Parent = NULL;
+	OWActivationReleaseFolder();
+}
+
+void COWRootShellFolder::Publish(COWSnapshot **Target, COWSnapshot *Snapshot)
+{
+	// Everyone takes their reference under the lock, so once the pointer is swapped
+	// no one else can get to the old one, and ours can go.
+	COWSnapshot *Old = *Target;
+	*Target = Snapshot;
+	if (Old != NULL)
+		Old->Release();
+}
+
+unsigned COWRootShellFolder::RecordItem(LPCITEMIDLIST pidl)
+{
+	int Item;
+
+	if (pidl == NULL)
+		return OW_CALLLOG_ITEM_NULL;
+	if (pidl->mkid.cb == 0)
+		return OW_CALLLOG_ITEM_ROOT;
+	if (!COWItem::IsOwn(pidl))
+		return OW_CALLLOG_ITEM_FOREIGN;
 
-class CCopyItemPidl
+	ObjectLock Lock(this);
+	if (m_Snapshot == NULL)
+		return OW_CALLLOG_ITEM_STALE;
+
+	// The rank is the snapshot index, unless the pidl is older than the snapshot
+	// or from fuzzy search results
+	COWItemList &Windows = m_Snapshot->Items;
+	Item = COWItem::GetRank(pidl);
+	if (Item >= Windows.GetSize() || OWStrCmp(Windows[Item].GetPath(), COWItem::GetPath(pidl)) != 0)
+		Item = m_Index.Find(COWItem::GetPath(pidl));
+
+	return Item < 0 ? OW_CALLLOG_ITEM_STALE : OW_CALLLOG_ITEM_FIRST + Item;
+}
+
+// Enumerate the opened windows again (or read the closed ones), and everything that is
+// derived from them.
+void COWRootShellFolder::RefreshSnapshot(HWND hwndOwner)
 {
-public:
-	static void init(LPITEMIDLIST* p)
+	COWSnapshot *Snapshot = COWSnapshot::Create();
+	if (Snapshot == NULL)
+		return;
+	COWItemList &Windows = Snapshot->Items;
+	COWSnapshot *Previous = NULL;
+	int i;
+
+	// Every window is asked across processes, so other callers aren't held up meanwhile.
+	// Two refreshes can overlap; the last one in wins.
+	if (m_Kind == OW_FOLDER_RECENT)
+		OWHistoryGetRecent(&Windows, OW_HISTORY_KEEP);
+	else if (m_Kind == OW_FOLDER_GROUP)
 	{
+		// Out of the root's windows, which are only asked again when they're old
+		if (m_Parent != NULL)
+			m_Parent->GetGroup(m_Key, hwndOwner, &Windows);
 	}
-
-	static HRESULT copy(LPITEMIDLIST* pTo, COWItem* pFrom)
+	else
+	{
+		EnumerateExplorerWindows(&Windows, hwndOwner);
+		// The shell's order means nothing, the ones picked most and last go first
+		OWFrecencyOrder(&Windows);
+		// The ones switched to lately go first, the rest stay as frecency put them
+		OWActivationOrder(&Windows);
+	}
+	OWMetricsCount(OW_COUNTER_SNAPSHOT);
+
+	// Grouped, the root lists a folder for each group, and only the windows in none
+	const int *Listed = NULL;
+	int ListedCount = 0;
+	if (m_Kind == ROOT && OWGroupingEnabled() && Snapshot->Groups.Build(Windows))
+		Listed = Snapshot->Groups.GetUngrouped(&ListedCount);
+
+	// Our own folders are listed before the windows
+	LPCITEMIDLIST *Folders = new LPCITEMIDLIST[1 + Snapshot->Groups.GetCount()];
+	int FolderCount = 0;
+	if (Folders == NULL)
+	{
+		Snapshot->Release();
+		return;
+	}
+	if (m_Kind == ROOT && OWHistoryEnabled())
+	{
+		WCHAR Name[MAX_PATH];
+		LoadWideString(IDS_RECENT_FOLDER, Name);
+		COWFolderItem Recent(OW_FOLDER_RECENT, Name);
+		Folders[FolderCount] = m_PidlMgr.Create(Recent);
+		if (Folders[FolderCount] != NULL)
+			FolderCount++;
+	}
+	for (i = 0; i < Snapshot->Groups.GetCount(); i++)
 	{
-		*pTo = s_PidlMgr.Create(*pFrom);
-		return (NULL != *pTo) ? S_OK : E_OUTOFMEMORY;
+		COWFolderItem Group(OW_FOLDER_GROUP, Snapshot->Groups.GetName(i), Snapshot->Groups.GetKey(i));
+		Folders[FolderCount] = m_PidlMgr.Create(Group);
+		if (Folders[FolderCount] != NULL)
+			FolderCount++;
 	}
 
-	static void destroy(LPITEMIDLIST* p)
 	{
-		s_PidlMgr.Delete(*p); 
+		ObjectLock Lock(this);
+		m_RefreshTime = GetTickCount();
+
+		// Most refreshes find the same windows; then there's nothing to rebuild.
+		if (m_Snapshot != NULL && !SnapshotChanged(m_Snapshot->Items, Windows))
+		{
+			OWMetricsCount(OW_COUNTER_SNAPSHOT_UNCHANGED);
+			OW_TRACE3(OW_EVENT_SNAPSHOT, this, Windows.GetSize(), 0);
+			if (g_OWCallLogOn)
+				OWCallLogWriteSnapshot(this, Windows, false);
+			Snapshot->Release();
+			Snapshot = NULL;
+		}
+		else
+		{
+			OW_TRACE3(OW_EVENT_SNAPSHOT, this, Windows.GetSize(), 1);
+		}
+
+		// The pidls are encoded once here, instead of for every enumeration
+		if (Snapshot != NULL && !Snapshot->Seal(Folders, FolderCount, Listed, ListedCount))
+		{
+			Snapshot->Release();
+			Snapshot = NULL;
+		}
+
+		if (Snapshot != NULL)
+		{
+			// Enumerators of the old one carry on with it, and so does the history
+			Previous = m_Snapshot;
+			if (Previous != NULL)
+				Previous->AddRef();
+			Snapshot->AddRef();
+			Publish(&m_Snapshot, Snapshot);
+
+			if (g_OWCallLogOn)
+				OWCallLogWriteSnapshot(this, Windows, true);
+
+			m_Index.Update(Windows);
+			BuildTables(Windows, m_Search, m_Details);
+
+			if (m_SearchQuery[0] != L'\0')
+				RunSearch();
+		}
 	}
 
-protected:
-	static CPidlMgr s_PidlMgr;
-};
+	for (i = 0; i < FolderCount; i++)
+		m_PidlMgr.Delete((LPITEMIDLIST)Folders[i]);
+	delete [] Folders;
+	if (Snapshot == NULL)
+		return;
 
-CPidlMgr CCopyItemPidl::s_PidlMgr;
+	// Can wait on other processes, so it's outside of the lock
+	if (m_Kind == ROOT)
+		OWHistoryNoteWindows(Previous != NULL ? &Previous->Items : NULL, Windows);
 
-// This class implements the IEnumIDList for our CDataFavo items.
-typedef CComEnumOnCArray<IEnumIDList, &IID_IEnumIDList, LPITEMIDLIST, CCopyItemPidl, COWItemList> CEnumItemsIDList;
+	if (Previous != NULL)
+		Previous->Release();
+	Snapshot->Release();
+}
 
-//========================================================================================
-// COWRootShellFolder
+void COWRootShellFolder::GetGroup(LPCWSTR Key, HWND hwndOwner, COWItemList *Items)
+{
+	bool Refresh;
+	int Group, Count, i;
 
-COWRootShellFolder::COWRootShellFolder() : m_pidlRoot(NULL)
+	{
+		ObjectLock Lock(this);
+		Refresh = m_Snapshot == NULL || GetTickCount() - m_RefreshTime > GROUP_FRESH_MS;
+	}
+	if (Refresh)
+		RefreshSnapshot(hwndOwner);
+
+	ObjectLock Lock(this);
+	if (m_Snapshot == NULL)
+		return;
+	Group = m_Snapshot->Groups.Find(Key);
+	if (Group < 0)
+		return;
+
+	const int *Members = m_Snapshot->Groups.GetMembers(Group, &Count);
+	for (i = 0; i < Count; i++)
+	{
+		Items->Add(m_Snapshot->Items[Members[i]]);
+		// In the group's own snapshot, the rank is the index too
+		(*Items)[i].SetRank(i);
+	}
+}
+
+// Run the current query over the snapshot and collect the results.
+void COWRootShellFolder::RunSearch()
 {
+	int i;
+
+	if (m_SearchMode == OWSEARCH_FUZZY)
+		m_Search.QueryFuzzy(m_SearchQuery);
+	else
+		m_Search.Query(m_SearchQuery);
+
+	COWSnapshot *Results = COWSnapshot::Create();
+	if (Results == NULL)
+	{
+		Publish(&m_SearchResults, NULL);
+		return;
+	}
+	for (i = 0; i < m_Search.GetResultCount(); i++)
+	{
+		Results->Items.Add(m_Snapshot->Items[m_Search.GetResult(i)]);
 
+		// Fuzzy results come best first; make that the rank, so sorting by
+		// the default column keeps the best matches on top.
+		if (m_SearchMode == OWSEARCH_FUZZY)
+			Results->Items[i].SetRank(i);
+	}
+	if (!Results->Seal())
+	{
+		Results->Release();
+		Publish(&m_SearchResults, NULL);
+		return;
+	}
+	Publish(&m_SearchResults, Results);
+
+	OW_TRACE3(OW_EVENT_SEARCH, this, Results->Items.GetSize(), m_SearchMode);
+
+	if (g_OWCallLogOn)
+	{
+		int *Results = new int[m_Search.GetResultCount() + 1];
+		if (Results != NULL)
+		{
+			for (i = 0; i < m_Search.GetResultCount(); i++)
+				Results[i] = m_Search.GetResult(i);
+			OWCallLogWriteResults(this, Results, m_Search.GetResultCount(), m_SearchMode);
+			delete [] Results;
+		}
+	}
 }
 
 STDMETHODIMP COWRootShellFolder::GetClassID(CLSID* pClsid)
 {
+	OW_TRACE1(OW_EVENT_GETCLASSID, this);
+	COWMetricTimer Timer(OW_TIMER_GETCLASSID);
+	OW_RECORD_CALL(OW_EVENT_GETCLASSID, this, 0, 0, 0);
+
 	if ( NULL == pClsid )
 		return E_POINTER;
 
@@ -148,8 +409,12 @@ STDMETHODIMP COWRootShellFolder::GetClassID(CLSID* pClsid)
 // Initialize() is passed the PIDL of the folder where our extension is.
 STDMETHODIMP COWRootShellFolder::Initialize(LPCITEMIDLIST pidl)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::Initialize() pidl=[%s]\n"), this, PidlToString(pidl));
+	OW_TRACE2(OW_EVENT_INITIALIZE, this, OWTraceItemKey(pidl));
+	COWMetricTimer Timer(OW_TIMER_INITIALIZE);
+	OW_RECORD_CALL(OW_EVENT_INITIALIZE, this, 0, 0, 0);
 
+	ObjectLock Lock(this);
+	m_PidlMgr.Delete(m_pidlRoot);
 	m_pidlRoot = m_PidlMgr.Copy(pidl);
 
 	return S_OK;
@@ -157,11 +422,14 @@ STDMETHODIMP COWRootShellFolder::Initialize(LPCITEMIDLIST pidl)
 
 STDMETHODIMP COWRootShellFolder::GetCurFolder(LPITEMIDLIST *ppidl)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::GetCurFolder()\n"), this);
+	OW_TRACE1(OW_EVENT_GETCURFOLDER, this);
+	COWMetricTimer Timer(OW_TIMER_GETCURFOLDER);
+	OW_RECORD_CALL(OW_EVENT_GETCURFOLDER, this, 0, 0, 0);
 
 	if (ppidl == NULL)
 		return E_POINTER;
 
+	ObjectLock Lock(this);
 	*ppidl = m_PidlMgr.Copy(m_pidlRoot);
 
 	return S_OK;
@@ -173,7 +441,22 @@ STDMETHODIMP COWRootShellFolder::GetCurFolder(LPITEMIDLIST *ppidl)
 // BindToObject() is called when a folder in our part of the namespace is being browsed.
 STDMETHODIMP COWRootShellFolder::BindToObject(LPCITEMIDLIST pidl, LPBC pbcReserved, REFIID riid, void** ppvOut)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::BindToObject() pidl=[%s]\n"), this, PidlToString(pidl));
+	OW_TRACE2(OW_EVENT_BINDTOOBJECT, this, OWTraceItemKey(pidl));
+	COWMetricTimer Timer(OW_TIMER_BINDTOOBJECT);
+	OW_RECORD_CALL(OW_EVENT_BINDTOOBJECT, this, RecordItem(pidl), 0, 0);
+
+	// One of our own folders, or something below it
+	if (COWFolderItem::IsOwn(pidl))
+	{
+		if (m_PidlMgr.IsSingle(pidl))
+			return BindToFolder(pidl, riid, ppvOut);
+
+		CComPtr<IShellFolder> FolderPtr;
+		HRESULT hr = BindToFolder(pidl, IID_IShellFolder, (void**)&FolderPtr);
+		if (FAILED(hr))
+			return hr;
+		return FolderPtr->BindToObject(m_PidlMgr.GetNextItem(pidl), pbcReserved, riid, ppvOut);
+	}
 
 	// If the passed pidl is not ours, fail.
 	if (!COWItem::IsOwn(pidl))
@@ -186,20 +469,9 @@ STDMETHODIMP COWRootShellFolder::BindToObject(LPCITEMIDLIST pidl, LPBC pbcReserv
 	// Note that we also use multi-level pidl if "EnableFavoritesSubfolders" is enabled.
 	if (!m_PidlMgr.IsSingle(pidl))
 	{
-		HRESULT hr;
-		hr = SHGetDesktopFolder(&DesktopPtr);
-		if (FAILED(hr))
-			return hr;
-
-		LPITEMIDLIST pidlLocal;
-		hr = DesktopPtr->ParseDisplayName(NULL, pbcReserved, COWItem::GetPath(pidl), NULL, &pidlLocal, NULL);
-		if (FAILED(hr))
-			return hr;
-
 		// Bind to the root folder of the favorite folder
 		CComPtr<IShellFolder> RootFolderPtr;
-		hr = DesktopPtr->BindToObject(pidlLocal, NULL, IID_IShellFolder, (void**)&RootFolderPtr);
-		ILFree(pidlLocal);
+		HRESULT hr = BindToWindowFolder(pidl, pbcReserved, &RootFolderPtr);
 		if (FAILED(hr))
 			return hr;
 
@@ -208,6 +480,9 @@ STDMETHODIMP COWRootShellFolder::BindToObject(LPCITEMIDLIST pidl, LPBC pbcReserv
 	}
 
 	// Okay, browsing into a favorite item will redirect to its real path.
+	// That's what picking it is, see Frecency.h.
+	OWFrecencyNoteVisit(COWItem::GetPath(pidl));
+
 	HRESULT hr;
 	hr = SHGetDesktopFolder(&DesktopPtr);
 	if (FAILED(hr))
@@ -226,11 +501,124 @@ STDMETHODIMP COWRootShellFolder::BindToObject(LPCITEMIDLIST pidl, LPBC pbcReserv
 	// could also use this one? ILCreateFromPathW 
 }
 
+HRESULT COWRootShellFolder::BindToWindowFolder(LPCITEMIDLIST pidl, LPBC pbc, IShellFolder **ppFolder)
+{
+	CComPtr<IShellFolder> DesktopPtr;
+	HRESULT hr;
+
+	*ppFolder = NULL;
+	hr = SHGetDesktopFolder(&DesktopPtr);
+	if (FAILED(hr))
+		return hr;
+
+	LPITEMIDLIST pidlLocal;
+	hr = DesktopPtr->ParseDisplayName(NULL, pbc, COWItem::GetPath(pidl), NULL, &pidlLocal, NULL);
+	if (FAILED(hr))
+		return hr;
+
+	hr = DesktopPtr->BindToObject(pidlLocal, NULL, IID_IShellFolder, (void**)ppFolder);
+	ILFree(pidlLocal);
+	return hr;
+}
+
+HRESULT COWRootShellFolder::BindToFolder(LPCITEMIDLIST pidl, REFIID riid, void **ppvOut)
+{
+	HRESULT hr;
+
+	if (ppvOut == NULL)
+		return E_POINTER;
+	*ppvOut = NULL;
+
+	// Pidls from newer versions can have folders we don't know. Groups are only in
+	// the root.
+	int Kind = COWFolderItem::GetKind(pidl);
+	if (Kind != OW_FOLDER_RECENT && !(Kind == OW_FOLDER_GROUP && m_Kind == ROOT))
+		return E_INVALIDARG;
+
+	// Its own pidl ends with its item, without what was below it
+	COWFolderItem Item(Kind, COWFolderItem::GetName(pidl), COWFolderItem::GetKey(pidl));
+	LPITEMIDLIST pidlItem = m_PidlMgr.Create(Item);
+	if (pidlItem == NULL)
+		return E_OUTOFMEMORY;
+	LPITEMIDLIST pidlFolder;
+	{
+		ObjectLock Lock(this);
+		pidlFolder = ILCombine(m_pidlRoot, pidlItem);
+	}
+	m_PidlMgr.Delete(pidlItem);
+	if (pidlFolder == NULL)
+		return E_OUTOFMEMORY;
+
+	CComObject<COWRootShellFolder>* pFolder;
+	hr = CComObject<COWRootShellFolder>::CreateInstance(&pFolder);
+	if (FAILED(hr))
+	{
+		ILFree(pidlFolder);
+		return hr;
+	}
+
+	pFolder->AddRef();
+	pFolder->m_Kind = Kind;
+	if (Kind == OW_FOLDER_GROUP)
+	{
+		// It lists its windows out of ours
+		GetUnknown()->AddRef();
+		pFolder->m_Parent = this;
+		wcsncpy(pFolder->m_Key, COWFolderItem::GetKey(pidl), MAX_PATH);
+		pFolder->m_Key[MAX_PATH-1] = L'\0';
+	}
+	hr = pFolder->Initialize(pidlFolder);
+	if (SUCCEEDED(hr))
+		hr = pFolder->QueryInterface(riid, ppvOut);
+	pFolder->Release();
+
+	ILFree(pidlFolder);
+	return hr;
+}
+
 // CompareIDs() is responsible for returning the sort order of two PIDLs.
 // lParam can be the 0-based Index of the details column
 STDMETHODIMP COWRootShellFolder::CompareIDs(LPARAM lParam, LPCITEMIDLIST pidl1, LPCITEMIDLIST pidl2)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::CompareIDs(lParam=%d) pidl1=[%s], pidl2=[%s]\n"), this, lParam, PidlToString(pidl1), PidlToString(pidl2));
+	OW_TRACE4(OW_EVENT_COMPAREIDS, this, lParam, OWTraceItemKey(pidl1), OWTraceItemKey(pidl2));
+	COWMetricTimer Timer(OW_TIMER_COMPAREIDS);
+	OW_RECORD_CALL(OW_EVENT_COMPAREIDS, this, lParam, RecordItem(pidl1), RecordItem(pidl2));
+
+	// Our own folders come before the windows
+	bool Folder1 = COWFolderItem::IsOwn(pidl1), Folder2 = COWFolderItem::IsOwn(pidl2);
+	if (Folder1 || Folder2)
+	{
+		if (!Folder2 && COWItem::IsOwn(pidl2))
+			return MAKE_HRESULT(SEVERITY_SUCCESS, 0, (USHORT)-1);
+		if (!Folder1 && COWItem::IsOwn(pidl1))
+			return MAKE_HRESULT(SEVERITY_SUCCESS, 0, 1);
+		if (!Folder1 || !Folder2)
+			return E_INVALIDARG;
+
+		int Kinds = COWFolderItem::GetKind(pidl1) - COWFolderItem::GetKind(pidl2);
+		if (Kinds != 0)
+			return MAKE_HRESULT(SEVERITY_SUCCESS, 0, (USHORT)(Kinds < 0 ? -1 : 1));
+		// Groups go by name, then by key, as two can have the same name
+		int Names = _wcsicmp(COWFolderItem::GetName(pidl1), COWFolderItem::GetName(pidl2));
+		if (Names == 0)
+			Names = wcscmp(COWFolderItem::GetKey(pidl1), COWFolderItem::GetKey(pidl2));
+		if (Names != 0)
+			return MAKE_HRESULT(SEVERITY_SUCCESS, 0, (USHORT)(Names < 0 ? -1 : 1));
+		if (m_PidlMgr.IsSingle(pidl1) && m_PidlMgr.IsSingle(pidl2))
+			return MAKE_HRESULT(SEVERITY_SUCCESS, 0, 0);
+
+		// Below the same folder, it's up to that folder
+		if (m_PidlMgr.IsSingle(pidl1))
+			return MAKE_HRESULT(SEVERITY_SUCCESS, 0, (USHORT)-1);
+		if (m_PidlMgr.IsSingle(pidl2))
+			return MAKE_HRESULT(SEVERITY_SUCCESS, 0, 1);
+
+		CComPtr<IShellFolder> FolderPtr;
+		HRESULT hr = BindToFolder(pidl1, IID_IShellFolder, (void**)&FolderPtr);
+		if (FAILED(hr))
+			return hr;
+		return FolderPtr->CompareIDs(lParam, m_PidlMgr.GetNextItem(pidl1), m_PidlMgr.GetNextItem(pidl2));
+	}
 
 	// First check if the pidl are ours
 	if (!COWItem::IsOwn(pidl1) || !COWItem::IsOwn(pidl2))
@@ -240,15 +628,11 @@ STDMETHODIMP COWRootShellFolder::CompareIDs(LPARAM lParam, LPCITEMIDLIST pidl1,
 	if (!m_PidlMgr.IsSingle(pidl1) || !m_PidlMgr.IsSingle(pidl2))
 		return MAKE_HRESULT(SEVERITY_SUCCESS, 0, 1);
 
-	USHORT Result = 0;	// see note below (MAKE_HRESULT)
+	UINT Column = (UINT)(lParam & SHCIDS_COLUMNMASK);
+	if (Column >= DETAILS_COLUMN_MAX)
+		return E_INVALIDARG;
 
-	switch (lParam & SHCIDS_COLUMNMASK)
-	{
-	case DETAILS_COLUMN_NAME:		Result = wcscmp(COWItem::GetName(pidl1), COWItem::GetName(pidl2));	break;
-	case DETAILS_COLUMN_PATH:		Result = wcscmp(COWItem::GetPath(pidl1), COWItem::GetPath(pidl2));	break;
-	case DETAILS_COLUMN_RANK:		Result = COWItem::GetRank(pidl1)-COWItem::GetRank(pidl2);			break;
-	default:						return E_INVALIDARG;
-	}
+	USHORT Result = OWItemCompare(pidl1, pidl2, g_OWColumns[Column].Field);	// see note below (MAKE_HRESULT)
 
 	// Warning: the last param MUST be unsigned, if not (ie: short) a negative value will trash the high order word of the HRESULT!
 	return MAKE_HRESULT(SEVERITY_SUCCESS, 0, /*-1,0,1*/Result);
@@ -257,8 +641,9 @@ STDMETHODIMP COWRootShellFolder::CompareIDs(LPARAM lParam, LPCITEMIDLIST pidl1,
 // CreateViewObject() creates a new COM object that implements IShellView.
 STDMETHODIMP COWRootShellFolder::CreateViewObject(HWND hwndOwner, REFIID riid, void** ppvOut)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::CreateViewObject()"), this);
-	//DUMPIID(riid);
+	OW_TRACE2(OW_EVENT_CREATEVIEWOBJECT, this, riid.Data1);
+	COWMetricTimer Timer(OW_TIMER_CREATEVIEWOBJECT);
+	OW_RECORD_CALL(OW_EVENT_CREATEVIEWOBJECT, this, riid.Data1, 0, 0);
 
 	HRESULT hr;
 
@@ -270,8 +655,6 @@ STDMETHODIMP COWRootShellFolder::CreateViewObject(HWND hwndOwner, REFIID riid, v
 	// We handle only the IShellView
 	if (riid == IID_IShellView)
 	{
-		ATLTRACE(_T(" ** CreateViewObject for IShellView"));
-
 		// Create a view object
 		CComObject<COWRootShellView>* pViewObject;
 		hr = CComObject<COWRootShellView>::CreateInstance(&pViewObject);
@@ -292,59 +675,80 @@ STDMETHODIMP COWRootShellFolder::CreateViewObject(HWND hwndOwner, REFIID riid, v
 
 		return hr;
 	}
-	
-#if _DEBUG
-	// vista sludge that no one knows what it actually is
-	static const GUID unknownVistaGuid = // {93F81976-6A0D-42C3-94DD-AA258A155470}
-    {0x93F81976, 0x6A0D, 0x42C3, {0x94, 0xDD, 0xAA, 0x25, 0x8A, 0x15, 0x54, 0x70}};
 
-	if (riid != unknownVistaGuid) {
-		LPOLESTR unkIid = iidToString(riid);
-		ATLTRACE(_T(" ** CreateViewObject is unknown: %s"), unkIid);
-		CoTaskMemFree(unkIid);
-	}
-#endif
-
-	// We do not handle other objects
+	// We do not handle other objects. The trace has the first part of their IID;
+	// Vista asks for a {93F81976-6A0D-42C3-94DD-AA258A155470} that no one knows about.
 	return E_NOINTERFACE;
 }
 
 // EnumObjects() creates a COM object that implements IEnumIDList.
 STDMETHODIMP COWRootShellFolder::EnumObjects(HWND hwndOwner, DWORD dwFlags, LPENUMIDLIST* ppEnumIDList)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::EnumObjects(dwFlags=0x%04x)\n", this, dwFlags);
+	OW_TRACE2(OW_EVENT_ENUMOBJECTS, this, dwFlags);
+	COWMetricTimer Timer(OW_TIMER_ENUMOBJECTS);
+	OW_RECORD_CALL(OW_EVENT_ENUMOBJECTS, this, dwFlags, 0, 0);
 
 	HRESULT hr;
+	bool Refresh;
 
 	if (ppEnumIDList == NULL)
 		return E_POINTER;
 
     *ppEnumIDList = NULL;
 
-    // Enumerate DOpus Favorites and put them in an array
-	m_OpenedWindows.RemoveAll();
+	// Enumerate the opened windows and put them in an array.
+	// While searching, only the query changes between calls, so keep filtering
+	// the windows we already have instead of asking every window again.
+	{
+		ObjectLock Lock(this);
+		Refresh = m_SearchQuery[0] == L'\0' || !HaveWindows();
+	}
+	if (Refresh)
+		RefreshSnapshot(hwndOwner);
 
-	EnumerateExplorerWindows(&m_OpenedWindows, hwndOwner);
+	// Only the reference is taken under the lock
+	COWSnapshot *Snapshot;
+	{
+		ObjectLock Lock(this);
+		Snapshot = (m_SearchQuery[0] != L'\0') ? m_SearchResults : m_Snapshot;
+		if (Snapshot != NULL)
+			Snapshot->AddRef();
+	}
+	// No windows were ever found for the query to run over
+	if (Snapshot == NULL)
+	{
+		Snapshot = COWSnapshot::Create();
+		if (Snapshot == NULL)
+			return E_OUTOFMEMORY;
+		if (!Snapshot->Seal())
+		{
+			Snapshot->Release();
+			return E_OUTOFMEMORY;
+		}
+	}
 
-	ATLTRACE(_T(" ** EnumObjects: Now have %d items"), m_OpenedWindows.GetSize());
+	OW_TRACE2(OW_EVENT_ENUMOBJECTS_ITEMS, this, Snapshot->Items.GetSize());
+	RecordedCall.SetArg(1, Snapshot->Items.GetSize());
 
-    // Create an enumerator with CComEnumOnCArray<> and our copy policy class.
-	CComObject<CEnumItemsIDList>* pEnum;
-	hr = CComObject<CEnumItemsIDList>::CreateInstance(&pEnum);
+    // Create an enumerator over the snapshot
+	CComObject<COWEnumIDList>* pEnum;
+	hr = CComObject<COWEnumIDList>::CreateInstance(&pEnum);
 	if (FAILED(hr))
+	{
+		Snapshot->Release();
 		return hr;
+	}
 
     // AddRef() the object while we're using it.
 	pEnum->AddRef();
 
-    // Init the enumerator.  Init() will AddRef() our IUnknown (obtained with
-    // GetUnknown()) so this object will stay alive as long as the enumerator 
-    // needs access to the collection m_Favorites.
-	hr = pEnum->Init(GetUnknown(), m_OpenedWindows);
+    // Init the enumerator. It holds a reference on the snapshot, and its clones share
+    // it, so a refresh (on any thread) publishes a new one without disturbing them.
+	pEnum->Init(Snapshot);
+	Snapshot->Release();
 
     // Return an IEnumIDList interface to the caller.
-	if (SUCCEEDED(hr))
-		hr = pEnum->QueryInterface(IID_IEnumIDList, (void**)ppEnumIDList);
+	hr = pEnum->QueryInterface(IID_IEnumIDList, (void**)ppEnumIDList);
 
 	pEnum->Release();
 
@@ -355,17 +759,21 @@ STDMETHODIMP COWRootShellFolder::EnumObjects(HWND hwndOwner, DWORD dwFlags, LPEN
 // GetAttributesOf() returns the attributes for the items whose PIDLs are passed in.
 STDMETHODIMP COWRootShellFolder::GetAttributesOf(UINT uCount, LPCITEMIDLIST aPidls[], LPDWORD pdwAttribs)
 {
-#ifdef _DEBUG
-	if (uCount >= 1)
-		ATLTRACE(_T("COWRootShellFolder(0x%08x)::GetAttributesOf(uCount=%d) pidl=[%s]\n"), this, uCount, PidlToString(aPidls[0]));
-	else
-		ATLTRACE("COWRootShellFolder(0x%08x)::GetAttributesOf(uCount=%d)\n", this, uCount);
-#endif
+	OW_TRACE3(OW_EVENT_GETATTRIBUTESOF, this, uCount, uCount >= 1 ? OWTraceItemKey(aPidls[0]) : OW_TRACE_ITEM_NULL);
+	COWMetricTimer Timer(OW_TIMER_GETATTRIBUTESOF);
+	OW_RECORD_CALL(OW_EVENT_GETATTRIBUTESOF, this, uCount, uCount >= 1 ? RecordItem(aPidls[0]) : OW_CALLLOG_ITEM_NULL, *pdwAttribs);
 
 	// We limit the tree, by indicating that the favorites folder does not contain sub-folders
 
 	if ((uCount == 0) || (aPidls[0]->mkid.cb == 0))
 	    *pdwAttribs &= SFGAO_HASSUBFOLDER|SFGAO_FOLDER | SFGAO_FILESYSTEM|SFGAO_FILESYSANCESTOR | SFGAO_BROWSABLE;
+	else if (COWFolderItem::IsOwn(aPidls[0]))
+	{
+		// Our own folders aren't anywhere on disk, but file dialogs only browse ancestors.
+		// The windows in a group are folders, so the tree can expand it.
+		DWORD Subfolders = COWFolderItem::GetKind(aPidls[0]) == OW_FOLDER_GROUP ? SFGAO_HASSUBFOLDER : 0;
+	    *pdwAttribs &= SFGAO_FOLDER | SFGAO_FILESYSANCESTOR | SFGAO_BROWSABLE | Subfolders;
+	}
 	else 
 	    *pdwAttribs &= SFGAO_FOLDER | SFGAO_FILESYSTEM|SFGAO_FILESYSANCESTOR | SFGAO_BROWSABLE | SFGAO_LINK;
 
@@ -376,13 +784,9 @@ STDMETHODIMP COWRootShellFolder::GetAttributesOf(UINT uCount, LPCITEMIDLIST aPid
 // GetUIObjectOf() is called to get several sub-objects like IExtractIcon and IDataObject
 STDMETHODIMP COWRootShellFolder::GetUIObjectOf(HWND hwndOwner, UINT uCount, LPCITEMIDLIST* pPidl, REFIID riid, LPUINT puReserved, void** ppvReturn)
 {
-#ifdef _DEBUG
-	if (uCount >= 1)
-		ATLTRACE(_T("COWRootShellFolder(0x%08x)::GetUIObjectOf(uCount=%d) pidl=[%s]"), this, uCount, PidlToString(*pPidl));
-	else
-		ATLTRACE(_T("COWRootShellFolder(0x%08x)::GetUIObjectOf(uCount=%d)"), this, uCount);
-	//DUMPIID(riid);
-#endif
+	OW_TRACE4(OW_EVENT_GETUIOBJECTOF, this, uCount, uCount >= 1 ? OWTraceItemKey(*pPidl) : OW_TRACE_ITEM_NULL, riid.Data1);
+	COWMetricTimer Timer(OW_TIMER_GETUIOBJECTOF);
+	OW_RECORD_CALL(OW_EVENT_GETUIOBJECTOF, this, uCount, uCount >= 1 ? RecordItem(*pPidl) : OW_CALLLOG_ITEM_NULL, riid.Data1);
 
 	HRESULT hr;
 
@@ -402,9 +806,13 @@ STDMETHODIMP COWRootShellFolder::GetUIObjectOf(HWND hwndOwner, UINT uCount, LPCI
 			return E_INVALIDARG;
 
 		// Is this really one of our item?
-		if (!COWItem::IsOwn(*pPidl))
+		if (!COWItem::IsOwn(*pPidl) && !COWFolderItem::IsOwn(*pPidl))
 			return E_INVALIDARG;
 
+		// The file dialogs pick an item by asking for this
+		if (COWItem::IsOwn(*pPidl))
+			OWFrecencyNoteVisit(COWItem::GetPath(*pPidl));
+
 		// Create a COM object that exposes IDataObject
 		CComObject<CDataObject>* pDataObject;
 		hr = CComObject<CDataObject>::CreateInstance(&pDataObject);
@@ -418,7 +826,10 @@ STDMETHODIMP COWRootShellFolder::GetUIObjectOf(HWND hwndOwner, UINT uCount, LPCI
 		pDataObject->Init(GetUnknown());
 
 		// Okay, embed the pidl in the data
-		pDataObject->SetPidl(m_pidlRoot, *pPidl);
+		{
+			ObjectLock Lock(this);
+			pDataObject->SetPidl(m_pidlRoot, *pPidl);
+		}
 
 		// Return the requested interface to the caller
         hr = pDataObject->QueryInterface(riid, ppvReturn);
@@ -428,10 +839,32 @@ STDMETHODIMP COWRootShellFolder::GetUIObjectOf(HWND hwndOwner, UINT uCount, LPCI
 		return hr;
 	}
 
+	// Icons are worked out from the path, without going to the target, see IconCache.h
+	if (riid == IID_IExtractIconW || riid == IID_IExtractIconA)
+	{
+		if (uCount != 1 || (!COWItem::IsOwn(*pPidl) && !COWFolderItem::IsOwn(*pPidl)))
+			return E_INVALIDARG;
+
+		CComObject<COWExtractIcon>* pExtractIcon;
+		hr = CComObject<COWExtractIcon>::CreateInstance(&pExtractIcon);
+		if (FAILED(hr))
+			return hr;
+
+		pExtractIcon->AddRef();
+		{
+			ObjectLock Lock(this);
+			pExtractIcon->Init(GetUnknown(), m_pidlRoot, *pPidl);
+		}
+		hr = pExtractIcon->QueryInterface(riid, ppvReturn);
+		pExtractIcon->Release();
+		return hr;
+	}
+
 	// All other requests are delegated to the target path's IShellFolder
 
 	// because multiple items can point to different storages, we can't (easily) handle groups of items.
-	if (uCount > 1)
+	// Our own folders have no target at all.
+	if (uCount > 1 || !COWItem::IsOwn(*pPidl))
 		return E_NOINTERFACE;
 
 	CComPtr<IShellFolder> TargetParentShellFolderPtr;
@@ -472,13 +905,17 @@ STDMETHODIMP COWRootShellFolder::GetUIObjectOf(HWND hwndOwner, UINT uCount, LPCI
 
 STDMETHODIMP COWRootShellFolder::BindToStorage(LPCITEMIDLIST, LPBC, REFIID, void**)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::BindToStorage()\n", this);
+	OW_TRACE1(OW_EVENT_BINDTOSTORAGE, this);
+	COWMetricTimer Timer(OW_TIMER_BINDTOSTORAGE);
+	OW_RECORD_CALL(OW_EVENT_BINDTOSTORAGE, this, 0, 0, 0);
 	return E_NOTIMPL;
 }
 
 STDMETHODIMP COWRootShellFolder::GetDisplayNameOf(LPCITEMIDLIST pidl, DWORD uFlags, LPSTRRET lpName)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::GetDisplayNameOf(uFlags=0x%04x) pidl=[%s]\n"), this, uFlags, PidlToString(pidl));
+	OW_TRACE3(OW_EVENT_GETDISPLAYNAMEOF, this, uFlags, OWTraceItemKey(pidl));
+	COWMetricTimer Timer(OW_TIMER_GETDISPLAYNAMEOF);
+	OW_RECORD_CALL(OW_EVENT_GETDISPLAYNAMEOF, this, uFlags, RecordItem(pidl), 0);
 
 	if ((pidl == NULL) || (lpName == NULL))
 		return E_POINTER;
@@ -509,34 +946,183 @@ STDMETHODIMP COWRootShellFolder::GetDisplayNameOf(LPCITEMIDLIST pidl, DWORD uFla
 		return E_FAIL;
 	}
 
+	// Our own folders only have their name, and can't be renamed either
+	if (COWFolderItem::IsOwn(pidl))
+	{
+		if (uFlags & SHGDN_FOREDITING)
+			return E_FAIL;
+		return SetReturnStringW(COWFolderItem::GetName(pidl), COWFolderItem::GetNameLength(pidl), *lpName) ? S_OK : E_FAIL;
+	}
+
 	// At this stage, the pidl should be one of ours
 	if (!COWItem::IsOwn(pidl))
 		return E_INVALIDARG;
 
+	// Parsing names always come back as wide strings. They're what gets handed to
+	// other namespaces and Unicode-only APIs, and some callers read pOleStr directly.
 	switch (uFlags)
 	{
 	case SHGDN_NORMAL | SHGDN_FORPARSING :
 	case SHGDN_INFOLDER | SHGDN_FORPARSING :
-		return SetReturnStringW(COWItem::GetPath(pidl), *lpName) ? S_OK : E_FAIL;
+		return SetReturnStringW(COWItem::GetPath(pidl), COWItem::GetPathLength(pidl), *lpName) ? S_OK : E_FAIL;
 
 	case SHGDN_NORMAL | SHGDN_FOREDITING :
 	case SHGDN_INFOLDER | SHGDN_FOREDITING :
 		return E_FAIL;	// Can't rename!
 	}
 
-	// Any other combination results in returning the name.
-	return SetReturnStringW(COWItem::GetName(pidl), *lpName) ? S_OK : E_FAIL;
+	// Any other combination results in returning the name. Only the in-folder one,
+	// that the shell reads for its views, goes by offset; see ShellItems.h.
+	if ((uFlags & SHGDN_INFOLDER) && !(uFlags & SHGDN_FORPARSING))
+		return SetItemReturnString(pidl, COWItem::GetNameA(pidl), COWItem::GetName(pidl), COWItem::GetNameLength(pidl), *lpName) ? S_OK : E_FAIL;
+	return SetReturnStringW(COWItem::GetName(pidl), COWItem::GetNameLength(pidl), *lpName) ? S_OK : E_FAIL;
 }
 
-STDMETHODIMP COWRootShellFolder::ParseDisplayName(HWND, LPBC, LPOLESTR, LPDWORD, LPITEMIDLIST*, LPDWORD)
+// ParseDisplayName() turns a path or a window name back into one of our pidls.
+// The pidl is relative to us, so anything that isn't a window we know of isn't found.
+STDMETHODIMP COWRootShellFolder::ParseDisplayName(HWND hwndOwner, LPBC pbc, LPOLESTR pszDisplayName, LPDWORD pchEaten, LPITEMIDLIST *ppidl, LPDWORD pdwAttributes)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::ParseDisplayName()\n", this);
-	return E_NOTIMPL;
+	OW_TRACE1(OW_EVENT_PARSEDISPLAYNAME, this);
+	COWMetricTimer Timer(OW_TIMER_PARSEDISPLAYNAME);
+	OW_RECORD_CALL(OW_EVENT_PARSEDISPLAYNAME, this, OW_CALLLOG_ITEM_FOREIGN, 0, 0);
+
+	if (pszDisplayName == NULL || ppidl == NULL)
+		return E_POINTER;
+
+	*ppidl = NULL;
+
+	// Our own folders, by name
+	if (m_Kind == ROOT && OWHistoryEnabled())
+	{
+		WCHAR Name[MAX_PATH];
+		LoadWideString(IDS_RECENT_FOLDER, Name);
+		if (wcscmp(pszDisplayName, Name) == 0)
+		{
+			COWFolderItem Recent(OW_FOLDER_RECENT, Name);
+			*ppidl = m_PidlMgr.Create(Recent);
+			if (*ppidl == NULL)
+				return E_OUTOFMEMORY;
+			if (pchEaten)
+				*pchEaten = wcslen(pszDisplayName);
+			if (pdwAttributes)
+				GetAttributesOf(1, (LPCITEMIDLIST*)ppidl, pdwAttributes);
+			return S_OK;
+		}
+	}
+
+	// We can be asked to parse before anyone enumerated us
+	bool Empty;
+	{
+		ObjectLock Lock(this);
+		Empty = !HaveWindows();
+	}
+	if (Empty)
+		RefreshSnapshot(hwndOwner);
+
+	int Item;
+	{
+		ObjectLock Lock(this);
+		Item = m_Snapshot != NULL ? m_Index.Find(pszDisplayName) : -1;
+		if (Item >= 0)
+			*ppidl = m_PidlMgr.Create(m_Snapshot->Items[Item]);
+	}
+	if (Item >= 0)
+	{
+		OW_TRACE2(OW_EVENT_PARSEDISPLAYNAME_FOUND, this, Item);
+		RecordedCall.SetArg(0, OW_CALLLOG_ITEM_FIRST + Item);
+
+		if (*ppidl == NULL)
+			return E_OUTOFMEMORY;
+		OWMetricsCount(OW_COUNTER_PIDL_ALLOC);
+
+		if (pchEaten)
+			*pchEaten = wcslen(pszDisplayName);
+		if (pdwAttributes)
+			GetAttributesOf(1, (LPCITEMIDLIST*)ppidl, pdwAttributes);
+
+		return S_OK;
+	}
+
+	// The groups, by name
+	{
+		ObjectLock Lock(this);
+		int Group = m_Snapshot != NULL ? m_Snapshot->Groups.FindName(pszDisplayName) : -1;
+		if (Group >= 0)
+		{
+			COWFolderItem Item(OW_FOLDER_GROUP, m_Snapshot->Groups.GetName(Group), m_Snapshot->Groups.GetKey(Group));
+			*ppidl = m_PidlMgr.Create(Item);
+			if (*ppidl == NULL)
+				return E_OUTOFMEMORY;
+		}
+	}
+	if (*ppidl != NULL)
+	{
+		if (pchEaten)
+			*pchEaten = wcslen(pszDisplayName);
+		if (pdwAttributes)
+			GetAttributesOf(1, (LPCITEMIDLIST*)ppidl, pdwAttributes);
+		return S_OK;
+	}
+
+	// Below one of the windows: that window, then the rest as its folder parses it.
+	// The same two levels BindToObject() takes.
+	int Eaten = 0;
+	LPITEMIDLIST pidlWindow = NULL;
+	{
+		ObjectLock Lock(this);
+		Item = m_Snapshot != NULL ? m_Index.FindPathPrefix(pszDisplayName, &Eaten) : -1;
+		if (Item >= 0)
+			pidlWindow = m_PidlMgr.Create(m_Snapshot->Items[Item]);
+	}
+	// Anywhere else, the desktop could parse it, but into a pidl relative to itself,
+	// which callers would append to ours.
+	if (Item < 0)
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	if (pidlWindow == NULL)
+		return E_OUTOFMEMORY;
+	OW_TRACE2(OW_EVENT_PARSEDISPLAYNAME_FOUND, this, Item);
+	RecordedCall.SetArg(0, OW_CALLLOG_ITEM_FIRST + Item);
+
+	LPOLESTR Rest = pszDisplayName + Eaten;
+	while (*Rest == L'\\' || *Rest == L'/')
+		Rest++;
+	if (*Rest == L'\0')
+	{
+		*ppidl = pidlWindow;
+		if (pchEaten)
+			*pchEaten = wcslen(pszDisplayName);
+		if (pdwAttributes)
+			GetAttributesOf(1, (LPCITEMIDLIST*)ppidl, pdwAttributes);
+		return S_OK;
+	}
+
+	CComPtr<IShellFolder> WindowFolderPtr;
+	LPITEMIDLIST pidlChild = NULL;
+	ULONG ChildEaten = 0;
+	HRESULT hr = BindToWindowFolder(pidlWindow, pbc, &WindowFolderPtr);
+	if (SUCCEEDED(hr))
+		hr = WindowFolderPtr->ParseDisplayName(hwndOwner, pbc, Rest, &ChildEaten, &pidlChild, pdwAttributes);
+	if (SUCCEEDED(hr))
+	{
+		*ppidl = ILCombine(pidlWindow, pidlChild);
+		if (*ppidl == NULL)
+			hr = E_OUTOFMEMORY;
+		ILFree(pidlChild);
+	}
+	m_PidlMgr.Delete(pidlWindow);
+	if (FAILED(hr))
+		return hr;
+
+	if (pchEaten)
+		*pchEaten = (Rest - pszDisplayName) + ChildEaten;
+	return S_OK;
 }
 
 STDMETHODIMP COWRootShellFolder::SetNameOf(HWND, LPCITEMIDLIST, LPCOLESTR, DWORD, LPITEMIDLIST*)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::SetNameOf()\n", this);
+	OW_TRACE1(OW_EVENT_SETNAMEOF, this);
+	COWMetricTimer Timer(OW_TIMER_SETNAMEOF);
+	OW_RECORD_CALL(OW_EVENT_SETNAMEOF, this, 0, 0, 0);
 	return E_NOTIMPL;
 }
 
@@ -545,7 +1131,9 @@ STDMETHODIMP COWRootShellFolder::SetNameOf(HWND, LPCITEMIDLIST, LPCOLESTR, DWORD
 
 STDMETHODIMP COWRootShellFolder::ColumnClick(UINT iColumn)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::ColumnClick(iColumn=%d)\n", this, iColumn);
+	OW_TRACE2(OW_EVENT_COLUMNCLICK, this, iColumn);
+	COWMetricTimer Timer(OW_TIMER_COLUMNCLICK);
+	OW_RECORD_CALL(OW_EVENT_COLUMNCLICK, this, iColumn, 0, 0);
 
 	// The caller must sort the column itself
 	return S_FALSE;
@@ -554,47 +1142,56 @@ STDMETHODIMP COWRootShellFolder::ColumnClick(UINT iColumn)
 
 STDMETHODIMP COWRootShellFolder::GetDetailsOf(LPCITEMIDLIST pidl, UINT iColumn, LPSHELLDETAILS pDetails)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::GetDetailsOf(iColumn=%d) pidl=[%s]\n"), this, iColumn, PidlToString(pidl));
+	OW_TRACE3(OW_EVENT_GETDETAILSOF, this, iColumn, OWTraceItemKey(pidl));
+	COWMetricTimer Timer(OW_TIMER_GETDETAILSOF);
+	OW_RECORD_CALL(OW_EVENT_GETDETAILSOF, this, iColumn, RecordItem(pidl), 0);
 
 	if (iColumn >= DETAILS_COLUMN_MAX)
 		return E_FAIL;
 
+	const OWColumn &Column = g_OWColumns[iColumn];
+	pDetails->fmt = Column.Format;
+	pDetails->cxChar = Column.Width;
+
 	// Shell asks for the column headers
 	if (pidl == NULL)
 	{
 		// Load the iColumn based string from the resource
-		CString ColumnName(MAKEINTRESOURCE(IDS_COLUMN_NAME+iColumn));
-
-		if (iColumn == DETAILS_COLUMN_RANK)
-		{
-			pDetails->fmt = LVCFMT_RIGHT;
-			pDetails->cxChar = 6;
-		}
-		else
-		{
-			pDetails->fmt = LVCFMT_LEFT;
-			pDetails->cxChar = 32;
-		}
+		CString ColumnName(MAKEINTRESOURCE(Column.NameId));
 		return SetReturnString(ColumnName, pDetails->str) ? S_OK : E_OUTOFMEMORY;
 	}
 
+	// Our own folders only have a name
+	if (COWFolderItem::IsOwn(pidl))
+	{
+		if (Column.Field != OW_FIELD_NAME)
+			return SetReturnStringW(L"", 0, pDetails->str) ? S_OK : E_OUTOFMEMORY;
+		pDetails->cxChar = COWFolderItem::GetNameLength(pidl);
+		return SetReturnStringW(COWFolderItem::GetName(pidl), COWFolderItem::GetNameLength(pidl), pDetails->str) ? S_OK : E_OUTOFMEMORY;
+	}
+
 	// Okay, this time it's for a real item
 	TCHAR tmpStr[16];
-	switch (iColumn)
+	LPCWSTR Text;
+	ULONG Length;
+	switch (Column.Field)
 	{
-	case DETAILS_COLUMN_NAME:
-		pDetails->fmt = LVCFMT_LEFT;
-		pDetails->cxChar = wcslen(COWItem::GetName(pidl));
-		return SetReturnStringW(COWItem::GetName(pidl), pDetails->str) ? S_OK : E_OUTOFMEMORY;
-
-	case DETAILS_COLUMN_PATH:
-		pDetails->fmt = LVCFMT_LEFT;
-		pDetails->cxChar = wcslen(COWItem::GetName(pidl));
-		return SetReturnStringW(COWItem::GetPath(pidl), pDetails->str) ? S_OK : E_OUTOFMEMORY;
+	case OW_FIELD_NAME:
+		Length = COWItem::GetNameLength(pidl);
+		pDetails->cxChar = Length;
+		return SetItemReturnString(pidl, COWItem::GetNameA(pidl), COWItem::GetName(pidl), Length, pDetails->str) ? S_OK : E_OUTOFMEMORY;
+
+	case OW_FIELD_PATH:
+		Length = COWItem::GetPathLength(pidl);
+		pDetails->cxChar = Length;
+		return SetItemReturnString(pidl, COWItem::GetPathA(pidl), COWItem::GetPath(pidl), Length, pDetails->str) ? S_OK : E_OUTOFMEMORY;
 	
-	case DETAILS_COLUMN_RANK:
-		pDetails->fmt = LVCFMT_RIGHT;
-		pDetails->cxChar = 6;
+	case OW_FIELD_RANK:
+		// Without the lock: a refresh only ever adds a bigger table, see DetailTable.h.
+		// Pidls from before the current snapshot can have ranks we haven't made.
+		Text = m_Details.GetRankText(COWItem::GetRank(pidl), &Length);
+		if (Text != NULL)
+			return SetReturnStringW(Text, Length, pDetails->str) ? S_OK : E_OUTOFMEMORY;
 		wsprintf(tmpStr, _T("%d"), COWItem::GetRank(pidl));
 		return SetReturnString(tmpStr, pDetails->str) ? S_OK : E_OUTOFMEMORY;
 	}
@@ -607,13 +1204,50 @@ STDMETHODIMP COWRootShellFolder::GetDetailsOf(LPCITEMIDLIST pidl, UINT iColumn,
 
 STDMETHODIMP COWRootShellFolder::EnumSearches(IEnumExtraSearch **ppEnum)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::EnumSearches()\n", this);
-	return E_NOTIMPL;
+	OW_TRACE1(OW_EVENT_ENUMSEARCHES, this);
+	COWMetricTimer Timer(OW_TIMER_ENUMSEARCHES);
+	OW_RECORD_CALL(OW_EVENT_ENUMSEARCHES, this, 0, 0, 0);
+
+	HRESULT hr;
+
+	if (ppEnum == NULL)
+		return E_POINTER;
+
+	*ppEnum = NULL;
+
+	EXTRASEARCH Search;
+	memset(&Search, 0, sizeof(Search));
+	Search.guidSearch = GUID_OpenWindowsSearch;
+
+	CString SearchName(MAKEINTRESOURCE(IDS_SEARCH_NAME));
+#ifdef _UNICODE
+	wcsncpy(Search.wszFriendlyName, SearchName, 79);
+#else
+	mbstowcs(Search.wszFriendlyName, SearchName, 79);
+#endif
+
+	CComObject<CEnumExtraSearch>* pEnum;
+	hr = CComObject<CEnumExtraSearch>::CreateInstance(&pEnum);
+	if (FAILED(hr))
+		return hr;
+
+	pEnum->AddRef();
+
+	// The enumerator gets its own copy of the single entry
+	hr = pEnum->Init(&Search, &Search + 1, NULL, AtlFlagCopy);
+	if (SUCCEEDED(hr))
+		hr = pEnum->QueryInterface(IID_IEnumExtraSearch, (void**)ppEnum);
+
+	pEnum->Release();
+
+	return hr;
 }
 
 STDMETHODIMP COWRootShellFolder::GetDefaultColumn(DWORD dwReserved, ULONG *pSort, ULONG *pDisplay)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::GetDefaultColumn()\n", this);
+	OW_TRACE1(OW_EVENT_GETDEFAULTCOLUMN, this);
+	COWMetricTimer Timer(OW_TIMER_GETDEFAULTCOLUMN);
+	OW_RECORD_CALL(OW_EVENT_GETDEFAULTCOLUMN, this, 0, 0, 0);
 
 	if (!pSort || !pDisplay)
 		return E_POINTER;
@@ -626,88 +1260,163 @@ STDMETHODIMP COWRootShellFolder::GetDefaultColumn(DWORD dwReserved, ULONG *pSort
 
 STDMETHODIMP COWRootShellFolder::GetDefaultColumnState(UINT iColumn, SHCOLSTATEF *pcsFlags)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::GetDefaultColumnState(iColumn=%d)\n", this, iColumn);
+	OW_TRACE2(OW_EVENT_GETDEFAULTCOLUMNSTATE, this, iColumn);
+	COWMetricTimer Timer(OW_TIMER_GETDEFAULTCOLUMNSTATE);
+	OW_RECORD_CALL(OW_EVENT_GETDEFAULTCOLUMNSTATE, this, iColumn, 0, 0);
 
 	if (!pcsFlags)
 		return E_POINTER;
 
-	// Seems that SHCOLSTATE_PREFER_VARCMP doesn't have any noticeable effect (if supplied or not) for Win2K, but don't
-	// set it for WinXP, since it will not sort the column. (not setting it means that our CompareIDs() will be called)
-	switch (iColumn)
-	{
-	case DETAILS_COLUMN_NAME:		*pcsFlags = SHCOLSTATE_TYPE_STR | SHCOLSTATE_ONBYDEFAULT;	break;
-	case DETAILS_COLUMN_PATH:		*pcsFlags = SHCOLSTATE_TYPE_STR | SHCOLSTATE_ONBYDEFAULT;	break;
-	case DETAILS_COLUMN_RANK:		*pcsFlags = SHCOLSTATE_TYPE_INT | SHCOLSTATE_ONBYDEFAULT;	break;
-	default:						return E_INVALIDARG;
-	}
+	if (iColumn >= DETAILS_COLUMN_MAX)
+		return E_INVALIDARG;
 
+	*pcsFlags = g_OWColumns[iColumn].State;
 	return S_OK;
 }
 
 STDMETHODIMP COWRootShellFolder::GetDefaultSearchGUID(GUID *pguid)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::GetDefaultSearchGUID()\n", this);
-	return E_NOTIMPL;
+	OW_TRACE1(OW_EVENT_GETDEFAULTSEARCHGUID, this);
+	COWMetricTimer Timer(OW_TIMER_GETDEFAULTSEARCHGUID);
+	OW_RECORD_CALL(OW_EVENT_GETDEFAULTSEARCHGUID, this, 0, 0, 0);
+
+	if (pguid == NULL)
+		return E_POINTER;
+
+	*pguid = GUID_OpenWindowsSearch;
+	return S_OK;
 }
 
 STDMETHODIMP COWRootShellFolder::GetDetailsEx(LPCITEMIDLIST pidl, const SHCOLUMNID *pscid, VARIANT *pv)
 {
-	ATLTRACE(_T("COWRootShellFolder(0x%08x)::GetDetailsEx(pscid->pid=%d) pidl=[%s]\n"), this, pscid->pid, PidlToString(pidl));
+	OW_TRACE4(OW_EVENT_GETDETAILSEX, this, pscid->fmtid.Data1, pscid->pid, OWTraceItemKey(pidl));
+	COWMetricTimer Timer(OW_TIMER_GETDETAILSEX);
+	OW_RECORD_CALL(OW_EVENT_GETDETAILSEX, this, pscid->fmtid.Data1, pscid->pid, RecordItem(pidl));
 
 #if defined(OW_PKEYS_SUPPORT)
 	/*
-	 * Vista required. It appears ItemNameDisplay and ItemPathDisplay come
-	 * from their real FS representation. The API is also wide-only and is
+	 * Vista required, see Columns.cpp. The API is also wide-only and is
 	 * only available on XP SP2+ on, so it won't harm 9x.
 	 */
-	if (IsEqualPropertyKey(*pscid, PKEY_PropList_TileInfo))
-	{
-		ATLTRACE(_T(" ** GetDetailsEx: PKEY_PropList_TileInfo"));
-		return SUCCEEDED(InitVariantFromString(L"prop:System.ItemPathDisplay", pv));
-	}
-	else if (IsEqualPropertyKey(*pscid, PKEY_PropList_ExtendedTileInfo))
+	const OWFolderProperty *Property = OWFindFolderProperty(*pscid);
+	if (Property != NULL)
 	{
-		ATLTRACE(_T(" ** GetDetailsEx: PKEY_PropList_ExtendedTileInfo"));
-		return SUCCEEDED(InitVariantFromString(L"prop:System.ItemPathDisplay", pv));
-	}
-	else if (IsEqualPropertyKey(*pscid, PKEY_PropList_PreviewDetails))
-	{
-		ATLTRACE(_T(" ** GetDetailsEx: PKEY_PropList_PreviewDetails"));
-		return SUCCEEDED(InitVariantFromString(L"prop:System.ItemPathDisplay", pv));
-	}
-	else if (IsEqualPropertyKey(*pscid, PKEY_PropList_FullDetails))
-	{
-		ATLTRACE(_T(" ** GetDetailsEx: PKEY_PropList_FullDetails"));
-		return SUCCEEDED(InitVariantFromString(L"prop:System.ItemNameDisplay;System.ItemPathDisplay", pv));
-	}
-	else if (IsEqualPropertyKey(*pscid, PKEY_ItemType))
-	{
-		ATLTRACE(_T(" ** GetDetailsEx: PKEY_ItemType"));
-		return SUCCEEDED(InitVariantFromString(L"Directory", pv));
+		// The caller frees the VARIANT, so it gets its own copy
+		VariantInit(pv);
+		pv->bstrVal = SysAllocStringLen(Property->Value, Property->Length);
+		if (pv->bstrVal == NULL)
+			return E_OUTOFMEMORY;
+		pv->vt = VT_BSTR;
+		return S_OK;
 	}
 #endif
 
-	ATLTRACE(_T(" ** GetDetailsEx: Not implemented"));
 	return E_NOTIMPL;
 }
 
 STDMETHODIMP COWRootShellFolder::MapColumnToSCID(UINT iColumn, SHCOLUMNID *pscid)
 {
-	ATLTRACE("COWRootShellFolder(0x%08x)::MapColumnToSCID(iColumn=%d)\n", this, iColumn);
+	OW_TRACE2(OW_EVENT_MAPCOLUMNTOSCID, this, iColumn);
+	COWMetricTimer Timer(OW_TIMER_MAPCOLUMNTOSCID);
+	OW_RECORD_CALL(OW_EVENT_MAPCOLUMNTOSCID, this, iColumn, 0, 0);
 #if defined(OW_PKEYS_SUPPORT)
 	// This will map the columns to some built-in properties on Vista.
-	// It's needed for the tile subtitles to display properly.
-	switch (iColumn)
+	if (iColumn >= DETAILS_COLUMN_MAX || g_OWColumns[iColumn].Key == NULL)
+		return E_FAIL;
+
+	*pscid = *g_OWColumns[iColumn].Key;
+	return S_OK;
+#endif
+	return E_NOTIMPL;
+}
+
+//-------------------------------------------------------------------------------
+// IOpenWindowsRootShellFolder
+
+STDMETHODIMP COWRootShellFolder::SetSearchQuery(LPCWSTR pszQuery)
+{
+	OW_TRACE2(OW_EVENT_SETSEARCHQUERY, this, pszQuery != NULL ? wcslen(pszQuery) : 0);
+	COWMetricTimer Timer(OW_TIMER_SETSEARCHQUERY);
+	OW_RECORD_CALL(OW_EVENT_SETSEARCHQUERY, this, pszQuery != NULL ? wcslen(pszQuery) : 0, 0, 0);
+
+	ObjectLock Lock(this);
+
+	if (pszQuery == NULL || pszQuery[0] == L'\0')
 	{
-	case DETAILS_COLUMN_NAME:
-		*pscid = PKEY_ItemNameDisplay;
+		m_SearchQuery[0] = L'\0';
+		Publish(&m_SearchResults, NULL);
 		return S_OK;
-	case DETAILS_COLUMN_PATH:
-		*pscid = PKEY_ItemPathDisplay;
+	}
+
+	wcsncpy(m_SearchQuery, pszQuery, MAX_PATH-1);
+	m_SearchQuery[MAX_PATH-1] = L'\0';
+
+	// Without a snapshot, the next EnumObjects() will run the query
+	if (!HaveWindows())
+	{
+		Publish(&m_SearchResults, NULL);
 		return S_OK;
-	// We can seemingly skip rank and let it fall through to the legacy impl
 	}
-	return E_FAIL;
-#endif
-	return E_NOTIMPL;
+
+	RunSearch();
+	return S_OK;
+}
+
+STDMETHODIMP COWRootShellFolder::SetSearchMode(OWSEARCHMODE Mode)
+{
+	OW_TRACE2(OW_EVENT_SETSEARCHMODE, this, Mode);
+	COWMetricTimer Timer(OW_TIMER_SETSEARCHMODE);
+	OW_RECORD_CALL(OW_EVENT_SETSEARCHMODE, this, Mode, 0, 0);
+
+	if (Mode != OWSEARCH_SUBSTRING && Mode != OWSEARCH_FUZZY)
+		return E_INVALIDARG;
+
+	ObjectLock Lock(this);
+	m_SearchMode = Mode;
+
+	if (m_SearchQuery[0] != L'\0' && HaveWindows())
+		RunSearch();
+	return S_OK;
+}
+
+STDMETHODIMP COWRootShellFolder::GetMetricsReport(BSTR *pbstrReport)
+{
+	OW_TRACE1(OW_EVENT_GETMETRICSREPORT, this);
+
+	if (pbstrReport == NULL)
+		return E_POINTER;
+
+	*pbstrReport = NULL;
+
+	char Report[16384];
+	int Length = OWMetricsFormat(Report, sizeof(Report));
+
+	// The report is plain ASCII, so the lengths match
+	*pbstrReport = SysAllocStringLen(NULL, Length);
+	if (*pbstrReport == NULL)
+		return E_OUTOFMEMORY;
+	if (Length > 0)
+		MultiByteToWideChar(CP_ACP, 0, Report, Length, *pbstrReport, Length);
+
+	return S_OK;
+}
+
+STDMETHODIMP COWRootShellFolder::SaveTrace(LPCWSTR pszPath)
+{
+	OW_TRACE1(OW_EVENT_SAVETRACE, this);
+
+	if (pszPath == NULL)
+		return E_POINTER;
+
+	return OWTraceSave(CString(pszPath)) ? S_OK : E_FAIL;
+}
+
+STDMETHODIMP COWRootShellFolder::SaveFlightRecord(LPCWSTR pszPath)
+{
+	OW_TRACE1(OW_EVENT_SAVEFLIGHTRECORD, this);
+
+	if (pszPath == NULL)
+		return E_POINTER;
+
+	return OWFlightSave(CString(pszPath)) ? S_OK : E_FAIL;
 }
@@ -32,25 +32,28 @@ using namespace Mortimer;
 
 #include "ShellItems.h"
 #include "Enumerate.h"
-
-#include "CComEnumOnCArray.h"
-
-//========================================================================================
-
-enum
-{
-	DETAILS_COLUMN_NAME,
-	DETAILS_COLUMN_PATH,
-	DETAILS_COLUMN_RANK,
-
-	DETAILS_COLUMN_MAX
-};
+#include "WindowIndex.h"
+#include "SearchIndex.h"
+#include "DetailTable.h"
+#include "Columns.h"
+#include "Snapshot.h"
 
 //========================================================================================
 // COWRootShellFolder
 
+// The same class is the folders of our own below it too (see COWFolderItem), such as
+// the recently closed windows, which lists what the history has instead of the windows.
+// When the windows are grouped (see Groups.h), the root lists a folder for each group,
+// and a group's folder lists its windows out of the root's snapshot.
+//
+// The folder is registered as "Both", so the shell's background threads call it directly
+// instead of through the thread that made it. Everything below m_pidlRoot is guarded by
+// the object lock (ObjectLock); enumerating the windows is slow, so it happens outside
+// of it, and only the new snapshot is put in under it. Snapshots never change once
+// they're in, so enumerators read theirs without any lock.
+
 class ATL_NO_VTABLE COWRootShellFolder : 
-	public CComObjectRootEx<CComSingleThreadModel>,
+	public CComObjectRootEx<CComMultiThreadModel>,
 	public CComCoClass<COWRootShellFolder, &CLSID_OpenWindowsRootShellFolder>,
 	public IShellFolder2,
     public IPersistFolder2,
@@ -58,6 +61,7 @@ class ATL_NO_VTABLE COWRootShellFolder :
 {
 public:
 	COWRootShellFolder();
+	void FinalRelease();
 
 DECLARE_REGISTRY_RESOURCEID(IDR_ROOTSHELLFOLDER)
 
@@ -70,6 +74,7 @@ BEGIN_COM_MAP(COWRootShellFolder)
 	COM_INTERFACE_ENTRY(IPersistFolder2)
 	COM_INTERFACE_ENTRY(IPersist)
 	COM_INTERFACE_ENTRY_IID(IID_IShellDetails, IShellDetails)
+	COM_INTERFACE_ENTRY(IOpenWindowsRootShellFolder)
 END_COM_MAP()
 
 public:
@@ -116,13 +121,66 @@ public:
 	STDMETHOD(MapColumnToSCID) (UINT iColumn, SHCOLUMNID *pscid);
 
 	//-------------------------------------------------------------------------------
+	// IOpenWindowsRootShellFolder
+
+	STDMETHOD(SetSearchQuery) (LPCWSTR pszQuery);
+	STDMETHOD(SetSearchMode) (OWSEARCHMODE Mode);
+	STDMETHOD(GetMetricsReport) (BSTR *pbstrReport);
+	STDMETHOD(SaveTrace) (LPCWSTR pszPath);
+	STDMETHOD(SaveFlightRecord) (LPCWSTR pszPath);
+
+	//-------------------------------------------------------------------------------
 
 protected:
 	CPidlMgr m_PidlMgr;
 
 	LPITEMIDLIST m_pidlRoot;
 
-	COWItemList m_OpenedWindows;
+	// Which folder this is: ROOT, or an OWFolderKind. Set before it's handed out.
+	enum { ROOT = 0 };
+	int m_Kind;
+	// For a group: the root it's in, with a reference, and the group's key. Set
+	// before it's handed out too.
+	COWRootShellFolder *m_Parent;
+	wchar_t m_Key[MAX_PATH];
+
+	// When the snapshot was last refreshed (GetTickCount). A group lists the windows
+	// out of the root's snapshot as it is when it's this recent, instead of having
+	// them all asked again.
+	enum { GROUP_FRESH_MS = 2000 };
+	DWORD m_RefreshTime;
+
+	// The windows last found, NULL before the first refresh
+	COWSnapshot *m_Snapshot;
+	// Lookup by path/name over m_Snapshot, for ParseDisplayName
+	COWItemIndex m_Index;
+
+	// Type-ahead filtering over m_Snapshot. While a query is set,
+	// EnumObjects() returns m_SearchResults instead.
+	COWSearchIndex m_Search;
+	wchar_t m_SearchQuery[MAX_PATH];
+	OWSEARCHMODE m_SearchMode;
+	COWSnapshot *m_SearchResults;
+
+	// Column texts for the snapshot, for GetDetailsOf()
+	COWDetailTable m_Details;
+
+	// Takes the lock itself
+	void RefreshSnapshot(HWND hwndOwner);
+	// One of our own folders, from its item (the first one of pidl)
+	HRESULT BindToFolder(LPCITEMIDLIST pidl, REFIID riid, void **ppvOut);
+	// The real folder of a window, from its item (the first one of pidl)
+	HRESULT BindToWindowFolder(LPCITEMIDLIST pidl, LPBC pbc, IShellFolder **ppFolder);
+	// The windows in the group Key, ranked in their order. Takes the lock itself.
+	void GetGroup(LPCWSTR Key, HWND hwndOwner, COWItemList *Items);
+	// Called with the lock held
+	void RunSearch();
+	bool HaveWindows() const { return m_Snapshot != NULL && m_Snapshot->Items.GetSize() != 0; }
+	// Put in a new snapshot (or none), letting go of the old one. With the lock held.
+	static void Publish(COWSnapshot **Target, COWSnapshot *Snapshot);
+
+	// How pidl is given in the call log, see CallLog.h
+	unsigned RecordItem(LPCITEMIDLIST pidl);
 };
 
 #endif //__ROOTSHELLFOLDER_H_
@@ -22,6 +22,8 @@
  */
 
 #include "ShellFolderView.h"
+#include "Trace.h"
+#include "IconCache.h"
 
 // define some undocumented messages. See "shlext.h" from Henk Devos & Andrew Le Bihan, at http://www.whirlingdervishes.com/nselib/public
 #define SFVCB_SELECTIONCHANGED    0x0008
@@ -48,10 +50,8 @@
 #define SFVCB_COLUMNCLICK2   0x32
 
 
-// Macros to trace the message name instead of its id
-#define BEGIN_TRACE_MSG_NAME() switch (uMsg) {
-#define END_TRACE_MSG_NAME() default: ATLTRACE("COWRootShellView(%08x) Msg: %2d:%2x w=%d, l=%d\n", this, uMsg, uMsg, wParam, lParam); }
-#define TRACE_MSG_NAME(name) case name: ATLTRACE("COWRootShellView(%08x) %s\n", this, #name); break;
+// Trace every message as it comes; Tools/TraceDecode knows their names.
+#define TRACE_SFV_MESSAGE() OW_TRACE4(OW_EVENT_VIEW_MESSAGE, this, uMsg, wParam, lParam);
 
 
 // This class does very little but it trace the messages.
@@ -61,12 +61,14 @@ class COWRootShellView : public CShellFolderViewImpl
 public:
 	COWRootShellView()
 	{
-		ATLTRACE("COWRootShellView(%08x) CONSTRUCTOR\n", this);
+		OW_TRACE1(OW_EVENT_VIEW_CREATED, this);
 	}
 
 	~COWRootShellView()
 	{
-		ATLTRACE("COWRootShellView(%08x) DESTRUCTOR\n", this);
+		OW_TRACE1(OW_EVENT_VIEW_DESTROYED, this);
+		// Items queued for their icons aren't on screen anymore
+		OWCancelIconLookups((IUnknown*)m_UnkOwnerPtr);
 	}
 
 	// If called, the passed object will be held (AddRef()'ed) until the View gets deleted.
@@ -77,59 +79,7 @@ public:
 
 	// The message map
 	BEGIN_MSG_MAP(COWRootShellView)
-		BEGIN_TRACE_MSG_NAME()		
-			TRACE_MSG_NAME(SFVM_MERGEMENU)
-			TRACE_MSG_NAME(SFVM_INVOKECOMMAND)
-			TRACE_MSG_NAME(SFVM_GETHELPTEXT)
-			TRACE_MSG_NAME(SFVM_GETTOOLTIPTEXT)
-			TRACE_MSG_NAME(SFVM_GETBUTTONINFO)
-			TRACE_MSG_NAME(SFVM_GETBUTTONS)
-			TRACE_MSG_NAME(SFVM_INITMENUPOPUP)
-			TRACE_MSG_NAME(SFVM_FSNOTIFY)
-			TRACE_MSG_NAME(SFVM_WINDOWCREATED)
-			TRACE_MSG_NAME(SFVM_GETDETAILSOF)
-			TRACE_MSG_NAME(SFVM_COLUMNCLICK)
-			TRACE_MSG_NAME(SFVM_QUERYFSNOTIFY)
-			TRACE_MSG_NAME(SFVM_DEFITEMCOUNT)
-			TRACE_MSG_NAME(SFVM_DEFVIEWMODE)
-			TRACE_MSG_NAME(SFVM_UNMERGEMENU)
-			TRACE_MSG_NAME(SFVM_UPDATESTATUSBAR)
-			TRACE_MSG_NAME(SFVM_BACKGROUNDENUM)
-			TRACE_MSG_NAME(SFVM_DIDDRAGDROP)
-			TRACE_MSG_NAME(SFVM_SETISFV)
-			TRACE_MSG_NAME(SFVM_THISIDLIST)
-			TRACE_MSG_NAME(SFVM_ADDPROPERTYPAGES)
-			TRACE_MSG_NAME(SFVM_BACKGROUNDENUMDONE)
-			TRACE_MSG_NAME(SFVM_GETNOTIFY)
-			TRACE_MSG_NAME(SFVM_GETSORTDEFAULTS)
-			TRACE_MSG_NAME(SFVM_SIZE)
-			TRACE_MSG_NAME(SFVM_GETZONE)
-			TRACE_MSG_NAME(SFVM_GETPANE)
-			TRACE_MSG_NAME(SFVM_GETHELPTOPIC)
-			TRACE_MSG_NAME(SFVM_GETANIMATION)
-
-			TRACE_MSG_NAME(SFVCB_SELECTIONCHANGED)
-			TRACE_MSG_NAME(SFVCB_DRAWMENUITEM)
-			TRACE_MSG_NAME(SFVCB_MEASUREMENUITEM)
-			TRACE_MSG_NAME(SFVCB_EXITMENULOOP)
-			TRACE_MSG_NAME(SFVCB_VIEWRELEASE)
-			TRACE_MSG_NAME(SFVCB_GETNAMELENGTH)
-			TRACE_MSG_NAME(SFVCB_WINDOWCLOSING)
-			TRACE_MSG_NAME(SFVCB_LISTREFRESHED)
-			TRACE_MSG_NAME(SFVCB_WINDOWFOCUSED)
-			TRACE_MSG_NAME(SFVCB_REGISTERCOPYHOOK)
-			TRACE_MSG_NAME(SFVCB_COPYHOOKCALLBACK)
-			TRACE_MSG_NAME(SFVCB_ADDINGOBJECT)
-			TRACE_MSG_NAME(SFVCB_REMOVINGOBJECT)
-			TRACE_MSG_NAME(SFVCB_GETCOMMANDDIR)
-			TRACE_MSG_NAME(SFVCB_GETCOLUMNSTREAM)
-			TRACE_MSG_NAME(SFVCB_CANSELECTALL)
-			TRACE_MSG_NAME(SFVCB_ISSTRICTREFRESH)
-			TRACE_MSG_NAME(SFVCB_ISCHILDOBJECT)
-			TRACE_MSG_NAME(SFVCB_COLUMNCLICK2)
-			TRACE_MSG_NAME(SFVCB_GETEXTVIEWS)
-			TRACE_MSG_NAME(SFVCB_WNDMAIN)
-		END_TRACE_MSG_NAME()
+		TRACE_SFV_MESSAGE()
 
 		MESSAGE_HANDLER(SFVM_COLUMNCLICK, OnColumnClick)
 		MESSAGE_HANDLER(SFVM_GETDETAILSOF, OnGetDetailsOf)
@@ -139,7 +89,7 @@ public:
 	// Offer to set the default view mode
 	LRESULT OnDefViewMode(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled)
 	{
-		ATLTRACE("COWRootShellView(%08x)::OnDefViewMode()\n", this);
+		OW_TRACE1(OW_EVENT_VIEW_DEFVIEWMODE, this);
 #ifdef FVM_CONTENT
 		/* Requires Windows 7+, by Gravis' request */
 		DWORD ver, maj, min;
@@ -155,7 +105,7 @@ public:
 	// When a user clicks on a column header in details mode
 	LRESULT OnColumnClick(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled)
 	{
-		ATLTRACE("COWRootShellView(%08x)::OnColumnClick(iColumn=%d)\n", this, wParam);
+		OW_TRACE2(OW_EVENT_VIEW_COLUMNCLICK, this, wParam);
 
 		// Shell version 4.7x doesn't understand S_FALSE as described in the SDK.
 		SendFolderViewMessage(SFVM_REARRANGE, wParam);
@@ -168,7 +118,7 @@ public:
 		int iColumn = (int)wParam;
 		DETAILSINFO* pDi = (DETAILSINFO*)lParam;
 
-		ATLTRACE("COWRootShellView(%08x)::OnGetDetailsOf(iColumn=%d)\n", this, iColumn);
+		OW_TRACE2(OW_EVENT_VIEW_GETDETAILSOF, this, iColumn);
 
 		if (!pDi)
 			return E_POINTER;
@@ -0,0 +1,416 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// No stdafx.h here on purpose; this builds without Windows.
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <ctype.h>			// towupper, VC++6 has no wctype.h
+#else
+#include <wctype.h>
+#endif
+
+#include "SearchIndex.h"
+#include "FuzzyMatch.h"
+
+//========================================================================================
+// Helpers
+
+// The separator between the name and the path, as in FuzzyMatch.cpp
+#define NAME_PATH_SEPARATOR '\1'
+
+static unsigned ClampLength(unsigned Length)
+{
+	return Length < OW_SEARCH_MAX_TEXT - 1 ? Length : OW_SEARCH_MAX_TEXT - 1;
+}
+
+static bool Contains(const OWCHAR *Text, const OWCHAR *Pattern)
+{
+	int i;
+
+	if (Pattern[0] == 0)
+		return true;
+
+	for (; *Text; Text++)
+	{
+		for (i = 0; Pattern[i] != 0 && Text[i] == Pattern[i]; i++)
+			;
+		if (Pattern[i] == 0)
+			return true;
+	}
+	return false;
+}
+
+struct FuzzyMatch
+{
+	int Item;
+	int Score;
+};
+
+// Best score first, then snapshot order
+static int CompareFuzzyMatches(const void *a, const void *b)
+{
+	const FuzzyMatch *x = (const FuzzyMatch*)a, *y = (const FuzzyMatch*)b;
+
+	if (x->Score != y->Score)
+		return x->Score > y->Score ? -1 : 1;
+	return x->Item - y->Item;
+}
+
+//========================================================================================
+// COWSearchIndex
+
+COWSearchIndex::COWSearchIndex()
+	: m_Texts(NULL), m_TextBlock(NULL), m_Masks(NULL), m_ItemCount(0), m_Postings(NULL),
+	  m_PostingCount(0), m_HasQuery(false), m_QueryFuzzy(false), m_Results(NULL),
+	  m_ResultCount(0), m_Scores(NULL)
+{
+	m_Query[0] = 0;
+}
+
+COWSearchIndex::~COWSearchIndex()
+{
+	RemoveAll();
+}
+
+void COWSearchIndex::RemoveAll()
+{
+	delete [] m_Texts;
+	delete [] m_TextBlock;
+	delete [] m_Masks;
+	delete [] m_Postings;
+	delete [] m_Results;
+	delete [] m_Scores;
+
+	m_Texts = NULL;
+	m_TextBlock = NULL;
+	m_Masks = NULL;
+	m_ItemCount = 0;
+	m_Postings = NULL;
+	m_PostingCount = 0;
+
+	m_HasQuery = false;
+	m_Query[0] = 0;
+	m_Results = NULL;
+	m_ResultCount = 0;
+	m_Scores = NULL;
+}
+
+// Upper case, cut to OW_SEARCH_MAX_TEXT with the terminator.
+void COWSearchIndex::Normalize(const OWCHAR *Source, unsigned Length, OWCHAR *Target)
+{
+	unsigned i;
+
+	// Paths are mostly ASCII, which doesn't need the CRT's tables
+	Length = ClampLength(Length);
+	for (i = 0; i < Length; i++)
+	{
+		OWCHAR c = Source[i];
+		if (c < 0x80)
+			Target[i] = (c >= 'a' && c <= 'z') ? (OWCHAR)(c - 'a' + 'A') : c;
+		else
+			Target[i] = (OWCHAR)towupper(c);
+	}
+	Target[Length] = 0;
+}
+
+// Three UTF-16 chars folded into a key. Collisions only cost a wasted candidate,
+// the substring match has the last word.
+unsigned COWSearchIndex::MakeTrigram(const OWCHAR *Text)
+{
+	unsigned a = Text[0], b = Text[1], c = Text[2];
+	return (a * 0x9E3779B1u) ^ (b << 11) ^ (b >> 21) ^ (c * 31u);
+}
+
+// Postings go in by item, so a stable sort on the trigram alone leaves every run in
+// item order. That's an LSD radix sort, a byte at a time: linear, where this used to
+// be a Shell sort that went quadratic with the ~60 postings per window. Passes where
+// every key has the same byte are skipped.
+bool COWSearchIndex::SortPostings(Posting *Postings, int Count)
+{
+	int Offsets[256];
+	int Shift, i;
+
+	if (Count < 2)
+		return true;
+
+	Posting *Scratch = new Posting[Count];
+	if (Scratch == NULL)
+		return false;
+
+	Posting *From = Postings, *To = Scratch;
+	for (Shift = 0; Shift < 32; Shift += 8)
+	{
+		memset(Offsets, 0, sizeof(Offsets));
+		for (i = 0; i < Count; i++)
+			Offsets[(From[i].Trigram >> Shift) & 255]++;
+		if (Offsets[(From[0].Trigram >> Shift) & 255] == Count)
+			continue;
+
+		int Total = 0;
+		for (i = 0; i < 256; i++)
+		{
+			int Bucket = Offsets[i];
+			Offsets[i] = Total;
+			Total += Bucket;
+		}
+		for (i = 0; i < Count; i++)
+			To[Offsets[(From[i].Trigram >> Shift) & 255]++] = From[i];
+
+		Posting *Swap = From;
+		From = To;
+		To = Swap;
+	}
+
+	if (From != Postings)
+		memcpy(Postings, From, Count * sizeof(Posting));
+	delete [] Scratch;
+	return true;
+}
+
+bool COWSearchIndex::Build(const OWItemData *Items, int Count)
+{
+	int i, j;
+
+	RemoveAll();
+
+	if (Count == 0)
+		return true;
+
+	// Every text in one block, terminated
+	unsigned TotalLength = 0;
+	for (i = 0; i < Count; i++)
+		TotalLength += ClampLength(Items[i].NameLength) + 1 + ClampLength(Items[i].PathLength) + 1;
+
+	m_Texts = new OWCHAR*[Count];
+	m_TextBlock = new OWCHAR[TotalLength];
+	m_Masks = new OWUINT64[Count];
+	m_Results = new int[Count];
+	m_Scores = new int[Count];
+	// Upper bound; trigrams spanning the separator are skipped
+	m_Postings = new Posting[TotalLength];
+	if (m_Texts == NULL || m_TextBlock == NULL || m_Masks == NULL || m_Results == NULL
+		|| m_Scores == NULL || m_Postings == NULL)
+	{
+		RemoveAll();
+		return false;
+	}
+
+	OWCHAR *Text = m_TextBlock;
+	for (i = 0; i < Count; i++)
+	{
+		unsigned NameLength = ClampLength(Items[i].NameLength);
+
+		Normalize(Items[i].Name, NameLength, Text);
+		Text[NameLength] = NAME_PATH_SEPARATOR;
+		Normalize(Items[i].Path, Items[i].PathLength, Text + NameLength + 1);
+
+		m_Texts[i] = Text;
+		m_Masks[i] = OWFuzzyCharMask(Text);
+		Text += NameLength + 1 + ClampLength(Items[i].PathLength) + 1;
+	}
+	m_ItemCount = Count;
+
+	for (i = 0; i < m_ItemCount; i++)
+	{
+		const OWCHAR *Text = m_Texts[i];
+		for (j = 0; Text[j] && Text[j+1] && Text[j+2]; j++)
+		{
+			if (Text[j] == NAME_PATH_SEPARATOR || Text[j+1] == NAME_PATH_SEPARATOR || Text[j+2] == NAME_PATH_SEPARATOR)
+				continue;
+			m_Postings[m_PostingCount].Trigram = MakeTrigram(Text + j);
+			m_Postings[m_PostingCount].Item = i;
+			m_PostingCount++;
+		}
+	}
+
+	if (!SortPostings(m_Postings, m_PostingCount))
+	{
+		RemoveAll();
+		return false;
+	}
+
+	return true;
+}
+
+// Returns the first posting for the trigram, and the length of its run.
+int COWSearchIndex::FindPostings(unsigned Trigram, int *pCount) const
+{
+	int Low = 0, High = m_PostingCount;
+	while (Low < High)
+	{
+		int Middle = (Low + High) / 2;
+		if (m_Postings[Middle].Trigram < Trigram)
+			Low = Middle + 1;
+		else
+			High = Middle;
+	}
+
+	int End = Low;
+	while (End < m_PostingCount && m_Postings[End].Trigram == Trigram)
+		End++;
+
+	*pCount = End - Low;
+	return Low;
+}
+
+bool COWSearchIndex::Matches(int Item, const OWCHAR *Text) const
+{
+	return Contains(m_Texts[Item], Text);
+}
+
+// Typing one more char can only remove results, for both kinds of queries.
+bool COWSearchIndex::IsNarrowing(const OWCHAR *Normalized, bool Fuzzy) const
+{
+	int i;
+
+	if (!m_HasQuery || m_QueryFuzzy != Fuzzy)
+		return false;
+
+	for (i = 0; m_Query[i] != 0; i++)
+	{
+		if (Normalized[i] != m_Query[i])
+			return false;
+	}
+	return true;
+}
+
+void COWSearchIndex::Query(const OWCHAR *Text)
+{
+	OWCHAR Normalized[OW_SEARCH_MAX_TEXT];
+	int i;
+
+	Normalize(Text, OWStrLen(Text), Normalized);
+	int Length = (int)OWStrLen(Normalized);
+
+	// Only look at what we already have if we can
+	if (IsNarrowing(Normalized, false))
+	{
+		int Kept = 0;
+		for (i = 0; i < m_ResultCount; i++)
+		{
+			if (Matches(m_Results[i], Normalized))
+				m_Results[Kept++] = m_Results[i];
+		}
+		m_ResultCount = Kept;
+	}
+	else if (Length < 3)
+	{
+		// Too short for a trigram; there's only so many items anyways
+		m_ResultCount = 0;
+		for (i = 0; i < m_ItemCount; i++)
+		{
+			if (Matches(i, Normalized))
+				m_Results[m_ResultCount++] = i;
+		}
+	}
+	else
+	{
+		// Every match contains every trigram of the query, so the shortest
+		// posting list holds all the candidates.
+		int Best = 0, BestCount = -1;
+		for (i = 0; i + 2 < Length; i++)
+		{
+			int Count;
+			int First = FindPostings(MakeTrigram(Normalized + i), &Count);
+			if (BestCount < 0 || Count < BestCount)
+			{
+				Best = First;
+				BestCount = Count;
+				if (Count == 0)
+					break;
+			}
+		}
+
+		m_ResultCount = 0;
+		int LastItem = -1;
+		for (i = Best; i < Best + BestCount; i++)
+		{
+			int Item = m_Postings[i].Item;
+			// An item has a posting for each occurence of the trigram
+			if (Item != LastItem && Matches(Item, Normalized))
+				m_Results[m_ResultCount++] = Item;
+			LastItem = Item;
+		}
+	}
+
+	memcpy(m_Query, Normalized, (Length+1)*sizeof(OWCHAR));
+	m_HasQuery = true;
+	m_QueryFuzzy = false;
+}
+
+void COWSearchIndex::QueryFuzzy(const OWCHAR *Text)
+{
+	OWCHAR Normalized[OW_SEARCH_MAX_TEXT];
+	int i;
+
+	Normalize(Text, OWStrLen(Text), Normalized);
+
+	// The candidates are either what the shorter query matched, or everything. They're
+	// scored and kept in place.
+	if (!IsNarrowing(Normalized, true))
+	{
+		for (i = 0; i < m_ItemCount; i++)
+			m_Results[i] = i;
+		m_ResultCount = m_ItemCount;
+	}
+
+	int Count = m_ResultCount;
+	if (Count > 0)
+	{
+		OWFuzzyScoreBatch(Normalized, m_Texts, m_Masks, m_Results, Count, m_Scores);
+
+		m_ResultCount = 0;
+		for (i = 0; i < Count; i++)
+		{
+			if (m_Scores[i] == OW_FUZZY_NOMATCH)
+				continue;
+			m_Results[m_ResultCount] = m_Results[i];
+			m_Scores[m_ResultCount] = m_Scores[i];
+			m_ResultCount++;
+		}
+	}
+
+	// Best score first, then snapshot order. Without the memory they stay in
+	// snapshot order, which is still right, only not as useful.
+	FuzzyMatch *Sorted = m_ResultCount > 1 ? new FuzzyMatch[m_ResultCount] : NULL;
+	if (Sorted != NULL)
+	{
+		for (i = 0; i < m_ResultCount; i++)
+		{
+			Sorted[i].Item = m_Results[i];
+			Sorted[i].Score = m_Scores[i];
+		}
+		qsort(Sorted, m_ResultCount, sizeof(FuzzyMatch), CompareFuzzyMatches);
+		for (i = 0; i < m_ResultCount; i++)
+		{
+			m_Results[i] = Sorted[i].Item;
+			m_Scores[i] = Sorted[i].Score;
+		}
+		delete [] Sorted;
+	}
+
+	memcpy(m_Query, Normalized, (OWStrLen(Normalized)+1)*sizeof(OWCHAR));
+	m_HasQuery = true;
+	m_QueryFuzzy = true;
+}
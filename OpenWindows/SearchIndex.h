@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __SEARCHINDEX_H_
+#define __SEARCHINDEX_H_
+
+//========================================================================================
+// Substring and fuzzy search over the names and paths of a window snapshot.
+//
+// Every item's text is split in trigrams, and the (trigram, item) pairs are kept sorted
+// so the candidates for a query are the posting list of its rarest trigram. Those are
+// then confirmed with a plain substring match. When the query grows by typing, the
+// previous results are narrowed instead of going back to the index.
+//
+// Fuzzy queries match the query as a subsequence, see FuzzyMatch.h. They narrow the
+// same way, and their results are ordered by score.
+//
+// Like OWCore.h, this doesn't include Windows headers, so the index can be built and
+// queried in the benchmarks; the folder fills it from its snapshot's OWItemData.
+
+#include "OWCore.h"
+
+enum
+{
+	// Longest normalized name or path, and query; longer ones are cut, as MAX_PATH
+	OW_SEARCH_MAX_TEXT = 260
+};
+
+class COWSearchIndex
+{
+public:
+	COWSearchIndex();
+	~COWSearchIndex();
+
+	// Index a new snapshot. This forgets the previous query.
+	bool Build(const OWItemData *Items, int Count);
+
+	// Run the query (case insensitive). The matching item indexes, in snapshot
+	// order, are then available through GetResult().
+	void Query(const OWCHAR *Text);
+
+	// Run a fuzzy query. The results are ordered best first, and GetScore() is
+	// their match score.
+	void QueryFuzzy(const OWCHAR *Text);
+
+	int GetResultCount() const { return m_ResultCount; }
+	int GetResult(int i) const { return m_Results[i]; }
+	int GetScore(int i) const { return m_Scores[i]; }
+
+	void RemoveAll();
+
+protected:
+	struct Posting
+	{
+		unsigned Trigram;
+		int Item;
+	};
+
+	static void Normalize(const OWCHAR *Source, unsigned Length, OWCHAR *Target);
+	static unsigned MakeTrigram(const OWCHAR *Text);
+	static bool SortPostings(Posting *Postings, int Count);
+	bool Matches(int Item, const OWCHAR *Text) const;
+	int FindPostings(unsigned Trigram, int *pCount) const;
+	bool IsNarrowing(const OWCHAR *Normalized, bool Fuzzy) const;
+
+	// Normalized "NAME\1PATH" of every item, so a match can't straddle both. They're
+	// all in one block.
+	OWCHAR **m_Texts;
+	OWCHAR *m_TextBlock;
+	// OWFuzzyCharMask() of every text
+	OWUINT64 *m_Masks;
+	int m_ItemCount;
+
+	// Sorted by trigram, then by item
+	Posting *m_Postings;
+	int m_PostingCount;
+
+	// Normalized text of the last query, and what it matched. Both arrays have room
+	// for every item.
+	OWCHAR m_Query[OW_SEARCH_MAX_TEXT];
+	bool m_HasQuery;
+	bool m_QueryFuzzy;
+	int *m_Results;
+	int m_ResultCount;
+	// Only for fuzzy queries, parallel to m_Results
+	int *m_Scores;
+};
+
+#endif // __SEARCHINDEX_H_
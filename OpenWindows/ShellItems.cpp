@@ -25,25 +25,60 @@
 
 #include "stdafx.h"
 #include "ShellItems.h"
+#include "Common.h"
+#include "Metrics.h"
 
 //========================================================================================
-// Helper for STRRET
+// The shell allocator
+
+// The DLL gets loaded into every process with a file dialog, and most never list us,
+// so nothing here is set up by a constructor at load time. A plain pointer needs none.
+static IMalloc * volatile s_Malloc = NULL;
 
-CMalloc::CMalloc()
+IMalloc *OWGetMalloc()
 {
-	HRESULT hr = SHGetMalloc(&m_MallocPtr);
-	ATLASSERT(SUCCEEDED(hr));
+	IMalloc *Malloc = s_Malloc, *Published;
+	if (Malloc == NULL)
+	{
+		if (FAILED(SHGetMalloc(&Malloc)))
+			return NULL;
+		// Threads racing here each got a reference; the first one published is kept, and
+		// the others give theirs back
+		Published = (IMalloc*)OWCompareExchangePointer((void * volatile*)&s_Malloc, Malloc, NULL);
+		if (Published != NULL)
+		{
+			Malloc->Release();
+			Malloc = Published;
+		}
+	}
+	return Malloc;
 }
 
-CMalloc g_Malloc;
+void OWReleaseMalloc()
+{
+	if (s_Malloc != NULL)
+		s_Malloc->Release();
+	s_Malloc = NULL;
+}
+
+//========================================================================================
+// Helper for STRRET
+
+static LPOLESTR AllocString(ULONG Size)
+{
+	IMalloc *Malloc = OWGetMalloc();
+	return Malloc != NULL ? (LPOLESTR)Malloc->Alloc(Size) : NULL;
+}
 
 bool SetReturnStringA(LPCSTR Source, STRRET &str)
 {
 	ULONG StringLen = strlen(Source)+1;
 	str.uType = STRRET_WSTR;
-	str.pOleStr = (LPOLESTR)g_Malloc.m_MallocPtr->Alloc(StringLen*sizeof(OLECHAR));
+	str.pOleStr = AllocString(StringLen*sizeof(OLECHAR));
 	if (!str.pOleStr)
 		return false;
+	OWMetricsCount(OW_COUNTER_STRRET_ALLOC);
+	OW_ALLOC_NOTE(OW_ALLOC_SHELL, StringLen*sizeof(OLECHAR));
 
 	mbstowcs(str.pOleStr, Source, StringLen);
 	return true;
@@ -53,31 +88,90 @@ bool SetReturnStringW(LPCWSTR Source, STRRET &str)
 {
 	ULONG StringLen = wcslen(Source)+1;
 	str.uType = STRRET_WSTR;
-	str.pOleStr = (LPOLESTR)g_Malloc.m_MallocPtr->Alloc(StringLen*sizeof(OLECHAR));
+	str.pOleStr = AllocString(StringLen*sizeof(OLECHAR));
 	if (!str.pOleStr)
 		return false;
+	OWMetricsCount(OW_COUNTER_STRRET_ALLOC);
+	OW_ALLOC_NOTE(OW_ALLOC_SHELL, StringLen*sizeof(OLECHAR));
 
 	wcsncpy(str.pOleStr, Source, StringLen);
 	return true;
 }
 
+bool SetReturnStringW(LPCWSTR Source, ULONG Length, STRRET &str)
+{
+	ULONG Size = (Length+1)*sizeof(OLECHAR);
+	str.uType = STRRET_WSTR;
+	str.pOleStr = AllocString(Size);
+	if (!str.pOleStr)
+		return false;
+	OWMetricsCount(OW_COUNTER_STRRET_ALLOC);
+	OW_ALLOC_NOTE(OW_ALLOC_SHELL, Size);
+
+	memcpy(str.pOleStr, Source, Size);
+	return true;
+}
+
+void SetReturnStringOffset(LPCITEMIDLIST pidl, LPCSTR Source, STRRET &str)
+{
+	str.uType = STRRET_OFFSET;
+	str.uOffset = (UINT)(Source - (LPCSTR)pidl);
+	OWMetricsCount(OW_COUNTER_STRRET_OFFSET);
+}
+
+//========================================================================================
+// COWItem
+
+COWItem::COWItem() : m_Rank(0), m_PathLength(0), m_NameLength(0), m_PathALength(0), m_NameALength(0), m_Window(NULL)
+{
+	m_Path[0] = L'\0';
+	m_Name[0] = L'\0';
+	m_PathA[0] = '\0';
+	m_NameA[0] = '\0';
+}
+
+void COWItem::GetData(OWItemData *Data) const
+{
+	Data->Rank = m_Rank;
+	Data->Path = m_Path;
+	Data->PathLength = m_PathLength;
+	Data->Name = m_Name;
+	Data->NameLength = m_NameLength;
+	Data->PathA = m_PathA;
+	Data->PathALength = m_PathALength;
+	Data->NameA = m_NameA;
+	Data->NameALength = m_NameALength;
+}
+
 ULONG COWItem::GetSize()
 {
-	return   4
-		   + 2
-		   + 2
-		   + (wcslen(m_Path)+1)*sizeof(OLECHAR)
-		   + (wcslen(m_Name)+1)*sizeof(OLECHAR)
-		   ;
+	OWItemData Data;
+	GetData(&Data);
+	return OWItemGetSize(&Data);
 }
 
 void COWItem::CopyTo(void *pTarget)
 {
-	*(DWORD*)pTarget = MAGIC;
-	*((USHORT*)pTarget+2) = 0;
-	*((USHORT*)pTarget+3) = m_Rank;
-	wcscpy((OLECHAR*)pTarget+4, m_Path);
-	wcscpy((OLECHAR*)pTarget+4+wcslen(m_Path)+1, m_Name);
+	OWItemData Data;
+	GetData(&Data);
+	OWItemEncode(&Data, pTarget);
+}
+
+// Convert to the ANSI code page, and check that nothing was lost on the way, since
+// the shell will convert it back. Returns the length, or ANSI_NONE.
+USHORT COWItem::MakeAnsiCopy(LPCWSTR Source, ULONG Length, LPSTR Target)
+{
+	wchar_t Check[MAX_PATH];
+
+	int Size = WideCharToMultiByte(CP_ACP, 0, Source, Length+1, Target, MAX_PATH*2, NULL, NULL);
+	if (Size == 0)
+		return ANSI_NONE;
+
+	int CheckSize = MultiByteToWideChar(CP_ACP, 0, Target, Size, Check, MAX_PATH);
+	if (CheckSize != (int)Length+1 || memcmp(Check, Source, CheckSize*sizeof(wchar_t)) != 0)
+		return ANSI_NONE;
+
+	return (USHORT)(Size-1);
 }
 
 //-------------------------------------------------------------------------------
@@ -85,11 +179,17 @@ void COWItem::CopyTo(void *pTarget)
 void COWItem::SetPath(LPCWSTR Path)
 {
 	wcsncpy(m_Path, Path, MAX_PATH);
+	m_Path[MAX_PATH-1] = L'\0';
+	m_PathLength = (USHORT)wcslen(m_Path);
+	m_PathALength = MakeAnsiCopy(m_Path, m_PathLength, m_PathA);
 }
 
 void COWItem::SetName(LPCWSTR Name)
 {
 	wcsncpy(m_Name, Name, MAX_PATH);
+	m_Name[MAX_PATH-1] = L'\0';
+	m_NameLength = (USHORT)wcslen(m_Name);
+	m_NameALength = MakeAnsiCopy(m_Name, m_NameLength, m_NameA);
 }
 
 void COWItem::SetRank(USHORT Rank)
@@ -101,86 +201,132 @@ void COWItem::SetRank(USHORT Rank)
 
 bool COWItem::IsOwn(LPCITEMIDLIST pidl)
 {
-	if ((pidl == NULL) || (pidl->mkid.cb < 4))
-		return false;
-
-	return *((DWORD*)(pidl->mkid.abID)) == MAGIC;
+	return OWItemIsOwn(pidl);
 }
 
 LPOLESTR COWItem::GetPath(LPCITEMIDLIST pidl)
 {
-	return (OLECHAR*)pidl+5;
+	return (LPOLESTR)OWItemGetPath(pidl);
 }
 
 LPOLESTR COWItem::GetName(LPCITEMIDLIST pidl)
 {
-	return (OLECHAR*) ( (BYTE*)pidl + 10 + (wcslen((OLECHAR*)pidl+5)+1) * sizeof(OLECHAR) );
+	return (LPOLESTR)OWItemGetName(pidl);
 }
 
-USHORT COWItem::GetRank(LPCITEMIDLIST pidl)
+ULONG COWItem::GetPathLength(LPCITEMIDLIST pidl)
 {
-	return *((USHORT*)pidl+4);
+	return OWItemGetPathLength(pidl);
 }
 
-//========================================================================================
-// CDataObject
+ULONG COWItem::GetNameLength(LPCITEMIDLIST pidl)
+{
+	return OWItemGetNameLength(pidl);
+}
 
-// helper function that creates a CFSTR_SHELLIDLIST format from given pidls.
-HGLOBAL CreateShellIDList(LPCITEMIDLIST pidlParent, LPCITEMIDLIST *aPidls, UINT uItemCount)
+LPCSTR COWItem::GetPathA(LPCITEMIDLIST pidl)
 {
-	HGLOBAL hGlobal = NULL;
-	LPIDA pData;
-	UINT iCurPos;
-	UINT cbPidl;
-	UINT i;
-	CPidlMgr PidlMgr;
+	return OWItemGetPathA(pidl);
+}
 
-	// get the size of the parent folder's PIDL
-	cbPidl = PidlMgr.GetSize(pidlParent);
+LPCSTR COWItem::GetNameA(LPCITEMIDLIST pidl)
+{
+	return OWItemGetNameA(pidl);
+}
+
+USHORT COWItem::GetRank(LPCITEMIDLIST pidl)
+{
+	return OWItemGetRank(pidl);
+}
+
+void OWReorderItems(COWItemList *Items, const int *Order)
+{
+	COWItemList Sorted;
+	int i;
 
-	// get the total size of all of the PIDLs
-	for (i=0; i<uItemCount; i++)
+	for (i = 0; i < Items->GetSize(); i++)
 	{
-		cbPidl += PidlMgr.GetSize(aPidls[i]);
+		Sorted.Add((*Items)[Order[i]]);
+		Sorted[i].SetRank(i);
 	}
+	Items->RemoveAll();
+	for (i = 0; i < Sorted.GetSize(); i++)
+		Items->Add(Sorted[i]);
+}
 
-	// Find the end of the CIDA structure. This is the size of the 
-	// CIDA structure itself (which includes one element of aoffset) plus the 
-	// additional number of elements in aoffset.
-	iCurPos = sizeof(CIDA) + (uItemCount * sizeof(UINT));
+//========================================================================================
+// COWFolderItem
 
-	// Allocate the memory for the CIDA structure and it's variable length members.
-	hGlobal = GlobalAlloc(GPTR | GMEM_SHARE, (DWORD)
-	                                         (iCurPos +        // size of the CIDA structure and the additional aoffset elements
-	                                         (cbPidl + 1)));   // size of the pidls
-	if (!hGlobal)
-		return NULL;
+COWFolderItem::COWFolderItem(int Kind, LPCWSTR Name, LPCWSTR Key) : m_Kind(Kind)
+{
+	wcsncpy(m_Name, Name, MAX_PATH);
+	m_Name[MAX_PATH-1] = L'\0';
+	m_NameLength = (USHORT)wcslen(m_Name);
+	wcsncpy(m_Key, Key, MAX_PATH);
+	m_Key[MAX_PATH-1] = L'\0';
+	m_KeyLength = (USHORT)wcslen(m_Key);
+}
 
-	if (pData = (LPIDA)GlobalLock(hGlobal))
-	{
-		pData->cidl = uItemCount;
-		pData->aoffset[0] = iCurPos;
+ULONG COWFolderItem::GetSize()
+{
+	return OWFolderItemGetSize(m_NameLength, m_KeyLength);
+}
+
+void COWFolderItem::CopyTo(void *pTarget)
+{
+	OWFolderItemEncode(m_Kind, m_Name, m_NameLength, m_Key, m_KeyLength, pTarget);
+}
 
-		// add the PIDL for the parent folder
-		cbPidl = PidlMgr.GetSize(pidlParent);
-		CopyMemory((LPBYTE)(pData) + iCurPos, (LPBYTE)pidlParent, cbPidl);
-		iCurPos += cbPidl;
+bool COWFolderItem::IsOwn(LPCITEMIDLIST pidl)
+{
+	return OWFolderItemIsOwn(pidl);
+}
 
-		for (i=0; i<uItemCount; i++)
-		{
-			// get the size of the PIDL
-			cbPidl = PidlMgr.GetSize(aPidls[i]);
+int COWFolderItem::GetKind(LPCITEMIDLIST pidl)
+{
+	return OWFolderItemGetKind(pidl);
+}
 
-			// fill out the members of the CIDA structure.
-			pData->aoffset[i + 1] = iCurPos;
+LPCWSTR COWFolderItem::GetName(LPCITEMIDLIST pidl)
+{
+	return OWFolderItemGetName(pidl);
+}
 
-			// copy the contents of the PIDL
-			CopyMemory((LPBYTE)(pData) + iCurPos, (LPBYTE)aPidls[i], cbPidl);
+ULONG COWFolderItem::GetNameLength(LPCITEMIDLIST pidl)
+{
+	return OWFolderItemGetNameLength(pidl);
+}
 
-			// set up the position of the next PIDL
-			iCurPos += cbPidl;
-		}
+LPCWSTR COWFolderItem::GetKey(LPCITEMIDLIST pidl)
+{
+	return OWFolderItemGetKey(pidl);
+}
+
+ULONG COWFolderItem::GetKeyLength(LPCITEMIDLIST pidl)
+{
+	return OWFolderItemGetKeyLength(pidl);
+}
 
+//========================================================================================
+// CDataObject
+
+// helper function that creates a CFSTR_SHELLIDLIST format from given pidls.
+HGLOBAL CreateShellIDList(LPCITEMIDLIST pidlParent, LPCITEMIDLIST *aPidls, UINT uItemCount)
+{
+	HGLOBAL hGlobal;
+	LPIDA pData;
+	UINT Size;
+
+	// The layout itself is done by the core; CIDA is a UINT count and UINT offsets
+	Size = OWShellIDListGetSize(pidlParent, (const void * const *)aPidls, uItemCount);
+
+	hGlobal = GlobalAlloc(GPTR | GMEM_SHARE, Size + 1);
+	if (!hGlobal)
+		return NULL;
+
+	if (pData = (LPIDA)GlobalLock(hGlobal))
+	{
+		OWShellIDListBuild(pData, pidlParent, (const void * const *)aPidls, uItemCount);
 		GlobalUnlock(hGlobal);
 	}
 
@@ -26,18 +26,16 @@
 
 #include "MPidlMgr.h"
 #include "CStringCopyTo.h"
+#include "OWCore.h"
 using namespace Mortimer;
 
 
 //========================================================================================
 
-// Used by SetReturnString.
-// Can also be used by anyone when the Shell Allocator is needed. Use the gloabl g_Malloc object which is a CMalloc.
-struct CMalloc
-{
-	CComPtr<IMalloc> m_MallocPtr;
-	CMalloc();
-};
+// Anyone needing the shell allocator uses OWGetMalloc(), see MPidlMgr.h.
+
+// Let go of the shell allocator, once nothing uses it anymore. Called from DllMain.
+void OWReleaseMalloc();
 
 // Set the return string 'Source' in the STRRET struct.
 // Note that it always allocate a UNICODE copy of the string.
@@ -45,6 +43,23 @@ struct CMalloc
 bool SetReturnStringA(LPCSTR Source, STRRET &str);
 bool SetReturnStringW(LPCWSTR Source, STRRET &str);
 
+// Same, when the length (in chars, without the null) is already known.
+bool SetReturnStringW(LPCWSTR Source, ULONG Length, STRRET &str);
+
+// Point the STRRET at ANSI text that lives inside pidl (STRRET_OFFSET). Nothing is
+// allocated, but the string is only valid along with the pidl it was asked for.
+// The metrics count how often that happens, see Metrics.h.
+//
+// There's no telling from the call whether the caller copes with anything but
+// STRRET_WSTR: some read pOleStr without looking at uType, and a caller that zeroes
+// the STRRET first looks the same as one asking for a wide string. So offsets only
+// go where the shell itself reads the string, through StrRetToBuf and the like:
+//  - GetDetailsOf, for the name and path columns of our views;
+//  - GetDisplayNameOf with SHGDN_INFOLDER, the name shown in views and address bars.
+// Everything else (SHGDN_NORMAL, which other hosts ask for, and parsing names) keeps
+// getting an allocated STRRET_WSTR.
+void SetReturnStringOffset(LPCITEMIDLIST pidl, LPCSTR Source, STRRET &str);
+
 #ifdef _UNICODE
 	#define SetReturnString SetReturnStringW
 #else
@@ -58,12 +73,18 @@ bool SetReturnStringW(LPCWSTR Source, STRRET &str);
 class COWItem : public CPidlData
 {
 public:
+	COWItem();
 
 	//-------------------------------------------------------------------------------
 	// used by the manager to embed data, previously set by clients, into a pidl
 
 	// The pidl signature
-	enum { MAGIC = 0xAA000055 | ('OW'<<8) };
+	enum { MAGIC = OW_ITEM_MAGIC };
+
+	// The pidl layout, stored right after the signature; see OWCore.h. Pidls can be
+	// persisted by the shell (i.e. recent places in file dialogs), so older layouts
+	// stay readable.
+	enum { LAYOUT_V0 = OW_LAYOUT_V0, LAYOUT_V1 = OW_LAYOUT_V1, LAYOUT_V2 = OW_LAYOUT_V2, LAYOUT_CURRENT = OW_LAYOUT_CURRENT };
 
 	// return the size of the pidl data. Not counting the mkid.cb member.
 	ULONG GetSize();
@@ -97,25 +118,97 @@ public:
 	// The pidl MUST remain valid until the caller has finished with the returned string.
 	static LPOLESTR GetName(LPCITEMIDLIST pidl);
 
+	// Length in chars of the path and name, without having to scan for them.
+	static ULONG GetPathLength(LPCITEMIDLIST pidl);
+	static ULONG GetNameLength(LPCITEMIDLIST pidl);
+
+	// ANSI copies of the path and name, made only when they convert back to the
+	// exact same wide string. NULL when there is none, such as for chars outside
+	// the ANSI code page, or older pidls.
+	static LPCSTR GetPathA(LPCITEMIDLIST pidl);
+	static LPCSTR GetNameA(LPCITEMIDLIST pidl);
+
 	// Retrieve the item rank
 	static USHORT GetRank(LPCITEMIDLIST pidl);
 
 	//-------------------------------------------------------------------------------
+	// Used by clients to get data back from an item that isn't a pidl yet
+
+	LPCWSTR GetPath() const { return m_Path; }
+	LPCWSTR GetName() const { return m_Name; }
+	USHORT GetRank() const { return m_Rank; }
+
+	// The window it was found in, if any. It isn't kept in the pidl.
+	void SetWindow(HWND Window) { m_Window = Window; }
+	HWND GetWindow() const { return m_Window; }
+
+	// Everything the core needs to know about the item. It points into the item.
+	void GetData(OWItemData *Data) const;
+
+	//-------------------------------------------------------------------------------
 
 protected:
-	USHORT m_Padding; /* Pascal's example used an item type here, we don't care about that */
+	static USHORT MakeAnsiCopy(LPCWSTR Source, ULONG Length, LPSTR Target);
+
+	// Length of an ANSI copy that couldn't be made
+	enum { ANSI_NONE = OW_NO_ANSI };
+
+	/* Pascal's example used an item type where the layout is, we didn't care about that */
 	USHORT m_Rank;
+	USHORT m_PathLength;
+	USHORT m_NameLength;
 	// The old wtlstr CString is always TCHAR, not a templated version, and
 	// do we really want to reimplement that? For now, statically allocate
 	// MAX_PATH worth. On Windows 10, this can be larger, but we can truncate
 	// for now.
 	wchar_t m_Path[MAX_PATH];
 	wchar_t m_Name[MAX_PATH];
+	// DBCS code pages can take two bytes a char
+	USHORT m_PathALength;
+	USHORT m_NameALength;
+	char m_PathA[MAX_PATH*2];
+	char m_NameA[MAX_PATH*2];
+	HWND m_Window;
 };
 
 
 // Collection for our data
-typedef CSimpleArray<COWItem> COWItemList;
+typedef COWSimpleArray<COWItem> COWItemList;
+
+// Put the items in the order given (Order[i] is the item to go i-th), and rank them in
+// that order
+void OWReorderItems(COWItemList *Items, const int *Order);
+
+//========================================================================================
+// A folder of our own below the root, like the recently closed windows. See OWCore.h.
+
+class COWFolderItem : public CPidlData
+{
+public:
+	COWFolderItem(int Kind, LPCWSTR Name, LPCWSTR Key = L"");
+
+	// The pidl signature
+	enum { MAGIC = OW_FOLDER_MAGIC };
+
+	ULONG GetSize();
+	void CopyTo(void *pTarget);
+
+	static bool IsOwn(LPCITEMIDLIST pidl);
+	static int GetKind(LPCITEMIDLIST pidl);
+	// The pidl MUST remain valid until the caller has finished with the returned string.
+	static LPCWSTR GetName(LPCITEMIDLIST pidl);
+	static ULONG GetNameLength(LPCITEMIDLIST pidl);
+	// Empty for folders there's only one of
+	static LPCWSTR GetKey(LPCITEMIDLIST pidl);
+	static ULONG GetKeyLength(LPCITEMIDLIST pidl);
+
+protected:
+	int m_Kind;
+	USHORT m_NameLength;
+	wchar_t m_Name[MAX_PATH];
+	USHORT m_KeyLength;
+	wchar_t m_Key[MAX_PATH];
+};
 
 //========================================================================================
 // Light implementation of IDataObject.
@@ -125,8 +218,10 @@ typedef CSimpleArray<COWItem> COWItemList;
 // into the IDataObject, so that the FileDialog can pass it further to our IShellFolder::BindToObject().
 // Because I'm only interested in the FileDialog behaviour, every methods returns E_NOTIMPL except GetData().
 
+// It's set up before it's handed out and only read after, so any thread can use it.
+
 class ATL_NO_VTABLE CDataObject :
-	public CComObjectRootEx<CComSingleThreadModel>,
+	public CComObjectRootEx<CComMultiThreadModel>,
 	public IDataObject, public IEnumFORMATETC
 {
 public:
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include "stdafx.h"
+#include "Snapshot.h"
+#include "Metrics.h"
+
+//========================================================================================
+// COWSnapshot
+
+COWSnapshot::COWSnapshot() : m_Refs(1), m_Count(0), m_Images(NULL), m_Offsets(NULL)
+{
+}
+
+COWSnapshot::~COWSnapshot()
+{
+	delete [] m_Images;
+	delete [] m_Offsets;
+}
+
+COWSnapshot *COWSnapshot::Create()
+{
+	return new COWSnapshot;
+}
+
+STDMETHODIMP COWSnapshot::QueryInterface(REFIID riid, void **ppvObject)
+{
+	if (ppvObject == NULL)
+		return E_POINTER;
+
+	if (riid != IID_IUnknown)
+	{
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+
+	*ppvObject = (IUnknown*)this;
+	AddRef();
+	return S_OK;
+}
+
+STDMETHODIMP_(ULONG) COWSnapshot::AddRef()
+{
+	return (ULONG)InterlockedIncrement(&m_Refs);
+}
+
+STDMETHODIMP_(ULONG) COWSnapshot::Release()
+{
+	LONG Refs = InterlockedDecrement(&m_Refs);
+	if (Refs == 0)
+		delete this;
+	return (ULONG)Refs;
+}
+
+bool COWSnapshot::Seal(const LPCITEMIDLIST *Folders, int FolderCount, const int *Listed, int ListedCount)
+{
+	int Count = Listed != NULL ? ListedCount : Items.GetSize(), i;
+	unsigned FolderSize = 0, Position = 0;
+
+	OWItemData *Data = new OWItemData[Count + 1];
+	if (Data == NULL)
+		return false;
+	for (i = 0; i < Count; i++)
+		Items[Listed != NULL ? Listed[i] : i].GetData(&Data[i]);
+
+	// Images of their own, without the terminator
+	for (i = 0; i < FolderCount; i++)
+		FolderSize += Folders[i]->mkid.cb;
+
+	unsigned Size = FolderSize + OWItemImagesGetSize(Data, Count);
+	m_Images = new unsigned char[Size + 1];
+	m_Offsets = new unsigned[FolderCount + Count + 1];
+	if (m_Images == NULL || m_Offsets == NULL)
+	{
+		delete [] Data;
+		return false;
+	}
+	for (i = 0; i < FolderCount; i++)
+	{
+		m_Offsets[i] = Position;
+		memcpy(m_Images + Position, Folders[i], Folders[i]->mkid.cb);
+		Position += Folders[i]->mkid.cb;
+	}
+	OWItemImagesBuild(Data, Count, m_Images + FolderSize, m_Offsets + FolderCount);
+	for (i = 0; i <= Count; i++)
+		m_Offsets[FolderCount + i] += FolderSize;
+	OW_ALLOC_NOTE(OW_ALLOC_ARRAY, Size + (FolderCount + Count + 1) * sizeof(unsigned));
+	m_Count = FolderCount + Count;
+
+	delete [] Data;
+	return true;
+}
+
+//========================================================================================
+// COWEnumIDList
+
+static void *AllocPidl(void *Context, unsigned Size)
+{
+	return ((IMalloc*)Context)->Alloc(Size);
+}
+
+static void FreePidl(void *Context, void *Block)
+{
+	((IMalloc*)Context)->Free(Block);
+}
+
+COWEnumIDList::COWEnumIDList() : m_Snapshot(NULL), m_Position(0)
+{
+}
+
+COWEnumIDList::~COWEnumIDList()
+{
+	if (m_Snapshot != NULL)
+		m_Snapshot->Release();
+}
+
+void COWEnumIDList::Init(COWSnapshot *Snapshot, int Position)
+{
+	Snapshot->AddRef();
+	if (m_Snapshot != NULL)
+		m_Snapshot->Release();
+	m_Snapshot = Snapshot;
+	m_Position = Position;
+}
+
+STDMETHODIMP COWEnumIDList::Next(ULONG celt, LPITEMIDLIST *rgelt, ULONG *pceltFetched)
+{
+	if (rgelt == NULL || (celt != 1 && pceltFetched == NULL))
+		return E_POINTER;
+	if (m_Snapshot == NULL)
+		return E_FAIL;
+
+	if (pceltFetched)
+		*pceltFetched = 0;
+
+	IMalloc *Malloc = OWGetMalloc();
+	if (Malloc == NULL)
+		return E_OUTOFMEMORY;
+
+	// Take our items under the lock, so two threads calling at once each get their
+	// own, and make the pidls after it. The snapshot doesn't change.
+	int Position, Count;
+	{
+		ObjectLock Lock(this);
+		Position = m_Position;
+		ULONG Left = (ULONG)(m_Snapshot->GetCount() - Position);
+		Count = (int)(celt < Left ? celt : Left);
+		m_Position = Position + Count;
+	}
+
+	if (Count > 0)
+	{
+		if (OWItemImagesToPidls(m_Snapshot->GetImages(), m_Snapshot->GetOffsets(), Position, Count,
+			(void**)rgelt, AllocPidl, FreePidl, Malloc) == 0)
+		{
+			// Give them back, unless someone has moved on since
+			ObjectLock Lock(this);
+			if (m_Position == Position + Count)
+				m_Position = Position;
+			return E_OUTOFMEMORY;
+		}
+
+		const unsigned *Offsets = m_Snapshot->GetOffsets();
+		OW_ALLOC_NOTE(OW_ALLOC_PIDL, Offsets[Position + Count] - Offsets[Position] + Count * sizeof(USHORT));
+		OWMetricsCount(OW_COUNTER_PIDL_ALLOC, Count);
+	}
+
+	if (pceltFetched)
+		*pceltFetched = Count;
+	return (ULONG)Count < celt ? S_FALSE : S_OK;
+}
+
+STDMETHODIMP COWEnumIDList::Skip(ULONG celt)
+{
+	if (m_Snapshot == NULL)
+		return E_FAIL;
+
+	ObjectLock Lock(this);
+	ULONG Left = (ULONG)(m_Snapshot->GetCount() - m_Position);
+	if (celt > Left)
+	{
+		m_Position = m_Snapshot->GetCount();
+		return S_FALSE;
+	}
+	m_Position += (int)celt;
+	return S_OK;
+}
+
+STDMETHODIMP COWEnumIDList::Reset()
+{
+	if (m_Snapshot == NULL)
+		return E_FAIL;
+
+	ObjectLock Lock(this);
+	m_Position = 0;
+	return S_OK;
+}
+
+STDMETHODIMP COWEnumIDList::Clone(IEnumIDList **ppenum)
+{
+	if (ppenum == NULL)
+		return E_POINTER;
+	*ppenum = NULL;
+	if (m_Snapshot == NULL)
+		return E_FAIL;
+
+	// The clone shares the snapshot
+	CComObject<COWEnumIDList>* pEnum;
+	HRESULT hr = CComObject<COWEnumIDList>::CreateInstance(&pEnum);
+	if (FAILED(hr))
+		return hr;
+
+	int Position;
+	{
+		ObjectLock Lock(this);
+		Position = m_Position;
+	}
+
+	pEnum->AddRef();
+	pEnum->Init(m_Snapshot, Position);
+	hr = pEnum->QueryInterface(IID_IEnumIDList, (void**)ppenum);
+	pEnum->Release();
+	return hr;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef __SNAPSHOT_H_
+#define __SNAPSHOT_H_
+
+#include "ShellItems.h"
+#include "Groups.h"
+
+//========================================================================================
+// A list of items that doesn't change once it's been published: the windows the folder
+// last found, or the results of a search over them. The folder and every enumerator
+// (and clone) made from it share one, each holding a reference, so a refresh publishes
+// a new snapshot instead of changing the one they're reading.
+//
+// It's only an IUnknown, so enumerators can keep it alive like any other owner of the
+// collection they walk. Along with the items, it keeps them encoded as pidls back to
+// back (see OWItemImagesBuild), which is what enumerators hand out.
+
+class COWSnapshot : public IUnknown
+{
+public:
+	// A new, empty snapshot with one reference, the caller's. NULL when out of memory.
+	static COWSnapshot *Create();
+
+	//-------------------------------------------------------------------------------
+	// IUnknown methods
+
+	STDMETHOD(QueryInterface) (REFIID riid, void **ppvObject);
+	STDMETHOD_(ULONG, AddRef) ();
+	STDMETHOD_(ULONG, Release) ();
+
+	//-------------------------------------------------------------------------------
+
+	// Only filled in before it's published. The pidls can have folder items before
+	// these, see Seal().
+	COWItemList Items;
+	// Which of the items are in which group, when the windows are grouped
+	COWGroupIndex Groups;
+
+	// Encode the items, once they're all in, after the folder items given (single item
+	// pidls, which are copied). Only the Listed items get pidls when it isn't NULL; the
+	// others are still there for lookups. Call before publishing it; false when out of
+	// memory.
+	bool Seal(const LPCITEMIDLIST *Folders = NULL, int FolderCount = 0, const int *Listed = NULL, int ListedCount = 0);
+
+	int GetCount() const { return m_Count; }
+	const void *GetImages() const { return m_Images; }
+	const unsigned *GetOffsets() const { return m_Offsets; }
+
+protected:
+	COWSnapshot();
+	virtual ~COWSnapshot();
+
+	LONG m_Refs;
+	int m_Count;
+	unsigned char *m_Images;
+	unsigned *m_Offsets;
+};
+
+//========================================================================================
+// IEnumIDList over a snapshot. Next() makes the pidls for a whole request in one pass
+// over the images, and Skip() only moves the position. The position is only touched
+// under the object lock, since the shell can call from more than one thread.
+
+class ATL_NO_VTABLE COWEnumIDList :
+	public CComObjectRootEx<CComMultiThreadModel>,
+	public IEnumIDList
+{
+public:
+	BEGIN_COM_MAP(COWEnumIDList)
+		COM_INTERFACE_ENTRY_IID(IID_IEnumIDList, IEnumIDList)
+	END_COM_MAP()
+
+	//-------------------------------------------------------------------------------
+
+	COWEnumIDList();
+	~COWEnumIDList();
+
+	// Holds a reference on the snapshot, which must be sealed
+	void Init(COWSnapshot *Snapshot, int Position = 0);
+
+	//-------------------------------------------------------------------------------
+	// IEnumIDList methods
+
+	STDMETHOD(Next) (ULONG celt, LPITEMIDLIST *rgelt, ULONG *pceltFetched);
+	STDMETHOD(Skip) (ULONG celt);
+	STDMETHOD(Reset) ();
+	STDMETHOD(Clone) (IEnumIDList **ppenum);
+
+protected:
+	COWSnapshot *m_Snapshot;
+	int m_Position;
+};
+
+#endif // __SNAPSHOT_H_
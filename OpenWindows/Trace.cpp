@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "stdafx.h"
+#include "Trace.h"
+#include "Common.h"
+#include "Metrics.h"
+#include "OWCore.h"
+
+//========================================================================================
+// Rings
+
+struct OWTraceRing
+{
+	OWTraceRing *Next;
+	DWORD ThreadId;
+	// To see when the thread exits, and the ring can go to another
+	HANDLE Thread;
+	// Records ever written; the record is complete before this moves past it
+	volatile ULONG Head;
+	ULONG Sequence;
+	ULONG Countdown;
+	OWTraceRecord Records[OW_TRACE_RING_RECORDS];
+};
+
+volatile LONG g_OWTraceMask = ~0L;
+
+static DWORD s_Tls = TLS_OUT_OF_INDEXES;
+static ULONG s_SampleRate = 1;
+static TCHAR s_TraceFile[MAX_PATH];
+static bool s_SettingsLoaded = false;
+// Guards the list of rings and the settings, which are only loaded once
+static CRITICAL_SECTION s_RingLock;
+static OWTraceRing *s_Rings = NULL;
+static int s_RingCount = 0;
+// What a thread's slot holds when it found no ring, so it doesn't look again
+static char s_NoRing;
+
+void OWTraceInit()
+{
+	InitializeCriticalSection(&s_RingLock);
+	s_Tls = TlsAlloc();
+	s_TraceFile[0] = _T('\0');
+}
+
+void OWTraceTerm()
+{
+	OWTraceRing *Ring, *Next;
+
+	if (s_TraceFile[0] != _T('\0'))
+		OWTraceSave(s_TraceFile);
+
+	g_OWTraceMask = 0;
+	for (Ring = s_Rings; Ring != NULL; Ring = Next)
+	{
+		Next = Ring->Next;
+		if (Ring->Thread != NULL)
+			CloseHandle(Ring->Thread);
+		HeapFree(GetProcessHeap(), 0, Ring);
+	}
+	s_Rings = NULL;
+	s_RingCount = 0;
+
+	if (s_Tls != TLS_OUT_OF_INDEXES)
+		TlsFree(s_Tls);
+	s_Tls = TLS_OUT_OF_INDEXES;
+	DeleteCriticalSection(&s_RingLock);
+}
+
+// Not from DllMain, the registry might not be ready for us there. Called with the
+// lock held.
+static void LoadSettings()
+{
+	DWORD Value;
+
+	s_SettingsLoaded = true;
+	HKEY Key = OWOpenSettings();
+	if (Key == NULL)
+		return;
+
+	if (OWReadSetting(Key, _T("TraceMask"), &Value))
+		g_OWTraceMask = (LONG)Value;
+	if (OWReadSetting(Key, _T("TraceSampleRate"), &Value))
+	{
+		if (Value == 0)
+			g_OWTraceMask = 0;
+		else
+			s_SampleRate = Value;
+	}
+	OWReadSetting(Key, _T("TraceFile"), s_TraceFile, MAX_PATH);
+
+	RegCloseKey(Key);
+}
+
+// A ring for this thread: the one of a thread that exited, else a new one while there
+// are fewer than OW_TRACE_MAX_RINGS. Called with the lock.
+static OWTraceRing *ClaimRing(HANDLE Thread)
+{
+	OWTraceRing *Ring;
+
+	// Rings outlive their thread, so what it did before exiting can still be saved,
+	// but only until another thread needs one. Saving holds the lock too, so it
+	// doesn't see one change hands.
+	for (Ring = s_Rings; Ring != NULL; Ring = Ring->Next)
+	{
+		if (WaitForSingleObject(Ring->Thread, 0) == WAIT_OBJECT_0)
+		{
+			CloseHandle(Ring->Thread);
+			Ring->Head = 0;
+			Ring->Sequence = 0;
+			break;
+		}
+	}
+
+	if (Ring == NULL)
+	{
+		if (s_RingCount >= OW_TRACE_MAX_RINGS)
+			return NULL;
+		Ring = (OWTraceRing*)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(OWTraceRing));
+		if (Ring == NULL)
+			return NULL;
+		Ring->Next = s_Rings;
+		s_Rings = Ring;
+		s_RingCount++;
+	}
+
+	Ring->ThreadId = GetCurrentThreadId();
+	Ring->Thread = Thread;
+	Ring->Countdown = s_SampleRate;
+	return Ring;
+}
+
+static OWTraceRing *GetRing()
+{
+	HANDLE Thread;
+
+	if (s_Tls == TLS_OUT_OF_INDEXES)
+		return NULL;
+
+	OWTraceRing *Ring = (OWTraceRing*)TlsGetValue(s_Tls);
+	if (Ring == (OWTraceRing*)&s_NoRing)
+		return NULL;
+	if (Ring != NULL)
+		return Ring;
+
+	// First time on this thread
+	if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &Thread, SYNCHRONIZE, FALSE, 0))
+		Thread = NULL;
+
+	EnterCriticalSection(&s_RingLock);
+	if (!s_SettingsLoaded)
+		LoadSettings();
+	Ring = Thread != NULL ? ClaimRing(Thread) : NULL;
+	LeaveCriticalSection(&s_RingLock);
+
+	// Every ring is taken by a live thread; this one goes without
+	if (Ring == NULL)
+	{
+		if (Thread != NULL)
+			CloseHandle(Thread);
+		TlsSetValue(s_Tls, &s_NoRing);
+		return NULL;
+	}
+
+	TlsSetValue(s_Tls, Ring);
+	return Ring;
+}
+
+//========================================================================================
+// Writing
+
+void OWTraceWrite(unsigned Event, unsigned Arg0, unsigned Arg1, unsigned Arg2, unsigned Arg3)
+{
+	OWTraceRing *Ring = GetRing();
+	if (Ring == NULL || !OWTraceOn(Event))
+		return;
+
+	// Events that aren't sampled still count, so the decoder can show the gaps
+	Ring->Sequence++;
+	if (--Ring->Countdown != 0)
+		return;
+	Ring->Countdown = s_SampleRate;
+
+	ULONG Head = Ring->Head;
+	OWTraceRecord *Record = &Ring->Records[Head & (OW_TRACE_RING_RECORDS - 1)];
+	Record->Ticks = (OWUINT64)OWMetricsNow();
+	Record->Sequence = Ring->Sequence;
+	Record->Event = (unsigned short)Event;
+	Record->Reserved = 0;
+	Record->Args[0] = Arg0;
+	Record->Args[1] = Arg1;
+	Record->Args[2] = Arg2;
+	Record->Args[3] = Arg3;
+
+	// Publishes the record. Volatile stores aren't reordered with the ones before
+	// them by VC++, nor by x86.
+	Ring->Head = Head + 1;
+}
+
+unsigned OWTraceItemKey(LPCITEMIDLIST pidl)
+{
+	if (pidl == NULL)
+		return OW_TRACE_ITEM_NULL;
+	if (pidl->mkid.cb == 0)
+		return OW_TRACE_ITEM_ROOT;
+	if (!OWItemIsOwn(pidl))
+		return OW_TRACE_ITEM_FOREIGN;
+
+	// FNV-1a over the path, folded to 16 bits
+	const OWCHAR *Path = OWItemGetPath(pidl);
+	size_t Length = OWItemGetPathLength(pidl);
+	ULONG Hash = 2166136261UL;
+	size_t i;
+	for (i = 0; i < Length; i++)
+	{
+		Hash ^= Path[i];
+		Hash *= 16777619UL;
+	}
+	Hash = (Hash >> 16) ^ (Hash & 0xFFFF);
+	if (Hash == 0)
+		Hash = 1;
+
+	return (unsigned)((Hash << 16) | OWItemGetRank(pidl));
+}
+
+//========================================================================================
+// Saving
+
+static bool WriteAll(HANDLE File, const void *Data, DWORD Size)
+{
+	DWORD Written;
+	return WriteFile(File, Data, Size, &Written, NULL) && Written == Size;
+}
+
+// Copy what a ring holds, oldest first, while its thread might be writing to it.
+// Returns how many records were copied.
+static ULONG CopyRing(OWTraceRing *Ring, OWTraceRecord *Target)
+{
+	ULONG First, Head, Skip, i;
+
+	Head = Ring->Head;
+	First = Head > OW_TRACE_RING_RECORDS ? Head - OW_TRACE_RING_RECORDS : 0;
+	for (i = First; i < Head; i++)
+		Target[i - First] = Ring->Records[i & (OW_TRACE_RING_RECORDS - 1)];
+
+	// Anything the thread wrote meanwhile overwrote the oldest records, and the
+	// record after the new head could be half written.
+	ULONG After = Ring->Head + 1;
+	Skip = 0;
+	if (After > OW_TRACE_RING_RECORDS && After - OW_TRACE_RING_RECORDS > First)
+		Skip = After - OW_TRACE_RING_RECORDS - First;
+	if (Skip >= Head - First)
+		return 0;
+
+	if (Skip > 0)
+		memmove(Target, Target + Skip, (Head - First - Skip) * sizeof(OWTraceRecord));
+	return Head - First - Skip;
+}
+
+bool OWTraceSave(LPCTSTR Path)
+{
+	OWTraceFileHeader Header;
+	OWTraceRingHeader RingHeader;
+	OWTraceRing *Ring;
+	bool Result = true;
+
+	OWTraceRecord *Records = (OWTraceRecord*)HeapAlloc(GetProcessHeap(), 0, sizeof(OWTraceRecord) * OW_TRACE_RING_RECORDS);
+	if (Records == NULL)
+		return false;
+
+	HANDLE File = CreateFile(Path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+	{
+		HeapFree(GetProcessHeap(), 0, Records);
+		return false;
+	}
+
+	// The list only grows at the head, so it can't change under us past this
+	EnterCriticalSection(&s_RingLock);
+
+	memset(&Header, 0, sizeof(Header));
+	Header.Magic = OW_TRACE_MAGIC;
+	Header.Version = OW_TRACE_VERSION;
+	Header.RecordSize = sizeof(OWTraceRecord);
+	Header.ProcessId = GetCurrentProcessId();
+	for (Ring = s_Rings; Ring != NULL; Ring = Ring->Next)
+		Header.RingCount++;
+	Header.Frequency = (OWUINT64)OWMetricsFrequency();
+	Header.SavedAt = (OWUINT64)OWMetricsNow();
+	Result = WriteAll(File, &Header, sizeof(Header));
+
+	for (Ring = s_Rings; Result && Ring != NULL; Ring = Ring->Next)
+	{
+		memset(&RingHeader, 0, sizeof(RingHeader));
+		RingHeader.ThreadId = Ring->ThreadId;
+		RingHeader.RecordCount = CopyRing(Ring, Records);
+		RingHeader.SampleRate = s_SampleRate;
+
+		Result = WriteAll(File, &RingHeader, sizeof(RingHeader))
+			&& WriteAll(File, Records, RingHeader.RecordCount * sizeof(OWTraceRecord));
+	}
+
+	LeaveCriticalSection(&s_RingLock);
+
+	CloseHandle(File);
+	HeapFree(GetProcessHeap(), 0, Records);
+	return Result;
+}
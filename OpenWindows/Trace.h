@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+#include "OWTrace.h"
+
+//========================================================================================
+// Binary event tracing, cheap enough to stay on in release builds.
+//
+// Each thread writes fixed size records (see OWTrace.h) into its own ring, so writing
+// takes no locks and formats nothing; the oldest records get overwritten. A reader
+// can save every ring to a file at any time, which Tools/TraceDecode turns into text.
+// The ring of a thread that exited goes to the next new thread, and there are at most
+// OW_TRACE_MAX_RINGS; threads that come when they're all in use don't trace.
+//
+// Under HKCU\Software\OpenWindows:
+//  TraceMask (DWORD)		OW_TRACE_CATEGORY() bits of what to trace, all by default
+//  TraceSampleRate (DWORD)	write 1 in this many events per thread, 1 by default
+//  TraceFile (string)		save the rings there when the DLL unloads
+
+// Records per thread, a power of two, and rings per process (32 KB each)
+enum
+{
+	OW_TRACE_RING_RECORDS = 1024,
+	OW_TRACE_MAX_RINGS = 32
+};
+
+// Call once from DllMain, before anything is traced, and once at the end.
+void OWTraceInit();
+void OWTraceTerm();
+
+extern volatile LONG g_OWTraceMask;
+
+inline bool OWTraceOn(unsigned Event)
+{
+	return (g_OWTraceMask & OW_TRACE_CATEGORY(Event)) != 0;
+}
+
+void OWTraceWrite(unsigned Event, unsigned Arg0, unsigned Arg1, unsigned Arg2, unsigned Arg3);
+
+// Identifies an item in a trace without copying its strings; see OWTrace.h
+unsigned OWTraceItemKey(LPCITEMIDLIST pidl);
+
+// Objects are told apart by the low 32 bits of their address
+#define OW_TRACE_OBJECT(p) ((unsigned)(size_t)(p))
+
+// The arguments are only evaluated when the event's category is on
+#define OW_TRACE1(Event, Object) \
+	do { if (OWTraceOn(Event)) OWTraceWrite(Event, OW_TRACE_OBJECT(Object), 0, 0, 0); } while (0)
+#define OW_TRACE2(Event, Object, Arg1) \
+	do { if (OWTraceOn(Event)) OWTraceWrite(Event, OW_TRACE_OBJECT(Object), (unsigned)(Arg1), 0, 0); } while (0)
+#define OW_TRACE3(Event, Object, Arg1, Arg2) \
+	do { if (OWTraceOn(Event)) OWTraceWrite(Event, OW_TRACE_OBJECT(Object), (unsigned)(Arg1), (unsigned)(Arg2), 0); } while (0)
+#define OW_TRACE4(Event, Object, Arg1, Arg2, Arg3) \
+	do { if (OWTraceOn(Event)) OWTraceWrite(Event, OW_TRACE_OBJECT(Object), (unsigned)(Arg1), (unsigned)(Arg2), (unsigned)(Arg3)); } while (0)
+
+// Write every thread's ring to a file, while they keep tracing.
+bool OWTraceSave(LPCTSTR Path);
+
+#endif // __TRACE_H_
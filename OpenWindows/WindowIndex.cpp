@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stdafx.h"
+#include "WindowIndex.h"
+
+//========================================================================================
+// COWStringIndex
+
+COWStringIndex::COWStringIndex()
+	: m_Entries(NULL), m_Capacity(0), m_Count(0), m_Removed(0),
+	  m_Generation(0), m_KeysChanged(false),
+	  m_Sorted(NULL), m_SortedCount(0)
+{
+}
+
+COWStringIndex::~COWStringIndex()
+{
+	RemoveAll();
+}
+
+void COWStringIndex::RemoveAll()
+{
+	int i;
+	for (i = 0; i < m_Capacity; i++)
+		delete [] m_Entries[i].Key;
+	delete [] m_Entries;
+	delete [] m_Sorted;
+
+	m_Entries = NULL;
+	m_Capacity = 0;
+	m_Count = 0;
+	m_Removed = 0;
+	m_Sorted = NULL;
+	m_SortedCount = 0;
+}
+
+void COWStringIndex::Normalize(LPCWSTR Source, LPWSTR Target, bool IsPath)
+{
+	int Length = 0;
+
+	while (Source[Length] != L'\0' && Length < MAX_PATH-1)
+	{
+		wchar_t c = Source[Length];
+		if (IsPath && c == L'/')
+			c = L'\\';
+		Target[Length++] = towupper(c);
+	}
+
+	// "C:\foo\" and "C:\foo" are the same folder, but keep the root of "C:\"
+	if (IsPath)
+	{
+		while (Length > 3 && Target[Length-1] == L'\\')
+			Length--;
+	}
+
+	Target[Length] = L'\0';
+}
+
+// FNV-1a. The keys are short and already normalized.
+ULONG COWStringIndex::Hash(LPCWSTR Key)
+{
+	ULONG h = 2166136261UL;
+	while (*Key)
+	{
+		h ^= *Key++;
+		h *= 16777619UL;
+	}
+	return h;
+}
+
+// Returns the slot holding Key, or the free slot where it would go: the first
+// tombstone on the way, if any.
+int COWStringIndex::Probe(LPCWSTR Key, ULONG KeyHash) const
+{
+	int Mask = m_Capacity - 1;
+	int Slot = KeyHash & Mask;
+	int Free = -1;
+
+	while (m_Entries[Slot].Key != NULL || m_Entries[Slot].Removed)
+	{
+		if (m_Entries[Slot].Key == NULL)
+		{
+			if (Free < 0)
+				Free = Slot;
+		}
+		else if (m_Entries[Slot].Hash == KeyHash && wcscmp(m_Entries[Slot].Key, Key) == 0)
+			return Slot;
+		Slot = (Slot + 1) & Mask;
+	}
+	return Free >= 0 ? Free : Slot;
+}
+
+// Rehash the live entries into a table of suitable size, without the tombstones.
+// Keys are moved, not copied.
+bool COWStringIndex::Grow()
+{
+	int NewCapacity = 16;
+	while (NewCapacity < (m_Count + 1) * 2)
+		NewCapacity *= 2;
+
+	Entry *NewEntries = new Entry[NewCapacity];
+	if (NewEntries == NULL)
+		return false;
+	memset(NewEntries, 0, NewCapacity * sizeof(Entry));
+
+	Entry *OldEntries = m_Entries;
+	int OldCapacity = m_Capacity;
+
+	m_Entries = NewEntries;
+	m_Capacity = NewCapacity;
+	m_Removed = 0;
+
+	int i;
+	for (i = 0; i < OldCapacity; i++)
+	{
+		if (OldEntries[i].Key == NULL)
+			continue;
+		m_Entries[Probe(OldEntries[i].Key, OldEntries[i].Hash)] = OldEntries[i];
+	}
+
+	delete [] OldEntries;
+	return true;
+}
+
+void COWStringIndex::BeginUpdate()
+{
+	m_Generation++;
+	m_KeysChanged = false;
+}
+
+bool COWStringIndex::Set(LPCWSTR Key, int Item)
+{
+	if ((m_Count + m_Removed + 1) * 2 > m_Capacity && !Grow())
+		return false;
+
+	ULONG KeyHash = Hash(Key);
+	int Slot = Probe(Key, KeyHash);
+	Entry &e = m_Entries[Slot];
+
+	if (e.Key != NULL)
+	{
+		// Duplicate in this pass (two windows with the same name): the first,
+		// better ranked one keeps it.
+		if (e.Generation != m_Generation)
+		{
+			e.Item = Item;
+			e.Generation = m_Generation;
+		}
+		return true;
+	}
+
+	ULONG Length = wcslen(Key);
+	e.Key = new wchar_t[Length+1];
+	if (e.Key == NULL)
+		return false;
+	memcpy(e.Key, Key, (Length+1)*sizeof(wchar_t));
+	e.Hash = KeyHash;
+	e.Item = Item;
+	e.Generation = m_Generation;
+	if (e.Removed)
+	{
+		e.Removed = false;
+		m_Removed--;
+	}
+
+	m_Count++;
+	m_KeysChanged = true;
+	return true;
+}
+
+void COWStringIndex::EndUpdate()
+{
+	int i, Removed = 0;
+
+	// Drop the keys of windows that went away
+	for (i = 0; i < m_Capacity; i++)
+	{
+		if (m_Entries[i].Key != NULL && m_Entries[i].Generation != m_Generation)
+		{
+			delete [] m_Entries[i].Key;
+			m_Entries[i].Key = NULL;
+			m_Entries[i].Removed = true;
+			Removed++;
+		}
+	}
+
+	if (Removed)
+	{
+		m_Count -= Removed;
+		m_Removed += Removed;
+		m_KeysChanged = true;
+		// Once they're a good part of the table, drop the tombstones. If that can't be
+		// done now, the table is still right, only slower.
+		if (m_Removed * 4 > m_Capacity)
+			Grow();
+	}
+
+	if (m_KeysChanged)
+		BuildSorted();
+}
+
+int COWStringIndex::Find(LPCWSTR Key) const
+{
+	if (m_Count == 0)
+		return -1;
+
+	wchar_t Normalized[MAX_PATH];
+	Normalize(Key, Normalized, false);
+
+	int Slot = Probe(Normalized, Hash(Normalized));
+	return m_Entries[Slot].Key ? m_Entries[Slot].Item : -1;
+}
+
+void COWStringIndex::BuildSorted()
+{
+	delete [] m_Sorted;
+	m_Sorted = NULL;
+	m_SortedCount = 0;
+
+	if (m_Count == 0)
+		return;
+
+	m_Sorted = new int[m_Count];
+	if (m_Sorted == NULL)
+		return;
+
+	int i, j, Gap;
+	for (i = 0; i < m_Capacity; i++)
+	{
+		if (m_Entries[i].Key != NULL)
+			m_Sorted[m_SortedCount++] = i;
+	}
+
+	// Shell sort; qsort() can't be given the entries table as context.
+	for (Gap = m_SortedCount / 2; Gap > 0; Gap /= 2)
+	{
+		for (i = Gap; i < m_SortedCount; i++)
+		{
+			int Slot = m_Sorted[i];
+			for (j = i; j >= Gap && wcscmp(m_Entries[m_Sorted[j-Gap]].Key, m_Entries[Slot].Key) > 0; j -= Gap)
+				m_Sorted[j] = m_Sorted[j-Gap];
+			m_Sorted[j] = Slot;
+		}
+	}
+}
+
+int COWStringIndex::FindPrefix(LPCWSTR Prefix) const
+{
+	if (m_SortedCount == 0 || Prefix[0] == L'\0')
+		return -1;
+
+	wchar_t Normalized[MAX_PATH];
+	Normalize(Prefix, Normalized, false);
+	ULONG Length = wcslen(Normalized);
+
+	// Lower bound of the prefix in the sorted keys
+	int Low = 0, High = m_SortedCount;
+	while (Low < High)
+	{
+		int Middle = (Low + High) / 2;
+		if (wcscmp(m_Entries[m_Sorted[Middle]].Key, Normalized) < 0)
+			Low = Middle + 1;
+		else
+			High = Middle;
+	}
+
+	if (Low == m_SortedCount || wcsncmp(m_Entries[m_Sorted[Low]].Key, Normalized, Length) != 0)
+		return -1;
+
+	// More than one completion means we can't guess which one was meant
+	if (Low+1 < m_SortedCount && wcsncmp(m_Entries[m_Sorted[Low+1]].Key, Normalized, Length) == 0)
+		return -1;
+
+	return m_Entries[m_Sorted[Low]].Item;
+}
+
+//========================================================================================
+// COWItemIndex
+
+void COWItemIndex::Update(COWItemList &Items)
+{
+	wchar_t Key[MAX_PATH];
+	int i;
+
+	m_Paths.BeginUpdate();
+	m_Names.BeginUpdate();
+
+	for (i = 0; i < Items.GetSize(); i++)
+	{
+		COWStringIndex::Normalize(Items[i].GetPath(), Key, true);
+		m_Paths.Set(Key, i);
+
+		COWStringIndex::Normalize(Items[i].GetName(), Key, false);
+		m_Names.Set(Key, i);
+	}
+
+	m_Paths.EndUpdate();
+	m_Names.EndUpdate();
+}
+
+int COWItemIndex::Find(LPCWSTR DisplayName) const
+{
+	wchar_t Key[MAX_PATH];
+	int Item;
+
+	COWStringIndex::Normalize(DisplayName, Key, true);
+	Item = m_Paths.Find(Key);
+	if (Item >= 0)
+		return Item;
+
+	Item = m_Names.Find(DisplayName);
+	if (Item >= 0)
+		return Item;
+
+	// Partial paths are real filesystem paths, not ours to complete.
+	if (wcschr(DisplayName, L'\\') || wcschr(DisplayName, L'/') || wcschr(DisplayName, L':'))
+		return -1;
+
+	return m_Names.FindPrefix(DisplayName);
+}
+
+int COWItemIndex::FindPathPrefix(LPCWSTR Path, int *Length) const
+{
+	wchar_t Key[MAX_PATH], Saved;
+	int End, Cut, Item;
+
+	// Normalizing keeps the length, but for the trailing separators, so the ends are
+	// where they are in Path
+	COWStringIndex::Normalize(Path, Key, true);
+
+	// From the longest, one exact lookup per separator
+	for (End = wcslen(Key); End > 0; End--)
+	{
+		if (Key[End] != L'\\' && Key[End] != L'\0')
+			continue;
+		// A drive's root is "C:\", with its separator
+		Cut = End == 2 && Key[1] == L':' && Key[End] == L'\\' ? 3 : End;
+		Saved = Key[Cut];
+		Key[Cut] = L'\0';
+		Item = m_Paths.Find(Key);
+		Key[Cut] = Saved;
+		if (Item >= 0)
+		{
+			*Length = Cut;
+			return Item;
+		}
+	}
+	return -1;
+}
+
+void COWItemIndex::RemoveAll()
+{
+	m_Paths.RemoveAll();
+	m_Names.RemoveAll();
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __WINDOWINDEX_H_
+#define __WINDOWINDEX_H_
+
+#include "ShellItems.h"
+
+//========================================================================================
+// Lookup table from a normalized string (path or display name) to the index of the
+// item in the current window snapshot.
+//
+// Lookups are a single hash probe sequence. For partial names, a sorted view of the
+// keys is kept so that a prefix can be resolved with a binary search. Updating from
+// a new snapshot only touches the entries that changed; the sorted view is only
+// rebuilt when keys are added or removed. Removed keys leave a tombstone, so the
+// probe sequences through them stay whole until the table is rehashed.
+
+class COWStringIndex
+{
+public:
+	COWStringIndex();
+	~COWStringIndex();
+
+	// Start a new update pass. Every key not Set() before EndUpdate() is dropped.
+	void BeginUpdate();
+	// Map Key to Item. If the key was already set in this pass, the first one wins.
+	bool Set(LPCWSTR Key, int Item);
+	void EndUpdate();
+
+	// Returns the item for the exact key, or -1.
+	int Find(LPCWSTR Key) const;
+
+	// Returns the item whose key uniquely starts with Prefix, or -1 if there is
+	// no such key or it is ambiguous.
+	int FindPrefix(LPCWSTR Prefix) const;
+
+	int GetCount() const { return m_Count; }
+
+	void RemoveAll();
+
+	// Normalize a string for use as a key. Target must hold MAX_PATH chars.
+	// Paths have their separators unified and trailing separators removed.
+	static void Normalize(LPCWSTR Source, LPWSTR Target, bool IsPath);
+
+protected:
+	struct Entry
+	{
+		LPWSTR Key;			// normalized, owned. NULL when the slot is free.
+		ULONG Hash;
+		int Item;
+		ULONG Generation;	// update pass this key was last seen in
+		bool Removed;		// free, but probes go on past it
+	};
+
+	static ULONG Hash(LPCWSTR Key);
+
+	int Probe(LPCWSTR Key, ULONG KeyHash) const;
+	bool Grow();
+	void BuildSorted();
+
+	Entry *m_Entries;
+	int m_Capacity;			// always a power of two
+	int m_Count;
+	int m_Removed;			// tombstones
+
+	ULONG m_Generation;
+	bool m_KeysChanged;
+
+	// Sorted (by key) array of slot numbers in m_Entries, for prefix lookups.
+	int *m_Sorted;
+	int m_SortedCount;
+};
+
+//========================================================================================
+// Indexes a window snapshot by its paths and display names.
+
+class COWItemIndex
+{
+public:
+	// Bring the index in line with the snapshot.
+	void Update(COWItemList &Items);
+
+	// Resolve what the user typed or what a caller round-tripped to an item
+	// index in the snapshot. Exact paths and names come first, then unique
+	// name prefixes. Returns -1 when it isn't ours.
+	int Find(LPCWSTR DisplayName) const;
+
+	// The item whose path is the longest one that Path starts with, up to a separator,
+	// or -1. *Length is how much of Path that is.
+	int FindPathPrefix(LPCWSTR Path, int *Length) const;
+
+	void RemoveAll();
+
+protected:
+	COWStringIndex m_Paths;
+	COWStringIndex m_Names;
+};
+
+#endif // __WINDOWINDEX_H_
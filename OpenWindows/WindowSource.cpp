@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "stdafx.h"
+#include "WindowSource.h"
+#include "FlightRecorder.h"
+
+//========================================================================================
+// COWShellWindowSource
+
+COWShellWindowSource::COWShellWindowSource() : m_Windows(NULL), m_Browser(NULL), m_BrowserIndex(-1), m_ComInitialized(false)
+{
+}
+
+COWShellWindowSource::~COWShellWindowSource()
+{
+	End();
+}
+
+long COWShellWindowSource::Begin()
+{
+	long count;
+	HRESULT hr;
+
+	End();
+
+	// The folder is free threaded, so this can be a thread of the MTA; COM is there
+	// already then, just not the way CoInitialize() asks for it.
+	hr = CoInitialize(NULL);
+	if (hr != RPC_E_CHANGED_MODE) {
+		if (FAILED(hr)) {
+			ATLTRACE(_T(" ** Enumerate can't init COM"));
+			return -1;
+		}
+		m_ComInitialized = true;
+	}
+	if (FAILED(CoCreateInstance(CLSID_ShellWindows, NULL, CLSCTX_ALL, IID_IShellWindows, (void**)&m_Windows))) {
+		ATLTRACE(_T(" ** Enumerate can't create IShellWindows"));
+		m_Windows = NULL;
+		return -1;
+	}
+	if (FAILED(m_Windows->get_Count(&count))) {
+		count = 0;
+	}
+	return count;
+}
+
+void COWShellWindowSource::End()
+{
+	if (m_Browser) {
+		m_Browser->Release();
+		m_Browser = NULL;
+	}
+	m_BrowserIndex = -1;
+	if (m_Windows) {
+		m_Windows->Release();
+		m_Windows = NULL;
+	}
+	if (m_ComInitialized) {
+		CoUninitialize();
+		m_ComInitialized = false;
+	}
+}
+
+IWebBrowserApp *COWShellWindowSource::GetBrowser(long i)
+{
+	IDispatch *wba_disp;
+
+	if (i == m_BrowserIndex)
+		return m_Browser;
+
+	if (m_Browser) {
+		m_Browser->Release();
+		m_Browser = NULL;
+	}
+	m_BrowserIndex = i;
+
+	VARIANT v;
+	v.vt = VT_I4;
+	V_I4(&v) = i;
+
+	OW_FLIGHT_MARK(m_Flight);
+	if (FAILED(m_Windows->Item(v, &wba_disp))) {
+		ATLTRACE(_T(" ** Enumerate isn't an item i=%ld"), i);
+		OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_BROWSER);
+		return NULL;
+	}
+	if (FAILED(wba_disp->QueryInterface(IID_IWebBrowserApp, (void**)&m_Browser))) {
+		ATLTRACE(_T(" ** Enumerate isn't an IWebBrowserApp i=%ld"), i);
+		m_Browser = NULL;
+	}
+	wba_disp->Release();
+	OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_BROWSER);
+	return m_Browser;
+}
+
+bool COWShellWindowSource::GetAppName(long i, BSTR *pAppName)
+{
+	IWebBrowserApp *wba = GetBrowser(i);
+	HRESULT hr;
+
+	if (wba == NULL)
+		return false;
+
+	OW_FLIGHT_MARK(m_Flight);
+	hr = wba->get_FullName(pAppName);
+	OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_FULL_NAME);
+	return SUCCEEDED(hr);
+}
+
+bool COWShellWindowSource::GetWindow(long i, HWND *pWindow)
+{
+	IWebBrowserApp *wba = GetBrowser(i);
+	SHANDLE_PTR windowPtr;
+	HRESULT hr;
+
+	if (wba == NULL)
+		return false;
+
+	OW_FLIGHT_MARK(m_Flight);
+	hr = wba->get_HWND(&windowPtr);
+	OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_HWND);
+	if (FAILED(hr))
+		return false;
+
+	*pWindow = (HWND)windowPtr;
+	return true;
+}
+
+bool COWShellWindowSource::GetName(long i, BSTR *pName)
+{
+	IWebBrowserApp *wba = GetBrowser(i);
+	HRESULT hr;
+
+	if (wba == NULL)
+		return false;
+
+	OW_FLIGHT_MARK(m_Flight);
+	hr = wba->get_LocationName(pName);
+	OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_LOCATION_NAME);
+	return SUCCEEDED(hr);
+}
+
+// Each step is a cross-process call or two, and is timed on its own for the flight
+// recorder, since which one hangs says a lot about what the window is doing.
+static BOOL FolderItemStrategy(IWebBrowserApp *wba, int i, BSTR *pathBStr, COWFlightTimeline *Flight)
+{
+	IDispatch *sfvd_disp;
+	IShellFolderViewDual *sfvd;
+	Folder *folder;
+	Folder2 *folder2;
+	FolderItem *selfItem;
+	HRESULT hr;
+	BOOL ok;
+
+	ok = TRUE;
+
+	// This huge involved process boils down to:
+	// - get the scriptable shell view from the browser object (thank IE)
+	// - get the active folder from that, cast it into a newer interface
+	// - get the folder as an item from the casted version
+	// - get the name and path from the item
+	// Unfortunately, this requires quite a bit of COM casting :/
+	OW_FLIGHT_MARK(Flight);
+	hr = wba->get_Document(&sfvd_disp);
+	OW_FLIGHT_LAP(Flight, OW_FLIGHT_DOCUMENT);
+	if (FAILED(hr)) {
+		ATLTRACE(_T(" ** Enumerate can't get document dispatch for i=%ld"), i);
+		ok = FALSE;
+		goto fail2;
+	}
+	hr = sfvd_disp->QueryInterface(IID_IShellFolderViewDual, (void**)&sfvd);
+	OW_FLIGHT_LAP(Flight, OW_FLIGHT_DOCUMENT);
+	if (FAILED(hr)) {
+		ATLTRACE(_T(" ** Enumerate isn't an IShellFolderViewDual i=%ld"), i);
+		ok = FALSE;
+		goto fail3;
+	}
+	hr = sfvd->get_Folder(&folder);
+	OW_FLIGHT_LAP(Flight, OW_FLIGHT_FOLDER);
+	if (FAILED(hr)) {
+		ATLTRACE(_T(" ** Enumerate can't get folder i=%ld"), i);
+		ok = FALSE;
+		goto fail4;
+	}
+	hr = folder->QueryInterface(IID_Folder2, (void**)&folder2);
+	OW_FLIGHT_LAP(Flight, OW_FLIGHT_FOLDER);
+	if (FAILED(hr)) {
+		ATLTRACE(_T(" ** Enumerate isn't a Folder2 i=%ld"), i);
+		ok = FALSE;
+		goto fail5;
+	}
+	// This part seems to fail on Me, possibly other 9x with 0xC0000005.
+	hr = folder2->get_Self(&selfItem);
+	OW_FLIGHT_LAP(Flight, OW_FLIGHT_SELF);
+	if (FAILED(hr)) {
+		ATLTRACE(_T(" ** Enumerate can't get FolderItem i=%ld"), i);
+		ok = FALSE;
+		goto fail6;
+	}
+	hr = selfItem->get_Path(pathBStr);
+	OW_FLIGHT_LAP(Flight, OW_FLIGHT_PATH);
+	if (FAILED(hr)) {
+		ATLTRACE(_T(" ** Enumerate doesn't have folder path i=%ld"), i);
+		ok = FALSE;
+		goto fail7;
+	}
+fail7:
+	selfItem->Release();
+fail6:
+	folder2->Release();
+fail5:
+	folder->Release();
+fail4:
+	sfvd->Release();
+fail3:
+	sfvd_disp->Release();
+fail2:
+	return ok;
+}
+
+static BSTR UriToDosPath(BSTR uri)
+{
+	DWORD size = INTERNET_MAX_URL_LENGTH;
+#pragma comment(lib, "urlmon")
+	// Using the SHLWAPI function is tempting, but it's broken with fancy
+	// characters even with Unicode
+	wchar_t strW[INTERNET_MAX_URL_LENGTH];
+	CoInternetParseUrl(uri, PARSE_PATH_FROM_URL, 0, strW, size, &size, 0);
+	return SysAllocString(strW);
+}
+
+static BOOL FileUriStrategy(IWebBrowserApp *wba, int i, BSTR *pathBStr, COWFlightTimeline *Flight)
+{
+	BSTR locationUrl, path;
+	BOOL ok;
+
+	ok = TRUE;
+
+	OW_FLIGHT_MARK(Flight);
+	if (FAILED(wba->get_LocationURL(&locationUrl))) {
+		ATLTRACE(_T(" ** Enumerate can't get location for i=%ld"), i);
+		ok = FALSE;
+		goto fail2;
+	}
+
+	path = UriToDosPath(locationUrl);
+	*pathBStr = path;
+
+	SysFreeString(locationUrl);
+fail2:
+	OW_FLIGHT_LAP(Flight, OW_FLIGHT_FILE_URI);
+	return ok;
+}
+
+bool COWShellWindowSource::GetPath(long i, OWPathStrategy Strategy, BSTR *pPath)
+{
+	IWebBrowserApp *wba = GetBrowser(i);
+	if (wba == NULL)
+		return false;
+
+	switch (Strategy)
+	{
+	case OW_STRATEGY_FOLDER_ITEM:	return FolderItemStrategy(wba, i, pPath, m_Flight) != FALSE;
+	case OW_STRATEGY_FILE_URI:		return FileUriStrategy(wba, i, pPath, m_Flight) != FALSE;
+	}
+	return false;
+}
+
+#if defined(OW_LOADGEN_SUPPORT)
+//========================================================================================
+// COWSyntheticWindowSource
+
+void OWDefaultSyntheticSettings(OWSyntheticSettings *Settings)
+{
+	memset(Settings, 0, sizeof(*Settings));
+	Settings->WindowCount = 50;
+	Settings->UncPercent = 10;
+	Settings->NamespacePercent = 5;
+	Settings->DuplicatePercent = 5;
+	Settings->PathDepth = 4;
+	Settings->LatencyMicroseconds = 200;
+	Settings->JitterMicroseconds = 100;
+	Settings->HungMilliseconds = 5000;
+	Settings->Seed = 1;
+}
+
+COWSyntheticWindowSource::COWSyntheticWindowSource(const OWSyntheticSettings &Settings)
+	: m_Settings(Settings), m_State(Settings.Seed), m_PassSeed(Settings.Seed)
+{
+}
+
+// Numerical Recipes LCG; good enough to spread windows around
+DWORD COWSyntheticWindowSource::Random()
+{
+	m_State = m_State * 1664525UL + 1013904223UL;
+	return m_State >> 8;
+}
+
+// The same answer for a window every time it's asked during a pass
+DWORD COWSyntheticWindowSource::Random(long i, DWORD Salt) const
+{
+	DWORD h = m_PassSeed ^ (Salt * 0x9E3779B1UL) ^ ((DWORD)i * 0x85EBCA6BUL);
+	h ^= h >> 15;
+	h *= 0x2C1B3C6DUL;
+	h ^= h >> 12;
+	return h;
+}
+
+long COWSyntheticWindowSource::Begin()
+{
+	m_PassSeed = Random();
+	return m_Settings.WindowCount;
+}
+
+void COWSyntheticWindowSource::End()
+{
+}
+
+void COWSyntheticWindowSource::Wait(long i)
+{
+	if (m_Settings.HungPercent > 0 && (int)(Random(i, 1) % 100) < m_Settings.HungPercent)
+	{
+		Sleep(m_Settings.HungMilliseconds);
+		return;
+	}
+
+	LONGLONG Delay = m_Settings.LatencyMicroseconds;
+	if (m_Settings.JitterMicroseconds > 0)
+		Delay += (LONGLONG)(Random() % (2 * m_Settings.JitterMicroseconds + 1)) - m_Settings.JitterMicroseconds;
+	if (Delay <= 0)
+		return;
+
+	// Sleep() is far too coarse for what a cross-process call takes, so spin
+	LARGE_INTEGER Frequency, Start, Now;
+	if (!QueryPerformanceFrequency(&Frequency) || !QueryPerformanceCounter(&Start))
+	{
+		Sleep((DWORD)(Delay / 1000));
+		return;
+	}
+	LONGLONG Ticks = Delay * Frequency.QuadPart / 1000000;
+	do
+	{
+		QueryPerformanceCounter(&Now);
+	} while (Now.QuadPart - Start.QuadPart < Ticks);
+}
+
+// Paths only depend on the seed, so windows are the same folders every pass.
+void COWSyntheticWindowSource::MakePath(long i, wchar_t *Path) const
+{
+	DWORD Pick = (m_Settings.Seed * 0x9E3779B1UL) ^ ((DWORD)i * 0x85EBCA6BUL);
+	int Depth, d, Length;
+
+	Pick ^= Pick >> 13;
+	Pick *= 0xC2B2AE35UL;
+	Pick ^= Pick >> 16;
+
+	int Kind = (int)(Pick % 100);
+	if (i > 0 && Kind < m_Settings.DuplicatePercent)
+	{
+		MakePath((long)((Pick >> 8) % (DWORD)i), Path);
+		return;
+	}
+	Kind -= m_Settings.DuplicatePercent;
+
+	if (Kind >= 0 && Kind < m_Settings.NamespacePercent)
+	{
+		wsprintfW(Path, L"::{%08lX-0000-0000-0000-%012lX}", Pick, (DWORD)i);
+		return;
+	}
+	Kind -= m_Settings.NamespacePercent;
+
+	if (Kind >= 0 && Kind < m_Settings.UncPercent)
+		Length = wsprintfW(Path, L"\\\\server%lu\\share%lu", (Pick >> 8) % 16, (Pick >> 12) % 8);
+	else
+		Length = wsprintfW(Path, L"C:\\Users\\user%lu", (Pick >> 8) % 4);
+
+	Depth = m_Settings.PathDepth > 0 ? (int)((Pick >> 16) % m_Settings.PathDepth) + 1 : 0;
+	for (d = 0; d < Depth && Length < MAX_PATH - 32; d++)
+		Length += wsprintfW(Path + Length, L"\\Folder %lu", (Pick >> (d * 3)) % 64 + (DWORD)i * 64);
+}
+
+// Each call is one wait, so it's timed as a whole for the flight recorder; the folder
+// item strategy goes under Path.
+bool COWSyntheticWindowSource::GetAppName(long i, BSTR *pAppName)
+{
+	OW_FLIGHT_MARK(m_Flight);
+	Wait(i);
+	OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_FULL_NAME);
+	*pAppName = SysAllocString(L"C:\\WINDOWS\\Explorer.EXE");
+	return *pAppName != NULL;
+}
+
+bool COWSyntheticWindowSource::GetWindow(long i, HWND *pWindow)
+{
+	OW_FLIGHT_MARK(m_Flight);
+	Wait(i);
+	OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_HWND);
+	// Never a real window, and never the caller's
+	*pWindow = (HWND)(ULONG_PTR)(0x10000 + i * 4);
+	return true;
+}
+
+bool COWSyntheticWindowSource::GetPath(long i, OWPathStrategy Strategy, BSTR *pPath)
+{
+	wchar_t Path[MAX_PATH];
+
+	OW_FLIGHT_MARK(m_Flight);
+	Wait(i);
+	OW_FLIGHT_LAP(m_Flight, Strategy == OW_STRATEGY_FILE_URI ? OW_FLIGHT_FILE_URI : OW_FLIGHT_PATH);
+	if ((int)(Random(i, 2 + Strategy) % 100) < m_Settings.FailPercent[Strategy])
+		return false;
+
+	MakePath(i, Path);
+	*pPath = SysAllocString(Path);
+	return *pPath != NULL;
+}
+
+bool COWSyntheticWindowSource::GetName(long i, BSTR *pName)
+{
+	wchar_t Path[MAX_PATH];
+
+	OW_FLIGHT_MARK(m_Flight);
+	Wait(i);
+	OW_FLIGHT_LAP(m_Flight, OW_FLIGHT_LOCATION_NAME);
+	MakePath(i, Path);
+
+	// Like the shell, the last part of the path
+	wchar_t *Name = wcsrchr(Path, L'\\');
+	*pName = SysAllocString(Name && Name[1] ? Name + 1 : Path);
+	return *pName != NULL;
+}
+
+#endif // OW_LOADGEN_SUPPORT
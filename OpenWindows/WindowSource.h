@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef __WINDOWSOURCE_H_
+#define __WINDOWSOURCE_H_
+
+//========================================================================================
+// Where the windows to list come from. EnumerateWindows() asks the source about each
+// window, and decides what to list with the policy in OWCore.h.
+//
+// Strings are BSTRs owned by the caller. Failing calls don't stop the pass, the window
+// is just skipped.
+//
+// A source can be given the flight recorder's timeline for the pass, to mark how long
+// each of the calls it makes takes; see FlightRecorder.h.
+
+class COWFlightTimeline;
+
+enum OWPathStrategy
+{
+	OW_STRATEGY_FOLDER_ITEM,	// Folder2::get_Self(), preferred
+	OW_STRATEGY_FILE_URI,		// the file:// location URL, for when the above fails on Me
+
+	OW_STRATEGY_MAX
+};
+
+class COWWindowSource
+{
+public:
+	COWWindowSource() : m_Flight(NULL) {}
+	virtual ~COWWindowSource() {}
+
+	// NULL to stop timing
+	void SetFlight(COWFlightTimeline *Flight) { m_Flight = Flight; }
+
+	// Start a pass, and return how many windows there are (may be 0), or -1.
+	virtual long Begin() = 0;
+	virtual void End() = 0;
+
+	// About window i of the current pass
+	virtual bool GetAppName(long i, BSTR *pAppName) = 0;
+	virtual bool GetWindow(long i, HWND *pWindow) = 0;
+	virtual bool GetPath(long i, OWPathStrategy Strategy, BSTR *pPath) = 0;
+	virtual bool GetName(long i, BSTR *pName) = 0;
+
+protected:
+	COWFlightTimeline *m_Flight;
+};
+
+//========================================================================================
+// The real one: the shell's IShellWindows, and the IWebBrowserApp of each window.
+
+class COWShellWindowSource : public COWWindowSource
+{
+public:
+	COWShellWindowSource();
+	~COWShellWindowSource();
+
+	long Begin();
+	void End();
+
+	bool GetAppName(long i, BSTR *pAppName);
+	bool GetWindow(long i, HWND *pWindow);
+	bool GetPath(long i, OWPathStrategy Strategy, BSTR *pPath);
+	bool GetName(long i, BSTR *pName);
+
+protected:
+	IWebBrowserApp *GetBrowser(long i);
+
+	IShellWindows *m_Windows;
+	// The calls for a window come one after another, so keep the last one around
+	IWebBrowserApp *m_Browser;
+	long m_BrowserIndex;
+	// Whether Begin() initialized COM on the thread, and End() has to undo it
+	bool m_ComInitialized;
+};
+
+#if defined(OW_LOADGEN_SUPPORT)
+//========================================================================================
+// A made up source for load testing, so a pass over hundreds of windows doesn't
+// need hundreds of Explorer windows. Everything is driven by a seeded generator, so
+// runs with the same settings are the same.
+
+struct OWSyntheticSettings
+{
+	long WindowCount;
+
+	// Path distribution, in percent; the rest are local folders
+	int UncPercent;				// \\server\share\...
+	int NamespacePercent;		// ::{GUID}, which aren't listed
+	int DuplicatePercent;		// same folder as an earlier window
+	int PathDepth;				// folders below the root, at most
+
+	// Every call waits this long, give or take the jitter, like a cross-process call
+	DWORD LatencyMicroseconds;
+	DWORD JitterMicroseconds;
+
+	// How often each path strategy fails, in percent
+	int FailPercent[OW_STRATEGY_MAX];
+
+	// Hung windows take HungMilliseconds to answer anything, like an RPC timeout
+	int HungPercent;
+	DWORD HungMilliseconds;
+
+	DWORD Seed;
+};
+
+void OWDefaultSyntheticSettings(OWSyntheticSettings *Settings);
+
+class COWSyntheticWindowSource : public COWWindowSource
+{
+public:
+	COWSyntheticWindowSource(const OWSyntheticSettings &Settings);
+
+	long Begin();
+	void End();
+
+	bool GetAppName(long i, BSTR *pAppName);
+	bool GetWindow(long i, HWND *pWindow);
+	bool GetPath(long i, OWPathStrategy Strategy, BSTR *pPath);
+	bool GetName(long i, BSTR *pName);
+
+protected:
+	DWORD Random();
+	DWORD Random(long i, DWORD Salt) const;
+	void Wait(long i);
+	void MakePath(long i, wchar_t *Path) const;
+
+	OWSyntheticSettings m_Settings;
+	DWORD m_State;
+	// Per pass, so windows get hung and fail differently on each run
+	DWORD m_PassSeed;
+};
+
+// Run Runs enumerations over a synthetic source and give their latency percentiles,
+// in microseconds.
+void OWRunLoadGenerator(const OWSyntheticSettings &Settings, int Runs,
+	double *pP50, double *pP99, double *pMean, long *pListed);
+#endif // OW_LOADGEN_SUPPORT
+
+#endif // __WINDOWSOURCE_H_
@@ -10,6 +10,8 @@
 #define IDS_COLUMN_PATH                 201
 #define IDS_COLUMN_RANK                 202
 #define IDS_REMOVAL_MSG                 300
+#define IDS_SEARCH_NAME                 301
+#define IDS_RECENT_FOLDER               302
 
 // Next default values for new objects
 // 
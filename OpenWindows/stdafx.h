@@ -34,6 +34,15 @@
 // XXX: Perhaps it could disable all of IShellFolder2 for really old SDKs?
 #define OW_PKEYS_SUPPORT
 
+// A synthetic window source and the RunLoadGenerator rundll32 entry point that
+// drives it, for measuring enumeration with many windows. Off in normal builds, which
+// don't export the entry point either.
+//#define OW_LOADGEN_SUPPORT
+
+// Count what the hot paths allocate, and against which operation, to check them
+// against their budgets (see AllocProfile.h). Off in normal builds.
+//#define OW_ALLOC_PROFILE
+
 #include "targetver.h"
 
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
@@ -50,6 +59,7 @@
 
 extern CComModule _Module;
 
+#include "AllocProfile.h"
 #include "wtlstr.h"
 #include <atlcom.h>
 #include <atlwin.h>
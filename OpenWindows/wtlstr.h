@@ -716,6 +716,7 @@ inline BOOL CString::AllocBuffer(int nLen)
 		pData->nDataLength = nLen;
 		pData->nAllocLength = nLen;
 		m_pchData = pData->data();
+		OW_ALLOC_NOTE(OW_ALLOC_CSTRING, sizeof(CStringData) + (nLen + 1) * sizeof(TCHAR));
 	}
 
 	return TRUE;
@@ -0,0 +1,544 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+//========================================================================================
+// Replays a call log recorded by the folder (see OWCallLog.h) against the portable core,
+// so the call sequences of real hosts (defview, the file dialogs, Office) can be timed
+// and profiled anywhere. Build and run with:
+//
+//   g++ -O2 -I../OpenWindows CallReplay.cpp ../OpenWindows/OWCore.cpp -o CallReplay
+//   ./CallReplay calls.owc             recorded against replayed times, per method
+//   ./CallReplay -r 20 calls.owc       replay 20 times, and take the fastest of each
+//   ./CallReplay -v calls.owc          print the calls as well
+//   ./CallReplay -l 5000 calls.owc     exit with 1 when a replay takes over 5000us
+//
+// Each call does what the folder does with the core for it: snapshots are diffed,
+// EnumObjects creates a pidl per item like Next() does, CompareIDs compares, and the
+// display name and details calls make their strings, by offset when the item has an
+// ANSI copy. Calls that only touch COM or other folders are counted, not replayed. So
+// are calls about stale items, which the log can't give back.
+//
+// Replay times are per call, from the fastest of the runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "OWCallLog.h"
+
+namespace
+{
+
+//========================================================================================
+// The log
+
+// From the shell headers, so this builds without them
+enum
+{
+	SHCIDS_COLUMNMASK = 0x0000FFFF,
+	SHGDN_FORPARSING = 0x8000,
+	IID_IDATAOBJECT_DATA1 = 0x0000010E
+};
+
+// The folder's columns, see RootShellFolder.h
+enum
+{
+	DETAILS_COLUMN_NAME,
+	DETAILS_COLUMN_PATH,
+	DETAILS_COLUMN_RANK
+};
+
+typedef std::vector<unsigned char> Pidl;
+
+struct Record
+{
+	OWCallLogRecord Header;
+	// Snapshots: the items, each a pidl with its terminator. Results: the indexes.
+	std::vector<Pidl> Items;
+	std::vector<unsigned short> Results;
+};
+
+struct Log
+{
+	OWCallLogHeader Header;
+	std::vector<Record> Records;
+};
+
+bool Load(const char *Path, Log *Out)
+{
+	FILE *File = fopen(Path, "rb");
+	if (File == NULL)
+	{
+		perror(Path);
+		return false;
+	}
+
+	if (fread(&Out->Header, sizeof(Out->Header), 1, File) != 1
+		|| Out->Header.Magic != OW_CALLLOG_MAGIC
+		|| Out->Header.Version != OW_CALLLOG_VERSION
+		|| Out->Header.RecordSize != sizeof(OWCallLogRecord))
+	{
+		fprintf(stderr, "%s: not a call log this can read\n", Path);
+		fclose(File);
+		return false;
+	}
+
+	Record r;
+	while (fread(&r.Header, sizeof(r.Header), 1, File) == 1)
+	{
+		unsigned i;
+		bool Complete = true;
+
+		r.Items.clear();
+		r.Results.clear();
+
+		if (r.Header.Type == OW_CALLLOG_SNAPSHOT && r.Header.Args[2] != 0)
+		{
+			for (i = 0; i < r.Header.Args[0] && Complete; i++)
+			{
+				unsigned short cb;
+				if (fread(&cb, sizeof(cb), 1, File) != 1 || cb < sizeof(cb))
+				{
+					Complete = false;
+					break;
+				}
+				Pidl p(cb + sizeof(cb), 0);
+				memcpy(&p[0], &cb, sizeof(cb));
+				Complete = fread(&p[sizeof(cb)], cb - sizeof(cb), 1, File) == 1 || cb == sizeof(cb);
+				r.Items.push_back(p);
+			}
+		}
+		else if (r.Header.Type == OW_CALLLOG_RESULTS)
+		{
+			r.Results.resize(r.Header.Args[0]);
+			if (!r.Results.empty())
+				Complete = fread(&r.Results[0], sizeof(unsigned short), r.Results.size(), File) == r.Results.size();
+		}
+
+		// The process may have gone away in the middle of a record
+		if (!Complete)
+			break;
+		Out->Records.push_back(r);
+	}
+
+	fclose(File);
+	return true;
+}
+
+//========================================================================================
+// Methods
+
+struct MethodInfo
+{
+	unsigned Event;
+	const char *Name;
+};
+
+const MethodInfo s_Methods[] =
+{
+	{ OW_EVENT_GETCLASSID, "GetClassID" },
+	{ OW_EVENT_INITIALIZE, "Initialize" },
+	{ OW_EVENT_GETCURFOLDER, "GetCurFolder" },
+	{ OW_EVENT_BINDTOOBJECT, "BindToObject" },
+	{ OW_EVENT_COMPAREIDS, "CompareIDs" },
+	{ OW_EVENT_CREATEVIEWOBJECT, "CreateViewObject" },
+	{ OW_EVENT_ENUMOBJECTS, "EnumObjects" },
+	{ OW_EVENT_GETATTRIBUTESOF, "GetAttributesOf" },
+	{ OW_EVENT_GETUIOBJECTOF, "GetUIObjectOf" },
+	{ OW_EVENT_BINDTOSTORAGE, "BindToStorage" },
+	{ OW_EVENT_GETDISPLAYNAMEOF, "GetDisplayNameOf" },
+	{ OW_EVENT_PARSEDISPLAYNAME, "ParseDisplayName" },
+	{ OW_EVENT_SETNAMEOF, "SetNameOf" },
+	{ OW_EVENT_COLUMNCLICK, "ColumnClick" },
+	{ OW_EVENT_GETDETAILSOF, "GetDetailsOf" },
+	{ OW_EVENT_ENUMSEARCHES, "EnumSearches" },
+	{ OW_EVENT_GETDEFAULTCOLUMN, "GetDefaultColumn" },
+	{ OW_EVENT_GETDEFAULTCOLUMNSTATE, "GetDefaultColumnState" },
+	{ OW_EVENT_GETDEFAULTSEARCHGUID, "GetDefaultSearchGUID" },
+	{ OW_EVENT_GETDETAILSEX, "GetDetailsEx" },
+	{ OW_EVENT_MAPCOLUMNTOSCID, "MapColumnToSCID" },
+	{ OW_EVENT_SETSEARCHQUERY, "SetSearchQuery" },
+	{ OW_EVENT_SETSEARCHMODE, "SetSearchMode" }
+};
+
+const char *MethodName(const OWCallLogRecord &r)
+{
+	size_t i;
+
+	if (r.Type == OW_CALLLOG_SNAPSHOT)
+		return "(snapshot)";
+	if (r.Type == OW_CALLLOG_RESULTS)
+		return "(results)";
+	for (i = 0; i < sizeof(s_Methods) / sizeof(s_Methods[0]); i++)
+	{
+		if (s_Methods[i].Event == r.Event)
+			return s_Methods[i].Name;
+	}
+	return "?";
+}
+
+//========================================================================================
+// Replaying
+
+struct Folder
+{
+	std::vector<Pidl> Snapshot;
+	std::vector<unsigned short> Results;
+	bool Searching;
+
+	Folder() : Searching(false) {}
+
+	// NULL for items that aren't in the snapshot
+	const unsigned char *Item(unsigned Arg) const
+	{
+		if (Arg < OW_CALLLOG_ITEM_FIRST || Arg - OW_CALLLOG_ITEM_FIRST >= Snapshot.size())
+			return NULL;
+		return &Snapshot[Arg - OW_CALLLOG_ITEM_FIRST][0];
+	}
+};
+
+OWItemData DataOf(const unsigned char *pidl)
+{
+	OWItemData d;
+
+	d.Rank = OWItemGetRank(pidl);
+	d.Path = OWItemGetPath(pidl);
+	d.PathLength = (unsigned short)OWItemGetPathLength(pidl);
+	d.Name = OWItemGetName(pidl);
+	d.NameLength = (unsigned short)OWItemGetNameLength(pidl);
+	d.PathA = OWItemGetPathA(pidl);
+	d.PathALength = d.PathA ? (unsigned short)strlen(d.PathA) : (unsigned short)OW_NO_ANSI;
+	d.NameA = OWItemGetNameA(pidl);
+	d.NameALength = d.NameA ? (unsigned short)strlen(d.NameA) : (unsigned short)OW_NO_ANSI;
+	return d;
+}
+
+// Keeps the compiler from dropping work whose result isn't used
+volatile unsigned s_Sink;
+
+// A STRRET: by offset when there's an ANSI copy, or a copy from the shell allocator
+void ReturnString(const char *Ansi, const OWCHAR *Text, unsigned Length)
+{
+	if (Ansi != NULL)
+	{
+		s_Sink += (unsigned)(size_t)Ansi;
+		return;
+	}
+
+	OWCHAR *Copy = (OWCHAR*)malloc((Length + 1) * sizeof(OWCHAR));
+	memcpy(Copy, Text, (Length + 1) * sizeof(OWCHAR));
+	s_Sink += Copy[0];
+	free(Copy);
+}
+
+// What CPidlMgr::Create() does for each item Next() hands out; the shell frees them.
+void CreatePidl(const unsigned char *Item)
+{
+	OWItemData d = DataOf(Item);
+	unsigned Size = 2 + OWItemGetSize(&d);
+	unsigned char *p = (unsigned char*)malloc(Size + 2);
+	unsigned short cb = (unsigned short)Size;
+
+	memcpy(p, &cb, 2);
+	OWItemEncode(&d, p + 2);
+	memset(p + Size, 0, 2);
+	s_Sink += p[2];
+	free(p);
+}
+
+void DiffSnapshots(const std::vector<Pidl> &Old, const std::vector<Pidl> &New)
+{
+	std::vector<OWItemData> OldData(Old.size() + 1), NewData(New.size() + 1);
+	std::vector<int> Matches(New.size() + 1);
+	size_t i;
+
+	if (Old.size() != New.size() || New.empty())
+		return;
+	for (i = 0; i < Old.size(); i++)
+		OldData[i] = DataOf(&Old[i][0]);
+	for (i = 0; i < New.size(); i++)
+		NewData[i] = DataOf(&New[i][0]);
+	s_Sink += OWSnapshotDiff(&OldData[0], (int)Old.size(), &NewData[0], (int)New.size(), &Matches[0]);
+}
+
+// Returns whether the call was replayed
+bool Replay(const Record &r, Folder &f)
+{
+	const OWCallLogRecord &h = r.Header;
+	const unsigned char *Item, *Other;
+
+	if (h.Type == OW_CALLLOG_SNAPSHOT)
+	{
+		// The folder compares every new snapshot with the one it has
+		if (h.Args[2] != 0)
+		{
+			DiffSnapshots(f.Snapshot, r.Items);
+			f.Snapshot = r.Items;
+		}
+		else
+		{
+			DiffSnapshots(f.Snapshot, f.Snapshot);
+		}
+		return true;
+	}
+	if (h.Type == OW_CALLLOG_RESULTS)
+	{
+		f.Results = r.Results;
+		return true;
+	}
+
+	switch (h.Event)
+	{
+	case OW_EVENT_SETSEARCHQUERY:
+		f.Searching = h.Args[0] != 0;
+		return false;
+
+	case OW_EVENT_ENUMOBJECTS:
+		if (f.Searching)
+		{
+			for (size_t i = 0; i < f.Results.size(); i++)
+			{
+				if (f.Results[i] < f.Snapshot.size())
+					CreatePidl(&f.Snapshot[f.Results[i]][0]);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < f.Snapshot.size(); i++)
+				CreatePidl(&f.Snapshot[i][0]);
+		}
+		return true;
+
+	case OW_EVENT_COMPAREIDS:
+		Item = f.Item(h.Args[1]);
+		Other = f.Item(h.Args[2]);
+		if (Item == NULL || Other == NULL)
+			return false;
+		switch (h.Args[0] & SHCIDS_COLUMNMASK)
+		{
+		case DETAILS_COLUMN_NAME:	s_Sink += OWItemCompare(Item, Other, OW_FIELD_NAME);	break;
+		case DETAILS_COLUMN_PATH:	s_Sink += OWItemCompare(Item, Other, OW_FIELD_PATH);	break;
+		case DETAILS_COLUMN_RANK:	s_Sink += OWItemCompare(Item, Other, OW_FIELD_RANK);	break;
+		}
+		return true;
+
+	case OW_EVENT_GETDISPLAYNAMEOF:
+		if ((Item = f.Item(h.Args[1])) == NULL)
+			return false;
+		// Parsing names are always copied
+		if (h.Args[0] & SHGDN_FORPARSING)
+			ReturnString(NULL, OWItemGetPath(Item), OWItemGetPathLength(Item));
+		else
+			ReturnString(OWItemGetNameA(Item), OWItemGetName(Item), OWItemGetNameLength(Item));
+		return true;
+
+	case OW_EVENT_GETDETAILSOF:
+		if ((Item = f.Item(h.Args[1])) == NULL)
+			return false;
+		switch (h.Args[0])
+		{
+		case DETAILS_COLUMN_NAME:
+			ReturnString(OWItemGetNameA(Item), OWItemGetName(Item), OWItemGetNameLength(Item));
+			break;
+		case DETAILS_COLUMN_PATH:
+			ReturnString(OWItemGetPathA(Item), OWItemGetPath(Item), OWItemGetPathLength(Item));
+			break;
+		default:
+			{
+				char Rank[8];
+				s_Sink += snprintf(Rank, sizeof(Rank), "%d", OWItemGetRank(Item));
+			}
+			break;
+		}
+		return true;
+
+	case OW_EVENT_GETUIOBJECTOF:
+		// Only the data object is made here; the rest goes to other folders
+		if (h.Args[2] != IID_IDATAOBJECT_DATA1 || (Item = f.Item(h.Args[1])) == NULL)
+			return false;
+		{
+			static const unsigned char Root[2] = { 0, 0 };
+			const void *Items[1] = { Item };
+			unsigned Size = OWShellIDListGetSize(Root, Items, 1);
+			void *Cida = malloc(Size + 1);
+			OWShellIDListBuild(Cida, Root, Items, 1);
+			s_Sink += *(unsigned*)Cida;
+			free(Cida);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+//========================================================================================
+// Timing
+
+long long NowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct Stats
+{
+	unsigned Calls;
+	unsigned Replayed;
+	unsigned long long RecordedUs;
+	std::vector<unsigned> Durations;
+	long long ReplayNs;		// the fastest run's total
+
+	Stats() : Calls(0), Replayed(0), RecordedUs(0), ReplayNs(-1) {}
+};
+
+unsigned Percentile(std::vector<unsigned> Values, int Percentile)
+{
+	if (Values.empty())
+		return 0;
+	std::sort(Values.begin(), Values.end());
+	return Values[(Values.size() * Percentile + 99) / 100 - 1];
+}
+
+void PrintCall(const Record &r)
+{
+	const OWCallLogRecord &h = r.Header;
+
+	printf("%12.6f %08x %-22s %6uus %u %u %u\n", h.Start / 1000000.0, h.Object, MethodName(h),
+		h.Duration, h.Args[0], h.Args[1], h.Args[2]);
+}
+
+} // namespace
+
+//========================================================================================
+
+int main(int argc, char **argv)
+{
+	int Runs = 1, Run, i;
+	bool Verbose = false;
+	long long LimitUs = -1, FastestNs = -1;
+	const char *Path = NULL;
+	Log TheLog;
+	std::map<unsigned, Stats> ByMethod;		// by record type and event
+	std::map<unsigned, Stats>::iterator It;
+	size_t j;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			Runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			LimitUs = atoll(argv[++i]);
+		else if (strcmp(argv[i], "-v") == 0)
+			Verbose = true;
+		else
+			Path = argv[i];
+	}
+	if (Path == NULL || Runs < 1)
+	{
+		fprintf(stderr, "usage: %s [-v] [-r runs] [-l limit_us] calls.owc\n", argv[0]);
+		return 2;
+	}
+
+	if (!Load(Path, &TheLog))
+		return 2;
+
+	printf("host=%s pid=%u records=%u\n", TheLog.Header.Host, TheLog.Header.ProcessId,
+		(unsigned)TheLog.Records.size());
+
+	for (j = 0; j < TheLog.Records.size(); j++)
+	{
+		const OWCallLogRecord &h = TheLog.Records[j].Header;
+		Stats &s = ByMethod[(h.Type << 16) | h.Event];
+		s.Calls++;
+		s.RecordedUs += h.Duration;
+		s.Durations.push_back(h.Duration);
+		if (Verbose)
+			PrintCall(TheLog.Records[j]);
+	}
+
+	for (Run = 0; Run < Runs; Run++)
+	{
+		std::map<unsigned, Folder> Folders;
+		std::map<unsigned, long long> RunNs;
+		long long Total = 0;
+
+		for (j = 0; j < TheLog.Records.size(); j++)
+		{
+			const Record &r = TheLog.Records[j];
+			unsigned Key = (r.Header.Type << 16) | r.Header.Event;
+			Folder &f = Folders[r.Header.Object];
+
+			long long Start = NowNs();
+			bool Replayed = Replay(r, f);
+			long long Elapsed = NowNs() - Start;
+
+			if (Replayed)
+			{
+				RunNs[Key] += Elapsed;
+				Total += Elapsed;
+				if (Run == 0)
+					ByMethod[Key].Replayed++;
+			}
+		}
+
+		for (It = ByMethod.begin(); It != ByMethod.end(); ++It)
+		{
+			long long Ns = RunNs[It->first];
+			if (It->second.ReplayNs < 0 || Ns < It->second.ReplayNs)
+				It->second.ReplayNs = Ns;
+		}
+		if (FastestNs < 0 || Total < FastestNs)
+			FastestNs = Total;
+	}
+
+	printf("%-22s %8s %8s %12s %12s %12s\n", "method", "calls", "replayed", "rec_mean_us", "rec_p99_us", "replay_ns");
+	for (It = ByMethod.begin(); It != ByMethod.end(); ++It)
+	{
+		const Stats &s = It->second;
+		OWCallLogRecord h;
+		h.Type = (unsigned short)(It->first >> 16);
+		h.Event = (unsigned short)(It->first & 0xFFFF);
+
+		printf("%-22s %8u %8u %12llu %12u", MethodName(h), s.Calls, s.Replayed,
+			s.RecordedUs / s.Calls, Percentile(s.Durations, 99));
+		if (s.Replayed != 0)
+			printf(" %12lld\n", s.ReplayNs / s.Replayed);
+		else
+			printf(" %12s\n", "-");
+	}
+	printf("replay total %lldus\n", FastestNs / 1000);
+
+	if (LimitUs >= 0 && FastestNs / 1000 > LimitUs)
+	{
+		fprintf(stderr, "replay took %lldus, over the limit of %lldus\n", FastestNs / 1000, LimitUs);
+		return 1;
+	}
+	return 0;
+}
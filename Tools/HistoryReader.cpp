@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+//========================================================================================
+// Reads the history of closed windows the folder keeps (see OWHistory.h), such as one
+// copied off a machine where the folder shows something odd. It goes through the same
+// code the folder does, so it builds anywhere. Build and run with:
+//
+//   cl /EHsc /I..\OpenWindows HistoryReader.cpp ..\OpenWindows\OWHistory.cpp
+//   g++ -O2 -I../OpenWindows HistoryReader.cpp ../OpenWindows/OWHistory.cpp -o HistoryReader
+//   ./HistoryReader History.owh               the closed windows, latest first
+//   ./HistoryReader -a History.owh            every record, oldest first
+//   ./HistoryReader -c out.owh History.owh    write a compacted copy, like the folder does
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "OWHistory.h"
+
+namespace
+{
+
+// FILETIMEs count 100ns from 1601
+const OWUINT64 UNIX_EPOCH = 116444736000000000ULL;
+
+void PrintText(const OWCHAR *Text, unsigned Length)
+{
+	// As UTF-8; unpaired surrogates come out as they are
+	for (unsigned i = 0; i < Length; i++)
+	{
+		unsigned c = Text[i];
+		if (c >= 0xD800 && c < 0xDC00 && i + 1 < Length && Text[i + 1] >= 0xDC00 && Text[i + 1] < 0xE000)
+			c = 0x10000 + ((c - 0xD800) << 10) + (Text[++i] - 0xDC00);
+
+		if (c < 0x80)
+			putchar(c);
+		else if (c < 0x800)
+			printf("%c%c", 0xC0 | (c >> 6), 0x80 | (c & 0x3F));
+		else if (c < 0x10000)
+			printf("%c%c%c", 0xE0 | (c >> 12), 0x80 | ((c >> 6) & 0x3F), 0x80 | (c & 0x3F));
+		else
+			printf("%c%c%c%c", 0xF0 | (c >> 18), 0x80 | ((c >> 12) & 0x3F), 0x80 | ((c >> 6) & 0x3F), 0x80 | (c & 0x3F));
+	}
+}
+
+void PrintRecord(const OWHistoryRecord &Record)
+{
+	char When[32] = "?";
+	if (Record.Time >= UNIX_EPOCH)
+	{
+		time_t Seconds = (time_t)((Record.Time - UNIX_EPOCH) / 10000000);
+		struct tm *Local = localtime(&Seconds);
+		if (Local != NULL)
+			strftime(When, sizeof(When), "%Y-%m-%d %H:%M:%S", Local);
+	}
+
+	printf("%s  %-6s  ", When, Record.Kind == OW_HISTORY_CLOSED ? "closed" : "opened");
+	PrintText(Record.Name, Record.NameLength);
+	printf("  ");
+	PrintText(Record.Path, Record.PathLength);
+	printf("\n");
+}
+
+bool Load(const char *Path, unsigned char *Base)
+{
+	FILE *File = fopen(Path, "rb");
+	if (File == NULL)
+	{
+		fprintf(stderr, "can't open %s\n", Path);
+		return false;
+	}
+	size_t Size = fread(Base, 1, OW_HISTORY_SIZE, File);
+	fclose(File);
+
+	if (!OWHistoryCheck(Base, (unsigned)Size))
+	{
+		fprintf(stderr, "%s isn't a history this version reads\n", Path);
+		return false;
+	}
+	return true;
+}
+
+void Usage()
+{
+	fprintf(stderr, "usage: HistoryReader [-a | -c out.owh] History.owh\n");
+	exit(2);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	const char *Compacted = NULL;
+	bool All = false;
+	int i;
+
+	for (i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "-a") == 0)
+			All = true;
+		else if (strcmp(argv[i], "-c") == 0 && i + 2 < argc)
+			Compacted = argv[++i];
+		else
+			Usage();
+	}
+	if (i != argc - 1)
+		Usage();
+
+	static unsigned char Base[OW_HISTORY_SIZE];
+	if (!Load(argv[i], Base))
+		return 1;
+
+	if (Compacted != NULL)
+	{
+		static unsigned char Target[OW_HISTORY_SIZE];
+		OWHistoryCompact(Base, Target, OW_HISTORY_SIZE, OW_HISTORY_KEEP);
+
+		FILE *File = fopen(Compacted, "wb");
+		if (File == NULL || fwrite(Target, 1, OW_HISTORY_SIZE, File) != OW_HISTORY_SIZE)
+		{
+			fprintf(stderr, "can't write %s\n", Compacted);
+			return 1;
+		}
+		fclose(File);
+		printf("%u records, %u after compacting\n", OWHistoryGetCount(Base), OWHistoryGetCount(Target));
+		return 0;
+	}
+
+	OWHistoryRecord Record;
+	if (All)
+	{
+		unsigned Position = 0, Count = 0;
+		while (OWHistoryNext(Base, &Position, &Record))
+		{
+			PrintRecord(Record);
+			Count++;
+		}
+		// A record that doesn't check out ends the walk
+		if (Count != OWHistoryGetCount(Base))
+			printf("(%u records readable of %u)\n", Count, OWHistoryGetCount(Base));
+		return 0;
+	}
+
+	static OWHistoryRecord Records[OW_HISTORY_KEEP];
+	int Count = OWHistoryRecent(Base, Records, OW_HISTORY_KEEP);
+	for (int r = 0; r < Count; r++)
+		PrintRecord(Records[r]);
+	return 0;
+}
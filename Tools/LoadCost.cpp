@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+//========================================================================================
+// Times what the folder costs a process just by being loaded into it, which is every
+// process that opens a file dialog, whether or not it's ever listed. Each run loads the
+// DLL, creates the folder object once, and unloads it again, and each of those steps is
+// timed on its own. COM and the shell are loaded before the first run, so only our own
+// work is counted. Windows only. Build and run with:
+//
+//   cl /EHsc /I..\OpenWindows LoadCost.cpp ole32.lib shell32.lib
+//   LoadCost OpenWindows.dll            200 runs
+//   LoadCost -r 1000 OpenWindows.dll    1000 runs
+//   LoadCost -l 500 OpenWindows.dll     exit with 1 when loading takes over 500us (p50)
+//
+// Loading covers DllMain and the static constructors, which is what every process
+// pays. Creating covers DllGetClassObject and CreateInstance, which only the ones that
+// show the folder do.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <windows.h>
+#include <objbase.h>
+#include <shlobj.h>
+
+namespace
+{
+
+// CLSID_OpenWindowsRootShellFolder, see OpenWindows.idl
+const CLSID CLSID_Folder =
+	{ 0xE477F21A, 0xD9F6, 0x4B44, { 0xAD, 0x43, 0xA9, 0x5D, 0x62, 0x2D, 0x29, 0x10 } };
+
+typedef HRESULT (STDAPICALLTYPE *GetClassObjectProc)(REFCLSID, REFIID, LPVOID*);
+
+enum { STEP_LOAD, STEP_CREATE, STEP_UNLOAD, STEP_COUNT };
+
+const char *StepNames[STEP_COUNT] = { "load", "create", "unload" };
+
+double Frequency;
+
+double Now()
+{
+	LARGE_INTEGER Counter;
+	QueryPerformanceCounter(&Counter);
+	return (double)Counter.QuadPart * 1000000.0 / Frequency;
+}
+
+int CompareTimes(const void *a, const void *b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Times[STEP_*] in us. false when the DLL couldn't be loaded or the folder created.
+bool Run(const char *Path, double *Times)
+{
+	double Start = Now();
+	HMODULE Module = LoadLibraryA(Path);
+	Times[STEP_LOAD] = Now() - Start;
+	if (Module == NULL)
+	{
+		fprintf(stderr, "can't load %s (%lu)\n", Path, GetLastError());
+		return false;
+	}
+
+	Start = Now();
+	GetClassObjectProc GetClassObject = (GetClassObjectProc)GetProcAddress(Module, "DllGetClassObject");
+	IClassFactory *Factory = NULL;
+	IShellFolder *Folder = NULL;
+	HRESULT hr = E_FAIL;
+	if (GetClassObject != NULL)
+		hr = GetClassObject(CLSID_Folder, IID_IClassFactory, (void**)&Factory);
+	if (SUCCEEDED(hr))
+	{
+		hr = Factory->CreateInstance(NULL, IID_IShellFolder, (void**)&Folder);
+		Factory->Release();
+	}
+	if (SUCCEEDED(hr))
+		Folder->Release();
+	Times[STEP_CREATE] = Now() - Start;
+
+	Start = Now();
+	FreeLibrary(Module);
+	Times[STEP_UNLOAD] = Now() - Start;
+
+	if (FAILED(hr))
+	{
+		fprintf(stderr, "can't create the folder (0x%08lx)\n", (unsigned long)hr);
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	int Runs = 200;
+	double Limit = 0;
+	const char *Path = NULL;
+	bool Usage = false;
+	int i, Step;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			Runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			Limit = atof(argv[++i]);
+		else if (argv[i][0] != '-' && Path == NULL)
+			Path = argv[i];
+		else
+			Usage = true;
+	}
+	if (Usage || Path == NULL || Runs <= 0)
+	{
+		fprintf(stderr, "usage: %s [-r runs] [-l us] OpenWindows.dll\n", argv[0]);
+		return 2;
+	}
+
+	LARGE_INTEGER Counter;
+	if (!QueryPerformanceFrequency(&Counter))
+		return 1;
+	Frequency = (double)Counter.QuadPart;
+
+	// What a shell host has loaded already
+	CoInitialize(NULL);
+	LoadLibraryA("shell32.dll");
+
+	double *Times[STEP_COUNT];
+	for (Step = 0; Step < STEP_COUNT; Step++)
+		Times[Step] = new double[Runs];
+
+	// The first load reads the DLL from disk, so it's left out
+	double Discard[STEP_COUNT];
+	if (!Run(Path, Discard))
+		return 1;
+	for (i = 0; i < Runs; i++)
+	{
+		double One[STEP_COUNT];
+		if (!Run(Path, One))
+			return 1;
+		for (Step = 0; Step < STEP_COUNT; Step++)
+			Times[Step][i] = One[Step];
+	}
+
+	printf("%d runs, in us\n", Runs);
+	printf("%-8s %10s %10s %10s %10s\n", "step", "min", "p50", "p99", "max");
+	double LoadMedian = 0;
+	for (Step = 0; Step < STEP_COUNT; Step++)
+	{
+		double *t = Times[Step];
+		qsort(t, Runs, sizeof(double), CompareTimes);
+		double Median = t[Runs / 2];
+		printf("%-8s %10.1f %10.1f %10.1f %10.1f\n", StepNames[Step],
+			t[0], Median, t[(Runs * 99) / 100], t[Runs - 1]);
+		if (Step == STEP_LOAD)
+			LoadMedian = Median;
+		delete[] t;
+	}
+
+	CoUninitialize();
+
+	if (Limit > 0 && LoadMedian > Limit)
+	{
+		fprintf(stderr, "loading took %.1fus, over the limit of %.1fus\n", LoadMedian, Limit);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+//========================================================================================
+// Reads the metrics every process hosting the folder publishes (see OWSharedMetrics.h)
+// and adds them up, or shows them per process. On Windows it maps the named region;
+// elsewhere it reads a POSIX shared memory object with the same name and layout, which
+// is what a stand-in writer (or a test) provides. Build and run with:
+//
+//   cl /EHsc /I..\OpenWindows MetricsReader.cpp
+//   g++ -O2 -I../OpenWindows MetricsReader.cpp -o MetricsReader -lrt
+//   ./MetricsReader             everything, added up
+//   ./MetricsReader -p          each process on its own
+//   ./MetricsReader -l          only processes that are still running
+//   ./MetricsReader -w 5        again every 5 seconds
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define SleepSeconds(s) Sleep((s) * 1000)
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define SleepSeconds(s) sleep(s)
+#endif
+
+#include "OWSharedMetrics.h"
+
+namespace
+{
+
+//========================================================================================
+// Mapping the region
+
+const OWSharedMetrics *Open()
+{
+#ifdef _WIN32
+	HANDLE Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, "Local\\" OW_SHARED_METRICS_NAME);
+	if (Mapping == NULL)
+		Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, OW_SHARED_METRICS_NAME);
+	if (Mapping == NULL)
+		return NULL;
+	// The view keeps the mapping alive
+	const void *View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, sizeof(OWSharedMetrics));
+	CloseHandle(Mapping);
+	return (const OWSharedMetrics*)View;
+#else
+	int File = shm_open("/" OW_SHARED_METRICS_NAME, O_RDONLY, 0);
+	if (File < 0)
+		return NULL;
+	void *View = mmap(NULL, sizeof(OWSharedMetrics), PROT_READ, MAP_SHARED, File, 0);
+	close(File);
+	return View != MAP_FAILED ? (const OWSharedMetrics*)View : NULL;
+#endif
+}
+
+//========================================================================================
+// Adding up
+
+struct Totals
+{
+	OWUINT64 Calls[OW_SHARED_TIMERS];
+	OWUINT64 Microseconds[OW_SHARED_TIMERS];
+	unsigned int Max[OW_SHARED_TIMERS];
+	OWUINT64 Buckets[OW_SHARED_TIMERS][OW_METRICS_BUCKETS];
+	OWUINT64 Counters[OW_SHARED_COUNTERS];
+};
+
+// Every lane of the slot: each thread writes its own, so they're only added up here
+void Add(Totals *To, const OWSharedSlot &From, const OWSharedMetrics &Shared)
+{
+	for (int l = 0; l < OW_SHARED_LANES; l++)
+	{
+		const OWSharedLane &Lane = From.Lanes[l];
+		for (unsigned i = 0; i < Shared.TimerCount; i++)
+		{
+			const OWSharedTimer &t = Lane.Timers[i];
+			To->Calls[i] += t.Calls;
+			To->Microseconds[i] += ((OWUINT64)t.TotalHigh << 32) | t.TotalLow;
+			if (t.MaxMicroseconds > To->Max[i])
+				To->Max[i] = t.MaxMicroseconds;
+			for (int b = 0; b < OW_METRICS_BUCKETS; b++)
+				To->Buckets[i][b] += t.Buckets[b];
+		}
+		for (unsigned i = 0; i < Shared.CounterCount; i++)
+			To->Counters[i] += Lane.Counters[i];
+	}
+}
+
+unsigned int Percentile(const Totals &t, int Timer, int Percent)
+{
+	OWUINT64 Wanted = (t.Calls[Timer] * Percent + 99) / 100, Seen = 0;
+	if (Wanted == 0)
+		Wanted = 1;
+
+	for (int b = 0; b < OW_METRICS_BUCKETS; b++)
+	{
+		Seen += t.Buckets[Timer][b];
+		if (Seen >= Wanted)
+		{
+			unsigned int Upper = OWMetricsBucketUpperBound(b);
+			return Upper < t.Max[Timer] ? Upper : t.Max[Timer];
+		}
+	}
+	return t.Max[Timer];
+}
+
+void Print(const Totals &t, const OWSharedMetrics &Shared)
+{
+	printf("%-24s %12s %10s %10s %10s %10s\n", "timer", "calls", "mean_us", "p50_us", "p99_us", "max_us");
+	for (unsigned i = 0; i < Shared.TimerCount; i++)
+	{
+		if (t.Calls[i] == 0)
+			continue;
+		printf("%-24.*s %12llu %10llu %10u %10u %10u\n", OW_SHARED_NAME_LENGTH, Shared.TimerNames[i],
+			(unsigned long long)t.Calls[i], (unsigned long long)(t.Microseconds[i] / t.Calls[i]),
+			Percentile(t, i, 50), Percentile(t, i, 99), t.Max[i]);
+	}
+	for (unsigned i = 0; i < Shared.CounterCount; i++)
+		printf("%-24.*s %12llu\n", OW_SHARED_NAME_LENGTH, Shared.CounterNames[i], (unsigned long long)t.Counters[i]);
+}
+
+bool Wanted(const OWSharedSlot &Slot, bool LiveOnly)
+{
+	return Slot.State == OW_SLOT_LIVE || (!LiveOnly && Slot.State == OW_SLOT_EXITED);
+}
+
+void Report(const OWSharedMetrics &Shared, bool PerProcess, bool LiveOnly)
+{
+	Totals All;
+	memset(&All, 0, sizeof(All));
+	int Processes = 0;
+
+	for (unsigned i = 0; i < Shared.SlotCount; i++)
+	{
+		const OWSharedSlot &Slot = Shared.Slots[i];
+		if (!Wanted(Slot, LiveOnly))
+			continue;
+		Processes++;
+
+		if (PerProcess)
+		{
+			Totals One;
+			memset(&One, 0, sizeof(One));
+			Add(&One, Slot, Shared);
+			printf("\n== pid %u %.*s%s\n", Slot.ProcessId, OW_SHARED_HOST_LENGTH, Slot.Host,
+				Slot.State == OW_SLOT_EXITED ? " (exited)" : "");
+			Print(One, Shared);
+		}
+		Add(&All, Slot, Shared);
+	}
+
+	printf("\n== %d processes\n", Processes);
+	Print(All, Shared);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	bool PerProcess = false, LiveOnly = false;
+	int Interval = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-p") == 0)
+			PerProcess = true;
+		else if (strcmp(argv[i], "-l") == 0)
+			LiveOnly = true;
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			Interval = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: %s [-p] [-l] [-w seconds]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	const OWSharedMetrics *Shared = Open();
+	if (Shared == NULL)
+	{
+		fprintf(stderr, "no process has published metrics\n");
+		return 1;
+	}
+	if (Shared->Magic != OW_SHARED_METRICS_MAGIC || Shared->Version != OW_SHARED_METRICS_VERSION
+		|| Shared->Size != sizeof(OWSharedMetrics))
+	{
+		fprintf(stderr, "metrics version %u isn't supported\n", Shared->Version);
+		return 1;
+	}
+
+	for (;;)
+	{
+		Report(*Shared, PerProcess, LiveOnly);
+		if (Interval <= 0)
+			break;
+		fflush(stdout);
+		SleepSeconds(Interval);
+	}
+	return 0;
+}
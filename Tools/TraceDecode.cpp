@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2020 Calvin Buckley
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+//========================================================================================
+// Turns a trace saved by the folder (see OWTrace.h) back into text, one event per line
+// in time order, so nothing has to be formatted in the shell's process. It only needs
+// the format header, so it builds anywhere. Build and run with:
+//
+//   g++ -O2 -I../OpenWindows TraceDecode.cpp -o TraceDecode
+//   ./TraceDecode trace.owt            events, oldest first
+//   ./TraceDecode -s trace.owt         only how many of each event there were
+//
+// Lines are: seconds since the first event, thread, event, arguments. When events weren't
+// written, because of sampling, the count is shown before the next one from that thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "OWTrace.h"
+
+//========================================================================================
+// What the events mean
+
+namespace
+{
+
+// How to show an argument
+enum ArgKind
+{
+	ARG_NONE,
+	ARG_DEC,
+	ARG_HEX,
+	ARG_ITEM,		// OWTraceItemKey()
+	ARG_MESSAGE		// SFVM_/SFVCB_
+};
+
+struct EventInfo
+{
+	unsigned Event;
+	const char *Name;
+	// The first argument is always the object
+	ArgKind Kinds[3];
+	const char *Labels[3];
+};
+
+const EventInfo Events[] =
+{
+	{ OW_EVENT_GETCLASSID,				"GetClassID",				{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_INITIALIZE,				"Initialize",				{ ARG_ITEM, ARG_NONE, ARG_NONE }, { "pidl", NULL, NULL } },
+	{ OW_EVENT_GETCURFOLDER,			"GetCurFolder",				{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_BINDTOOBJECT,			"BindToObject",				{ ARG_ITEM, ARG_NONE, ARG_NONE }, { "pidl", NULL, NULL } },
+	{ OW_EVENT_COMPAREIDS,				"CompareIDs",				{ ARG_HEX, ARG_ITEM, ARG_ITEM }, { "lParam", "pidl1", "pidl2" } },
+	{ OW_EVENT_CREATEVIEWOBJECT,		"CreateViewObject",			{ ARG_HEX, ARG_NONE, ARG_NONE }, { "iid", NULL, NULL } },
+	{ OW_EVENT_ENUMOBJECTS,				"EnumObjects",				{ ARG_HEX, ARG_NONE, ARG_NONE }, { "flags", NULL, NULL } },
+	{ OW_EVENT_ENUMOBJECTS_ITEMS,		"EnumObjects.Items",		{ ARG_DEC, ARG_NONE, ARG_NONE }, { "count", NULL, NULL } },
+	{ OW_EVENT_GETATTRIBUTESOF,			"GetAttributesOf",			{ ARG_DEC, ARG_ITEM, ARG_NONE }, { "count", "pidl", NULL } },
+	{ OW_EVENT_GETUIOBJECTOF,			"GetUIObjectOf",			{ ARG_DEC, ARG_ITEM, ARG_HEX }, { "count", "pidl", "iid" } },
+	{ OW_EVENT_BINDTOSTORAGE,			"BindToStorage",			{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_GETDISPLAYNAMEOF,		"GetDisplayNameOf",			{ ARG_HEX, ARG_ITEM, ARG_NONE }, { "flags", "pidl", NULL } },
+	{ OW_EVENT_PARSEDISPLAYNAME,		"ParseDisplayName",			{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_PARSEDISPLAYNAME_FOUND,	"ParseDisplayName.Found",	{ ARG_DEC, ARG_NONE, ARG_NONE }, { "index", NULL, NULL } },
+	{ OW_EVENT_SETNAMEOF,				"SetNameOf",				{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_COLUMNCLICK,				"ColumnClick",				{ ARG_DEC, ARG_NONE, ARG_NONE }, { "column", NULL, NULL } },
+	{ OW_EVENT_GETDETAILSOF,			"GetDetailsOf",				{ ARG_DEC, ARG_ITEM, ARG_NONE }, { "column", "pidl", NULL } },
+	{ OW_EVENT_ENUMSEARCHES,			"EnumSearches",				{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_GETDEFAULTCOLUMN,		"GetDefaultColumn",			{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_GETDEFAULTCOLUMNSTATE,	"GetDefaultColumnState",	{ ARG_DEC, ARG_NONE, ARG_NONE }, { "column", NULL, NULL } },
+	{ OW_EVENT_GETDEFAULTSEARCHGUID,	"GetDefaultSearchGUID",		{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_GETDETAILSEX,			"GetDetailsEx",				{ ARG_HEX, ARG_DEC, ARG_ITEM }, { "fmtid", "pid", "pidl" } },
+	{ OW_EVENT_MAPCOLUMNTOSCID,			"MapColumnToSCID",			{ ARG_DEC, ARG_NONE, ARG_NONE }, { "column", NULL, NULL } },
+	{ OW_EVENT_SETSEARCHQUERY,			"SetSearchQuery",			{ ARG_DEC, ARG_NONE, ARG_NONE }, { "length", NULL, NULL } },
+	{ OW_EVENT_SETSEARCHMODE,			"SetSearchMode",			{ ARG_DEC, ARG_NONE, ARG_NONE }, { "mode", NULL, NULL } },
+	{ OW_EVENT_GETMETRICSREPORT,		"GetMetricsReport",			{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_SAVETRACE,				"SaveTrace",				{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_SAVEFLIGHTRECORD,		"SaveFlightRecord",			{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+
+	{ OW_EVENT_VIEW_CREATED,			"View.Created",				{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_VIEW_DESTROYED,			"View.Destroyed",			{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_VIEW_MESSAGE,			"View.Message",				{ ARG_MESSAGE, ARG_HEX, ARG_HEX }, { "msg", "w", "l" } },
+	{ OW_EVENT_VIEW_DEFVIEWMODE,		"View.DefViewMode",			{ ARG_NONE, ARG_NONE, ARG_NONE }, { NULL, NULL, NULL } },
+	{ OW_EVENT_VIEW_COLUMNCLICK,		"View.ColumnClick",			{ ARG_DEC, ARG_NONE, ARG_NONE }, { "column", NULL, NULL } },
+	{ OW_EVENT_VIEW_GETDETAILSOF,		"View.GetDetailsOf",		{ ARG_DEC, ARG_NONE, ARG_NONE }, { "column", NULL, NULL } },
+
+	{ OW_EVENT_SNAPSHOT,				"Snapshot",					{ ARG_DEC, ARG_DEC, ARG_NONE }, { "windows", "changed", NULL } },
+	{ OW_EVENT_SEARCH,					"Search",					{ ARG_DEC, ARG_DEC, ARG_NONE }, { "results", "mode", NULL } }
+};
+
+// The shell view callback messages, from ShlObj.h and RootShellView.h
+struct MessageName
+{
+	unsigned Message;
+	const char *Name;
+};
+
+const MessageName Messages[] =
+{
+	{ 1, "SFVM_MERGEMENU" },
+	{ 2, "SFVM_INVOKECOMMAND" },
+	{ 3, "SFVM_GETHELPTEXT" },
+	{ 4, "SFVM_GETTOOLTIPTEXT" },
+	{ 5, "SFVM_GETBUTTONINFO" },
+	{ 6, "SFVM_GETBUTTONS" },
+	{ 7, "SFVM_INITMENUPOPUP" },
+	{ 0x08, "SFVCB_SELECTIONCHANGED" },
+	{ 0x09, "SFVCB_DRAWMENUITEM" },
+	{ 0x0A, "SFVCB_MEASUREMENUITEM" },
+	{ 0x0B, "SFVCB_EXITMENULOOP" },
+	{ 0x0C, "SFVCB_VIEWRELEASE" },
+	{ 0x0D, "SFVCB_GETNAMELENGTH" },
+	{ 14, "SFVM_FSNOTIFY" },
+	{ 15, "SFVM_WINDOWCREATED" },
+	{ 0x10, "SFVCB_WINDOWCLOSING" },
+	{ 0x11, "SFVCB_LISTREFRESHED" },
+	{ 0x12, "SFVCB_WINDOWFOCUSED" },
+	{ 0x14, "SFVCB_REGISTERCOPYHOOK" },
+	{ 0x15, "SFVCB_COPYHOOKCALLBACK" },
+	{ 23, "SFVM_GETDETAILSOF" },
+	{ 24, "SFVM_COLUMNCLICK" },
+	{ 25, "SFVM_QUERYFSNOTIFY" },
+	{ 26, "SFVM_DEFITEMCOUNT" },
+	{ 27, "SFVM_DEFVIEWMODE" },
+	{ 28, "SFVM_UNMERGEMENU" },
+	{ 0x1D, "SFVCB_ADDINGOBJECT" },
+	{ 0x1E, "SFVCB_REMOVINGOBJECT" },
+	{ 31, "SFVM_UPDATESTATUSBAR" },
+	{ 32, "SFVM_BACKGROUNDENUM" },
+	{ 0x21, "SFVCB_GETCOMMANDDIR" },
+	{ 0x22, "SFVCB_GETCOLUMNSTREAM" },
+	{ 0x23, "SFVCB_CANSELECTALL" },
+	{ 0x25, "SFVCB_ISSTRICTREFRESH" },
+	{ 0x26, "SFVCB_ISCHILDOBJECT" },
+	{ 36, "SFVM_DIDDRAGDROP" },
+	{ 0x28, "SFVCB_GETEXTVIEWS" },
+	{ 39, "SFVM_SETISFV" },
+	{ 41, "SFVM_THISIDLIST" },
+	{ 46, "SFVCB_WNDMAIN" },
+	{ 47, "SFVM_ADDPROPERTYPAGES" },
+	{ 48, "SFVM_BACKGROUNDENUMDONE" },
+	{ 49, "SFVM_GETNOTIFY" },
+	{ 0x32, "SFVCB_COLUMNCLICK2" },
+	{ 53, "SFVM_GETSORTDEFAULTS" },
+	{ 57, "SFVM_SIZE" },
+	{ 58, "SFVM_GETZONE" },
+	{ 59, "SFVM_GETPANE" },
+	{ 63, "SFVM_GETHELPTOPIC" },
+	{ 68, "SFVM_GETANIMATION" }
+};
+
+const EventInfo *FindEvent(unsigned Event)
+{
+	for (size_t i = 0; i < sizeof(Events) / sizeof(Events[0]); i++)
+	{
+		if (Events[i].Event == Event)
+			return &Events[i];
+	}
+	return NULL;
+}
+
+const char *FindMessage(unsigned Message)
+{
+	for (size_t i = 0; i < sizeof(Messages) / sizeof(Messages[0]); i++)
+	{
+		if (Messages[i].Message == Message)
+			return Messages[i].Name;
+	}
+	return NULL;
+}
+
+void PrintArg(ArgKind Kind, const char *Label, unsigned Value)
+{
+	const char *Name;
+
+	switch (Kind)
+	{
+	case ARG_NONE:
+		return;
+	case ARG_DEC:
+		printf(" %s=%u", Label, Value);
+		return;
+	case ARG_HEX:
+		printf(" %s=0x%08x", Label, Value);
+		return;
+	case ARG_ITEM:
+		if (Value == OW_TRACE_ITEM_NULL)
+			printf(" %s=<null>", Label);
+		else if (Value == OW_TRACE_ITEM_ROOT)
+			printf(" %s=<root>", Label);
+		else if (Value == OW_TRACE_ITEM_FOREIGN)
+			printf(" %s=<foreign>", Label);
+		else
+			printf(" %s=#%u/%04x", Label, Value & 0xFFFF, Value >> 16);
+		return;
+	case ARG_MESSAGE:
+		Name = FindMessage(Value);
+		if (Name != NULL)
+			printf(" %s=%s", Label, Name);
+		else
+			printf(" %s=%u", Label, Value);
+		return;
+	}
+}
+
+//========================================================================================
+// Reading
+
+struct Event
+{
+	OWTraceRecord Record;
+	unsigned ThreadId;
+	unsigned Skipped;	// events on the thread since the previous record that weren't written
+};
+
+bool ByTime(const Event &a, const Event &b)
+{
+	return a.Record.Ticks < b.Record.Ticks;
+}
+
+bool Read(FILE *File, void *Target, size_t Size)
+{
+	return fread(Target, 1, Size, File) == Size;
+}
+
+bool Load(const char *Path, OWTraceFileHeader *Header, std::vector<Event> *Out)
+{
+	FILE *File = fopen(Path, "rb");
+	if (File == NULL)
+	{
+		perror(Path);
+		return false;
+	}
+
+	bool Result = false;
+	if (!Read(File, Header, sizeof(*Header)) || Header->Magic != OW_TRACE_MAGIC)
+		fprintf(stderr, "%s: not a trace\n", Path);
+	else if (Header->Version != OW_TRACE_VERSION || Header->RecordSize != sizeof(OWTraceRecord))
+		fprintf(stderr, "%s: trace version %u isn't supported\n", Path, Header->Version);
+	else
+	{
+		Result = true;
+		for (unsigned Ring = 0; Result && Ring < Header->RingCount; Ring++)
+		{
+			OWTraceRingHeader RingHeader;
+			if (!Read(File, &RingHeader, sizeof(RingHeader)))
+			{
+				Result = false;
+				break;
+			}
+
+			unsigned Previous = 0;
+			for (unsigned i = 0; i < RingHeader.RecordCount; i++)
+			{
+				Event e;
+				if (!Read(File, &e.Record, sizeof(e.Record)))
+				{
+					Result = false;
+					break;
+				}
+				e.ThreadId = RingHeader.ThreadId;
+				// The ring might have wrapped before the first one
+				e.Skipped = (i > 0 && e.Record.Sequence > Previous + 1) ? e.Record.Sequence - Previous - 1 : 0;
+				Previous = e.Record.Sequence;
+				Out->push_back(e);
+			}
+		}
+		if (!Result)
+			fprintf(stderr, "%s: truncated\n", Path);
+	}
+
+	fclose(File);
+	return Result;
+}
+
+//========================================================================================
+
+void PrintEvents(const OWTraceFileHeader &Header, const std::vector<Event> &Events)
+{
+	double Frequency = Header.Frequency != 0 ? (double)Header.Frequency : 1.0;
+	OWUINT64 Start = Events.empty() ? 0 : Events[0].Record.Ticks;
+
+	for (size_t i = 0; i < Events.size(); i++)
+	{
+		const Event &e = Events[i];
+		const EventInfo *Info = FindEvent(e.Record.Event);
+
+		if (e.Skipped != 0)
+			printf("%12s %6u (%u not sampled)\n", "", e.ThreadId, e.Skipped);
+
+		printf("%12.6f %6u ", (double)(e.Record.Ticks - Start) / Frequency, e.ThreadId);
+		if (Info == NULL)
+		{
+			printf("event-%04x obj=%08x %08x %08x %08x\n", e.Record.Event,
+				e.Record.Args[0], e.Record.Args[1], e.Record.Args[2], e.Record.Args[3]);
+			continue;
+		}
+
+		printf("%s obj=%08x", Info->Name, e.Record.Args[0]);
+		for (int Arg = 0; Arg < 3; Arg++)
+			PrintArg(Info->Kinds[Arg], Info->Labels[Arg], e.Record.Args[Arg + 1]);
+		printf("\n");
+	}
+}
+
+void PrintSummary(const std::vector<Event> &Events)
+{
+	std::vector<unsigned> Seen;
+	std::vector<unsigned> Counts;
+
+	for (size_t i = 0; i < Events.size(); i++)
+	{
+		size_t j = std::find(Seen.begin(), Seen.end(), Events[i].Record.Event) - Seen.begin();
+		if (j == Seen.size())
+		{
+			Seen.push_back(Events[i].Record.Event);
+			Counts.push_back(0);
+		}
+		Counts[j]++;
+	}
+
+	for (size_t i = 0; i < Seen.size(); i++)
+	{
+		const EventInfo *Info = FindEvent(Seen[i]);
+		if (Info != NULL)
+			printf("%-28s %10u\n", Info->Name, Counts[i]);
+		else
+			printf("event-%04x %27u\n", Seen[i], Counts[i]);
+	}
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	bool Summary = false;
+	const char *Path = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-s") == 0)
+			Summary = true;
+		else
+			Path = argv[i];
+	}
+	if (Path == NULL)
+	{
+		fprintf(stderr, "usage: %s [-s] trace.owt\n", argv[0]);
+		return 2;
+	}
+
+	OWTraceFileHeader Header;
+	std::vector<Event> Events;
+	if (!Load(Path, &Header, &Events))
+		return 1;
+
+	std::stable_sort(Events.begin(), Events.end(), ByTime);
+
+	printf("# process %u, %u threads, %u events, %llu ticks/s\n", Header.ProcessId, Header.RingCount,
+		(unsigned)Events.size(), (unsigned long long)Header.Frequency);
+	if (Summary)
+		PrintSummary(Events);
+	else
+		PrintEvents(Header, Events);
+	return 0;
+}